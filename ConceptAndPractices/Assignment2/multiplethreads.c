@@ -1,3 +1,6 @@
+// This is necessary for CPU affinity macros in Linux (fan-out mode)
+#define _GNU_SOURCE
+
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -95,6 +98,878 @@ void initialiseSysLog() {
  
 }
 
+#ifdef FANOUT_WAKEUP_MODE
+/* Fan-out wakeup benchmark.
+ *
+ * In the default mode the threads start staggered, one per pthread_create,
+ * so the log never shows how fast the scheduler wakes a large group at once.
+ * In this mode all NUM_THREADS threads block on the same primitive and the
+ * main thread releases them together, as a frame-sync fan-out would.
+ * Each thread records its wake delay relative to the release instant,
+ * for every primitive and for an increasing number of cores. */
+
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define NSEC_PER_SEC (1000000000)
+#define NSEC_PER_USEC (1000)
+
+// Number of release rounds measured for every primitive/core count pair
+#define FANOUT_ROUNDS (100)
+
+/* Time given to the waiters, after the last one announced itself, to
+ * actually go to sleep inside the primitive before the release */
+#define FANOUT_SETTLE_USEC (2000)
+
+/* Polling interval of the main thread while waiting for the waiters. It must
+ * sleep rather than yield: with SCHED_FIFO it outranks the waiters, and a
+ * sched_yield would never let them run on a shared core */
+#define FANOUT_POLL_USEC (100)
+
+// Clock used both for the release instant and for the wake timestamps
+#define FANOUT_CLOCK CLOCK_MONOTONIC
+
+#define CSV_FILE_NAME "multiplethreads_fanout.csv"
+
+typedef enum
+{
+    FANOUT_BARRIER,
+    FANOUT_FUTEX,
+    FANOUT_CONDVAR,
+    FANOUT_NUM_PRIMITIVES
+} fanoutPrimitive_t;
+
+static const char *fanoutPrimitiveNames[FANOUT_NUM_PRIMITIVES] =
+{
+    "barrier", "futex", "condvar"
+};
+
+// State shared by the main (releasing) thread and the waiters of one run
+typedef struct
+{
+    fanoutPrimitive_t primitive;
+    int cores;
+    int round;
+
+    pthread_barrier_t barrier;
+
+    // futex word, also used as release generation for the condvar
+    volatile unsigned int generation;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    // waiters about to block / waiters that recorded their wake time
+    volatile int arrived;
+    volatile int recorded;
+
+    struct timespec releaseTime;
+} fanoutRun_t;
+
+static fanoutRun_t fanoutRun;
+
+// Wake delay in nanoseconds of each thread, for each round of a run
+static long fanoutDelay[FANOUT_ROUNDS][NUM_THREADS];
+
+static long timespecDiffNsec(struct timespec *stop, struct timespec *start)
+{
+    return ((long)(stop->tv_sec - start->tv_sec) * NSEC_PER_SEC) +
+           (stop->tv_nsec - start->tv_nsec);
+}
+
+static int futexWait(volatile unsigned int *word, unsigned int value)
+{
+    return syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static int futexWake(volatile unsigned int *word, int count)
+{
+    return syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/* Blocks the calling waiter on the primitive under test until the main
+ * thread releases the current round */
+static void fanoutBlock(void)
+{
+    unsigned int generation;
+
+    switch(fanoutRun.primitive)
+    {
+        case FANOUT_BARRIER:
+            __atomic_add_fetch(&fanoutRun.arrived, 1, __ATOMIC_SEQ_CST);
+            pthread_barrier_wait(&fanoutRun.barrier);
+            break;
+
+        case FANOUT_FUTEX:
+            generation = __atomic_load_n(&fanoutRun.generation, __ATOMIC_ACQUIRE);
+            __atomic_add_fetch(&fanoutRun.arrived, 1, __ATOMIC_SEQ_CST);
+            // loop to filter out spurious wakeups
+            while(__atomic_load_n(&fanoutRun.generation, __ATOMIC_ACQUIRE) == generation)
+                futexWait(&fanoutRun.generation, generation);
+            break;
+
+        case FANOUT_CONDVAR:
+            pthread_mutex_lock(&fanoutRun.mutex);
+            generation = fanoutRun.generation;
+            __atomic_add_fetch(&fanoutRun.arrived, 1, __ATOMIC_SEQ_CST);
+            while(fanoutRun.generation == generation)
+                pthread_cond_wait(&fanoutRun.cond, &fanoutRun.mutex);
+            pthread_mutex_unlock(&fanoutRun.mutex);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Releases every waiter blocked on the primitive under test, stamping the
+ * release instant right before the releasing call */
+static void fanoutRelease(void)
+{
+    switch(fanoutRun.primitive)
+    {
+        case FANOUT_BARRIER:
+            // the main thread is the last participant to arrive
+            clock_gettime(FANOUT_CLOCK, &fanoutRun.releaseTime);
+            pthread_barrier_wait(&fanoutRun.barrier);
+            break;
+
+        case FANOUT_FUTEX:
+            clock_gettime(FANOUT_CLOCK, &fanoutRun.releaseTime);
+            __atomic_add_fetch(&fanoutRun.generation, 1, __ATOMIC_RELEASE);
+            futexWake(&fanoutRun.generation, INT_MAX);
+            break;
+
+        case FANOUT_CONDVAR:
+            pthread_mutex_lock(&fanoutRun.mutex);
+            clock_gettime(FANOUT_CLOCK, &fanoutRun.releaseTime);
+            fanoutRun.generation++;
+            pthread_cond_broadcast(&fanoutRun.cond);
+            pthread_mutex_unlock(&fanoutRun.mutex);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Entry point of the waiters: block, record the wake delay, repeat for
+ * every round of the current run */
+void fanoutThread(void *threadp)
+{
+    threadParams_t *threadParams = (threadParams_t *)threadp;
+    struct timespec wakeTime;
+    int round;
+
+    for(round=0; round < FANOUT_ROUNDS; round++)
+    {
+        fanoutBlock();
+
+        clock_gettime(FANOUT_CLOCK, &wakeTime);
+        fanoutDelay[round][threadParams->threadIdx] =
+            timespecDiffNsec(&wakeTime, &fanoutRun.releaseTime);
+
+        __atomic_add_fetch(&fanoutRun.recorded, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static int compareLong(const void *a, const void *b)
+{
+    long la = *(const long *)a, lb = *(const long *)b;
+    return (la > lb) - (la < lb);
+}
+
+/* Summarises the wake delays of a run: distribution over every thread of
+ * every round, plus the time it took the whole group to be awake
+ * (the slowest thread of each round) */
+static void fanoutReport(FILE *csvFile)
+{
+    static long allDelays[FANOUT_ROUNDS * NUM_THREADS];
+    long lastWaker[FANOUT_ROUNDS];
+    int round, index, count = 0;
+
+    for(round=0; round < FANOUT_ROUNDS; round++)
+    {
+        lastWaker[round] = fanoutDelay[round][0];
+
+        for(index=0; index < NUM_THREADS; index++)
+        {
+            allDelays[count++] = fanoutDelay[round][index];
+            if(fanoutDelay[round][index] > lastWaker[round])
+                lastWaker[round] = fanoutDelay[round][index];
+
+            if(csvFile != NULL)
+                fprintf(csvFile, "%s;%d;%d;%d;%ld\n",
+                        fanoutPrimitiveNames[fanoutRun.primitive],
+                        fanoutRun.cores, round, index, fanoutDelay[round][index]);
+        }
+    }
+
+    qsort(allDelays, count, sizeof(long), compareLong);
+    qsort(lastWaker, FANOUT_ROUNDS, sizeof(long), compareLong);
+
+    syslog(LOG_INFO, "fanout %s on %d cores: wake delay usec min=%ld p50=%ld p99=%ld max=%ld, all awake usec p50=%ld max=%ld",
+           fanoutPrimitiveNames[fanoutRun.primitive], fanoutRun.cores,
+           allDelays[0] / NSEC_PER_USEC,
+           allDelays[count / 2] / NSEC_PER_USEC,
+           allDelays[(count * 99) / 100] / NSEC_PER_USEC,
+           allDelays[count - 1] / NSEC_PER_USEC,
+           lastWaker[FANOUT_ROUNDS / 2] / NSEC_PER_USEC,
+           lastWaker[FANOUT_ROUNDS - 1] / NSEC_PER_USEC);
+}
+
+/* Runs FANOUT_ROUNDS releases of NUM_THREADS waiters blocked on primitive,
+ * with the waiters spread round robin over the first cores cores */
+static void fanoutRunOnce(fanoutPrimitive_t primitive, int cores, int rtPolicy, FILE *csvFile)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t cpuset;
+    struct timespec settle = {0, FANOUT_SETTLE_USEC * NSEC_PER_USEC};
+    struct timespec poll = {0, FANOUT_POLL_USEC * NSEC_PER_USEC};
+    int index, round;
+
+    memset(fanoutDelay, 0, sizeof(fanoutDelay));
+    fanoutRun.primitive = primitive;
+    fanoutRun.cores = cores;
+    fanoutRun.generation = 0;
+    fanoutRun.arrived = 0;
+    fanoutRun.recorded = 0;
+
+    // NUM_THREADS waiters plus the releasing main thread
+    pthread_barrier_init(&fanoutRun.barrier, NULL, NUM_THREADS + 1);
+    pthread_mutex_init(&fanoutRun.mutex, NULL);
+    pthread_cond_init(&fanoutRun.cond, NULL);
+
+    for(index=0; index < NUM_THREADS; index++)
+    {
+        threadParams[index].threadIdx=index;
+
+        pthread_attr_init(&attr);
+        CPU_ZERO(&cpuset);
+        CPU_SET(index % cores, &cpuset);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
+
+        /* Waiters one priority level below the releasing thread, so that
+         * the first woken ones do not preempt the release itself */
+        if(rtPolicy)
+        {
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+            pthread_attr_setschedparam(&attr, &param);
+        }
+
+        if(pthread_create(&threads[index], &attr, (void *)&fanoutThread,
+                          (void *)&(threadParams[index])) != 0)
+        {
+            perror("pthread_create fanout waiter");
+            exit(EXIT_FAILURE);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    for(round=0; round < FANOUT_ROUNDS; round++)
+    {
+        // wait until every waiter is about to block, then let them sleep
+        while(__atomic_load_n(&fanoutRun.arrived, __ATOMIC_SEQ_CST) < (round + 1) * NUM_THREADS)
+            nanosleep(&poll, NULL);
+        nanosleep(&settle, NULL);
+
+        fanoutRelease();
+
+        // every waiter must record before the next round reuses the primitive
+        while(__atomic_load_n(&fanoutRun.recorded, __ATOMIC_SEQ_CST) < (round + 1) * NUM_THREADS)
+            nanosleep(&poll, NULL);
+    }
+
+    for(index=0; index < NUM_THREADS; index++)
+        pthread_join(threads[index], NULL);
+
+    pthread_barrier_destroy(&fanoutRun.barrier);
+    pthread_mutex_destroy(&fanoutRun.mutex);
+    pthread_cond_destroy(&fanoutRun.cond);
+
+    fanoutReport(csvFile);
+}
+
+/* Sweeps every primitive over 1, 2, 4... cores up to every online core */
+void fanoutBenchmark(void)
+{
+    struct sched_param mainParam;
+    int rtPolicy = 1, primitive, cores, onlineCores;
+    FILE *csvFile;
+
+    onlineCores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // the releasing thread runs at the highest SCHED_FIFO priority if allowed
+    mainParam.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    if(sched_setscheduler(getpid(), SCHED_FIFO, &mainParam) < 0)
+    {
+        perror("sched_setscheduler, running fan-out with SCHED_OTHER");
+        rtPolicy = 0;
+    }
+
+    csvFile = fopen(CSV_FILE_NAME, "w");
+    if(csvFile != NULL)
+        fprintf(csvFile, "Primitive;Cores;Round;Thread;WakeDelayNsec\n");
+
+    for(primitive=0; primitive < FANOUT_NUM_PRIMITIVES; primitive++)
+    {
+        for(cores=1; ; cores *= 2)
+        {
+            if(cores > onlineCores)
+                cores = onlineCores;
+
+            fanoutRunOnce((fanoutPrimitive_t)primitive, cores, rtPolicy, csvFile);
+            printf("%s on %d cores: done\n", fanoutPrimitiveNames[primitive], cores);
+
+            if(cores == onlineCores)
+                break;
+        }
+    }
+
+    if(csvFile != NULL)
+        fclose(csvFile);
+}
+#endif
+
+#ifdef LOGGING_BENCHMARK_MODE
+/* Logging backend benchmark.
+ *
+ * In the default mode every thread calls syslog() once, all at about the
+ * same moment: each call takes the syslog lock of glibc and sends the
+ * message to /dev/log, so the threads are serialised by the logger rather
+ * than by the work they log. In this mode 1, 2, 4... NUM_THREADS threads,
+ * released together, each log LOGBENCH_MESSAGES messages through one of
+ * four backends:
+ *
+ *   syslog   the call of the default mode
+ *   write    a buffer per thread, appended to a shared file with one
+ *            write(2) once it is full
+ *   mpsc     a bounded lock-free queue shared by every thread, written to a
+ *            file by a drain thread; a full queue drops the message
+ *   mmap     a ring file per thread, mapped and copied into, written back
+ *            by the kernel
+ *
+ * Every call is timed on the caller side, formatting included, and the
+ * throughput counts the messages of all the threads over the time from the
+ * first call to the last one done. The mpsc backend also reports the
+ * messages it dropped and how long its drain thread took after the last
+ * call. */
+
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NSEC_PER_SEC (1000000000)
+#define NSEC_PER_USEC (1000)
+
+// Messages logged by each thread for every backend/thread count pair
+#define LOGBENCH_MESSAGES (500)
+
+// Longest formatted message, longer ones are truncated
+#define LOGBENCH_MESSAGE_MAX (96)
+
+// Buffer of each thread for the write backend
+#define LOGBENCH_WRITE_BUFFER (4096)
+
+// Slots of the MPSC queue, a power of two
+#define LOGBENCH_QUEUE_SLOTS (4096)
+
+// Buffer of the drain thread, written whenever it is full or the queue is empty
+#define LOGBENCH_DRAIN_BUFFER (65536)
+
+// Polling interval of the drain thread on an empty queue
+#define LOGBENCH_DRAIN_POLL_USEC (100)
+
+// Size of the ring file of each thread for the mmap backend
+#define LOGBENCH_RING_BYTES (1024 * 1024)
+
+// Clock used for the caller-side latency of every call
+#define LOGBENCH_CLOCK CLOCK_MONOTONIC
+
+#define CSV_FILE_NAME "multiplethreads_logbench.csv"
+#define LOG_FILE_NAME "multiplethreads_logbench.log"
+#define RING_FILE_FORMAT "multiplethreads_logbench_ring%d.log"
+
+typedef enum
+{
+    LOGBENCH_SYSLOG,
+    LOGBENCH_WRITE,
+    LOGBENCH_MPSC,
+    LOGBENCH_MMAP,
+    LOGBENCH_NUM_BACKENDS
+} logBackend_t;
+
+static const char *logBackendNames[LOGBENCH_NUM_BACKENDS] =
+{
+    "syslog", "write", "mpsc", "mmap"
+};
+
+/* One message of the MPSC queue. The sequence tells who owns the slot:
+ * equal to the position of a producer, the slot is free for it; one more,
+ * the message is complete for the drain thread */
+typedef struct
+{
+    volatile unsigned long sequence;
+    int length;
+    char text[LOGBENCH_MESSAGE_MAX];
+} logSlot_t;
+
+// Private state of one logging thread
+typedef struct
+{
+    char buffer[LOGBENCH_WRITE_BUFFER];
+    int used;
+
+    char *ring;
+    int ringFd;
+    size_t ringOffset;
+} logWriter_t;
+
+// State shared by the main thread, the loggers and the drain thread of one run
+typedef struct
+{
+    logBackend_t backend;
+    int loggers;
+
+    pthread_barrier_t start;
+    int logFd;
+
+    // producers claim positions from head, the drain thread alone moves tail
+    volatile unsigned long head;
+    unsigned long tail;
+    volatile int drainStop;
+    volatile unsigned long dropped;
+} logRun_t;
+
+static logRun_t logRun;
+static logSlot_t logQueue[LOGBENCH_QUEUE_SLOTS];
+static logWriter_t logWriters[NUM_THREADS];
+
+// Caller-side latency in nanoseconds of each call of each thread
+static long logLatency[NUM_THREADS][LOGBENCH_MESSAGES];
+
+// Start of the first call and end of the last call of each thread
+static struct timespec logFirst[NUM_THREADS], logLast[NUM_THREADS];
+
+static long timespecDiffNsec(struct timespec *stop, struct timespec *start)
+{
+    return ((long)(stop->tv_sec - start->tv_sec) * NSEC_PER_SEC) +
+           (stop->tv_nsec - start->tv_nsec);
+}
+
+/* Writes all of length bytes, a regular file only returns short on error */
+static void writeAll(int fd, const char *text, size_t length)
+{
+    ssize_t written;
+
+    while(length > 0)
+    {
+        written = write(fd, text, length);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            perror("write log file");
+            return;
+        }
+        text += written;
+        length -= written;
+    }
+}
+
+/* Copies a message into the queue, FALSE when it is full. Producers race
+ * for a position with a compare and swap on head; the winner owns the slot
+ * until it publishes the message with the sequence */
+static int queuePush(const char *text, int length)
+{
+    unsigned long position = __atomic_load_n(&logRun.head, __ATOMIC_RELAXED);
+    logSlot_t *slot;
+    long difference;
+
+    for(;;)
+    {
+        slot = &logQueue[position & (LOGBENCH_QUEUE_SLOTS - 1)];
+        difference = (long)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+
+        if(difference == 0)
+        {
+            // on failure position is reloaded with the current head
+            if(__atomic_compare_exchange_n(&logRun.head, &position, position + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(difference < 0)
+            return 0;
+        else
+            position = __atomic_load_n(&logRun.head, __ATOMIC_RELAXED);
+    }
+
+    memcpy(slot->text, text, length);
+    slot->length = length;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Takes the oldest message of the queue, 0 when it is empty or the oldest
+ * is still being copied by its producer */
+static int queuePop(char *text)
+{
+    logSlot_t *slot = &logQueue[logRun.tail & (LOGBENCH_QUEUE_SLOTS - 1)];
+    int length;
+
+    if(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != logRun.tail + 1)
+        return 0;
+
+    length = slot->length;
+    memcpy(text, slot->text, length);
+    // free for the producer one lap later
+    __atomic_store_n(&slot->sequence, logRun.tail + LOGBENCH_QUEUE_SLOTS, __ATOMIC_RELEASE);
+    logRun.tail++;
+    return length;
+}
+
+/* Entry point of the drain thread of the mpsc backend: empties the queue
+ * into the log file until the loggers are done and nothing is left */
+void drainThread(void *arg)
+{
+    static char buffer[LOGBENCH_DRAIN_BUFFER];
+    struct timespec poll = {0, LOGBENCH_DRAIN_POLL_USEC * NSEC_PER_USEC};
+    int used = 0, length, stop;
+
+    for(;;)
+    {
+        stop = __atomic_load_n(&logRun.drainStop, __ATOMIC_ACQUIRE);
+
+        while(used + LOGBENCH_MESSAGE_MAX <= LOGBENCH_DRAIN_BUFFER &&
+              (length = queuePop(&buffer[used])) > 0)
+            used += length;
+
+        if(used > 0)
+        {
+            writeAll(logRun.logFd, buffer, used);
+            used = 0;
+            continue;
+        }
+
+        // checked before the last pop, so nothing pushed before the stop is lost
+        if(stop)
+            break;
+
+        nanosleep(&poll, NULL);
+    }
+}
+
+/* Appends a message to the ring file of the thread, wrapping to the start
+ * when the rest of the ring is too short for it */
+static void ringAppend(logWriter_t *writer, const char *text, int length)
+{
+    if(writer->ringOffset + length > LOGBENCH_RING_BYTES)
+        writer->ringOffset = 0;
+
+    memcpy(&writer->ring[writer->ringOffset], text, length);
+    writer->ringOffset += length;
+}
+
+/* Logs one message through the backend under test */
+static void logMessage(logWriter_t *writer, int threadIdx, int sequence, int sum)
+{
+    char text[LOGBENCH_MESSAGE_MAX];
+    int length;
+
+    if(logRun.backend == LOGBENCH_SYSLOG)
+    {
+        syslog(LOG_INFO, "Thread idx=%d, sum[0...%d]=%d seq=%d\n",
+               threadIdx, threadIdx, sum, sequence);
+        return;
+    }
+
+    length = snprintf(text, sizeof(text), "Thread idx=%d, sum[0...%d]=%d seq=%d\n",
+                      threadIdx, threadIdx, sum, sequence);
+    if(length >= (int)sizeof(text))
+        length = sizeof(text) - 1;
+
+    switch(logRun.backend)
+    {
+        case LOGBENCH_WRITE:
+            if(writer->used + length > LOGBENCH_WRITE_BUFFER)
+            {
+                writeAll(logRun.logFd, writer->buffer, writer->used);
+                writer->used = 0;
+            }
+            memcpy(&writer->buffer[writer->used], text, length);
+            writer->used += length;
+            break;
+
+        case LOGBENCH_MPSC:
+            if(!queuePush(text, length))
+                __atomic_add_fetch(&logRun.dropped, 1, __ATOMIC_RELAXED);
+            break;
+
+        case LOGBENCH_MMAP:
+            ringAppend(writer, text, length);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Entry point of the loggers: the sum of the default mode, then
+ * LOGBENCH_MESSAGES timed log calls once every logger is ready */
+void loggerThread(void *threadp)
+{
+    threadParams_t *threadParams = (threadParams_t *)threadp;
+    logWriter_t *writer = &logWriters[threadParams->threadIdx];
+    struct timespec before, after;
+    int sum=0, i;
+
+    for(i=1; i < (threadParams->threadIdx)+1; i++)
+        sum=sum+i;
+
+    pthread_barrier_wait(&logRun.start);
+
+    for(i=0; i < LOGBENCH_MESSAGES; i++)
+    {
+        clock_gettime(LOGBENCH_CLOCK, &before);
+        logMessage(writer, threadParams->threadIdx, i, sum);
+        clock_gettime(LOGBENCH_CLOCK, &after);
+
+        logLatency[threadParams->threadIdx][i] = timespecDiffNsec(&after, &before);
+        if(i == 0)
+            logFirst[threadParams->threadIdx] = before;
+    }
+    logLast[threadParams->threadIdx] = after;
+
+    // what is left in the buffer goes out untimed, as an exit handler would
+    if(logRun.backend == LOGBENCH_WRITE && writer->used > 0)
+    {
+        writeAll(logRun.logFd, writer->buffer, writer->used);
+        writer->used = 0;
+    }
+}
+
+/* Maps a prefaulted ring file for the logger, outside of the timed calls */
+static int ringOpen(logWriter_t *writer, int threadIdx)
+{
+    char fileName[64];
+
+    snprintf(fileName, sizeof(fileName), RING_FILE_FORMAT, threadIdx);
+    writer->ringFd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(writer->ringFd < 0 || ftruncate(writer->ringFd, LOGBENCH_RING_BYTES) < 0)
+    {
+        perror("ring file");
+        return -1;
+    }
+
+    writer->ring = mmap(NULL, LOGBENCH_RING_BYTES, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, writer->ringFd, 0);
+    if(writer->ring == MAP_FAILED)
+    {
+        perror("mmap ring file");
+        writer->ring = NULL;
+        return -1;
+    }
+
+    writer->ringOffset = 0;
+    return 0;
+}
+
+static void ringClose(logWriter_t *writer, int threadIdx)
+{
+    char fileName[64];
+
+    if(writer->ring != NULL)
+        munmap(writer->ring, LOGBENCH_RING_BYTES);
+    if(writer->ringFd >= 0)
+        close(writer->ringFd);
+
+    snprintf(fileName, sizeof(fileName), RING_FILE_FORMAT, threadIdx);
+    unlink(fileName);
+
+    writer->ring = NULL;
+    writer->ringFd = -1;
+}
+
+static int compareLong(const void *a, const void *b)
+{
+    long la = *(const long *)a, lb = *(const long *)b;
+    return (la > lb) - (la < lb);
+}
+
+/* Summarises the calls of a run: latency distribution over every call of
+ * every thread, and the throughput of the whole group from the first call
+ * to the last one done */
+static void logReport(long drainNsec, FILE *csvFile)
+{
+    static long allLatencies[NUM_THREADS * LOGBENCH_MESSAGES];
+    struct timespec *first = &logFirst[0], *last = &logLast[0];
+    int index, message, count = 0;
+    long elapsedNsec;
+    double throughput;
+
+    for(index=0; index < logRun.loggers; index++)
+    {
+        for(message=0; message < LOGBENCH_MESSAGES; message++)
+            allLatencies[count++] = logLatency[index][message];
+
+        if(timespecDiffNsec(&logFirst[index], first) < 0)
+            first = &logFirst[index];
+        if(timespecDiffNsec(&logLast[index], last) > 0)
+            last = &logLast[index];
+    }
+    elapsedNsec = timespecDiffNsec(last, first);
+
+    qsort(allLatencies, count, sizeof(long), compareLong);
+    throughput = (elapsedNsec > 0) ? (double)count * NSEC_PER_SEC / elapsedNsec : 0.0;
+
+    printf("%-6s %3d threads: call nsec p50=%ld p90=%ld p99=%ld p99.9=%ld max=%ld, %.0lf msgs/s",
+           logBackendNames[logRun.backend], logRun.loggers,
+           allLatencies[count / 2],
+           allLatencies[(count * 90) / 100],
+           allLatencies[(count * 99) / 100],
+           allLatencies[(count * 999) / 1000],
+           allLatencies[count - 1],
+           throughput);
+    if(logRun.backend == LOGBENCH_MPSC)
+        printf(", dropped %lu, drained %ld usec after the last call",
+               logRun.dropped, drainNsec / NSEC_PER_USEC);
+    printf("\n");
+
+    if(csvFile != NULL)
+        fprintf(csvFile, "%s;%d;%d;%ld;%ld;%ld;%ld;%ld;%.0lf;%lu;%ld\n",
+                logBackendNames[logRun.backend], logRun.loggers, count,
+                allLatencies[count / 2],
+                allLatencies[(count * 90) / 100],
+                allLatencies[(count * 99) / 100],
+                allLatencies[(count * 999) / 1000],
+                allLatencies[count - 1],
+                throughput, logRun.dropped, drainNsec);
+}
+
+/* Runs LOGBENCH_MESSAGES calls of each of loggers threads through backend */
+static void logRunOnce(logBackend_t backend, int loggers, FILE *csvFile)
+{
+    pthread_t drain;
+    struct timespec stop, drained;
+    long drainNsec = 0;
+    int index;
+
+    memset(logLatency, 0, sizeof(logLatency));
+    logRun.backend = backend;
+    logRun.loggers = loggers;
+    logRun.head = 0;
+    logRun.tail = 0;
+    logRun.drainStop = 0;
+    logRun.dropped = 0;
+    logRun.logFd = -1;
+
+    for(index=0; index < LOGBENCH_QUEUE_SLOTS; index++)
+        logQueue[index].sequence = index;
+
+    if(backend == LOGBENCH_WRITE || backend == LOGBENCH_MPSC)
+    {
+        logRun.logFd = open(LOG_FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if(logRun.logFd < 0)
+        {
+            perror("open log file");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for(index=0; index < loggers; index++)
+    {
+        logWriters[index].used = 0;
+        logWriters[index].ring = NULL;
+        logWriters[index].ringFd = -1;
+        if(backend == LOGBENCH_MMAP && ringOpen(&logWriters[index], index) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    if(backend == LOGBENCH_MPSC &&
+       pthread_create(&drain, (void *)0, (void *)&drainThread, (void *)0) != 0)
+    {
+        perror("pthread_create drain thread");
+        exit(EXIT_FAILURE);
+    }
+
+    // the loggers plus the main thread, which releases them
+    pthread_barrier_init(&logRun.start, NULL, loggers + 1);
+
+    for(index=0; index < loggers; index++)
+    {
+        threadParams[index].threadIdx=index;
+
+        if(pthread_create(&threads[index], (void *)0, (void *)&loggerThread,
+                          (void *)&(threadParams[index])) != 0)
+        {
+            perror("pthread_create logger");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(&logRun.start);
+
+    for(index=0; index < loggers; index++)
+        pthread_join(threads[index], NULL);
+
+    if(backend == LOGBENCH_MPSC)
+    {
+        clock_gettime(LOGBENCH_CLOCK, &stop);
+        __atomic_store_n(&logRun.drainStop, 1, __ATOMIC_RELEASE);
+        pthread_join(drain, NULL);
+        clock_gettime(LOGBENCH_CLOCK, &drained);
+        drainNsec = timespecDiffNsec(&drained, &stop);
+    }
+
+    pthread_barrier_destroy(&logRun.start);
+
+    for(index=0; index < loggers; index++)
+        if(backend == LOGBENCH_MMAP)
+            ringClose(&logWriters[index], index);
+
+    if(logRun.logFd >= 0)
+    {
+        close(logRun.logFd);
+        unlink(LOG_FILE_NAME);
+    }
+
+    logReport(drainNsec, csvFile);
+}
+
+/* Sweeps every backend over 1, 2, 4... NUM_THREADS logging threads */
+void loggingBenchmark(void)
+{
+    int backend, loggers;
+    FILE *csvFile;
+
+    /* syslog without LOG_PERROR: the copy to stderr is a second locked
+     * write the other backends do not do */
+    closelog();
+    openlog(COURSE_ID_STRING, LOG_NDELAY, LOG_USER);
+
+    csvFile = fopen(CSV_FILE_NAME, "w");
+    if(csvFile != NULL)
+        fprintf(csvFile, "Backend;Threads;Calls;P50Nsec;P90Nsec;P99Nsec;P999Nsec;MaxNsec;MsgsPerSec;Dropped;DrainNsec\n");
+
+    for(backend=0; backend < LOGBENCH_NUM_BACKENDS; backend++)
+        for(loggers=1; loggers <= NUM_THREADS; loggers *= 2)
+            logRunOnce((logBackend_t)backend, loggers, csvFile);
+
+    if(csvFile != NULL)
+        fclose(csvFile);
+}
+#endif
+
 
 int main (int argc, char *argv[])
 {
@@ -103,6 +978,18 @@ int main (int argc, char *argv[])
     // configure our program to log to the syslog file
     initialiseSysLog();
 
+#ifdef FANOUT_WAKEUP_MODE
+    // release all the threads together instead of one per pthread_create
+    fanoutBenchmark();
+    return 0;
+#endif
+
+#ifdef LOGGING_BENCHMARK_MODE
+    // the same log load through syslog and three other backends
+    loggingBenchmark();
+    return 0;
+#endif
+
     /* Loop over the 128 items of the threadParams array to spawn the
      * respective thread and associate to it the entry point function
      * counterThread */
@@ -12,6 +12,11 @@
 #include <sched.h>
 #include <unistd.h>
 
+/* Including seqthread.h to start the threads pinned to core 3 inside the
+ * cpuset partition of ../Assignment5/seqisol -s, which they are otherwise
+ * kept out of */
+#include "seqthread.h"
+
 // Specified number of threads for this assignment: 128
 #define NUM_THREADS 128
 
@@ -82,6 +87,8 @@ void set_scheduler(void){
   pthread_attr_setschedpolicy(&fifo_sched_attr, SCHED_POLICY);
   
   CPU_ZERO(&cpuset); // Clears the cpuset variables, so that it contains no CPU
+  /* Nothing keeps other tasks, IRQs and kernel threads off core 3: check it,
+   * or shield it for the run, with ../Assignment5/seqisol -c 3 [-s] ./fifothreads */
   cpuidx=(3);
   CPU_SET(cpuidx, &cpuset); // Set the CPU set to the indicated cpuidx
   
@@ -215,7 +222,9 @@ int main (int argc, char *argv[])
     // Sets the scheduler according to configuraiton
     set_scheduler();
 
-    pthread_create(&startthread,   // pointer to thread descriptor
+    /* The starter thread is pinned to core 3 as well, and the threads it
+     * creates start in the RT partition with it */
+    startRtThread(&startthread,   // pointer to thread descriptor
                   &fifo_sched_attr,     // use FIFO RT max priority attributes
                   (void *)&starterThread, // thread function entry point
                   (void *)0 // parameters to pass in
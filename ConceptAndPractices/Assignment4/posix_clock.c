@@ -5,6 +5,9 @@
 /*                                                                          */
 /****************************************************************************/
 
+// Necessary for sched_getcpu
+#define _GNU_SOURCE
+
 #include <pthread.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -12,6 +15,11 @@
 #include <time.h>
 #include <errno.h>
 #include <string.h> // in order to use strlen
+#include <math.h> // in order to use sqrt and fabs
+#include <sched.h> // in order to use sched_getcpu
+#include <sys/sysinfo.h> // in order to use get_nprocs_conf
+
+#include "seqpower.h" // C-state and frequency pinning, shared with seqgen3
 
 /**
  * @brief Number of nanoseconds per second
@@ -59,6 +67,13 @@ struct sched_param main_param;
 
 FILE* csvFileOutput = NULL;
 
+/**
+ * @brief Core the test thread woke up on in the latest iteration, and its frequency in MHz
+ * (0 when cpufreq does not report it)
+ */
+static int wakeup_core = -1;
+static double wakeup_core_mhz = 0.0;
+
 #define CSV_EXTENSION ".csv"
 
 // Use a compilation switch to determine which clock to use
@@ -398,6 +413,13 @@ void delay_test(void *threadID)
      */ 
     clock_gettime(MY_CLOCK, &realTimeClock_stop_time);
 
+    /**
+     * Record where the thread woke up and at which frequency that core runs now,
+     * outside of the measured interval
+     */
+    wakeup_core = sched_getcpu();
+    wakeup_core_mhz = coreFrequencyMhz(wakeup_core);
+
     // Calculate the delta time between the stop and start time
     delta_t(&realTimeClock_stop_time, &realTimeClock_start_time, &realTimeClock_dt);
     delta_t(&realTimeClock_dt, &sleep_requested, &delay_error);
@@ -434,26 +456,412 @@ void end_delay_test(void)
   printf("\n");
   printf("Sleep loop count = %ld\n", sleep_count);
 #endif
-  printf("%s delay error = %ld, nanoseconds = %ld\n", 
+  printf("%s delay error = %ld, nanoseconds = %ld, woke on core %d at %.0lf MHz\n", 
         get_used_clock(MY_CLOCK), 
         delay_error.tv_sec, 
-        delay_error.tv_nsec);
+        delay_error.tv_nsec,
+        wakeup_core,
+        wakeup_core_mhz);
 
 
   if(csvFileOutput!=NULL){
     // print to csv file
-    fprintf(csvFileOutput, "%6.9lf;%6.9lf\n", timespecToDouble(&realTimeClock_dt), timespecToDouble(&delay_error));
+    fprintf(csvFileOutput, "%6.9lf;%6.9lf;%d;%.0lf\n", timespecToDouble(&realTimeClock_dt), timespecToDouble(&delay_error),
+            wakeup_core, wakeup_core_mhz);
+  }
+
+}
+
+/****************************************************************************/
+/* Clock stability: how the clocks drift against each other                 */
+/*                                                                          */
+/* The delay test above only shows the nanosleep error of one clock. The    */
+/* stability run reads pairs of clocks once per interval for a long time    */
+/* and tells how they move against each other under NTP: CLOCK_MONOTONIC   */
+/* and CLOCK_REALTIME are slewed, CLOCK_REALTIME can also be stepped, and   */
+/* CLOCK_MONOTONIC_RAW is the undisciplined hardware counter all pairs are  */
+/* read against.                                                            */
+/****************************************************************************/
+
+/**
+ * @brief Default interval between two samples of the clock offsets
+ */
+#define STABILITY_DEFAULT_INTERVAL_MS (1000)
+
+/**
+ * @brief Sandwich reads per sample, the one with the smallest uncertainty is kept
+ */
+#define SANDWICH_TRIES (16)
+
+/**
+ * @brief Default jump of the offset beyond its steady trend that is reported as a step
+ */
+#define STEP_THRESHOLD_USEC (1000)
+
+/**
+ * @brief Averaging intervals of the Allan deviation go up in powers of two
+ * while at least this many second differences are left to average
+ */
+#define ADEV_MIN_TERMS (8)
+
+/**
+ * @brief Differences of the first samples whose median is the initial trend,
+ * so a step in the first interval is not taken for the trend
+ */
+#define TREND_SEED_DIFFERENCES (5)
+
+/**
+ * @brief A pair of clocks: the clock under test, read between two reads of the reference
+ */
+typedef struct
+{
+  clockid_t clock;
+  clockid_t reference;
+  long double first_nsec;   // offset at the first sample, the epochs of the clocks differ by decades
+  double *offset_nsec;       // clock minus reference minus first_nsec, at every sample
+  double *uncertainty_nsec;  // half the time between the two reference reads
+} clock_pair_t;
+
+#define NUM_CLOCK_PAIRS (3)
+
+static clock_pair_t clock_pairs[NUM_CLOCK_PAIRS] = {
+  {CLOCK_MONOTONIC, CLOCK_MONOTONIC_RAW, 0.0, NULL, NULL},  // NTP slewing
+  {CLOCK_REALTIME, CLOCK_MONOTONIC_RAW, 0.0, NULL, NULL},   // slewing and steps
+  {CLOCK_REALTIME, CLOCK_MONOTONIC, 0.0, NULL, NULL}        // steps only, both are slewed alike
+};
+
+/**
+ * @brief Converts a timespec to nanoseconds as a long double, precise enough for the offsets
+ * of clocks counting from different epochs
+ */
+static long double timespec_to_nsec(struct timespec *time_info)
+{
+  return ((long double)time_info->tv_sec * NSEC_PER_SEC) + time_info->tv_nsec;
+}
+
+/**
+ * @brief Offset of a clock against a reference by the sandwich method: read the
+ * reference, the clock, the reference again. The clock was read half way
+ * between the two reference reads, give or take half the time between them.
+ * 
+ * @param pair the two clocks
+ * @param offset_nsec clock minus reference
+ * @param uncertainty_nsec half the width of the best sandwich
+ */
+static void sandwich_offset(const clock_pair_t *pair, long double *offset_nsec, double *uncertainty_nsec)
+{
+  struct timespec before, during, after;
+  long double width, best_width = -1.0;
+  int try;
+
+  for(try = 0; try < SANDWICH_TRIES; try++)
+  {
+    clock_gettime(pair->reference, &before);
+    clock_gettime(pair->clock, &during);
+    clock_gettime(pair->reference, &after);
+
+    width = timespec_to_nsec(&after) - timespec_to_nsec(&before);
+    if(best_width < 0.0 || width < best_width)
+    {
+      best_width = width;
+      *offset_nsec = timespec_to_nsec(&during) - ((timespec_to_nsec(&before) + timespec_to_nsec(&after)) / 2.0);
+      *uncertainty_nsec = (double)(width / 2.0);
+    }
+  }
+}
+
+/**
+ * @brief Overlapping Allan deviation of the phase samples x, taken every tau0 seconds,
+ * at the averaging interval m * tau0
+ */
+static double allan_deviation(const double *x_nsec, int count, int m, double tau0)
+{
+  double sum = 0.0, second_difference, tau = m * tau0;
+  int i;
+
+  for(i = 0; i + (2 * m) < count; i++)
+  {
+    second_difference = (x_nsec[i + (2 * m)] - (2.0 * x_nsec[i + m]) + x_nsec[i]) / NSEC_PER_SEC;
+    sum += second_difference * second_difference;
   }
 
+  return sqrt(sum / (2.0 * tau * tau * (count - (2 * m))));
+}
+
+static int compare_double(const void *a, const void *b)
+{
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+/**
+ * @brief Median of the first differences of the offsets, the trend the first
+ * interval is tested against
+ */
+static double initial_trend(const double *offset_nsec, int count)
+{
+  double differences[TREND_SEED_DIFFERENCES];
+  int i, n = (count - 1 < TREND_SEED_DIFFERENCES) ? count - 1 : TREND_SEED_DIFFERENCES;
+
+  if(n <= 0)
+    return 0.0;
+
+  for(i = 0; i < n; i++)
+    differences[i] = offset_nsec[i + 1] - offset_nsec[i];
+
+  qsort(differences, n, sizeof(double), compare_double);
+  return (n % 2) ? differences[n / 2] : (differences[(n / 2) - 1] + differences[n / 2]) / 2.0;
+}
+
+/**
+ * @brief Analyses the offsets of one pair: steps, frequency offset, Allan deviation.
+ * Prints the report and returns the number of steps found.
+ */
+static int analyse_clock_pair(const clock_pair_t *pair, int count, double tau0, double step_threshold_nsec)
+{
+  double *phase_nsec = malloc(count * sizeof(double));
+  double step_nsec, correction = 0.0, trend = 0.0, sum_uncertainty = 0.0, max_uncertainty = 0.0;
+  double drift_nsec = 0.0, drift_seconds = 0.0;
+  int i, m, steps = 0;
+
+  if(phase_nsec == NULL)
+    return 0;
+
+  printf("%s - %s: %d samples every %.3lf s, offset at the first %.6Lf s\n", get_used_clock(pair->clock), get_used_clock(pair->reference),
+         count, tau0, pair->first_nsec / NSEC_PER_SEC);
+
+  /**
+   * The phase is the offset with the steps taken out. A step is a change of the
+   * offset between two samples that departs from the trend of the previous
+   * interval by more than the threshold: slewing changes the trend slowly, a
+   * step all at once. The first interval has no previous one, it is tested
+   * against the median of the first few.
+   */
+  trend = initial_trend(pair->offset_nsec, count);
+  phase_nsec[0] = 0.0;
+  for(i = 1; i < count; i++)
+  {
+    step_nsec = pair->offset_nsec[i] - pair->offset_nsec[i - 1];
+
+    if(fabs(step_nsec - trend) > step_threshold_nsec)
+    {
+      printf("  step at %.3lf s: %+.1lf usec\n", i * tau0, (step_nsec - trend) / NSEC_PER_USEC);
+      correction += step_nsec - trend;
+      steps++;
+
+      // with the step taken out the interval followed the trend, it still counts for the frequency
+      step_nsec = trend;
+    }
+
+    trend = step_nsec;
+    drift_nsec += step_nsec;
+    drift_seconds += tau0;
+
+    phase_nsec[i] = pair->offset_nsec[i] - correction;
+  }
+
+  for(i = 0; i < count; i++)
+  {
+    sum_uncertainty += pair->uncertainty_nsec[i];
+    if(pair->uncertainty_nsec[i] > max_uncertainty)
+      max_uncertainty = pair->uncertainty_nsec[i];
+  }
+
+  // ns of offset gained per second of reference is parts per billion
+  printf("  sandwich uncertainty nsec avg=%.1lf max=%.1lf, frequency offset %+.3lf ppm, %d step%s\n",
+         sum_uncertainty / count, max_uncertainty, (drift_seconds > 0.0) ? drift_nsec / drift_seconds / 1000.0 : 0.0,
+         steps, (steps == 1) ? "" : "s");
+
+  printf("  Allan deviation:");
+  for(m = 1; count - (2 * m) >= ADEV_MIN_TERMS; m *= 2)
+    printf(" tau=%gs %.2e", m * tau0, allan_deviation(phase_nsec, count, m, tau0));
+  printf("\n");
+
+  free(phase_nsec);
+  return steps;
+}
+
+/**
+ * @brief Samples every clock pair once per interval for the given number of seconds,
+ * optionally writes the offsets as CSV, then analyses every pair
+ * 
+ * @param seconds length of the run
+ * @param interval_ms time between samples
+ * @param step_threshold_usec departure from the trend reported as a step
+ * @param csv_path file for the raw offsets, NULL for none
+ */
+void clock_stability(int seconds, int interval_ms, int step_threshold_usec, const char *csv_path)
+{
+  struct timespec next;
+  FILE *csv = NULL;
+  double tau0 = interval_ms / 1000.0, slew_ppm;
+  long double offset_nsec;
+  int count = (int)((seconds * 1000LL) / interval_ms) + 1, sample, pair, steps[NUM_CLOCK_PAIRS];
+
+  for(pair = 0; pair < NUM_CLOCK_PAIRS; pair++)
+  {
+    clock_pairs[pair].offset_nsec = calloc(count, sizeof(double));
+    clock_pairs[pair].uncertainty_nsec = calloc(count, sizeof(double));
+    if(clock_pairs[pair].offset_nsec == NULL || clock_pairs[pair].uncertainty_nsec == NULL)
+    {
+      perror("clock stability samples");
+      exit(-1);
+    }
+  }
+
+  if(csv_path != NULL)
+  {
+    csv = fopen(csv_path, "w");
+    if(csv == NULL)
+      perror(csv_path);
+    else
+      fprintf(csv, "Time;MONOTONIC-MONOTONIC_RAW drift;Uncertainty;REALTIME-MONOTONIC_RAW drift;Uncertainty;REALTIME-MONOTONIC drift;Uncertainty\n");
+  }
+
+  printf("Sampling clock offsets every %d ms for %d s\n", interval_ms, seconds);
+
+  // Samples are taken on an absolute CLOCK_MONOTONIC schedule, the analysis assumes a regular interval
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for(sample = 0; sample < count; sample++)
+  {
+    for(pair = 0; pair < NUM_CLOCK_PAIRS; pair++)
+    {
+      sandwich_offset(&clock_pairs[pair], &offset_nsec, &clock_pairs[pair].uncertainty_nsec[sample]);
+      if(sample == 0)
+        clock_pairs[pair].first_nsec = offset_nsec;
+      clock_pairs[pair].offset_nsec[sample] = (double)(offset_nsec - clock_pairs[pair].first_nsec);
+    }
+
+    if(csv != NULL)
+    {
+      fprintf(csv, "%.3lf", sample * tau0);
+      for(pair = 0; pair < NUM_CLOCK_PAIRS; pair++)
+        fprintf(csv, ";%.1lf;%.1lf", clock_pairs[pair].offset_nsec[sample], clock_pairs[pair].uncertainty_nsec[sample]);
+      fprintf(csv, "\n");
+    }
+
+    next.tv_nsec += (long)interval_ms * NSEC_PER_MSEC;
+    next.tv_sec += next.tv_nsec / NSEC_PER_SEC;
+    next.tv_nsec %= NSEC_PER_SEC;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+  }
+
+  if(csv != NULL)
+    fclose(csv);
+
+  for(pair = 0; pair < NUM_CLOCK_PAIRS; pair++)
+    steps[pair] = analyse_clock_pair(&clock_pairs[pair], count, tau0, step_threshold_usec * (double)NSEC_PER_USEC);
+
+  /**
+   * What the measurement says about the choice of clock. seqgen3 arms its
+   * sequencer timer and stamps its releases with CLOCK_REALTIME.
+   */
+  slew_ppm = clock_pairs[0].offset_nsec[count - 1] / ((count - 1) * tau0 * 1000.0);
+  if(steps[2] > 0)
+    printf("CLOCK_REALTIME was stepped %d time%s: use CLOCK_MONOTONIC for timers and interval timestamps, keep CLOCK_REALTIME for wall clock time only\n",
+           steps[2], (steps[2] == 1) ? "" : "s");
+  else
+    printf("CLOCK_REALTIME was not stepped in this run, it moved with CLOCK_MONOTONIC; a step at any time would still shift every timer armed on it\n");
+
+  /* MONOTONIC minus RAW growing: MONOTONIC runs fast, and a sleep timed on it is over early in RAW time */
+  printf("NTP slewed CLOCK_MONOTONIC by %+.3lf ppm against CLOCK_MONOTONIC_RAW: it runs %s by %.1lf usec per second, intervals timed on it are %s in RAW time\n",
+         slew_ppm, (slew_ppm >= 0.0) ? "fast" : "slow", fabs(slew_ppm), (slew_ppm >= 0.0) ? "shorter" : "longer");
+
+  for(pair = 0; pair < NUM_CLOCK_PAIRS; pair++)
+  {
+    free(clock_pairs[pair].offset_nsec);
+    free(clock_pairs[pair].uncertainty_nsec);
+  }
 }
 
 #define RUN_RT_THREAD
 
+/**
+ * @brief Prints the command line options of the program
+ * 
+ * @param program the name the program was started with
+ */
+void print_usage(const char *program)
+{
+  printf("Usage: %s [-l usec] [-g keep|performance|max|khz] [-s seconds [-i interval_ms] [-j step_usec] [-o file]]\n", program);
+  printf("  -l usec  hold /dev/cpu_dma_latency at usec, keeping the cores out of slower idle states\n");
+  printf("  -g mode  pin cpufreq of every core: performance governor, max frequency, a frequency in kHz,\n");
+  printf("           or keep; either option samples the frequency the cores actually ran at\n");
+  printf("  -s sec   instead of the delay test, sample the offsets between clocks for sec seconds and report\n");
+  printf("           their frequency offset, Allan deviation and steps\n");
+  printf("  -i ms    interval between clock samples, %d by default\n", STABILITY_DEFAULT_INTERVAL_MS);
+  printf("  -j usec  departure of an offset from its trend reported as a step, %d by default\n", STEP_THRESHOLD_USEC);
+  printf("  -o file  write every clock sample as CSV into file\n");
+}
+
 int main(int argc, char *argv[])
 {
+  int opt, dma_latency_usec = -1, power_control = 0, core;
+  int stability_seconds = 0, stability_interval_ms = STABILITY_DEFAULT_INTERVAL_MS, step_threshold_usec = STEP_THRESHOLD_USEC;
+  const char *stability_csv = NULL;
+  unsigned long long all_cores = 0;
+  frequencyPin_t frequency_pin = {FREQUENCY_KEEP, 0};
+
+  /**
+   * Parse the power options. By default the idle states and the frequency
+   * of the cores are left as the system manages them.
+   */
+  while((opt = getopt(argc, argv, "l:g:s:i:j:o:h")) != -1)
+  {
+    switch(opt)
+    {
+      case 'l':
+        dma_latency_usec = atoi(optarg);
+        power_control = 1;
+        if(dma_latency_usec < 0)
+        {
+          print_usage(argv[0]);
+          exit(-1);
+        }
+        break;
+      case 'g':
+        power_control = 1;
+        if(parseFrequencyPin(optarg, &frequency_pin) != 0)
+        {
+          print_usage(argv[0]);
+          exit(-1);
+        }
+        break;
+      case 's':
+        stability_seconds = atoi(optarg);
+        break;
+      case 'i':
+        stability_interval_ms = atoi(optarg);
+        break;
+      case 'j':
+        step_threshold_usec = atoi(optarg);
+        break;
+      case 'o':
+        stability_csv = optarg;
+        break;
+      default:
+        print_usage(argv[0]);
+        exit(-1);
+    }
+  }
+
+  if(stability_seconds < 0 || stability_interval_ms <= 0 || step_threshold_usec <= 0)
+  {
+    print_usage(argv[0]);
+    exit(-1);
+  }
+
   // Print the clock used in this execution
   print_used_clock(MY_CLOCK);
 
+  // The stability run reads all the clocks against each other, the clock of the build does not matter
+  if(stability_seconds > 0)
+  {
+    clock_stability(stability_seconds, stability_interval_ms, step_threshold_usec, stability_csv);
+    printf("TEST COMPLETE\n");
+    return 0;
+  }
+
   // Print scheduler policy before setting new configuration
   printf("Before adjustments to scheduling policy:\n");
   print_scheduler();
@@ -467,7 +875,20 @@ int main(int argc, char *argv[])
   csvFileOutput = fopen(csvFileName, "w");
 
   if(csvFileOutput != NULL){
-    fprintf(csvFileOutput, "Clock Time;Delay Error\n");
+    fprintf(csvFileOutput, "Clock Time;Delay Error;Core;Core MHz\n");
+  }
+
+  /**
+   * The test thread is not pinned, so the power settings apply to every core.
+   * They are restored at exit.
+   */
+  if(power_control)
+  {
+    for(core = 0; core < get_nprocs_conf() && core < POWER_MAX_CORES; core++)
+      all_cores |= 1ULL << core;
+
+    if(startPowerControl(all_cores, dma_latency_usec, &frequency_pin) != 0)
+      exit(-1);
   }
 
 #ifdef RUN_RT_THREAD
@@ -527,6 +948,10 @@ int main(int argc, char *argv[])
     fclose(csvFileOutput);
   }
 
+  // Print the frequency every core ran at and restore the power settings
+  if(power_control)
+    stopPowerControl();
+
   printf("TEST COMPLETE\n");
 
   return 0;
@@ -0,0 +1,414 @@
+// seqanalyze - single pass analysis of the releases of a seqgen3 run
+//
+// Reads either the syslog of a run (the last one between the START and STOP
+// LOGGING markers) or a binary trace written with seqgen3 -b, whichever the
+// file holds, in one pass and with memory that does not depend on the length
+// of the run. Per service it follows the intervals between consecutive
+// releases, the distribution of their deviation from the period in a log-linear
+// histogram, gaps and duplicates in the release numbering, and intervals long
+// enough for a release slot to have passed without a wakeup.
+//
+// The summary goes to stdout as CSV, or as JSON with -J. With -o, the min, avg
+// and max interval of every service and window of -w seconds are written as
+// CSV while the input is read, so plot_results.py only has to plot.
+//
+// Usage: seqanalyze [-J] [-o windows.csv] [-w seconds] [file]
+//
+// The file is /var/log/syslog by default.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "seqgen3.h"
+#include "seqtrace.h"
+#include "seqhist.h"
+
+#define DEFAULT_SYSLOG_PATH "/var/log/syslog"
+#define DEFAULT_WINDOW_SEC (1.0)
+
+// As logged by seqgen3 around a run
+#define RUN_START_PATTERN "==== START LOGGING ===="
+#define RUN_STOP_PATTERN "==== STOP LOGGING ===="
+
+#define LINE_MAX_LEN (512)
+
+// Binary trace records read at once
+#define TRACE_CHUNK (4096)
+
+// An interval this many periods long passed over a release slot
+#define LONG_INTERVAL_PERIODS (1.5)
+
+static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+static const char *percentileNames[] = {"p50", "p90", "p99", "p999", "p9999"};
+#define NUM_PERCENTILES (sizeof(percentiles) / sizeof(percentiles[0]))
+
+typedef struct
+{
+    int seen;
+    unsigned int periodMs;
+    int core;
+    unsigned long long releases;
+    unsigned long long lastReleaseCnt;
+    unsigned long long lastNsec;
+    unsigned long long intervals;
+    unsigned long long minIntervalNsec;
+    unsigned long long maxIntervalNsec;
+    double sumIntervalNsec;
+    double sumSqIntervalNsec;
+    unsigned long long gaps;             // jumps in the release numbering
+    unsigned long long missed;           // release numbers never logged
+    unsigned long long duplicates;       // release numbers logged again, or going back
+    unsigned long long longIntervals;
+    histogram_t jitter;                  // deviation of the intervals from the period
+    unsigned long long windowId;         // interval window being accumulated
+    unsigned long long windowIntervals;
+    unsigned long long windowMinNsec;
+    unsigned long long windowMaxNsec;
+    double windowSumNsec;
+} serviceTrace_t;
+
+static serviceTrace_t services[MAX_SERVICES];
+static FILE *windowsFile;
+static unsigned long long windowNsec;
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [-J] [-o windows.csv] [-w seconds] [file]\n", program);
+    printf("  -J          summary as JSON instead of CSV\n");
+    printf("  -o file     min/avg/max release interval per service and window, as CSV\n");
+    printf("  -w seconds  window of -o, %.1lf by default\n", DEFAULT_WINDOW_SEC);
+    printf("  file        syslog or binary trace of seqgen3 -b, %s by default\n", DEFAULT_SYSLOG_PATH);
+}
+
+static void writeWindowsHeader(void)
+{
+    fprintf(windowsFile, "service,period_ms,window_start_sec,intervals,interval_min_ms,interval_avg_ms,interval_max_ms\n");
+}
+
+static void flushWindow(int serviceIdx)
+{
+    serviceTrace_t *service = &services[serviceIdx];
+
+    if(windowsFile == NULL || service->windowIntervals == 0)
+        return;
+
+    fprintf(windowsFile, "S%d,%u,%.3lf,%llu,%.6lf,%.6lf,%.6lf\n", serviceIdx+1, service->periodMs,
+            (double)(service->windowId * windowNsec) / NANOSEC_PER_SEC, service->windowIntervals,
+            (double)service->windowMinNsec / NANOSEC_PER_MSEC,
+            service->windowSumNsec / service->windowIntervals / NANOSEC_PER_MSEC,
+            (double)service->windowMaxNsec / NANOSEC_PER_MSEC);
+
+    service->windowIntervals = 0;
+    service->windowMaxNsec = 0;
+    service->windowSumNsec = 0.0;
+}
+
+// Forgets what was read so far: a later run in the syslog replaces it
+static void resetRun(void)
+{
+    memset(services, 0, sizeof(services));
+
+    if(windowsFile != NULL)
+    {
+        fflush(windowsFile);
+        if(ftruncate(fileno(windowsFile), 0) != 0)
+            perror("truncate windows file");
+        rewind(windowsFile);
+        writeWindowsHeader();
+    }
+}
+
+// One release, its time relative to the start of the run
+static void accountRelease(int serviceNum, unsigned int periodMs, int core,
+                           unsigned long long releaseCnt, unsigned long long timeNsec)
+{
+    serviceTrace_t *service;
+    unsigned long long intervalNsec, deviationNsec, periodNsec, windowId;
+
+    if(serviceNum < 1 || serviceNum > MAX_SERVICES)
+        return;
+
+    service = &services[serviceNum-1];
+    service->core = core;
+
+    // release 1 again is a service removed and registered again in the slot
+    if(service->seen && releaseCnt <= service->lastReleaseCnt && releaseCnt != 1)
+    {
+        service->duplicates++;
+        return;
+    }
+
+    service->releases++;
+
+    // a period change or a new incarnation starts over, intervals across it compare to neither
+    if(!service->seen || periodMs != service->periodMs || releaseCnt == 1)
+    {
+        flushWindow(serviceNum-1);
+        service->seen = TRUE;
+        service->periodMs = periodMs;
+        service->lastReleaseCnt = releaseCnt;
+        service->lastNsec = timeNsec;
+        return;
+    }
+
+    if(releaseCnt != service->lastReleaseCnt + 1)
+    {
+        service->gaps++;
+        service->missed += releaseCnt - service->lastReleaseCnt - 1;
+        service->lastReleaseCnt = releaseCnt;
+        service->lastNsec = timeNsec;
+        return;
+    }
+
+    intervalNsec = (timeNsec > service->lastNsec) ? timeNsec - service->lastNsec : 0;
+    periodNsec = (unsigned long long)periodMs * NANOSEC_PER_MSEC;
+    deviationNsec = (intervalNsec > periodNsec) ? intervalNsec - periodNsec : periodNsec - intervalNsec;
+
+    service->lastReleaseCnt = releaseCnt;
+    service->lastNsec = timeNsec;
+
+    if(service->intervals == 0 || intervalNsec < service->minIntervalNsec)
+        service->minIntervalNsec = intervalNsec;
+    if(intervalNsec > service->maxIntervalNsec)
+        service->maxIntervalNsec = intervalNsec;
+
+    service->intervals++;
+    service->sumIntervalNsec += (double)intervalNsec;
+    service->sumSqIntervalNsec += (double)intervalNsec * (double)intervalNsec;
+    histogramRecord(&service->jitter, deviationNsec);
+
+    if((double)intervalNsec > LONG_INTERVAL_PERIODS * periodNsec)
+        service->longIntervals++;
+
+    if(windowsFile == NULL)
+        return;
+
+    windowId = timeNsec / windowNsec;
+    if(windowId != service->windowId)
+    {
+        flushWindow(serviceNum-1);
+        service->windowId = windowId;
+    }
+
+    if(service->windowIntervals == 0 || intervalNsec < service->windowMinNsec)
+        service->windowMinNsec = intervalNsec;
+    if(intervalNsec > service->windowMaxNsec)
+        service->windowMaxNsec = intervalNsec;
+    service->windowIntervals++;
+    service->windowSumNsec += (double)intervalNsec;
+}
+
+// "S<n> <hz> Hz on core <c> for release <k> @ sec=<s> period=<p> ms" logged by seqgen3;
+// without the period, as logged by older runs, it is taken back from the rate
+static int readSyslog(FILE *input)
+{
+    char line[LINE_MAX_LEN];
+    const char *record;
+    unsigned long long releaseCnt;
+    unsigned int periodMs;
+    double hz, sec;
+    int serviceNum, core, fields, running = FALSE, runs = 0;
+
+    while(fgets(line, sizeof(line), input) != NULL)
+    {
+        record = strstr(line, "seqgen3");
+        if(record == NULL)
+            continue;
+
+        if(strstr(record, RUN_START_PATTERN) != NULL)
+        {
+            resetRun();
+            running = TRUE;
+            runs++;
+            continue;
+        }
+
+        if(strstr(record, RUN_STOP_PATTERN) != NULL)
+        {
+            running = FALSE;
+            continue;
+        }
+
+        if(!running || (record = strstr(record, ": S")) == NULL)
+            continue;
+
+        fields = sscanf(record + 2, "S%d %lf Hz on core %d for release %llu @ sec=%lf period=%u ms",
+                        &serviceNum, &hz, &core, &releaseCnt, &sec, &periodMs);
+        if(fields < 5 || hz <= 0.0 || sec < 0.0)
+            continue;
+
+        if(fields < 6 || periodMs == 0)
+            periodMs = (unsigned int)lround(1000.0 / hz);
+
+        accountRelease(serviceNum, periodMs, core, releaseCnt, llround(sec * NANOSEC_PER_SEC));
+    }
+
+    if(runs == 0)
+    {
+        printf("No seqgen3 run found\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int readTrace(FILE *input, const traceHeader_t *header)
+{
+    static traceRecord_t records[TRACE_CHUNK];
+    size_t count, i;
+
+    resetRun();
+
+    while((count = fread(records, sizeof(traceRecord_t), TRACE_CHUNK, input)) > 0)
+    {
+        for(i=0; i < count; i++)
+        {
+            if(records[i].wakeNsec < header->startNsec)
+                continue;
+
+            accountRelease(records[i].serviceNum, records[i].periodMs, records[i].core,
+                           records[i].releaseCnt, records[i].wakeNsec - header->startNsec);
+        }
+    }
+
+    return 0;
+}
+
+static void printSummary(int json)
+{
+    serviceTrace_t *service;
+    double averageNsec, deviationNsec;
+    int i, first = TRUE;
+    unsigned int p;
+
+    if(json)
+        printf("[");
+    else
+    {
+        printf("service,period_ms,core,releases,intervals,interval_min_ms,interval_avg_ms,interval_max_ms,interval_sd_ms");
+        for(p=0; p < NUM_PERCENTILES; p++)
+            printf(",jitter_%s_us", percentileNames[p]);
+        printf(",jitter_max_us,gaps,missed,duplicates,long_intervals\n");
+    }
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        service = &services[i];
+        if(!service->seen)
+            continue;
+
+        averageNsec = (service->intervals > 0) ? service->sumIntervalNsec / service->intervals : 0.0;
+        deviationNsec = (service->intervals > 0) ?
+                        sqrt(fmax(0.0, (service->sumSqIntervalNsec / service->intervals) - (averageNsec * averageNsec))) : 0.0;
+
+        if(json)
+        {
+            printf("%s\n  {\"service\": \"S%d\", \"period_ms\": %u, \"core\": %d, \"releases\": %llu, \"intervals\": %llu, "
+                   "\"interval_min_ms\": %.6lf, \"interval_avg_ms\": %.6lf, \"interval_max_ms\": %.6lf, \"interval_sd_ms\": %.6lf",
+                   first ? "" : ",", i+1, service->periodMs, service->core, service->releases, service->intervals,
+                   (double)service->minIntervalNsec / NANOSEC_PER_MSEC, averageNsec / NANOSEC_PER_MSEC,
+                   (double)service->maxIntervalNsec / NANOSEC_PER_MSEC, deviationNsec / NANOSEC_PER_MSEC);
+            for(p=0; p < NUM_PERCENTILES; p++)
+                printf(", \"jitter_%s_us\": %.3lf", percentileNames[p], histogramPercentile(&service->jitter, percentiles[p]) / 1000.0);
+            printf(", \"jitter_max_us\": %.3lf, \"gaps\": %llu, \"missed\": %llu, \"duplicates\": %llu, \"long_intervals\": %llu}",
+                   service->jitter.max / 1000.0, service->gaps, service->missed, service->duplicates, service->longIntervals);
+        }
+        else
+        {
+            printf("S%d,%u,%d,%llu,%llu,%.6lf,%.6lf,%.6lf,%.6lf", i+1, service->periodMs, service->core,
+                   service->releases, service->intervals,
+                   (double)service->minIntervalNsec / NANOSEC_PER_MSEC, averageNsec / NANOSEC_PER_MSEC,
+                   (double)service->maxIntervalNsec / NANOSEC_PER_MSEC, deviationNsec / NANOSEC_PER_MSEC);
+            for(p=0; p < NUM_PERCENTILES; p++)
+                printf(",%.3lf", histogramPercentile(&service->jitter, percentiles[p]) / 1000.0);
+            printf(",%.3lf,%llu,%llu,%llu,%llu\n", service->jitter.max / 1000.0,
+                   service->gaps, service->missed, service->duplicates, service->longIntervals);
+        }
+
+        first = FALSE;
+    }
+
+    if(json)
+        printf("\n]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *inputPath = DEFAULT_SYSLOG_PATH, *windowsPath = NULL;
+    double windowSec = DEFAULT_WINDOW_SEC;
+    traceHeader_t header;
+    FILE *input;
+    int opt, json = FALSE, rc, i;
+
+    while((opt = getopt(argc, argv, "Jo:w:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'J':
+                json = TRUE;
+                break;
+            case 'o':
+                windowsPath = optarg;
+                break;
+            case 'w':
+                windowSec = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    if(optind < argc)
+        inputPath = argv[optind];
+
+    if(windowSec <= 0.0)
+    {
+        usage(argv[0]);
+        exit(-1);
+    }
+    windowNsec = (unsigned long long)(windowSec * NANOSEC_PER_SEC);
+
+    input = fopen(inputPath, "r");
+    if(input == NULL)
+    {
+        perror(inputPath);
+        exit(-1);
+    }
+
+    if(windowsPath != NULL)
+    {
+        windowsFile = fopen(windowsPath, "w");
+        if(windowsFile == NULL)
+        {
+            perror(windowsPath);
+            exit(-1);
+        }
+    }
+
+    // a binary trace announces itself, anything else is read as syslog text
+    if(fread(&header, sizeof(header), 1, input) == 1 && memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0)
+        rc = readTrace(input, &header);
+    else
+    {
+        rewind(input);
+        rc = readSyslog(input);
+    }
+
+    fclose(input);
+
+    for(i=0; i < MAX_SERVICES; i++)
+        flushWindow(i);
+
+    if(windowsFile != NULL)
+        fclose(windowsFile);
+
+    if(rc != 0)
+        exit(-1);
+
+    printSummary(json);
+    return 0;
+}
@@ -0,0 +1,421 @@
+// Aperiodic server of seqgen3
+//
+// The budget is shared by the server thread, which consumes it, and the
+// Sequencer, which gives it back, so it is only changed atomically. Pending
+// sporadic replenishments are a ring with a single writer on each end: the
+// server appends, the Sequencer takes the due ones. A server out of budget
+// sleeps on a semaphore the Sequencer posts after a replenishment.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "seqgen3.h"
+#include "seqsched.h"
+#include "seqhist.h"
+#include "seqaper.h"
+#include "seqthread.h"
+
+// Stands for the server in the service models admission control checks, beyond every slot
+#define SERVER_MODEL_IDX (MAX_SERVICES)
+
+typedef struct
+{
+    unsigned long long arrivalNsec;   // CLOCK_MONOTONIC
+    unsigned int workUsec;
+} aperiodicEvent_t;
+
+typedef struct
+{
+    unsigned long long dueNsec;       // CLOCK_MONOTONIC
+    long long amountNsec;
+} replenishment_t;
+
+static serverKind_t serverKind = SERVER_OFF;
+static unsigned int serverBudgetUsec, serverPeriodMs;
+static int serverCore = 2;
+static int serverPriority;
+static unsigned long long serverPeriodTicks;
+
+static unsigned int meanInterarrivalMs, meanWorkUsec;
+
+static const char *serverKindNames[NUM_SERVER_KINDS] = {"off", "sporadic", "deferrable"};
+
+static int eventPipe[2] = {-1, -1};
+static pthread_t serverThread, generatorThread;
+static int generatorStarted;
+
+static long long budgetNsec;
+// Set by the server before it blocks: it writes the flag and reads the budget, the
+// Sequencer writes the budget and reads the flag, both sequentially consistent
+static int serverWaiting;
+static sem_t replenished;
+
+static replenishment_t replenishments[SERVER_MAX_REPLENISHMENTS];
+static unsigned int replenishHead, replenishTail;
+
+// Written by the server thread, read once it is joined
+static unsigned long long served, exhaustions, consumedNsec;
+static histogram_t responseNsec;
+
+static unsigned long long posted, dropped, replenishCount;
+
+// Exponentially distributed around mean, for the Poisson arrivals and the work of the events
+static double exponentialSample(double mean, unsigned int *seed)
+{
+    double uniform = (double)rand_r(seed) / ((double)RAND_MAX + 1.0);
+
+    return -mean * log(1.0 - uniform);
+}
+
+int configureAperiodicServer(const char *arg)
+{
+    char kind[16];
+    int core = serverCore;
+
+    if(sscanf(arg, "%15[a-z],%u,%u,%d", kind, &serverBudgetUsec, &serverPeriodMs, &core) < 3 ||
+       serverBudgetUsec == 0 || serverPeriodMs == 0 || serverBudgetUsec > serverPeriodMs * USEC_PER_MSEC)
+        return -1;
+
+    for(serverKind = SERVER_SPORADIC; serverKind < NUM_SERVER_KINDS && strcmp(kind, serverKindNames[serverKind]) != 0; serverKind++);
+
+    if(serverKind == NUM_SERVER_KINDS)
+    {
+        serverKind = SERVER_OFF;
+        return -1;
+    }
+
+    serverCore = core;
+    return 0;
+}
+
+int configureAperiodicEvents(const char *arg)
+{
+    if(sscanf(arg, "%u,%u", &meanInterarrivalMs, &meanWorkUsec) != 2 || meanInterarrivalMs == 0 || meanWorkUsec == 0)
+        return -1;
+
+    return 0;
+}
+
+int aperiodicServerModel(serviceModel_t *model)
+{
+    if(serverKind == SERVER_OFF)
+        return FALSE;
+
+    memset(model, 0, sizeof(*model));
+    model->serviceIdx = SERVER_MODEL_IDX;
+    setServicePeriod(model, (unsigned long long)serverPeriodMs * USEC_PER_MSEC);
+    model->wcetUsec = (serverKind == SERVER_DEFERRABLE) ? 2 * serverBudgetUsec : serverBudgetUsec;
+    model->core = serverCore;
+    model->policy = OVERLOAD_QUEUE;
+    model->backlogCap = DEFAULT_BACKLOG_CAP;
+    model->criticality = DEFAULT_CRITICALITY;
+    model->resource = -1;
+
+    return TRUE;
+}
+
+int aperiodicServerOutranks(const serviceModel_t *model)
+{
+    serviceModel_t server;
+
+    if(model->serviceIdx == SERVER_MODEL_IDX || !aperiodicServerModel(&server))
+        return FALSE;
+
+    return rmHigherPriority(&server, model);
+}
+
+// Sporadic: what the server consumed since it became active at activeNsec comes back one period later
+static void scheduleReplenishment(unsigned long long activeNsec, unsigned long long amountNsec)
+{
+    unsigned int head = replenishHead;
+
+    if(serverKind != SERVER_SPORADIC || amountNsec == 0)
+        return;
+
+    // full, the amount comes back with the latest one, later than it should, never earlier
+    if(head - __atomic_load_n(&replenishTail, __ATOMIC_ACQUIRE) >= SERVER_MAX_REPLENISHMENTS)
+    {
+        __atomic_add_fetch(&replenishments[(head - 1) % SERVER_MAX_REPLENISHMENTS].amountNsec, (long long)amountNsec, __ATOMIC_RELEASE);
+        return;
+    }
+
+    replenishments[head % SERVER_MAX_REPLENISHMENTS].dueNsec = activeNsec + ((unsigned long long)serverPeriodMs * NANOSEC_PER_MSEC);
+    replenishments[head % SERVER_MAX_REPLENISHMENTS].amountNsec = (long long)amountNsec;
+    __atomic_store_n(&replenishHead, head + 1, __ATOMIC_RELEASE);
+}
+
+void replenishAperiodicServer(unsigned long long quantum, unsigned long long nowMonoNsec)
+{
+    unsigned int tail, head;
+    int given = FALSE;
+
+    if(serverKind == SERVER_DEFERRABLE && (quantum % serverPeriodTicks) == 0)
+    {
+        __atomic_store_n(&budgetNsec, (long long)serverBudgetUsec * 1000, __ATOMIC_SEQ_CST);
+        given = TRUE;
+    }
+    else if(serverKind == SERVER_SPORADIC)
+    {
+        tail = replenishTail;
+        head = __atomic_load_n(&replenishHead, __ATOMIC_ACQUIRE);
+
+        while(tail != head && replenishments[tail % SERVER_MAX_REPLENISHMENTS].dueNsec <= nowMonoNsec)
+        {
+            __atomic_add_fetch(&budgetNsec, __atomic_exchange_n(&replenishments[tail % SERVER_MAX_REPLENISHMENTS].amountNsec, 0, __ATOMIC_ACQ_REL),
+                               __ATOMIC_SEQ_CST);
+            tail++;
+            given = TRUE;
+        }
+
+        __atomic_store_n(&replenishTail, tail, __ATOMIC_RELEASE);
+    }
+
+    if(given)
+    {
+        replenishCount++;
+        if(__atomic_load_n(&serverWaiting, __ATOMIC_SEQ_CST))
+            sem_post(&replenished);
+    }
+}
+
+// Blocks until the Sequencer gives budget back, FALSE if it stopped meanwhile
+static int waitForBudget(void)
+{
+    struct timespec until;
+
+    __atomic_store_n(&serverWaiting, TRUE, __ATOMIC_SEQ_CST);
+
+    // the flag store and the budget load cannot be reordered, nor the budget
+    // store and the flag load of the Sequencer: either it sees the flag and
+    // posts, or this load sees its budget. A post with budget already seen
+    // only makes one wait below return at once.
+    while(__atomic_load_n(&budgetNsec, __ATOMIC_SEQ_CST) <= 0 && !sequencerDone)
+    {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += SERVER_POLL_MS * NANOSEC_PER_MSEC;
+        until.tv_sec += until.tv_nsec / NANOSEC_PER_SEC;
+        until.tv_nsec %= NANOSEC_PER_SEC;
+        sem_timedwait(&replenished, &until);
+    }
+
+    __atomic_store_n(&serverWaiting, FALSE, __ATOMIC_SEQ_CST);
+    return !sequencerDone;
+}
+
+static void *aperiodicServer(void *arg)
+{
+    struct pollfd pending = {eventPipe[0], POLLIN, 0};
+    aperiodicEvent_t event;
+    unsigned long long remainingNsec, sliceNsec, usedNsec, activeNsec=0, activeConsumedNsec=0;
+    long long budget;
+    int active = FALSE;
+
+    while(!sequencerDone)
+    {
+        // the queue is empty: a sporadic server goes idle and schedules what it consumed
+        if(poll(&pending, 1, active ? 0 : SERVER_POLL_MS) <= 0)
+        {
+            if(active)
+                scheduleReplenishment(activeNsec, activeConsumedNsec);
+            active = FALSE;
+            continue;
+        }
+
+        if(read(eventPipe[0], &event, sizeof(event)) != sizeof(event))
+            continue;
+
+        remainingNsec = (unsigned long long)event.workUsec * 1000;
+
+        while(remainingNsec > 0)
+        {
+            budget = __atomic_load_n(&budgetNsec, __ATOMIC_ACQUIRE);
+
+            if(budget <= 0)
+            {
+                if(active)
+                    scheduleReplenishment(activeNsec, activeConsumedNsec);
+                active = FALSE;
+                exhaustions++;
+
+                if(!waitForBudget())
+                    break;
+                continue;
+            }
+
+            if(!active)
+            {
+                active = TRUE;
+                activeNsec = monotonicNsec();
+                activeConsumedNsec = 0;
+            }
+
+            sliceNsec = (unsigned long long)SERVER_SLICE_USEC * 1000;
+            if(sliceNsec > remainingNsec)
+                sliceNsec = remainingNsec;
+            if(sliceNsec > (unsigned long long)budget)
+                sliceNsec = (unsigned long long)budget;
+
+            usedNsec = burnCpuNsec(sliceNsec, NULL, NULL);
+            __atomic_sub_fetch(&budgetNsec, (long long)usedNsec, __ATOMIC_RELEASE);
+            activeConsumedNsec += usedNsec;
+            consumedNsec += usedNsec;
+            remainingNsec = (usedNsec < remainingNsec) ? remainingNsec - usedNsec : 0;
+        }
+
+        if(remainingNsec == 0)
+        {
+            served++;
+            histogramRecord(&responseNsec, monotonicNsec() - event.arrivalNsec);
+        }
+    }
+
+    return NULL;
+}
+
+int postAperiodicEvent(unsigned int workUsec)
+{
+    aperiodicEvent_t event;
+
+    event.arrivalNsec = monotonicNsec();
+    event.workUsec = workUsec;
+
+    // records are far below PIPE_BUF, a write is all or nothing
+    if(write(eventPipe[1], &event, sizeof(event)) != sizeof(event))
+    {
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    __atomic_add_fetch(&posted, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Poisson arrivals on an absolute CLOCK_MONOTONIC schedule, whatever the server does
+static void *aperiodicGenerator(void *arg)
+{
+    struct timespec until;
+    unsigned long long nextNsec, wakeNsec, workUsec;
+    unsigned int seed = (unsigned int)monotonicNsec();
+
+    nextNsec = monotonicNsec();
+
+    while(!sequencerDone)
+    {
+        nextNsec += (unsigned long long)exponentialSample((double)meanInterarrivalMs * NANOSEC_PER_MSEC, &seed);
+
+        while(!sequencerDone && monotonicNsec() < nextNsec)
+        {
+            wakeNsec = monotonicNsec() + (SERVER_POLL_MS * NANOSEC_PER_MSEC);
+            if(wakeNsec > nextNsec)
+                wakeNsec = nextNsec;
+
+            until.tv_sec = wakeNsec / NANOSEC_PER_SEC;
+            until.tv_nsec = wakeNsec % NANOSEC_PER_SEC;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+        }
+
+        workUsec = (unsigned long long)(exponentialSample(meanWorkUsec, &seed) + 0.5);
+        if(!sequencerDone)
+            postAperiodicEvent((workUsec > 0) ? (unsigned int)workUsec : 1);
+    }
+
+    return NULL;
+}
+
+int startAperiodicServer(void)
+{
+    serviceModel_t model;
+    pthread_attr_t attr;
+    struct sched_param param = {0};
+    cpu_set_t serverCpu;
+    int rc;
+
+    if(!aperiodicServerModel(&model))
+        return 0;
+
+    if(pipe2(eventPipe, O_NONBLOCK) != 0)
+    {
+        perror("pipe for aperiodic events");
+        return -1;
+    }
+
+    sem_init(&replenished, 0, 0);
+    serverPeriodTicks = serverPeriodMs / releaseQuantumMs;
+    budgetNsec = (long long)serverBudgetUsec * 1000;
+    serverPriority = rmPriorityOfModel(&model);
+
+    CPU_ZERO(&serverCpu);
+    CPU_SET(serverCore, &serverCpu);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &serverCpu);
+    param.sched_priority = serverPriority;
+    pthread_attr_setschedparam(&attr, &param);
+
+    rc = startRtThread(&serverThread, &attr, aperiodicServer, NULL);
+    pthread_attr_destroy(&attr);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for aperiodic server");
+        return -1;
+    }
+
+    printf("Aperiodic server: %s, budget %u usec every %u ms on core %d at priority %d\n",
+           serverKindNames[serverKind], serverBudgetUsec, serverPeriodMs, serverCore, serverPriority);
+    syslog(LOG_CRIT, "Aperiodic server: %s, budget %u usec every %u ms on core %d at priority %d\n",
+           serverKindNames[serverKind], serverBudgetUsec, serverPeriodMs, serverCore, serverPriority);
+
+    if(meanInterarrivalMs == 0)
+        return 0;
+
+    rc = startNonRtThread(&generatorThread, aperiodicGenerator, NULL);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for aperiodic event generator");
+        return -1;
+    }
+
+    generatorStarted = TRUE;
+    printf("Aperiodic events: Poisson arrivals every %u ms on average, %u usec of work on average\n", meanInterarrivalMs, meanWorkUsec);
+    return 0;
+}
+
+void stopAperiodicServer(unsigned long long periodicMisses)
+{
+    if(serverKind == SERVER_OFF)
+        return;
+
+    if(generatorStarted)
+        pthread_join(generatorThread, NULL);
+    pthread_join(serverThread, NULL);
+
+    printf("Aperiodic server (%s, %u usec every %u ms): %llu events, %llu served, %llu dropped, %llu pending, response usec p50=%.1lf p99=%.1lf max=%.1lf, %llu budget exhaustions, %llu replenishments, CPU used %.1lf ms; periodic misses=%llu\n",
+           serverKindNames[serverKind], serverBudgetUsec, serverPeriodMs, posted + dropped, served, dropped, posted - served,
+           histogramPercentile(&responseNsec, 50.0) / 1000.0, histogramPercentile(&responseNsec, 99.0) / 1000.0, responseNsec.max / 1000.0,
+           exhaustions, replenishCount, consumedNsec / 1000000.0, periodicMisses);
+    syslog(LOG_CRIT, "Aperiodic server (%s, %u usec every %u ms): %llu events, %llu served, %llu dropped, response usec p50=%.1lf p99=%.1lf max=%.1lf, %llu budget exhaustions; periodic misses=%llu\n",
+           serverKindNames[serverKind], serverBudgetUsec, serverPeriodMs, posted + dropped, served, dropped,
+           histogramPercentile(&responseNsec, 50.0) / 1000.0, histogramPercentile(&responseNsec, 99.0) / 1000.0, responseNsec.max / 1000.0,
+           exhaustions, periodicMisses);
+
+    close(eventPipe[0]);
+    close(eventPipe[1]);
+    sem_destroy(&replenished);
+}
@@ -0,0 +1,73 @@
+// Aperiodic server of seqgen3: aperiodic events served next to the periodic services
+//
+// Events (a stamp of their arrival and the CPU time they need) are queued on a
+// pipe. A SCHED_FIFO server thread, pinned to a core and given the rate
+// monotonic priority of its replenishment period, takes them in arrival order
+// and serves them as long as it has budget left; the budget is thread CPU
+// time, so preemption does not consume it. Once the budget is used up the
+// server blocks until the Sequencer gives it back:
+//
+//   deferrable   the whole budget at every replenishment period boundary;
+//                budget left unused is kept until then
+//   sporadic     what was consumed since the server became active, one
+//                replenishment period after it did, so the server never puts
+//                more demand on its core in any window than a periodic
+//                service with the same budget and period
+//
+// Replenishments are done by the Sequencer at its ticks, async-signal-safe.
+// Admission control counts the server as a periodic service; a deferrable
+// server with twice its budget, a safe bound for the back to back execution
+// it allows across a period boundary.
+//
+// Events come from a Poisson generator thread, exponentially distributed in
+// interarrival time and in work, or from any thread calling
+// postAperiodicEvent. The response time of each event, from its arrival to
+// the end of its service, is reported next to the periodic deadline misses.
+
+#ifndef SEQAPER_H
+#define SEQAPER_H
+
+#include "seqgen3.h"
+
+// The server does not consume its budget in one go, it checks it this often
+#define SERVER_SLICE_USEC (100)
+
+// Sporadic replenishments pending at most, further ones are merged into the last
+#define SERVER_MAX_REPLENISHMENTS (64)
+
+// How often a blocked server or the generator checks whether the sequencer is done
+#define SERVER_POLL_MS (100)
+
+typedef enum
+{
+    SERVER_OFF,
+    SERVER_SPORADIC,
+    SERVER_DEFERRABLE,
+    NUM_SERVER_KINDS
+} serverKind_t;
+
+// "sporadic|deferrable,budget_usec,period_ms[,core]", -1 if malformed
+int configureAperiodicServer(const char *arg);
+
+// "mean_interarrival_ms,mean_work_usec" of the Poisson event generator, -1 if malformed
+int configureAperiodicEvents(const char *arg);
+
+// Demand of the server as admission control sees it, FALSE without a server
+int aperiodicServerModel(serviceModel_t *model);
+
+// TRUE if the server takes a higher RM priority than a service of this model
+int aperiodicServerOutranks(const serviceModel_t *model);
+
+// Once the initial services run: the queue, the server thread and the generator
+int startAperiodicServer(void);
+
+// Queues one event needing workUsec of CPU time, -1 if the queue is full
+int postAperiodicEvent(unsigned int workUsec);
+
+// Called by the Sequencer at every release quantum. Async-signal-safe.
+void replenishAperiodicServer(unsigned long long quantum, unsigned long long nowMonoNsec);
+
+// Once the sequencer is done: joins the threads and prints the response times
+void stopAperiodicServer(unsigned long long periodicMisses);
+
+#endif
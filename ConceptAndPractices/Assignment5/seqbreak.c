@@ -0,0 +1,334 @@
+// Breakdown utilisation of the seqgen3 service set
+//
+// The cores are searched together, one window per step, each on its own
+// scale: services are pinned, so what runs on one core does not change what
+// misses on another. A core passes a window when none of its services missed a
+// deadline and none was left more than one release behind at its end. The
+// search thread is not real-time, it only sleeps, sets loads and reads counters.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <math.h>
+#include <syslog.h>
+#include <errno.h>
+
+#include "seqgen3.h"
+#include "seqsched.h"
+#include "seqproc.h"
+#include "seqbreak.h"
+#include "seqthread.h"
+
+// How often a wait checks whether the sequencer is done
+#define BREAKDOWN_POLL_MS (10)
+
+// Bisection steps of the offline prediction, far below the measured tolerance
+#define PREDICTION_STEPS (40)
+
+typedef struct
+{
+    int count;                        // services pinned to the core
+    double baseUtilisation;           // sum of declared wcet / period
+    double passScale;                 // highest scale that held a window, 0 for none yet
+    double failScale;                 // lowest scale that missed, or the scale filling the core
+    double testScale;                 // scale of the current window
+    unsigned long long misses;        // over the current window
+    int windows;
+} breakdownCore_t;
+
+static pthread_t breakdownThread;
+static unsigned int breakdownWindowSec;
+
+// Declared models, the loads are derived from their wcet
+static serviceModel_t baseSet[MAX_SERVICES];
+static int baseCount;
+
+static breakdownCore_t cores[NUM_CPU_CORES];
+static int searchSteps;
+
+// Misses of every service of baseSet when the current window started
+static unsigned long long missesAtStart[MAX_SERVICES];
+
+// Synthetic load of a service at a scale, never beyond its period
+static unsigned int scaledLoadUsec(const serviceModel_t *model, double scale)
+{
+    double loadUsec = (scale * model->wcetUsec) + 0.5;
+    double periodUsec = (double)model->periodUsec;
+
+    return (unsigned int)((loadUsec < periodUsec) ? loadUsec : periodUsec);
+}
+
+// Utilisation of a core once its loads are scaled, with the rounding they get
+static double utilisationAt(int core, double scale)
+{
+    double utilisation = 0.0;
+    int i;
+
+    for(i=0; i < baseCount; i++)
+    {
+        if(baseSet[i].core == core)
+            utilisation += (double)scaledLoadUsec(&baseSet[i], scale) / (double)baseSet[i].periodUsec;
+    }
+
+    return utilisation;
+}
+
+// Highest scale at which response time analysis still admits every service of the core
+static double predictedScale(int core)
+{
+    serviceModel_t set[MAX_SERVICES];
+    double low = 0.0, high = 1.0 / cores[core].baseUtilisation, scale;
+    int i, step, admitted;
+
+    for(step=0; step < PREDICTION_STEPS; step++)
+    {
+        scale = (low + high) / 2.0;
+        admitted = TRUE;
+
+        for(i=0; i < baseCount; i++)
+        {
+            set[i] = baseSet[i];
+            if(set[i].core == core)
+                set[i].wcetUsec = scaledLoadUsec(&baseSet[i], scale);
+        }
+
+        for(i=0; i < baseCount && admitted; i++)
+        {
+            if(set[i].core == core && responseTimeUsec(set, baseCount, i) > set[i].periodUsec)
+                admitted = FALSE;
+        }
+
+        if(admitted)
+            low = scale;
+        else
+            high = scale;
+    }
+
+    return low;
+}
+
+static unsigned long long serviceMisses(int serviceIdx)
+{
+    if(releaseSegment != NULL)
+        return __atomic_load_n(&releaseSegment->gates[serviceIdx].stats.deadlineMisses, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&threadParams[serviceIdx].stats.deadlineMisses, __ATOMIC_RELAXED);
+}
+
+// Sleeps for ms, FALSE if the sequencer stopped meanwhile
+static int waitMs(unsigned long long ms)
+{
+    struct timespec pause = {0, BREAKDOWN_POLL_MS * NANOSEC_PER_MSEC};
+    unsigned long long endNsec = monotonicNsec() + (ms * NANOSEC_PER_MSEC);
+
+    while(!sequencerDone && monotonicNsec() < endNsec)
+        nanosleep(&pause, NULL);
+
+    return !sequencerDone;
+}
+
+static int backlogsDrained(void)
+{
+    int i;
+
+    for(i=0; i < baseCount; i++)
+    {
+        if(releaseBacklog(baseSet[i].serviceIdx) > 1)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Sets the load of every service to the test scale of its core
+static void applyScales(void)
+{
+    serviceModel_t model;
+    int i;
+
+    for(i=0; i < baseCount; i++)
+    {
+        model = baseSet[i];
+        model.loadUsec = scaledLoadUsec(&baseSet[i], cores[model.core].testScale);
+        updateServiceModel(model.serviceIdx, &model);
+    }
+}
+
+// New loads run for a while, longer than the longest period, and the backlogs
+// of the previous step drain before a window starts
+static int settle(void)
+{
+    unsigned long long settleMs = BREAKDOWN_SETTLE_MIN_MS, waitedMs;
+    int i;
+
+    for(i=0; i < baseCount; i++)
+    {
+        if(2ULL * baseSet[i].periodMs > settleMs)
+            settleMs = 2ULL * baseSet[i].periodMs;
+    }
+
+    if(!waitMs(settleMs))
+        return FALSE;
+
+    for(waitedMs = settleMs; !backlogsDrained() && waitedMs < BREAKDOWN_SETTLE_MAX_MS; waitedMs += BREAKDOWN_POLL_MS)
+    {
+        if(!waitMs(BREAKDOWN_POLL_MS))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int searchDone(void)
+{
+    int core;
+
+    if(searchSteps >= BREAKDOWN_MAX_STEPS)
+        return TRUE;
+
+    for(core=0; core < NUM_CPU_CORES; core++)
+    {
+        if(cores[core].count > 0 &&
+           (cores[core].failScale - cores[core].passScale) * cores[core].baseUtilisation > BREAKDOWN_TOLERANCE)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// One window at the midpoint of every core, FALSE if the run stopped before its end
+static int searchStep(void)
+{
+    breakdownCore_t *state;
+    int i, core;
+
+    for(core=0; core < NUM_CPU_CORES; core++)
+        cores[core].testScale = (cores[core].passScale + cores[core].failScale) / 2.0;
+
+    applyScales();
+
+    if(!settle())
+        return FALSE;
+
+    for(i=0; i < baseCount; i++)
+        missesAtStart[i] = serviceMisses(baseSet[i].serviceIdx);
+
+    if(!waitMs((unsigned long long)breakdownWindowSec * 1000))
+        return FALSE;
+
+    for(core=0; core < NUM_CPU_CORES; core++)
+        cores[core].misses = 0;
+
+    // a release still queued behind another at the end of the window is a miss to come
+    for(i=0; i < baseCount; i++)
+    {
+        state = &cores[baseSet[i].core];
+        state->misses += serviceMisses(baseSet[i].serviceIdx) - missesAtStart[i];
+        if(releaseBacklog(baseSet[i].serviceIdx) > 1)
+            state->misses++;
+    }
+
+    searchSteps++;
+
+    for(core=0; core < NUM_CPU_CORES; core++)
+    {
+        state = &cores[core];
+        if(state->count == 0)
+            continue;
+
+        state->windows++;
+        if(state->misses == 0)
+            state->passScale = state->testScale;
+        else
+            state->failScale = state->testScale;
+
+        printf("Breakdown step %d: core %d scale %.3lf U=%.3lf misses=%llu %s\n", searchSteps, core,
+               state->testScale, utilisationAt(core, state->testScale), state->misses, (state->misses == 0) ? "held" : "broke");
+        syslog(LOG_CRIT, "Breakdown step %d: core %d scale %.3lf U=%.3lf misses=%llu\n", searchSteps, core,
+               state->testScale, utilisationAt(core, state->testScale), state->misses);
+    }
+
+    return TRUE;
+}
+
+static void *breakdownSearch(void *arg)
+{
+    int i;
+
+    while(!searchDone() && searchStep());
+
+    // back to the declared loads for the last releases, then the run ends at the next tick
+    for(i=0; i < baseCount; i++)
+        updateServiceModel(baseSet[i].serviceIdx, &baseSet[i]);
+
+    abortTest = TRUE;
+    return NULL;
+}
+
+int startBreakdownThread(unsigned int windowSeconds)
+{
+    int i, rc, core;
+
+    baseCount = collectServiceModels(baseSet);
+    breakdownWindowSec = windowSeconds;
+
+    for(i=0; i < baseCount; i++)
+    {
+        if(baseSet[i].wcetUsec == 0)
+        {
+            printf("Breakdown search: S%d declares no wcet to scale\n", baseSet[i].serviceIdx+1);
+            return -1;
+        }
+
+        core = baseSet[i].core;
+        cores[core].count++;
+        cores[core].baseUtilisation += (double)baseSet[i].wcetUsec / (double)baseSet[i].periodUsec;
+    }
+
+    // a core is surely broken once its loads add up to all of it
+    for(core=0; core < NUM_CPU_CORES; core++)
+    {
+        if(cores[core].count > 0)
+            cores[core].failScale = 1.0 / cores[core].baseUtilisation;
+    }
+
+    rc = startNonRtThread(&breakdownThread, breakdownSearch, NULL);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for breakdown thread");
+        return -1;
+    }
+
+    printf("Breakdown search: %u s windows, loads scaled from the declared wcet until deadlines are missed\n", windowSeconds);
+    return 0;
+}
+
+void stopBreakdownThread(void)
+{
+    const breakdownCore_t *state;
+    double measured, predicted, bound;
+    int core;
+
+    pthread_join(breakdownThread, NULL);
+
+    for(core=0; core < NUM_CPU_CORES; core++)
+    {
+        state = &cores[core];
+        if(state->count == 0)
+            continue;
+
+        measured = utilisationAt(core, state->passScale);
+        predicted = utilisationAt(core, predictedScale(core));
+        bound = state->count * (pow(2.0, 1.0 / state->count) - 1.0);
+
+        printf("Breakdown core %d: %d services, measured U=%s%.3lf (scale %.3lf, %d windows of %u s), RTA U=%.3lf, Liu-Layland bound U=%.3lf\n",
+               core, state->count, (state->passScale > 0.0) ? "" : "<", (state->passScale > 0.0) ? measured : utilisationAt(core, state->failScale),
+               state->passScale, state->windows, breakdownWindowSec, predicted, bound);
+        syslog(LOG_CRIT, "Breakdown core %d: %d services, measured U=%s%.3lf (scale %.3lf, %d windows of %u s), RTA U=%.3lf, Liu-Layland bound U=%.3lf\n",
+               core, state->count, (state->passScale > 0.0) ? "" : "<", (state->passScale > 0.0) ? measured : utilisationAt(core, state->failScale),
+               state->passScale, state->windows, breakdownWindowSec, predicted, bound);
+    }
+}
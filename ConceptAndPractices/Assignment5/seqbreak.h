@@ -0,0 +1,30 @@
+// Breakdown utilisation of the seqgen3 service set, measured on the running system
+//
+// Periods, cores and priorities stay as they are. The synthetic load of every
+// service (thread CPU time, see serviceJob) is set to scale times its declared
+// wcet, one scale per core, and a non-RT thread bisects each scale for the
+// highest one at which the core runs a whole window without a deadline miss.
+// The utilisation reached is reported per core next to the Liu-Layland bound
+// and to the breakdown utilisation response time analysis predicts for the
+// same set.
+
+#ifndef SEQBREAK_H
+#define SEQBREAK_H
+
+// Bisection stops once every core is known to within this utilisation
+#define BREAKDOWN_TOLERANCE (0.01)
+
+// Windows run at most, whatever the tolerance reached
+#define BREAKDOWN_MAX_STEPS (16)
+
+// Before a window, new loads run for at least this long and until backlogs drain
+#define BREAKDOWN_SETTLE_MIN_MS (1000)
+#define BREAKDOWN_SETTLE_MAX_MS (30000)
+
+// Started once the initial services are registered, before the sequencer starts
+int startBreakdownThread(unsigned int windowSeconds);
+
+// Waits for the search and prints the breakdown utilisation of every core
+void stopBreakdownThread(void);
+
+#endif
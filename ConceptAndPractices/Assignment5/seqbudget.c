@@ -0,0 +1,190 @@
+// Execution budget of a service, enforced while its job runs
+//
+// The handler runs on the overrunning thread, in the middle of its job. It
+// only stamps the CPU time, raises a flag and, to demote, changes the priority
+// of the calling thread with one system call; the accounting is done by the
+// job itself once it ends. A signal still pending when the job disarms its
+// timer is delivered before the disarm returns, never in a later job.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "seqgen3.h"
+#include "seqbudget.h"
+
+static const char *budgetActionNames[NUM_BUDGET_ACTIONS] = {"none", "log", "demote", "abort"};
+
+// Async-signal-safe: clock_gettime, sched_getparam and sched_setparam only.
+// With pid 0 the scheduling calls apply to the calling thread.
+static void budgetExpired(int signo, siginfo_t *info, void *context)
+{
+    budgetTimer_t *timer = (budgetTimer_t *)info->si_value.sival_ptr;
+    struct sched_param param;
+    int savedErrno = errno;
+
+    if(info->si_code != SI_TIMER || timer == NULL || !timer->armed || timer->expired)
+        return;
+
+    timer->expiredCpuNsec = threadCpuNsec();
+    timer->expired = TRUE;
+
+    if(timer->action == BUDGET_DEMOTE && sched_getparam(0, &param) == 0)
+    {
+        timer->demotedFrom = param.sched_priority;
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        sched_setparam(0, &param);
+    }
+
+    errno = savedErrno;
+}
+
+budgetAction_t budgetActionByName(const char *name)
+{
+    budgetAction_t action;
+
+    for(action=0; action < NUM_BUDGET_ACTIONS && strcmp(name, budgetActionNames[action]) != 0; action++);
+
+    return action;
+}
+
+const char *budgetActionName(budgetAction_t action)
+{
+    if(action < 0 || action >= NUM_BUDGET_ACTIONS)
+        return "unknown";
+
+    return budgetActionNames[action];
+}
+
+int budgetOpen(budgetTimer_t *timer)
+{
+    struct sigaction action;
+    struct sigevent event;
+
+    memset(timer, 0, sizeof(*timer));
+
+    // the same handler for every service, installing it again changes nothing
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = budgetExpired;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(sigaction(BUDGET_SIGNAL, &action, NULL) != 0)
+    {
+        perror("sigaction for budget signal");
+        return -1;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = BUDGET_SIGNAL;
+    event.sigev_value.sival_ptr = timer;
+    event._sigev_un._tid = syscall(SYS_gettid);
+
+    if(timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer->timer) != 0)
+    {
+        perror("timer_create on thread CPU clock");
+        return -1;
+    }
+
+    timer->created = TRUE;
+    return 0;
+}
+
+void budgetClose(budgetTimer_t *timer)
+{
+    if(timer->created)
+        timer_delete(timer->timer);
+
+    timer->created = FALSE;
+}
+
+void budgetArm(budgetTimer_t *timer, unsigned int budgetUsec, budgetAction_t action)
+{
+    struct itimerspec budget = {{0, 0}, {0, 0}};
+
+    if(!timer->created || budgetUsec == 0 || action == BUDGET_NONE)
+        return;
+
+    timer->action = action;
+    timer->budgetNsec = (unsigned long long)budgetUsec * 1000;
+    timer->expired = FALSE;
+    timer->demotedFrom = 0;
+    timer->startCpuNsec = threadCpuNsec();
+    timer->armed = TRUE;
+
+    budget.it_value.tv_sec = timer->budgetNsec / NANOSEC_PER_SEC;
+    budget.it_value.tv_nsec = timer->budgetNsec % NANOSEC_PER_SEC;
+    if(timer_settime(timer->timer, 0, &budget, NULL) != 0)
+        timer->armed = FALSE;
+}
+
+int budgetAbortDue(const budgetTimer_t *timer)
+{
+    return (timer != NULL && timer->expired && timer->action == BUDGET_ABORT);
+}
+
+void budgetDisarm(budgetTimer_t *timer, budgetStats_t *stats)
+{
+    static const struct itimerspec disarmed = {{0, 0}, {0, 0}};
+    unsigned long long executionNsec, enforcementNsec;
+    struct sched_param param;
+
+    if(!timer->armed)
+        return;
+
+    timer_settime(timer->timer, 0, &disarmed, NULL);
+    executionNsec = threadCpuNsec() - timer->startCpuNsec;
+    timer->armed = FALSE;
+
+    stats->jobs++;
+    stats->budgetNsec = timer->budgetNsec;
+    stats->action = timer->action;
+    if(executionNsec > stats->maxExecutionNsec)
+        stats->maxExecutionNsec = executionNsec;
+
+    if(!timer->expired)
+        return;
+
+    stats->overruns++;
+    enforcementNsec = (timer->expiredCpuNsec > timer->startCpuNsec + timer->budgetNsec) ?
+                      timer->expiredCpuNsec - timer->startCpuNsec - timer->budgetNsec : 0;
+    stats->sumEnforcementNsec += enforcementNsec;
+    if(enforcementNsec > stats->maxEnforcementNsec)
+        stats->maxEnforcementNsec = enforcementNsec;
+
+    if(timer->action == BUDGET_ABORT)
+        stats->aborted++;
+
+    // back to the priority it had, unless it was given a new one while demoted
+    if(timer->demotedFrom > 0)
+    {
+        stats->demoted++;
+        if(sched_getparam(0, &param) == 0 && param.sched_priority == sched_get_priority_min(SCHED_FIFO))
+        {
+            param.sched_priority = timer->demotedFrom;
+            sched_setparam(0, &param);
+        }
+    }
+}
+
+void printBudgetStats(int serviceIdx, const budgetStats_t *stats)
+{
+    if(stats->jobs == 0)
+        return;
+
+    printf("S%d budget %.1lf usec (%s): %llu jobs, %llu overruns, %llu demoted, %llu aborted, enforcement latency usec avg/max=%.1lf/%.1lf, longest job %.1lf usec\n",
+           serviceIdx+1, stats->budgetNsec / 1000.0, budgetActionName(stats->action), stats->jobs, stats->overruns,
+           stats->demoted, stats->aborted, (stats->overruns > 0) ? stats->sumEnforcementNsec / stats->overruns / 1000.0 : 0.0,
+           stats->maxEnforcementNsec / 1000.0, stats->maxExecutionNsec / 1000.0);
+    syslog(LOG_CRIT, "S%d budget %.1lf usec (%s): %llu jobs, %llu overruns, %llu demoted, %llu aborted, enforcement latency usec avg/max=%.1lf/%.1lf, longest job %.1lf usec\n",
+           serviceIdx+1, stats->budgetNsec / 1000.0, budgetActionName(stats->action), stats->jobs, stats->overruns,
+           stats->demoted, stats->aborted, (stats->overruns > 0) ? stats->sumEnforcementNsec / stats->overruns / 1000.0 : 0.0,
+           stats->maxEnforcementNsec / 1000.0, stats->maxExecutionNsec / 1000.0);
+}
@@ -0,0 +1,86 @@
+// Execution budget of a service, enforced while its job runs
+//
+// Deadline misses only show a runaway service after the fact, by then every
+// lower priority service on its core has starved. A service given a budget
+// (model budgetUsec) arms a timer on its own CLOCK_THREAD_CPUTIME_ID at the
+// start of every job. When the job has used the budget, the timer signals the
+// service thread itself (SIGEV_THREAD_ID), and the handler applies the action
+// of the service on the spot:
+//
+//   log      the overrun is only counted
+//   demote   the thread drops to the lowest SCHED_FIFO priority for the rest
+//            of the job, below every other service
+//   abort    the job gives up at its next check of its CPU time, a critical
+//            section on a shared resource is never aborted
+//
+// The kernel checks CPU timers at the scheduler tick, so the job runs past its
+// budget for a while before the handler runs. That enforcement latency, in CPU
+// time of the job, is reported per service with the overruns.
+
+#ifndef SEQBUDGET_H
+#define SEQBUDGET_H
+
+#include <signal.h>
+#include <time.h>
+
+// Directed to the overrunning thread, the Sequencer has SIGALRM
+#define BUDGET_SIGNAL (SIGRTMIN + 1)
+
+typedef enum
+{
+    BUDGET_NONE,             // no budget enforced
+    BUDGET_LOG,
+    BUDGET_DEMOTE,
+    BUDGET_ABORT,
+    NUM_BUDGET_ACTIONS
+} budgetAction_t;
+
+// Timer of one service, private to its thread or process
+typedef struct
+{
+    timer_t timer;
+    int created;
+    volatile sig_atomic_t armed;
+    volatile sig_atomic_t expired;      // the running job has used its budget
+    budgetAction_t action;              // of the running job
+    unsigned long long startCpuNsec;    // thread CPU time when the job started
+    unsigned long long budgetNsec;
+    unsigned long long expiredCpuNsec;  // thread CPU time when the handler ran
+    int demotedFrom;                    // priority before a demotion, 0 for none
+} budgetTimer_t;
+
+// Jobs of one service over the run, plain data like releaseStats_t
+typedef struct
+{
+    unsigned long long jobs;            // run with a budget
+    unsigned long long overruns;
+    unsigned long long demoted;
+    unsigned long long aborted;
+    double sumEnforcementNsec;          // budget used up to handler run, CPU time
+    unsigned long long maxEnforcementNsec;
+    unsigned long long maxExecutionNsec;
+    unsigned long long budgetNsec;      // latest budget
+    budgetAction_t action;              // latest action
+} budgetStats_t;
+
+// Creates the timer on the CPU clock of the calling thread, so it must be
+// called by the service thread or process itself
+int budgetOpen(budgetTimer_t *timer);
+void budgetClose(budgetTimer_t *timer);
+
+// At the start of a job, nothing is armed without a budget or an action
+void budgetArm(budgetTimer_t *timer, unsigned int budgetUsec, budgetAction_t action);
+
+// Polled by the job: TRUE once it overran a budget with BUDGET_ABORT
+int budgetAbortDue(const budgetTimer_t *timer);
+
+// At the end of the job: disarms, restores a demoted priority and accounts the job
+void budgetDisarm(budgetTimer_t *timer, budgetStats_t *stats);
+
+// NUM_BUDGET_ACTIONS if name is none of "none", "log", "demote", "abort"
+budgetAction_t budgetActionByName(const char *name);
+const char *budgetActionName(budgetAction_t action);
+
+void printBudgetStats(int serviceIdx, const budgetStats_t *stats);
+
+#endif
@@ -0,0 +1,586 @@
+// Run-time control socket of seqgen3
+//
+// A non-RT (SCHED_OTHER) thread serves a UNIX domain stream socket, one client
+// at a time, one command per line:
+//
+//   add <period> <wcet_usec> <core>      register a new service, replies "OK S<n>"
+//   remove <n>                           remove service S<n>
+//   period <n> <period>                  change the period of service S<n>
+//   policy <n> queue|skip|abort|degrade  what happens to the releases of S<n> when late
+//   policy <n> cap <K>                   at most K releases of S<n> pending
+//   criticality <n> <level>              higher levels are served first by degrade
+//   load <n> <usec>                      CPU time burned by each release of S<n>
+//   resource <n> <r> <usec>              each release of S<n> holds shared resource R<r> for usec
+//   resource <n> none                    S<n> no longer uses a shared resource
+//   wait <n> spin <usec>                 S<n> spins up to usec for a release before blocking
+//   wait <n> block                       S<n> blocks for its releases at once (default)
+//   budget <n> <usec> log|demote|abort   a job of S<n> using more CPU time than usec is acted on
+//   budget <n> none                      S<n> runs without an execution budget (default)
+//   list                                 one line per registered service
+//
+// A period is in ms, or in usec with a "us" suffix (tickless mode only, e.g. 2500us).
+//
+// e.g. "echo 'add 50 2000 2' | nc -U /tmp/seqgen3.sock"
+//
+// Every change is checked by admission control first (seqsched.c). The new
+// release table is then handed to the sequencer, which swaps it in at its next
+// hyperperiod boundary: the sequencer never waits on this thread.
+// Errors are replied as "ERR <reason>".
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "seqgen3.h"
+#include "seqsched.h"
+#include "seqctl.h"
+#include "seqres.h"
+#include "seqthread.h"
+
+// How often the server checks whether the sequencer is done
+#define CONTROL_POLL_MS (200)
+
+#define CONTROL_LINE_MAX (256)
+#define CONTROL_REPLY_MAX (224 * MAX_SERVICES)
+
+static pthread_t controlThread;
+static int listenFd = -1;
+static struct sockaddr_un controlAddr;
+
+// Slot of service S<n>, or -1 if n does not name a registered service
+static int serviceSlot(const char *name)
+{
+    int serviceNum;
+
+    if(name[0] == 'S' || name[0] == 's')
+        name++;
+
+    serviceNum = atoi(name);
+    if(serviceNum < 1 || serviceNum > MAX_SERVICES || !threadParams[serviceNum-1].inUse)
+        return -1;
+
+    return serviceNum-1;
+}
+
+// "<ms>", "<ms>ms" or "<usec>us" in usec, 0 if malformed
+static unsigned long long parsePeriodUsec(const char *text)
+{
+    unsigned long long period;
+    char *unit;
+
+    if(text[0] < '0' || text[0] > '9')
+        return 0;
+
+    period = strtoull(text, &unit, 10);
+    if(strcmp(unit, "us") == 0)
+        return period;
+    if(unit[0] == '\0' || strcmp(unit, "ms") == 0)
+        return period * USEC_PER_MSEC;
+
+    return 0;
+}
+
+// A period the way it is given: in ms when whole, in usec otherwise
+static const char *periodText(unsigned long long periodUsec, char *text, size_t len)
+{
+    if((periodUsec % USEC_PER_MSEC) == 0)
+        snprintf(text, len, "%llu ms", periodUsec / USEC_PER_MSEC);
+    else
+        snprintf(text, len, "%llu us", periodUsec);
+
+    return text;
+}
+
+static void controlAdd(unsigned long long periodUsec, unsigned int wcetUsec, int core, char *reply, size_t replyLen)
+{
+    serviceModel_t set[MAX_SERVICES];
+    releaseTable_t table;
+    char reason[CONTROL_LINE_MAX], period[32];
+    int count, slot;
+
+    for(slot=0; slot < MAX_SERVICES && threadParams[slot].inUse; slot++);
+
+    if(slot == MAX_SERVICES)
+    {
+        snprintf(reply, replyLen, "ERR no free service slot\n");
+        return;
+    }
+
+    count = collectServiceModels(set);
+    set[count].serviceIdx = slot;
+    setServicePeriod(&set[count], periodUsec);
+    set[count].wcetUsec = wcetUsec;
+    set[count].core = core;
+    set[count].loadUsec = 0;
+    set[count].policy = OVERLOAD_QUEUE;
+    set[count].backlogCap = DEFAULT_BACKLOG_CAP;
+    set[count].criticality = DEFAULT_CRITICALITY;
+    set[count].resource = -1;
+    set[count].criticalSectionUsec = 0;
+    set[count].spinUsec = 0;
+    set[count].budgetUsec = 0;
+    set[count].budgetAction = BUDGET_NONE;
+    count++;
+
+    if(!admitServiceSet(set, count, reason, sizeof(reason)))
+    {
+        snprintf(reply, replyLen, "ERR rejected: %s\n", reason);
+        return;
+    }
+
+    // the thread must be waiting on its semaphore before the sequencer can release it
+    threadParams[slot].model = set[count-1];
+    if(startService(slot) != 0)
+    {
+        snprintf(reply, replyLen, "ERR cannot start service thread\n");
+        return;
+    }
+
+    buildReleaseTable(&table, set, count);
+    if(publishReleaseTable(&table) != 0)
+    {
+        stopService(slot);
+        snprintf(reply, replyLen, "ERR sequencer stopped before the release table swap\n");
+        return;
+    }
+
+    syslog(LOG_CRIT, "S%d registered with period %s, wcet %u usec on core %d\n", slot+1,
+           periodText(periodUsec, period, sizeof(period)), wcetUsec, core);
+    snprintf(reply, replyLen, "OK S%d\n", slot+1);
+}
+
+static void controlRemove(int slot, char *reply, size_t replyLen)
+{
+    serviceModel_t set[MAX_SERVICES];
+    releaseTable_t table;
+    int count, i, kept=0;
+
+    // release table without the service, it is stopped once no longer released
+    count = collectServiceModels(set);
+    for(i=0; i < count; i++)
+    {
+        if(set[i].serviceIdx != slot)
+            set[kept++] = set[i];
+    }
+
+    buildReleaseTable(&table, set, kept);
+    if(publishReleaseTable(&table) != 0)
+    {
+        snprintf(reply, replyLen, "ERR sequencer stopped before the release table swap\n");
+        return;
+    }
+
+    stopService(slot);
+
+    syslog(LOG_CRIT, "S%d removed\n", slot+1);
+    snprintf(reply, replyLen, "OK\n");
+}
+
+static void controlPeriod(int slot, unsigned long long periodUsec, char *reply, size_t replyLen)
+{
+    serviceModel_t set[MAX_SERVICES];
+    releaseTable_t table;
+    char reason[CONTROL_LINE_MAX], period[32];
+    serviceModel_t model;
+    int count, i;
+
+    count = collectServiceModels(set);
+    for(i=0; i < count; i++)
+    {
+        if(set[i].serviceIdx == slot)
+            setServicePeriod(&set[i], periodUsec);
+    }
+
+    if(!admitServiceSet(set, count, reason, sizeof(reason)))
+    {
+        snprintf(reply, replyLen, "ERR rejected: %s\n", reason);
+        return;
+    }
+
+    buildReleaseTable(&table, set, count);
+    if(publishReleaseTable(&table) != 0)
+    {
+        snprintf(reply, replyLen, "ERR sequencer stopped before the release table swap\n");
+        return;
+    }
+
+    // released at the new rate from now on, priorities follow
+    model = threadParams[slot].model;
+    setServicePeriod(&model, periodUsec);
+    updateServiceModel(slot, &model);
+
+    syslog(LOG_CRIT, "S%d period changed to %s\n", slot+1, periodText(periodUsec, period, sizeof(period)));
+    snprintf(reply, replyLen, "OK\n");
+}
+
+// Overload handling does not change the timing model, no admission control needed
+static void controlPolicy(int slot, const char *policyName, unsigned int backlogCap, char *reply, size_t replyLen)
+{
+    serviceModel_t model = threadParams[slot].model;
+    int policy;
+
+    for(policy=0; policy < NUM_OVERLOAD_POLICIES; policy++)
+    {
+        if(strcmp(policyName, overloadPolicyName(policy)) == 0)
+            break;
+    }
+
+    if(policy == NUM_OVERLOAD_POLICIES || (policy == OVERLOAD_CAP && backlogCap == 0))
+    {
+        snprintf(reply, replyLen, "ERR usage: policy <n> queue|skip|abort|degrade|cap <K>\n");
+        return;
+    }
+
+    model.policy = policy;
+    if(policy == OVERLOAD_CAP)
+        model.backlogCap = backlogCap;
+    updateServiceModel(slot, &model);
+
+    syslog(LOG_CRIT, "S%d overload policy %s\n", slot+1, policyName);
+    snprintf(reply, replyLen, "OK\n");
+}
+
+static void controlResource(int slot, const char *resourceName, unsigned int criticalSectionUsec, char *reply, size_t replyLen)
+{
+    serviceModel_t model = threadParams[slot].model;
+
+    if(!resourcesActive)
+    {
+        snprintf(reply, replyLen, "ERR shared resources are only available to service threads\n");
+        return;
+    }
+
+    if(strcmp(resourceName, "none") == 0)
+    {
+        model.resource = -1;
+        model.criticalSectionUsec = 0;
+    }
+    else
+    {
+        if(resourceName[0] == 'R' || resourceName[0] == 'r')
+            resourceName++;
+
+        model.resource = atoi(resourceName);
+        model.criticalSectionUsec = criticalSectionUsec;
+
+        if(model.resource < 0 || model.resource >= MAX_RESOURCES || criticalSectionUsec == 0)
+        {
+            snprintf(reply, replyLen, "ERR usage: resource <registered service number> 0..%d <usec>\n", MAX_RESOURCES-1);
+            return;
+        }
+    }
+
+    updateServiceModel(slot, &model);
+
+    syslog(LOG_CRIT, "S%d resource %d critical section %u usec\n", slot+1, model.resource, model.criticalSectionUsec);
+    snprintf(reply, replyLen, "OK\n");
+}
+
+static void controlWait(int slot, const char *mode, unsigned int spinUsec, char *reply, size_t replyLen)
+{
+    serviceModel_t set[MAX_SERVICES];
+    char reason[CONTROL_LINE_MAX];
+    serviceModel_t model = threadParams[slot].model;
+    int count, i;
+
+    if(strcmp(mode, "block") == 0)
+        spinUsec = 0;
+    else if(strcmp(mode, "spin") != 0 || spinUsec == 0)
+    {
+        snprintf(reply, replyLen, "ERR usage: wait <registered service number> spin <usec> | block\n");
+        return;
+    }
+
+    // the spin budget keeps the core busy, lower priority services on it must still make it
+    count = collectServiceModels(set);
+    for(i=0; i < count; i++)
+    {
+        if(set[i].serviceIdx == slot)
+            set[i].spinUsec = spinUsec;
+    }
+
+    if(!admitServiceSet(set, count, reason, sizeof(reason)))
+    {
+        snprintf(reply, replyLen, "ERR rejected: %s\n", reason);
+        return;
+    }
+
+    model.spinUsec = spinUsec;
+    updateServiceModel(slot, &model);
+
+    syslog(LOG_CRIT, "S%d spin budget %u usec\n", slot+1, spinUsec);
+    snprintf(reply, replyLen, "OK\n");
+}
+
+static void controlBudget(int slot, unsigned int budgetUsec, const char *actionName, char *reply, size_t replyLen)
+{
+    serviceModel_t model = threadParams[slot].model;
+    budgetAction_t action = budgetActionByName(actionName);
+
+    if(action == NUM_BUDGET_ACTIONS || (action != BUDGET_NONE && budgetUsec == 0))
+    {
+        snprintf(reply, replyLen, "ERR usage: budget <registered service number> <usec> log|demote|abort | none\n");
+        return;
+    }
+
+    // enforcement only bounds the damage of an overrun, admission control still counts the declared wcet
+    model.budgetUsec = (action == BUDGET_NONE) ? 0 : budgetUsec;
+    model.budgetAction = action;
+    updateServiceModel(slot, &model);
+
+    syslog(LOG_CRIT, "S%d execution budget %u usec, %s on overrun\n", slot+1, model.budgetUsec, budgetActionName(action));
+    snprintf(reply, replyLen, "OK\n");
+}
+
+static void controlList(char *reply, size_t replyLen)
+{
+    char period[32];
+    size_t used = 0;
+    int i;
+
+    reply[0] = '\0';
+
+    for(i=0; i < MAX_SERVICES && used < replyLen; i++)
+    {
+        if(!threadParams[i].inUse)
+            continue;
+
+        used += snprintf(reply + used, replyLen - used,
+                         "S%d period %s wcet %u usec core %d prio %d load %u usec policy %s criticality %d resource %d cs %u usec spin %u usec budget %u usec %s\n",
+                         i+1, periodText(threadParams[i].model.periodUsec, period, sizeof(period)), threadParams[i].model.wcetUsec,
+                         threadParams[i].model.core, threadParams[i].priority, threadParams[i].model.loadUsec,
+                         overloadPolicyName(threadParams[i].model.policy), threadParams[i].model.criticality,
+                         threadParams[i].model.resource, threadParams[i].model.criticalSectionUsec,
+                         threadParams[i].model.spinUsec, threadParams[i].model.budgetUsec,
+                         budgetActionName(threadParams[i].model.budgetAction));
+    }
+
+    if(used < replyLen)
+        snprintf(reply + used, replyLen - used, "OK\n");
+}
+
+static void handleCommand(char *line, char *reply, size_t replyLen)
+{
+    char command[16], name[16], policyName[16], period[16];
+    unsigned long long periodUsec = 0;
+    unsigned int wcetUsec, value=0;
+    serviceModel_t model;
+    int core, slot, level;
+
+    if(sscanf(line, "%15s", command) != 1)
+    {
+        snprintf(reply, replyLen, "ERR empty command\n");
+    }
+    else if(strcmp(command, "add") == 0)
+    {
+        if(sscanf(line, "%*s %15s %u %d", period, &wcetUsec, &core) != 3 || (periodUsec = parsePeriodUsec(period)) == 0)
+            snprintf(reply, replyLen, "ERR usage: add <period_ms>|<period_usec>us <wcet_usec> <core>\n");
+        else
+            controlAdd(periodUsec, wcetUsec, core, reply, replyLen);
+    }
+    else if(strcmp(command, "remove") == 0)
+    {
+        if(sscanf(line, "%*s %15s", name) != 1 || (slot = serviceSlot(name)) < 0)
+            snprintf(reply, replyLen, "ERR usage: remove <registered service number>\n");
+        else
+            controlRemove(slot, reply, replyLen);
+    }
+    else if(strcmp(command, "period") == 0)
+    {
+        if(sscanf(line, "%*s %15s %15s", name, period) != 2 || (slot = serviceSlot(name)) < 0 ||
+           (periodUsec = parsePeriodUsec(period)) == 0)
+            snprintf(reply, replyLen, "ERR usage: period <registered service number> <period_ms>|<period_usec>us\n");
+        else
+            controlPeriod(slot, periodUsec, reply, replyLen);
+    }
+    else if(strcmp(command, "policy") == 0)
+    {
+        if(sscanf(line, "%*s %15s %15s %u", name, policyName, &value) < 2 || (slot = serviceSlot(name)) < 0)
+            snprintf(reply, replyLen, "ERR usage: policy <registered service number> <policy> [K]\n");
+        else
+            controlPolicy(slot, policyName, value, reply, replyLen);
+    }
+    else if(strcmp(command, "criticality") == 0)
+    {
+        if(sscanf(line, "%*s %15s %d", name, &level) != 2 || (slot = serviceSlot(name)) < 0)
+        {
+            snprintf(reply, replyLen, "ERR usage: criticality <registered service number> <level>\n");
+        }
+        else
+        {
+            model = threadParams[slot].model;
+            model.criticality = level;
+            updateServiceModel(slot, &model);
+            snprintf(reply, replyLen, "OK\n");
+        }
+    }
+    else if(strcmp(command, "load") == 0)
+    {
+        if(sscanf(line, "%*s %15s %u", name, &value) != 2 || (slot = serviceSlot(name)) < 0)
+        {
+            snprintf(reply, replyLen, "ERR usage: load <registered service number> <usec>\n");
+        }
+        else
+        {
+            model = threadParams[slot].model;
+            model.loadUsec = value;
+            updateServiceModel(slot, &model);
+            snprintf(reply, replyLen, "OK\n");
+        }
+    }
+    else if(strcmp(command, "resource") == 0)
+    {
+        if(sscanf(line, "%*s %15s %15s %u", name, policyName, &value) < 2 || (slot = serviceSlot(name)) < 0)
+            snprintf(reply, replyLen, "ERR usage: resource <registered service number> <resource> <usec> | none\n");
+        else
+            controlResource(slot, policyName, value, reply, replyLen);
+    }
+    else if(strcmp(command, "wait") == 0)
+    {
+        if(sscanf(line, "%*s %15s %15s %u", name, policyName, &value) < 2 || (slot = serviceSlot(name)) < 0)
+            snprintf(reply, replyLen, "ERR usage: wait <registered service number> spin <usec> | block\n");
+        else
+            controlWait(slot, policyName, value, reply, replyLen);
+    }
+    else if(strcmp(command, "budget") == 0)
+    {
+        // "budget <n> none" has no usec
+        if(sscanf(line, "%*s %15s %15s", name, policyName) == 2 && strcmp(policyName, "none") == 0 && (slot = serviceSlot(name)) >= 0)
+            controlBudget(slot, 0, policyName, reply, replyLen);
+        else if(sscanf(line, "%*s %15s %u %15s", name, &value, policyName) != 3 || (slot = serviceSlot(name)) < 0)
+            snprintf(reply, replyLen, "ERR usage: budget <registered service number> <usec> log|demote|abort | none\n");
+        else
+            controlBudget(slot, value, policyName, reply, replyLen);
+    }
+    else if(strcmp(command, "list") == 0)
+    {
+        controlList(reply, replyLen);
+    }
+    else
+    {
+        snprintf(reply, replyLen, "ERR unknown command %s\n", command);
+    }
+}
+
+static void *controlServer(void *arg)
+{
+    static char line[CONTROL_LINE_MAX], reply[CONTROL_REPLY_MAX];
+    struct pollfd pfd;
+    size_t used = 0;
+    ssize_t received;
+    char *eol;
+    int clientFd = -1;
+
+    while(!sequencerDone)
+    {
+        pfd.fd = (clientFd >= 0) ? clientFd : listenFd;
+        pfd.events = POLLIN;
+
+        if(poll(&pfd, 1, CONTROL_POLL_MS) <= 0)
+            continue;
+
+        if(clientFd < 0)
+        {
+            clientFd = accept(listenFd, NULL, NULL);
+            used = 0;
+            continue;
+        }
+
+        received = read(clientFd, line + used, sizeof(line) - 1 - used);
+        if(received <= 0)
+        {
+            close(clientFd);
+            clientFd = -1;
+            continue;
+        }
+
+        used += received;
+        line[used] = '\0';
+
+        while((eol = strchr(line, '\n')) != NULL)
+        {
+            *eol = '\0';
+            handleCommand(line, reply, sizeof(reply));
+            if(write(clientFd, reply, strlen(reply)) < 0)
+                perror("control socket write");
+
+            used -= (eol + 1 - line);
+            memmove(line, eol + 1, used + 1);
+        }
+
+        if(used == sizeof(line) - 1)
+        {
+            snprintf(reply, sizeof(reply), "ERR line too long\n");
+            if(write(clientFd, reply, strlen(reply)) < 0)
+                perror("control socket write");
+            used = 0;
+        }
+    }
+
+    if(clientFd >= 0)
+        close(clientFd);
+
+    return NULL;
+}
+
+// Binds the control socket and starts serving it on a SCHED_OTHER thread
+int startControlThread(const char *socketPath)
+{
+    int rc;
+
+    if(strlen(socketPath) >= sizeof(controlAddr.sun_path))
+    {
+        printf("Control socket path too long: %s\n", socketPath);
+        return -1;
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenFd < 0)
+    {
+        perror("control socket");
+        return -1;
+    }
+
+    memset(&controlAddr, 0, sizeof(controlAddr));
+    controlAddr.sun_family = AF_UNIX;
+    strcpy(controlAddr.sun_path, socketPath);
+    unlink(socketPath);
+
+    if(bind(listenFd, (struct sockaddr *)&controlAddr, sizeof(controlAddr)) < 0 || listen(listenFd, 1) < 0)
+    {
+        perror("control socket bind");
+        close(listenFd);
+        return -1;
+    }
+
+    rc = startNonRtThread(&controlThread, controlServer, NULL);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for control thread");
+        close(listenFd);
+        unlink(socketPath);
+        return -1;
+    }
+
+    printf("Control socket listening on %s\n", socketPath);
+    return 0;
+}
+
+// Waits for the control thread, which exits once the sequencer is done
+void stopControlThread(void)
+{
+    pthread_join(controlThread, NULL);
+    close(listenFd);
+    unlink(controlAddr.sun_path);
+}
@@ -0,0 +1,13 @@
+// Run-time control socket of seqgen3: register, remove and re-period services
+// without restarting the sequencer
+
+#ifndef SEQCTL_H
+#define SEQCTL_H
+
+// Default path of the UNIX domain control socket
+#define CONTROL_SOCKET_PATH "/tmp/seqgen3.sock"
+
+int startControlThread(const char *socketPath);
+void stopControlThread(void);
+
+#endif
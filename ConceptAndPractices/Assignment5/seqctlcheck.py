@@ -0,0 +1,112 @@
+import argparse
+import os
+import re
+import socket
+import subprocess
+import sys
+import time
+
+# This python script exercises the control socket of seqgen3 on a running
+# sequencer: it removes every service, so the sequencer runs with an empty
+# release table, then registers a new one and checks that the run completes
+# and that the new service is released. Once ticked and once tickless.
+# Run it as root from the directory of seqgen3, e.g.
+#
+#   sudo python3 seqctlcheck.py
+
+socket_path = "/tmp/seqgen3_check.sock"
+
+# Seconds to wait for the control socket to show up
+socket_wait_seconds = 5
+
+# Seconds the sequencer runs with no service at all
+empty_seconds = 0.5
+
+threads_pattern = re.compile(r"^S(\d+) threads: (\d+) releases", re.MULTILINE)
+
+def command(client, line):
+
+    client.sendall((line + "\n").encode())
+    reply = b""
+    while not reply.endswith(b"\n"):
+        chunk = client.recv(4096)
+        if not chunk:
+            break
+        reply += chunk
+    return reply.decode().strip()
+
+def connect():
+
+    deadline = time.time() + socket_wait_seconds
+    while time.time() < deadline:
+        if os.path.exists(socket_path):
+            client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            try:
+                client.connect(socket_path)
+                return client
+            except OSError:
+                client.close()
+        time.sleep(0.05)
+    return None
+
+def check(mode, seconds, core):
+
+    name = "tickless" if "-T" in mode else "ticked"
+    run = subprocess.Popen(["./seqgen3", "-d", str(seconds), "-c", socket_path] + mode,
+                           stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    failures = []
+
+    added = ""
+    client = connect()
+    if client is None:
+        failures.append("no control socket at " + socket_path)
+    else:
+        try:
+            # the list ends with a line of its own once every service is in it
+            listing = command(client, "list")
+            while not listing.endswith("OK"):
+                listing += "\n" + client.recv(4096).decode().strip()
+            services = [line.split()[0] for line in listing.splitlines() if line.startswith("S")]
+
+            for service in services:
+                reply = command(client, "remove " + service)
+                if reply != "OK":
+                    failures.append("remove {}: {}".format(service, reply))
+
+            time.sleep(empty_seconds)
+
+            added = command(client, "add 30 100 {}".format(core))
+            if not added.startswith("OK S"):
+                failures.append("add after removing every service: " + added)
+        except OSError as error:
+            # the sequencer died under the client
+            failures.append("control socket: {}".format(error))
+        client.close()
+
+    output, _ = run.communicate()
+
+    if run.returncode != 0:
+        failures.append("seqgen3 exited with {}".format(run.returncode))
+    if "TEST COMPLETE" not in output:
+        failures.append("run did not complete")
+    if added.startswith("OK S"):
+        slot = added.split()[1][1:]
+        # the slot may have been used before, the last report is the new service
+        releases = [int(count) for number, count in threads_pattern.findall(output) if number == slot]
+        if not releases or releases[-1] == 0:
+            failures.append("S{} added to an empty table was never released".format(slot))
+
+    for failure in failures:
+        print("  {}: {}".format(name, failure), file=sys.stderr)
+    print("{}: {}".format(name, "passed" if not failures else "FAILED"))
+    return not failures
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Removes every service of a running seqgen3 and adds one back")
+    parser.add_argument("-d", "--seconds", type=int, default=3, help="length of each run")
+    parser.add_argument("-c", "--core", type=int, default=2, help="core of the service added back")
+    args = parser.parse_args()
+
+    passed = [check(mode, args.seconds, args.core) for mode in ([], ["-T"])]
+    sys.exit(0 if all(passed) else 1)
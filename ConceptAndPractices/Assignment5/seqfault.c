@@ -0,0 +1,628 @@
+// Fault and overload injection of seqgen3
+//
+// The plan is sorted by due time and never changes once the sequencer runs.
+// The Sequencer alone moves through it; what it fires is handed over without
+// locks: pending spikes and blocks are per service words the service takes
+// with an exchange, a hog is woken through its semaphore, a burst is written
+// to the aperiodic event pipe. Only the threads that suffer a fault log it.
+// The effect of the faults is accounted by each service for its own releases.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <syslog.h>
+
+#include "seqgen3.h"
+#include "seqsched.h"
+#include "seqaper.h"
+#include "seqfault.h"
+#include "seqthread.h"
+
+typedef struct
+{
+    unsigned int atMs;                        // after the sequencer starts
+    faultKind_t kind;
+    int target;                               // service index, core or event count
+    unsigned int usec;
+    int order;                                // in the script, keeps equal due times in order
+    unsigned long long quantum;               // release quantum the fault is due at
+    volatile unsigned long long firedNsec;    // MY_CLOCK_TYPE, 0 until fired
+    volatile unsigned long long appliedNsec;  // when it took hold, 0 if it never did
+    volatile unsigned long long appliedRelease; // release of the service that took a spike or a block
+    int posted;                               // burst events the server queue accepted
+} faultEvent_t;
+
+// Faults waiting for the next job of a service
+typedef struct
+{
+    volatile unsigned int spikeUsec;
+    volatile int spikeEvent;
+    volatile unsigned int blockUsec;
+    volatile int blockEvent;
+} faultPending_t;
+
+// Core stealing thread, one per core a hog fault names
+typedef struct
+{
+    int started;
+    int core;
+    pthread_t thread;
+    sem_t wake;
+    volatile unsigned int pendingUsec;
+    volatile int event;
+} faultHog_t;
+
+// Releases of one service attributed to one fault, or to no fault at all
+typedef struct
+{
+    unsigned long long releases;
+    unsigned long long misses;
+    unsigned long long maxLatencyNsec;
+    unsigned long long maxResponseNsec;
+} faultEffect_t;
+
+static const char *faultKindNames[NUM_FAULT_KINDS] = {"spike", "block", "hog", "delay", "burst"};
+
+static faultEvent_t events[FAULT_MAX_EVENTS];
+static int eventCount;
+static int faultsActive;
+
+static int randomPlan;
+static unsigned int randomSeed, randomIntervalMs, randomMaxUsec;
+
+// Next fault to fire, the Sequencer only; fired ones for the accounting
+static int nextEvent;
+static int firedCount;
+
+static faultPending_t pending[MAX_SERVICES];
+static faultHog_t hogs[NUM_CPU_CORES];
+
+// effects[event * MAX_SERVICES + serviceIdx]
+static faultEffect_t *effects;
+static faultEffect_t baseline[MAX_SERVICES];
+
+// Seconds since the start, the time base of the release log
+static double logSec(unsigned long long nsec)
+{
+    return ((double)nsec / NANOSEC_PER_SEC) - start_realtime;
+}
+
+static faultKind_t faultKindByName(const char *name)
+{
+    faultKind_t kind;
+
+    for(kind=0; kind < NUM_FAULT_KINDS && strcmp(name, faultKindNames[kind]) != 0; kind++);
+
+    return kind;
+}
+
+// Target of a fault as written in a script: S<n>, a core, an event count or "-"
+static int parseTarget(faultKind_t kind, const char *text, int *target)
+{
+    switch(kind)
+    {
+        case FAULT_SPIKE:
+        case FAULT_BLOCK:
+            if(sscanf(text, "S%d", target) != 1 || *target < 1 || *target > MAX_SERVICES)
+                return -1;
+            (*target)--;
+            return 0;
+        case FAULT_HOG:
+            return (sscanf(text, "%d", target) == 1 && *target >= 0 && *target < NUM_CPU_CORES) ? 0 : -1;
+        case FAULT_BURST:
+            return (sscanf(text, "%d", target) == 1 && *target >= 1 && *target <= FAULT_MAX_BURST) ? 0 : -1;
+        case FAULT_DELAY:
+            *target = 0;
+            return (strcmp(text, "-") == 0) ? 0 : -1;
+        default:
+            return -1;
+    }
+}
+
+static const char *formatTarget(const faultEvent_t *event, char *text, size_t length)
+{
+    switch(event->kind)
+    {
+        case FAULT_SPIKE:
+        case FAULT_BLOCK:
+            snprintf(text, length, "S%d", event->target + 1);
+            break;
+        case FAULT_DELAY:
+            snprintf(text, length, "-");
+            break;
+        default:
+            snprintf(text, length, "%d", event->target);
+            break;
+    }
+
+    return text;
+}
+
+static int addEvent(unsigned int atMs, faultKind_t kind, int target, unsigned int usec)
+{
+    if(eventCount >= FAULT_MAX_EVENTS)
+        return -1;
+
+    memset(&events[eventCount], 0, sizeof(events[eventCount]));
+    events[eventCount].atMs = atMs;
+    events[eventCount].kind = kind;
+    events[eventCount].target = target;
+    events[eventCount].usec = usec;
+    events[eventCount].order = eventCount;
+    eventCount++;
+    return 0;
+}
+
+// One fault per line, "at_ms kind target usec [count every_ms]", # starts a comment
+static int readScript(const char *path)
+{
+    char line[256], kindName[16], targetText[16];
+    unsigned int atMs, usec, count, everyMs, i;
+    faultKind_t kind;
+    int fields, target, lineNum=0;
+    FILE *script;
+
+    script = fopen(path, "r");
+    if(script == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), script) != NULL)
+    {
+        lineNum++;
+        line[strcspn(line, "#\n")] = '\0';
+
+        count = 1;
+        everyMs = 0;
+        fields = sscanf(line, "%u %15s %15s %u %u %u", &atMs, kindName, targetText, &usec, &count, &everyMs);
+        if(fields <= 0)
+            continue;
+
+        kind = (fields >= 2) ? faultKindByName(kindName) : NUM_FAULT_KINDS;
+        if(fields < 4 || fields == 5 || kind == NUM_FAULT_KINDS || parseTarget(kind, targetText, &target) != 0 ||
+           usec == 0 || usec > FAULT_MAX_USEC || count == 0)
+        {
+            printf("%s line %d: expected \"at_ms spike|block|hog|delay|burst S<n>|core|-|count usec [count every_ms]\"\n", path, lineNum);
+            fclose(script);
+            return -1;
+        }
+
+        for(i=0; i < count; i++)
+        {
+            if(addEvent(atMs + (i * everyMs), kind, target, usec) != 0)
+            {
+                printf("%s line %d: more than %d faults\n", path, lineNum, FAULT_MAX_EVENTS);
+                fclose(script);
+                return -1;
+            }
+        }
+    }
+
+    fclose(script);
+    return (eventCount > 0) ? 0 : -1;
+}
+
+int configureFaults(const char *arg)
+{
+    eventCount = 0;
+
+    if(strncmp(arg, "random,", strlen("random,")) != 0)
+        return readScript(arg);
+
+    if(sscanf(arg, "random,%u,%u,%u", &randomSeed, &randomIntervalMs, &randomMaxUsec) != 3 ||
+       randomIntervalMs == 0 || randomMaxUsec == 0 || randomMaxUsec > FAULT_MAX_USEC)
+        return -1;
+
+    randomPlan = TRUE;
+    return 0;
+}
+
+static double uniformSample(unsigned int *seed)
+{
+    return (double)rand_r(seed) / ((double)RAND_MAX + 1.0);
+}
+
+// Faults at Poisson instants over the run, each of a random kind, target and
+// length; the same seed and service set always give the same plan
+static void drawRandomPlan(const serviceModel_t *set, int count, unsigned int runSeconds, int withServer)
+{
+    unsigned int seed = randomSeed, usec;
+    double atMs = 0.0;
+    faultKind_t kind;
+    int target;
+
+    while(eventCount < FAULT_MAX_EVENTS)
+    {
+        atMs += -(double)randomIntervalMs * log(1.0 - uniformSample(&seed));
+        if(atMs >= (double)runSeconds * 1000.0)
+            break;
+
+        kind = (faultKind_t)(uniformSample(&seed) * (withServer ? NUM_FAULT_KINDS : FAULT_BURST));
+        usec = 1 + (unsigned int)(uniformSample(&seed) * randomMaxUsec);
+        target = (int)(uniformSample(&seed) * count);
+
+        switch(kind)
+        {
+            case FAULT_HOG:
+                target = set[target].core;
+                break;
+            case FAULT_DELAY:
+                target = 0;
+                break;
+            case FAULT_BURST:
+                target = 1 + (int)(uniformSample(&seed) * 8);
+                break;
+            default:
+                target = set[target].serviceIdx;
+                break;
+        }
+
+        addEvent((unsigned int)atMs, kind, target, usec);
+    }
+}
+
+static int compareEvents(const void *a, const void *b)
+{
+    const faultEvent_t *ea = (const faultEvent_t *)a, *eb = (const faultEvent_t *)b;
+
+    if(ea->atMs != eb->atMs)
+        return (ea->atMs > eb->atMs) - (ea->atMs < eb->atMs);
+
+    return ea->order - eb->order;
+}
+
+// Spins for usec on the wall clock, whatever preempts it meanwhile
+static void spinUsec(unsigned int usec)
+{
+    unsigned long long untilNsec = monotonicNsec() + ((unsigned long long)usec * 1000);
+
+    while(monotonicNsec() < untilNsec);
+}
+
+static void *faultHog(void *arg)
+{
+    faultHog_t *hog = (faultHog_t *)arg;
+    struct timespec until;
+    sigset_t alarmSet;
+    unsigned long long startNsec;
+    unsigned int usec;
+    int event;
+
+    // the Sequencer signal handler must never wait for a hog
+    sigemptyset(&alarmSet);
+    sigaddset(&alarmSet, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarmSet, NULL);
+
+    while(!sequencerDone)
+    {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += FAULT_POLL_MS * NANOSEC_PER_MSEC;
+        until.tv_sec += until.tv_nsec / NANOSEC_PER_SEC;
+        until.tv_nsec %= NANOSEC_PER_SEC;
+        if(sem_timedwait(&hog->wake, &until) != 0)
+            continue;
+
+        event = __atomic_load_n(&hog->event, __ATOMIC_ACQUIRE);
+        usec = __atomic_exchange_n(&hog->pendingUsec, 0, __ATOMIC_ACQ_REL);
+        if(usec == 0)
+            continue;
+
+        startNsec = nowNsec();
+        events[event].appliedNsec = startNsec;
+        spinUsec(usec);
+
+        // logged once the core is given back, not to add to the disturbance
+        syslog(LOG_CRIT, "FAULT %d hog core %d %u usec @ sec=%6.9lf\n", event+1, hog->core, usec, logSec(startNsec));
+    }
+
+    return NULL;
+}
+
+static int startHog(int core)
+{
+    faultHog_t *hog = &hogs[core];
+    pthread_attr_t attr;
+    struct sched_param param = {0};
+    cpu_set_t hogCpu;
+    int rc;
+
+    if(hog->started)
+        return 0;
+
+    hog->core = core;
+    sem_init(&hog->wake, 0, 0);
+
+    CPU_ZERO(&hogCpu);
+    CPU_SET(core, &hogCpu);
+
+    // at the priority of the Sequencer, above every service of the core
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &hogCpu);
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    rc = startRtThread(&hog->thread, &attr, faultHog, hog);
+    pthread_attr_destroy(&attr);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for fault hog");
+        sem_destroy(&hog->wake);
+        return -1;
+    }
+
+    hog->started = TRUE;
+    return 0;
+}
+
+int startFaultInjection(const serviceModel_t *set, int count, unsigned int runSeconds)
+{
+    serviceModel_t serverModel;
+    char target[16];
+    int i, withServer = aperiodicServerModel(&serverModel);
+
+    if(randomPlan)
+        drawRandomPlan(set, count, runSeconds, withServer);
+
+    qsort(events, eventCount, sizeof(faultEvent_t), compareEvents);
+
+    for(i=0; i < eventCount; i++)
+    {
+        if(events[i].kind == FAULT_BURST && !withServer)
+        {
+            printf("Fault %d: a burst of aperiodic events needs the aperiodic server (-A)\n", i+1);
+            return -1;
+        }
+
+        if(events[i].kind == FAULT_HOG && startHog(events[i].target) != 0)
+            return -1;
+
+        events[i].quantum = events[i].atMs / releaseQuantumMs;
+    }
+
+    effects = calloc((size_t)(eventCount > 0 ? eventCount : 1) * MAX_SERVICES, sizeof(faultEffect_t));
+    if(effects == NULL)
+    {
+        perror("fault effects");
+        return -1;
+    }
+
+    if(randomPlan)
+        printf("Fault plan: %d faults drawn from seed %u, every %u ms on average, up to %u usec\n",
+               eventCount, randomSeed, randomIntervalMs, randomMaxUsec);
+    else
+        printf("Fault plan: %d faults\n", eventCount);
+
+    // in the script format, to replay the plan
+    for(i=0; i < eventCount; i++)
+        printf("  %u %s %s %u   # FAULT %d\n", events[i].atMs, faultKindNames[events[i].kind],
+               formatTarget(&events[i], target, sizeof(target)), events[i].usec, i+1);
+
+    syslog(LOG_CRIT, "Fault plan: %d faults\n", eventCount);
+
+    faultsActive = TRUE;
+    return 0;
+}
+
+void injectFaults(unsigned long long quantum)
+{
+    faultEvent_t *event;
+    unsigned int delayUsec = 0;
+    int i, firstDelay = nextEvent;
+
+    if(!faultsActive)
+        return;
+
+    while(nextEvent < eventCount && events[nextEvent].quantum <= quantum)
+    {
+        event = &events[nextEvent];
+        event->firedNsec = nowNsec();
+
+        switch(event->kind)
+        {
+            case FAULT_SPIKE:
+                __atomic_store_n(&pending[event->target].spikeEvent, nextEvent, __ATOMIC_RELEASE);
+                __atomic_add_fetch(&pending[event->target].spikeUsec, event->usec, __ATOMIC_RELEASE);
+                break;
+            case FAULT_BLOCK:
+                __atomic_store_n(&pending[event->target].blockEvent, nextEvent, __ATOMIC_RELEASE);
+                __atomic_add_fetch(&pending[event->target].blockUsec, event->usec, __ATOMIC_RELEASE);
+                break;
+            case FAULT_HOG:
+                __atomic_store_n(&hogs[event->target].event, nextEvent, __ATOMIC_RELEASE);
+                __atomic_add_fetch(&hogs[event->target].pendingUsec, event->usec, __ATOMIC_RELEASE);
+                sem_post(&hogs[event->target].wake);
+                break;
+            case FAULT_DELAY:
+                delayUsec += event->usec;
+                break;
+            case FAULT_BURST:
+                // write(2) on a non blocking pipe, async-signal-safe
+                for(i=0; i < event->target; i++)
+                    event->posted += (postAperiodicEvent(event->usec) == 0);
+                event->appliedNsec = event->firedNsec;
+                break;
+            default:
+                break;
+        }
+
+        nextEvent++;
+        __atomic_store_n(&firedCount, nextEvent, __ATOMIC_RELEASE);
+    }
+
+    if(delayUsec == 0)
+        return;
+
+    // the whole tick is late, the releases of this quantum included
+    spinUsec(delayUsec);
+
+    for(i=firstDelay; i < nextEvent; i++)
+    {
+        if(events[i].kind == FAULT_DELAY)
+            events[i].appliedNsec = nowNsec();
+    }
+}
+
+static int budgetStopDue(void *arg)
+{
+    return budgetAbortDue((const budgetTimer_t *)arg);
+}
+
+void injectJobFaults(int serviceIdx, unsigned long long releaseCnt, const budgetTimer_t *budget)
+{
+    faultPending_t *faults = &pending[serviceIdx];
+    struct timespec sleepTime;
+    unsigned long long startNsec;
+    unsigned int usec;
+    int event;
+
+    if(!faultsActive)
+        return;
+
+    usec = __atomic_exchange_n(&faults->spikeUsec, 0, __ATOMIC_ACQ_REL);
+    if(usec > 0)
+    {
+        event = __atomic_load_n(&faults->spikeEvent, __ATOMIC_ACQUIRE);
+        startNsec = nowNsec();
+        events[event].appliedNsec = startNsec;
+        events[event].appliedRelease = releaseCnt;
+        syslog(LOG_CRIT, "FAULT %d spike S%d %u usec in release %llu @ sec=%6.9lf\n",
+               event+1, serviceIdx+1, usec, releaseCnt, logSec(startNsec));
+
+        // CPU time of the job, an execution budget still applies to it
+        burnCpuNsec((unsigned long long)usec * 1000, budgetStopDue, (void *)budget);
+    }
+
+    usec = __atomic_exchange_n(&faults->blockUsec, 0, __ATOMIC_ACQ_REL);
+    if(usec > 0)
+    {
+        event = __atomic_load_n(&faults->blockEvent, __ATOMIC_ACQUIRE);
+        startNsec = nowNsec();
+        events[event].appliedNsec = startNsec;
+        events[event].appliedRelease = releaseCnt;
+        syslog(LOG_CRIT, "FAULT %d block S%d %u usec in release %llu @ sec=%6.9lf\n",
+               event+1, serviceIdx+1, usec, releaseCnt, logSec(startNsec));
+
+        sleepTime.tv_sec = usec / 1000000;
+        sleepTime.tv_nsec = (usec % 1000000) * 1000;
+        while(clock_nanosleep(CLOCK_MONOTONIC, 0, &sleepTime, &sleepTime) == EINTR);
+    }
+}
+
+static void accountEffect(faultEffect_t *effect, unsigned long long latencyNsec, unsigned long long responseNsec, int missed)
+{
+    effect->releases++;
+    effect->misses += missed;
+    if(latencyNsec > effect->maxLatencyNsec)
+        effect->maxLatencyNsec = latencyNsec;
+    if(responseNsec > effect->maxResponseNsec)
+        effect->maxResponseNsec = responseNsec;
+}
+
+void faultAccountRelease(int serviceIdx, unsigned long long releaseNsec, unsigned long long latencyNsec,
+                         unsigned long long responseNsec, int missed)
+{
+    unsigned long long firedNsec, windowNsec;
+    int i;
+
+    if(!faultsActive)
+        return;
+
+    // the latest fault fired before the release whose window still holds it;
+    // none fired longer ago than the longest window can
+    for(i=__atomic_load_n(&firedCount, __ATOMIC_ACQUIRE) - 1; i >= 0; i--)
+    {
+        firedNsec = events[i].firedNsec;
+        if(firedNsec > releaseNsec)
+            continue;
+        if(releaseNsec - firedNsec > ((unsigned long long)FAULT_MAX_USEC * 1000) + ((unsigned long long)FAULT_SETTLE_MS * NANOSEC_PER_MSEC))
+            break;
+
+        windowNsec = ((unsigned long long)events[i].usec * 1000) + ((unsigned long long)FAULT_SETTLE_MS * NANOSEC_PER_MSEC);
+        if(releaseNsec - firedNsec <= windowNsec)
+        {
+            accountEffect(&effects[(i * MAX_SERVICES) + serviceIdx], latencyNsec, responseNsec, missed);
+            return;
+        }
+    }
+
+    accountEffect(&baseline[serviceIdx], latencyNsec, responseNsec, missed);
+}
+
+static void printEffect(const char *label, int serviceIdx, const faultEffect_t *effect)
+{
+    printf("  %s S%d: %llu releases, latency usec max=%.1lf, response usec max=%.1lf, %llu misses\n",
+           label, serviceIdx+1, effect->releases, effect->maxLatencyNsec / 1000.0, effect->maxResponseNsec / 1000.0, effect->misses);
+    syslog(LOG_CRIT, "  %s S%d: %llu releases, latency usec max=%.1lf, response usec max=%.1lf, %llu misses\n",
+           label, serviceIdx+1, effect->releases, effect->maxLatencyNsec / 1000.0, effect->maxResponseNsec / 1000.0, effect->misses);
+}
+
+void stopFaultInjection(void)
+{
+    const faultEvent_t *event;
+    char target[16], applied[64];
+    int i, serviceIdx;
+
+    if(!faultsActive)
+        return;
+
+    for(i=0; i < NUM_CPU_CORES; i++)
+    {
+        if(!hogs[i].started)
+            continue;
+
+        pthread_join(hogs[i].thread, NULL);
+        sem_destroy(&hogs[i].wake);
+        hogs[i].started = FALSE;
+    }
+
+    printf("Faults: %d of %d fired; releases within %d ms after the end of a fault are its effect\n", firedCount, eventCount, FAULT_SETTLE_MS);
+    syslog(LOG_CRIT, "Faults: %d of %d fired\n", firedCount, eventCount);
+
+    for(serviceIdx=0; serviceIdx < MAX_SERVICES; serviceIdx++)
+    {
+        if(baseline[serviceIdx].releases > 0)
+            printEffect("no fault", serviceIdx, &baseline[serviceIdx]);
+    }
+
+    for(i=0; i < firedCount; i++)
+    {
+        event = &events[i];
+
+        if(event->appliedNsec == 0)
+            snprintf(applied, sizeof(applied), "never applied");
+        else if(event->kind == FAULT_SPIKE || event->kind == FAULT_BLOCK)
+            snprintf(applied, sizeof(applied), "applied in release %llu @ sec=%6.9lf", event->appliedRelease, logSec(event->appliedNsec));
+        else if(event->kind == FAULT_BURST)
+            snprintf(applied, sizeof(applied), "%d of %d events queued", event->posted, event->target);
+        else
+            snprintf(applied, sizeof(applied), "applied @ sec=%6.9lf", logSec(event->appliedNsec));
+
+        printf("FAULT %d %s %s %u usec at %u ms: fired @ sec=%6.9lf, %s\n", i+1, faultKindNames[event->kind],
+               formatTarget(event, target, sizeof(target)), event->usec, event->atMs, logSec(event->firedNsec), applied);
+        syslog(LOG_CRIT, "FAULT %d %s %s %u usec at %u ms: fired @ sec=%6.9lf, %s\n", i+1, faultKindNames[event->kind],
+               formatTarget(event, target, sizeof(target)), event->usec, event->atMs, logSec(event->firedNsec), applied);
+
+        for(serviceIdx=0; serviceIdx < MAX_SERVICES; serviceIdx++)
+        {
+            if(effects[(i * MAX_SERVICES) + serviceIdx].releases > 0)
+                printEffect("after it", serviceIdx, &effects[(i * MAX_SERVICES) + serviceIdx]);
+        }
+    }
+
+    free(effects);
+    effects = NULL;
+    faultsActive = FALSE;
+}
@@ -0,0 +1,71 @@
+// Fault and overload injection of seqgen3: disturbances on a plan, traced to their effect
+//
+// A plan is a list of faults, each due a number of ms after the sequencer
+// starts. It is read from a script or drawn at random from a seed, so a run
+// can be repeated exactly:
+//
+//   spike   the next job of a service burns usec more CPU time
+//   block   the next job of a service sleeps usec, as on a blocking read
+//   hog     a SCHED_FIFO thread at the priority of the Sequencer, pinned to a
+//           core, spins for usec, above every service of that core
+//   delay   the sequencer tick spins usec before it stamps and releases
+//   burst   a number of aperiodic events of usec each, posted to the server
+//
+// The Sequencer fires the faults due at each release quantum. Each one is
+// tagged "FAULT <n>" with the instant it fired and the instant it took hold,
+// on the same time base as the release log. Every release is attributed to
+// the latest fault it followed within the fault length plus
+// FAULT_SETTLE_MS; its latency, response time and misses are reported per
+// fault and per service next to those of the releases outside every fault.
+
+#ifndef SEQFAULT_H
+#define SEQFAULT_H
+
+#include "seqgen3.h"
+
+// Faults in a plan at most, repetitions included
+#define FAULT_MAX_EVENTS (256)
+
+// Longest fault, a hog or a tick delay beyond it would stall the run
+#define FAULT_MAX_USEC (1000000)
+
+// Largest burst of aperiodic events
+#define FAULT_MAX_BURST (256)
+
+// How long releases after a fault still count as affected by it
+#define FAULT_SETTLE_MS (500)
+
+// How often an idle hog checks whether the sequencer is done
+#define FAULT_POLL_MS (100)
+
+typedef enum
+{
+    FAULT_SPIKE,
+    FAULT_BLOCK,
+    FAULT_HOG,
+    FAULT_DELAY,
+    FAULT_BURST,
+    NUM_FAULT_KINDS
+} faultKind_t;
+
+// A script path, or "random,seed,mean_interval_ms,max_usec", -1 if malformed
+int configureFaults(const char *arg);
+
+// With the initial services known: draws a random plan over runSeconds, puts
+// the plan on the release quanta and starts the hogs
+int startFaultInjection(const serviceModel_t *set, int count, unsigned int runSeconds);
+
+// Called by the Sequencer at every release quantum, before it stamps the tick. Async-signal-safe.
+void injectFaults(unsigned long long quantum);
+
+// Called by a service job once its release is logged: the spikes and blocks pending for it
+void injectJobFaults(int serviceIdx, unsigned long long releaseCnt, const budgetTimer_t *budget);
+
+// Called once a release is complete, to attribute it to a fault or to the baseline
+void faultAccountRelease(int serviceIdx, unsigned long long releaseNsec, unsigned long long latencyNsec,
+                         unsigned long long responseNsec, int missed);
+
+// Once the sequencer is done: joins the hogs and prints every fault with its effect
+void stopFaultInjection(void);
+
+#endif
@@ -0,0 +1,276 @@
+// Frame buffer pool of the pipeline mode
+//
+// Only the capture stage takes buffers, scanning the pool round robin for one
+// whose reference count is 0, and any stage may drop the last reference, so a
+// buffer changes hands with one atomic per side and no list that could suffer
+// from ABA. Page faults and data TLB misses are measured around the frame work
+// only, getrusage(RUSAGE_THREAD) and a perf counter of the stage thread.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "seqgen3.h"
+#include "seqframe.h"
+
+int framePoolActive = FALSE;
+
+static frameBuffer_t buffers[FRAME_POOL_BUFFERS];
+static unsigned char *poolMemory;
+static size_t poolSize;
+static size_t frameBytes;
+static unsigned int frameWidth, frameHeight;
+static const char *poolBacking;
+static unsigned int nextBuffer;      // capture stage only
+
+static frameStageStats_t stageStats[MAX_SERVICES];
+static int tlbFds[MAX_SERVICES];
+
+// Transparent huge pages backing the process, from /proc/self/smaps_rollup, -1 if unknown
+static long anonHugePagesKb(void)
+{
+    char line[128];
+    long kb = -1;
+    FILE *smaps;
+
+    smaps = fopen("/proc/self/smaps_rollup", "r");
+    if(smaps == NULL)
+        return -1;
+
+    while(fgets(line, sizeof(line), smaps) != NULL)
+    {
+        if(sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+            break;
+    }
+
+    fclose(smaps);
+    return kb;
+}
+
+int createFramePool(unsigned int width, unsigned int height)
+{
+    size_t stride;
+    int i;
+
+    frameWidth = width;
+    frameHeight = height;
+    frameBytes = (size_t)width * height * FRAME_BYTES_PER_PIXEL;
+    // whole huge pages per buffer, so no two buffers share a TLB entry
+    stride = (frameBytes + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+    poolSize = stride * FRAME_POOL_BUFFERS;
+
+    poolMemory = mmap(NULL, poolSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    poolBacking = "hugetlb pages";
+
+    if(poolMemory == MAP_FAILED)
+    {
+        poolMemory = mmap(NULL, poolSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(poolMemory == MAP_FAILED)
+        {
+            perror("mmap frame pool");
+            poolMemory = NULL;
+            return -1;
+        }
+
+        poolBacking = (madvise(poolMemory, poolSize, MADV_HUGEPAGE) == 0) ? "transparent huge pages" : "base pages";
+    }
+
+    // faulted in and locked now rather than by the first captures
+    memset(poolMemory, 0, poolSize);
+    if(mlock(poolMemory, poolSize) != 0)
+        perror("mlock frame pool");
+
+    memset(buffers, 0, sizeof(buffers));
+    for(i=0; i < FRAME_POOL_BUFFERS; i++)
+        buffers[i].pixels = poolMemory + (i * stride);
+
+    memset(stageStats, 0, sizeof(stageStats));
+    for(i=0; i < MAX_SERVICES; i++)
+        tlbFds[i] = -1;
+    nextBuffer = 0;
+
+    printf("Frame pool: %d buffers of %ux%u (%zu KiB) in %zu MiB of %s, %ld KiB of transparent huge pages in the process\n",
+           FRAME_POOL_BUFFERS, width, height, frameBytes / 1024, poolSize / (1024 * 1024), poolBacking, anonHugePagesKb());
+
+    framePoolActive = TRUE;
+    return 0;
+}
+
+void destroyFramePool(void)
+{
+    framePoolActive = FALSE;
+    munmap(poolMemory, poolSize);
+    poolMemory = NULL;
+}
+
+void frameStageOpen(int stage)
+{
+    struct perf_event_attr attr;
+
+    if(!framePoolActive)
+        return;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // this thread, on whatever CPU it runs, left out if the PMU has no such event
+    tlbFds[stage] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    stageStats[stage].tlbCounted = (tlbFds[stage] >= 0);
+}
+
+void frameStageClose(int stage)
+{
+    if(tlbFds[stage] >= 0)
+        close(tlbFds[stage]);
+    tlbFds[stage] = -1;
+}
+
+typedef struct
+{
+    unsigned long long startNsec;
+    unsigned long long tlbMisses;
+    struct rusage usage;
+} frameMark_t;
+
+static void markBegin(int stage, frameMark_t *mark)
+{
+    if(tlbFds[stage] < 0 || read(tlbFds[stage], &mark->tlbMisses, sizeof(mark->tlbMisses)) != sizeof(mark->tlbMisses))
+        mark->tlbMisses = 0;
+    getrusage(RUSAGE_THREAD, &mark->usage);
+    mark->startNsec = nowNsec();
+}
+
+static void markEnd(int stage, const frameMark_t *begin, unsigned long long bytes)
+{
+    frameStageStats_t *stats = &stageStats[stage];
+    unsigned long long endNsec = nowNsec(), tlbMisses;
+    struct rusage usage;
+
+    getrusage(RUSAGE_THREAD, &usage);
+    if(tlbFds[stage] >= 0 && read(tlbFds[stage], &tlbMisses, sizeof(tlbMisses)) == sizeof(tlbMisses))
+        stats->tlbMisses += tlbMisses - begin->tlbMisses;
+
+    stats->frames++;
+    stats->bytes += bytes;
+    stats->nsec += endNsec - begin->startNsec;
+    stats->minorFaults += usage.ru_minflt - begin->usage.ru_minflt;
+    stats->majorFaults += usage.ru_majflt - begin->usage.ru_majflt;
+}
+
+int frameCapture(int stage, unsigned long long frame, unsigned long long captureNsec)
+{
+    unsigned long long *pixels, pattern = frame * 0x9e3779b97f4a7c15ULL;
+    frameMark_t mark;
+    size_t i, words = frameBytes / sizeof(unsigned long long);
+    int buffer, tries;
+
+    for(tries=0; tries < FRAME_POOL_BUFFERS; tries++)
+    {
+        buffer = nextBuffer;
+        nextBuffer = (nextBuffer + 1) % FRAME_POOL_BUFFERS;
+
+        if(__atomic_load_n(&buffers[buffer].refs, __ATOMIC_ACQUIRE) == 0)
+            break;
+    }
+
+    if(tries == FRAME_POOL_BUFFERS)
+    {
+        stageStats[stage].exhausted++;
+        return -1;
+    }
+
+    markBegin(stage, &mark);
+
+    // the emulated sensor: a pattern that changes with every frame
+    pixels = (unsigned long long *)buffers[buffer].pixels;
+    for(i=0; i < words; i++)
+        pixels[i] = pattern + i;
+
+    markEnd(stage, &mark, frameBytes);
+
+    buffers[buffer].frame = frame;
+    buffers[buffer].captureNsec = captureNsec;
+    __atomic_store_n(&buffers[buffer].refs, 1, __ATOMIC_RELEASE);
+
+    return buffer;
+}
+
+void frameProcess(int stage, int buffer, int lastStage)
+{
+    unsigned long long *pixels = (unsigned long long *)buffers[buffer].pixels, checksum = 0;
+    frameMark_t mark;
+    size_t i, words = frameBytes / sizeof(unsigned long long);
+
+    markBegin(stage, &mark);
+
+    if(lastStage)
+    {
+        // output: reads the frame out
+        for(i=0; i < words; i++)
+            checksum += pixels[i];
+        stageStats[stage].checksum += checksum;
+    }
+    else
+    {
+        // processing in place, read and written back
+        for(i=0; i < words; i++)
+            pixels[i] = ~pixels[i];
+    }
+
+    markEnd(stage, &mark, lastStage ? frameBytes : 2 * frameBytes);
+}
+
+void frameRelease(int buffer)
+{
+    __atomic_sub_fetch(&buffers[buffer].refs, 1, __ATOMIC_RELEASE);
+}
+
+void printFrameStats(int stages)
+{
+    const frameStageStats_t *stats;
+    unsigned long long faults = 0;
+    int stage;
+
+    if(!framePoolActive)
+        return;
+
+    printf("Frame pool: %ux%u frames in %s\n", frameWidth, frameHeight, poolBacking);
+
+    for(stage=0; stage < stages; stage++)
+    {
+        stats = &stageStats[stage];
+        if(stats->frames == 0)
+            continue;
+
+        faults += stats->minorFaults + stats->majorFaults;
+
+        printf("Frame stage %d (S%d): %llu frames, %.1lf usec per frame at %.2lf GB/s, dTLB load misses per frame=%.1lf%s, page faults minor=%llu major=%llu",
+               stage, stage+1, stats->frames, (double)stats->nsec / stats->frames / 1000.0,
+               (stats->nsec > 0) ? (double)stats->bytes / stats->nsec : 0.0,
+               (double)stats->tlbMisses / stats->frames, stats->tlbCounted ? "" : " (not counted)",
+               stats->minorFaults, stats->majorFaults);
+        if(stage == 0)
+            printf(", %llu captures without a free buffer", stats->exhausted);
+        printf("\n");
+
+        syslog(LOG_CRIT, "Frame stage %d (S%d): %llu frames, %.1lf usec per frame at %.2lf GB/s, dTLB load misses per frame=%.1lf, page faults minor=%llu major=%llu\n",
+               stage, stage+1, stats->frames, (double)stats->nsec / stats->frames / 1000.0,
+               (stats->nsec > 0) ? (double)stats->bytes / stats->nsec : 0.0,
+               (double)stats->tlbMisses / stats->frames, stats->minorFaults, stats->majorFaults);
+    }
+
+    printf("Frame pool: %s\n", (faults == 0) ? "no page fault in any frame, the pool was allocated and faulted in once"
+                                             : "page faults while handling frames, memory was not all resident");
+}
@@ -0,0 +1,69 @@
+// Frame buffer pool of the pipeline mode: emulated capture of large frames
+//
+// The buffers are allocated once, at start, in huge pages if the system has
+// some reserved (MAP_HUGETLB), else in memory advised for transparent huge
+// pages, and faulted in before the first release. The capture stage fills a
+// free buffer per release, later stages work on it in place and pass it on by
+// index, and the last reference gives it back: no release copies or allocates
+// a frame. Every stage counts its data TLB misses, page faults and the memory
+// bandwidth it reaches on the frames.
+
+#ifndef SEQFRAME_H
+#define SEQFRAME_H
+
+// Buffers in the pool, a capture finding none free drops its frame
+#define FRAME_POOL_BUFFERS (16)
+
+// YUYV: two bytes per pixel
+#define FRAME_BYTES_PER_PIXEL (2)
+
+#define DEFAULT_FRAME_WIDTH (640)
+#define DEFAULT_FRAME_HEIGHT (480)
+
+// The closest sequencer period to a 30 Hz camera
+#define DEFAULT_CAPTURE_PERIOD_MS (30)
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct
+{
+    unsigned int refs;               // 0 when free, taken by the capture stage only
+    unsigned long long frame;
+    unsigned long long captureNsec;
+    unsigned char *pixels;
+} frameBuffer_t;
+
+// Frame work of one stage, written by the stage thread only
+typedef struct
+{
+    unsigned long long frames;
+    unsigned long long bytes;        // read plus written
+    unsigned long long nsec;
+    unsigned long long tlbMisses;
+    unsigned long long minorFaults;
+    unsigned long long majorFaults;
+    unsigned long long exhausted;    // capture only: no free buffer
+    unsigned long long checksum;     // output only, keeps the reads from being optimized out
+    int tlbCounted;                  // the dTLB miss counter could be opened
+} frameStageStats_t;
+
+extern int framePoolActive;
+
+int createFramePool(unsigned int width, unsigned int height);
+void destroyFramePool(void);
+
+// Calling stage thread: its data TLB miss counter
+void frameStageOpen(int stage);
+void frameStageClose(int stage);
+
+// Capture: a buffer filled with a new frame, -1 if the pool is exhausted
+int frameCapture(int stage, unsigned long long frame, unsigned long long captureNsec);
+
+// Later stages: works on the frame in place, the last stage only reads it
+void frameProcess(int stage, int buffer, int lastStage);
+
+void frameRelease(int buffer);
+
+void printFrameStats(int stages);
+
+#endif
@@ -88,6 +88,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 #include <unistd.h>
 
 #include <pthread.h>
@@ -103,24 +105,26 @@
 
 #include <signal.h>
 
-#define USEC_PER_MSEC (1000)
-#define NANOSEC_PER_MSEC (1000000)
-#define NANOSEC_PER_SEC (1000000000)
-#define NUM_CPU_CORES (4)
-#define TRUE (1)
-#define FALSE (0)
-
-#define NUM_THREADS (3)
-
-#define T1_PERIOD_MS 20
-#define T2_PERIOD_MS 100
-#define T3_PERIOD_MS 150
-
-#define MS_TO_SEC_FACTOR (double)(1/(double)1000.0)
-
-#define F1_FREQ_HZ (double) (1 / (MS_TO_SEC_FACTOR * (double)T1_PERIOD_MS))
-#define F2_FREQ_HZ (double) (1 / (MS_TO_SEC_FACTOR * (double)T2_PERIOD_MS))
-#define F3_FREQ_HZ (double) (1 / (MS_TO_SEC_FACTOR * (double)T3_PERIOD_MS))
+#include "seqgen3.h"
+#include "seqsched.h"
+#include "seqctl.h"
+#include "seqproc.h"
+#include "seqtelemetry.h"
+#include "seqsoak.h"
+#include "seqjitter.h"
+#include "seqtrace.h"
+#include "seqpipe.h"
+#include "seqframe.h"
+#include "seqtickless.h"
+#include "seqres.h"
+#include "seqspin.h"
+#include "seqbudget.h"
+#include "seqhist.h"
+#include "seqbreak.h"
+#include "seqpower.h"
+#include "seqaper.h"
+#include "seqfault.h"
+#include "seqthread.h"
 
 /* Introduced 2 new defines to isolate, within the syslog file 
  * the area in which the program is logging information 
@@ -131,41 +135,75 @@
 FILE* csvFileOutput = NULL;
 #define CSV_EXTENSION ".csv"
 
-// Of the available user space clocks, CLOCK_MONONTONIC_RAW is typically most precise and not subject to 
-// updates from external timer adjustments
-//
-// However, some POSIX functions like clock_nanosleep can only use adjusted CLOCK_MONOTONIC or CLOCK_REALTIME
-//
-#define MY_CLOCK_TYPE CLOCK_REALTIME
-//#define MY_CLOCK_TYPE CLOCK_MONOTONIC
-//#define MY_CLOCK_TYPE CLOCK_MONOTONIC_RAW
-//#define MY_CLOCK_TYPE CLOCK_REALTIME_COARSE
-//#define MY_CLOCK_TYPE CLOCK_MONTONIC_COARSE
-
-int abortTest=FALSE;
-int abortS1=FALSE, abortS2=FALSE, abortS3=FALSE;
-sem_t semS1, semS2, semS3;
+volatile int abortTest=FALSE;
+volatile int sequencerDone=FALSE;
+threadParams_t threadParams[MAX_SERVICES];
 struct timespec start_time_val;
 double start_realtime;
 unsigned long long sequencePeriods;
 
+static int rt_max_prio, rt_min_prio;
+
 static timer_t timer_1;
 static struct itimerspec itime = {{1,0}, {1,0}};
 static struct itimerspec last_itime;
 
 static unsigned long long seqCnt=0;
 
-typedef struct
-{
-    int threadIdx;
-} threadParams_t;
+// Period of the ticked sequencer, SEQUENCER_PERIOD_MS unless set with -r. A tick
+// shorter than the 1 ms release quantum only keeps time, ticksPerQuantum of them
+// make a release tick.
+static unsigned long long sequencerTickNsec = SEQUENCER_PERIOD_MS * NANOSEC_PER_MSEC;
+static unsigned int ticksPerQuantum = 1;
+
+// How late the sequencer woke up, over the run
+static histogram_t tickLatencyNsec;
+
+// Releases given by the sequencer, next to seqCnt its wakeups
+static unsigned long long sequencerReleases=0;
+
+// Ticked mode: timer expirations that came while the Sequencer still ran, counted
+// in seqCnt without a wakeup of their own
+static unsigned long long lostTicks=0;
+
+// Tickless mode: CLOCK_MONOTONIC time the run ends, the ticked run length
+static unsigned long long ticklessEndNsec;
+
+// Tickless mode: CLOCK_MONOTONIC time the timer is armed for, a release, the end
+// of the run, or a poll for a new table while no service is left
+static unsigned long long ticklessArmedNsec;
+
+// Time the interval timer was armed, the ideal time of tick n is one period later per tick
+static unsigned long long timerStartNsec;
+
+// Same instant on CLOCK_MONOTONIC, the ideal schedule the phase of every release is measured against
+static unsigned long long timerStartMonoNsec;
+
+// RCU-style release table: the sequencer only ever reads activeTable. A new
+// table is handed over through pendingTable and taken by the sequencer at the
+// next hyperperiod boundary, which hands the old one back through retiredTable.
+// The sequencer never waits on the control side and never takes a lock.
+static releaseTable_t releaseTables[2];
+static releaseTable_t *activeTable;
+static releaseTable_t *pendingTable;
+static releaseTable_t *retiredTable;
+
+// Run length unless set with -d, 2000 ticks of the default sequencer
+#define DEFAULT_RUN_SECONDS (20)
+
+// Polling interval while waiting for the sequencer to take a new release table
+#define TABLE_SWAP_POLL_MS (1)
+
 
 
 void Sequencer(int id);
+void TicklessSequencer(int id);
+static void startTicklessSequencer(void);
 
-void *Service_1(void *threadp);
-void *Service_2(void *threadp);
-void *Service_3(void *threadp);
+void *Service(void *threadp);
+static void abortService(int serviceIdx);
+static void joinService(int serviceIdx);
+static unsigned long long printRunSummary(int tickless);
 
 double getTimeMsec(void);
 double realtime(struct timespec *tsptr);
@@ -207,12 +245,72 @@ static inline unsigned ccnt_read (void)
     return cc;
 }
 
-int main(int arg, char* argv[])
+static void usage(const char *program)
+{
+    printf("Usage: %s [-c control_socket_path] [-m] [-s summary_minutes] [-j threshold_usec] [-p] [-b trace_file] [-P seq|data] [-F WxH[@period_ms]] [-T] [-r hz] [-n count] [-d sec] [-R none|inherit|protect] [-U window_sec] [-L usec] [-G keep|performance|max|khz] [-B log|demote|abort] [-A sporadic|deferrable,budget_usec,period_ms[,core]] [-E mean_ms,work_usec] [-I script|random,seed,mean_ms,max_usec]\n", program);
+    printf("  -c path  serve the run-time control socket at path (e.g. %s)\n", CONTROL_SOCKET_PATH);
+    printf("  -m       run every service as a separate process released through shared memory\n");
+    printf("  -s min   soak: run until SIGINT/SIGTERM, one summary per service every min minutes\n");
+    printf("           into %s instead of one syslog line per release\n", SOAK_SUMMARY_PATH);
+    printf("  -j usec  rank the interference sources of releases later than usec\n");
+    printf("  -p       count cycles, instructions, LLC misses, context switches and task clock per release\n");
+    printf("  -b file  write a binary trace record per release into file instead of a syslog line (see seqanalyze)\n");
+    printf("  -P mode  chain the initial services as pipeline stages, later stages released by the sequencer (seq)\n");
+    printf("           or by the stage before them (data); reports per stage and end to end frame latency\n");
+    printf("  -F WxH   with -P, capture WxH frames every period_ms (%d by default) into a preallocated\n", DEFAULT_CAPTURE_PERIOD_MS);
+    printf("           huge page pool, processed in place by the later stages\n");
+    printf("  -T       tickless: one absolute timer for the next due release, periods in usec from %d usec on\n", TICKLESS_MIN_PERIOD_USEC);
+    printf("           (control socket periods in ms or with a us suffix)\n");
+    printf("  -r hz    rate of the ticked sequencer (%d by default), a whole number of ms or a divisor of 1 ms\n", 1000 / SEQUENCER_PERIOD_MS);
+    printf("  -n count start with count services, the initial ones plus logging only services at 2, 5 and\n");
+    printf("           10 release quanta, up to %d\n", MAX_SERVICES);
+    printf("  -d sec   length of the run, %d s by default\n", DEFAULT_RUN_SECONDS);
+    printf("  -R prot  protocol of the shared resource mutexes: none (default), inherit (priority inheritance)\n");
+    printf("           or protect (priority ceiling at the highest service priority)\n");
+    printf("  -U sec   breakdown search: scale every service load from its wcet, bisecting per core for the\n");
+    printf("           highest utilisation without a deadline miss over sec long windows, then stop\n");
+    printf("  -L usec  hold /dev/cpu_dma_latency at usec for the run, keeping the cores out of slower idle states\n");
+    printf("  -G mode  pin cpufreq of the service cores for the run: performance governor, max frequency, a\n");
+    printf("           frequency in kHz, or keep; either option samples the frequency the cores actually ran at\n");
+    printf("  -B act   enforce the declared wcet of every initial service as its execution budget, on a CPU time\n");
+    printf("           timer of the service; a job overrunning it is logged, demoted to the lowest priority or aborted\n");
+    printf("  -A srv   serve aperiodic events with a sporadic or deferrable server of budget_usec every period_ms,\n");
+    printf("           on core 2 unless given, at the RM priority of its period\n");
+    printf("  -E ev    Poisson aperiodic events every mean_ms on average needing work_usec of CPU time on average\n");
+    printf("  -I plan  inject execution spikes, blocking sleeps, core hogs, tick delays and aperiodic bursts from a\n");
+    printf("           script of \"at_ms kind target usec [count every_ms]\" lines, or at random from a seed\n");
+}
+
+// Soak mode, the breakdown search and pinned power settings end on SIGINT/SIGTERM, at the next sequencer tick
+static void stopSoak(int signo)
+{
+    abortTest=TRUE;
+}
+
+// Mode name printed with the release statistics
+#define SERVICE_MODE_NAME ((releaseSegment != NULL) ? "processes" : "threads")
+
+int main(int argc, char* argv[])
 {
     struct timespec current_time_val, current_time_res;
     double current_realtime, current_realtime_res;
-
-    char csvFileName[strlen(argv[0]) + strlen(CSV_EXTENSION)];
+    const char *controlSocketPath = NULL, *tracePath = NULL;
+    serviceModel_t initialSet[MAX_SERVICES + 1];
+    char reason[256];
+    int opt, multiProcess=FALSE, serviceProcess=0, soakMinutes=0, jitterThresholdUsec=0, perfCounters=FALSE;
+    pipelineMode_t pipeline=PIPELINE_OFF;
+    int tickless=FALSE, serviceCount=0, runSeconds=DEFAULT_RUN_SECONDS;
+    unsigned int sequencerRateHz=0, breakdownWindowSec=0;
+    int dmaLatencyUsec=-1, powerControl=FALSE;
+    frequencyPin_t frequencyPin={FREQUENCY_KEEP, 0};
+    budgetAction_t budgetAction=BUDGET_NONE;
+    int aperiodicServer=FALSE, aperiodicEvents=FALSE, faultInjection=FALSE;
+    unsigned long long periodicMisses;
+    unsigned long long serviceCores=0;
+    resourceProtocol_t resourceProtocol=RESOURCE_PLAIN;
+    unsigned int frameWidth=0, frameHeight=0, capturePeriodMs=DEFAULT_CAPTURE_PERIOD_MS;
+
+    char csvFileName[strlen(argv[0]) + strlen(CSV_EXTENSION) + 1];
 
     strcpy(csvFileName, argv[0]);
     strcat(csvFileName, CSV_EXTENSION);
@@ -224,17 +322,263 @@ int main(int arg, char* argv[])
         fprintf(csvFileOutput, "Frequency;Core;ReleaseNumber;ReleaseTime\n");
     }
 
-    int i, rc, scope, flags=0;
+    while((opt = getopt(argc, argv, "c:ms:j:pb:P:F:Tr:n:d:R:U:L:G:B:A:E:I:S:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c':
+                controlSocketPath = optarg;
+                break;
+            case 'm':
+                multiProcess = TRUE;
+                break;
+            case 's':
+                soakMinutes = atoi(optarg);
+                if(soakMinutes <= 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'j':
+                jitterThresholdUsec = atoi(optarg);
+                if(jitterThresholdUsec <= 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'p':
+                perfCounters = TRUE;
+                break;
+            case 'b':
+                tracePath = optarg;
+                break;
+            case 'P':
+                if(strcmp(optarg, "seq") == 0)
+                    pipeline = PIPELINE_SEQUENCER;
+                else if(strcmp(optarg, "data") == 0)
+                    pipeline = PIPELINE_DATA;
+                else
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'F':
+                if(sscanf(optarg, "%ux%u@%u", &frameWidth, &frameHeight, &capturePeriodMs) < 2 ||
+                   frameWidth == 0 || frameHeight == 0 || capturePeriodMs == 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'T':
+                tickless = TRUE;
+                break;
+            case 'r':
+                sequencerRateHz = atoi(optarg);
+                if(sequencerRateHz == 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'n':
+                serviceCount = atoi(optarg);
+                if(serviceCount < 1 || serviceCount > MAX_SERVICES)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'd':
+                runSeconds = atoi(optarg);
+                if(runSeconds <= 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'R':
+                resourceProtocol = resourceProtocolByName(optarg);
+                if(resourceProtocol == NUM_RESOURCE_PROTOCOLS)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'U':
+                breakdownWindowSec = atoi(optarg);
+                if(breakdownWindowSec == 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'L':
+                dmaLatencyUsec = atoi(optarg);
+                powerControl = TRUE;
+                if(dmaLatencyUsec < 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'G':
+                powerControl = TRUE;
+                if(parseFrequencyPin(optarg, &frequencyPin) != 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'B':
+                budgetAction = budgetActionByName(optarg);
+                if(budgetAction == NUM_BUDGET_ACTIONS)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'A':
+                aperiodicServer = TRUE;
+                if(configureAperiodicServer(optarg) != 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'E':
+                aperiodicEvents = TRUE;
+                if(configureAperiodicEvents(optarg) != 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'I':
+                faultInjection = TRUE;
+                if(configureFaults(optarg) != 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            case 'S':
+                // internal: exec'd by the sequencer as the process of service S<n>
+                serviceProcess = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    if(serviceProcess > 0 && serviceProcess <= MAX_SERVICES)
+        return serviceProcessMain(serviceProcess-1);
 
-    cpu_set_t threadcpu;
-    cpu_set_t allcpuset;
+    // the queues between stages live in the memory of the process
+    if(pipeline != PIPELINE_OFF && multiProcess)
+    {
+        printf("Pipeline mode runs the services as threads, -P and -m cannot be combined\n");
+        exit(-1);
+    }
 
-    pthread_t threads[NUM_THREADS];
-    threadParams_t threadParams[NUM_THREADS];
-    pthread_attr_t rt_sched_attr[NUM_THREADS];
-    int rt_max_prio, rt_min_prio, cpuidx;
+    // shared resources are mutexes in the memory of the process
+    if(resourceProtocol != RESOURCE_PLAIN && multiProcess)
+    {
+        printf("Shared resources are locked by service threads, -R and -m cannot be combined\n");
+        exit(-1);
+    }
+
+    // the search owns the loads and the length of the run
+    if(breakdownWindowSec > 0 && (controlSocketPath != NULL || soakMinutes > 0))
+    {
+        printf("The breakdown search sets the service loads and ends the run, -U cannot be combined with -c or -s\n");
+        exit(-1);
+    }
+
+    // the search runs the services beyond their wcet on purpose
+    if(breakdownWindowSec > 0 && budgetAction != BUDGET_NONE)
+    {
+        printf("The breakdown search loads the services beyond their wcet, -U and -B cannot be combined\n");
+        exit(-1);
+    }
+
+    if(aperiodicEvents && !aperiodicServer)
+    {
+        printf("Aperiodic events are served by the aperiodic server, -E needs -A\n");
+        exit(-1);
+    }
+
+    // the server is admitted with the initial set and replenished at the ticks
+    if(aperiodicServer && (controlSocketPath != NULL || tickless))
+    {
+        printf("The aperiodic server is admitted with the initial services and replenished at sequencer ticks, -A cannot be combined with -c or -T\n");
+        exit(-1);
+    }
+
+    // spikes and blocks are taken by service threads, the plan is fired at sequencer ticks
+    if(faultInjection && (multiProcess || tickless))
+    {
+        printf("Faults are injected into service threads at sequencer ticks, -I cannot be combined with -m or -T\n");
+        exit(-1);
+    }
+
+    if(frameWidth > 0 && pipeline == PIPELINE_OFF)
+    {
+        printf("Frames are passed along a pipeline, -F needs -P\n");
+        exit(-1);
+    }
+
+    // every period, including those set later on the control socket, is a multiple of the quantum
+    if(tickless)
+        releaseQuantumMs = TICKLESS_QUANTUM_MS;
+
+    if(sequencerRateHz > 0)
+    {
+        if(tickless)
+        {
+            printf("The tickless sequencer has no rate, -r and -T cannot be combined\n");
+            exit(-1);
+        }
+
+        sequencerTickNsec = NANOSEC_PER_SEC / sequencerRateHz;
+        if((NANOSEC_PER_SEC % sequencerRateHz) != 0 ||
+           (sequencerTickNsec >= NANOSEC_PER_MSEC && (sequencerTickNsec % NANOSEC_PER_MSEC) != 0) ||
+           (sequencerTickNsec < NANOSEC_PER_MSEC && (NANOSEC_PER_MSEC % sequencerTickNsec) != 0))
+        {
+            printf("Sequencer rate %u Hz: the tick must be a whole number of ms or divide 1 ms\n", sequencerRateHz);
+            exit(-1);
+        }
+
+        if(sequencerTickNsec >= NANOSEC_PER_MSEC)
+        {
+            releaseQuantumMs = sequencerTickNsec / NANOSEC_PER_MSEC;
+        }
+        else
+        {
+            releaseQuantumMs = 1;
+            ticksPerQuantum = NANOSEC_PER_MSEC / sequencerTickNsec;
+        }
+    }
+
+    // tickless, a period is any number of usec the sequencer keeps up with
+    periodQuantumUsec = tickless ? 1 : releaseQuantumMs * USEC_PER_MSEC;
+    minPeriodUsec = tickless ? TICKLESS_MIN_PERIOD_USEC : periodQuantumUsec;
+    maxHyperperiodUsec = tickless ? ULLONG_MAX : MAX_HYPERPERIOD_USEC;
+
+    if(frameWidth > 0 && (capturePeriodMs % releaseQuantumMs) != 0)
+    {
+        printf("Capture period %u ms is not a multiple of the %u ms release quantum\n", capturePeriodMs, releaseQuantumMs);
+        exit(-1);
+    }
+
+    int i, rc, scope, flags=0, initialCount;
+
+    cpu_set_t allcpuset;
 
-    struct sched_param rt_param[NUM_THREADS];
     struct sched_param main_param;
 
     pthread_attr_t main_attr;
@@ -249,6 +593,11 @@ int main(int arg, char* argv[])
 
     syslog(LOG_CRIT, START_LOGGGING_PATTERN);
 
+    // Opened before the service processes are exec'd, they inherit it
+    if(tracePath != NULL &&
+       openTrace(tracePath, ((unsigned long long)start_time_val.tv_sec * NANOSEC_PER_SEC) + start_time_val.tv_nsec) != 0)
+        exit(-1);
+
    //timestamp = ccnt_read();
    //printf("timestamp=%u\n", timestamp);
 
@@ -262,12 +611,6 @@ int main(int arg, char* argv[])
    printf("Using CPUS=%d from total available.\n", CPU_COUNT(&allcpuset));
 
 
-    // initialize the sequencer semaphores
-    //
-    if (sem_init (&semS1, 0, 0)) { printf ("Failed to initialize S1 semaphore\n"); exit (-1); }
-    if (sem_init (&semS2, 0, 0)) { printf ("Failed to initialize S2 semaphore\n"); exit (-1); }
-    if (sem_init (&semS3, 0, 0)) { printf ("Failed to initialize S3 semaphore\n"); exit (-1); }
-
     mainpid=getpid();
 
     rt_max_prio = sched_get_priority_max(SCHED_FIFO);
@@ -293,78 +636,76 @@ int main(int arg, char* argv[])
     printf("rt_max_prio=%d\n", rt_max_prio);
     printf("rt_min_prio=%d\n", rt_min_prio);
 
+    // Services become processes attached to the release segment instead of threads
+    if(multiProcess && createReleaseSegment(argv[0]) != 0)
+        exit(-1);
 
-    for(i=0; i < NUM_THREADS; i++)
-    {
-      // run even indexed threads on core 2
-      if(i % 2 == 0)
-      {
-          CPU_ZERO(&threadcpu);
-          cpuidx=(2);
-          CPU_SET(cpuidx, &threadcpu);
-      }
-
-      // run odd indexed threads on core 3
-      else
-      {
-          CPU_ZERO(&threadcpu);
-          cpuidx=(3);
-          CPU_SET(cpuidx, &threadcpu);
-      }
-
-      rc=pthread_attr_init(&rt_sched_attr[i]);
-      rc=pthread_attr_setinheritsched(&rt_sched_attr[i], PTHREAD_EXPLICIT_SCHED);
-      rc=pthread_attr_setschedpolicy(&rt_sched_attr[i], SCHED_FIFO);
-      rc=pthread_attr_setaffinity_np(&rt_sched_attr[i], sizeof(cpu_set_t), &threadcpu);
+    // Services of the thread mode may lock shared resources, the ceiling is the highest service priority
+    if(!multiProcess && createResources(resourceProtocol, rt_max_prio-1) != 0)
+        exit(-1);
 
-      rt_param[i].sched_priority=rt_max_prio-i;
-      pthread_attr_setschedparam(&rt_sched_attr[i], &rt_param[i]);
+    // Live counters for seqmon, before any service starts publishing
+    createTelemetrySegment();
 
-      threadParams[i].threadIdx=i;
+    // Services open their performance counters as they start
+    if(perfCounters)
+    {
+        if(telemetrySegment != NULL)
+            telemetrySegment->perfCounters = TRUE;
+        else
+            printf("Performance counters need the telemetry segment, running without them\n");
     }
-   
-    printf("Service threads will run on %d CPU cores\n", CPU_COUNT(&threadcpu));
+
 
     // Create Service threads which will block awaiting release for:
     //
-
     // Servcie_1 = RT_MAX-1	@ 50 Hz
+    // Service_2 = RT_MAX-2	@ 10 Hz
+    // Service_3 = RT_MAX-3	@ 6.67 Hz
     //
-    rt_param[0].sched_priority=rt_max_prio-1;
-    pthread_attr_setschedparam(&rt_sched_attr[0], &rt_param[0]);
-    rc=pthread_create(&threads[0],               // pointer to thread descriptor
-                      &rt_sched_attr[0],         // use specific attributes
-                      //(void *)0,               // default attributes
-                      Service_1,                 // thread function entry point
-                      (void *)&(threadParams[0]) // parameters to pass in
-                     );
-    if(rc < 0)
-        perror("pthread_create for service 1");
-    else
-        printf("pthread_create successful for service 1\n");
+    // run even indexed threads on core 2, odd indexed threads on core 3
+    initialCount = (serviceCount > 0) ? scaledServiceSet(initialSet, serviceCount) : initialServiceSet(initialSet);
 
+    if(pipeline != PIPELINE_OFF)
+        startPipeline(pipeline, initialCount);
 
-    // Service_2 = RT_MAX-2	@ 10 Hz
-    //
-    rt_param[1].sched_priority=rt_max_prio-2;
-    pthread_attr_setschedparam(&rt_sched_attr[1], &rt_param[1]);
-    rc=pthread_create(&threads[1], &rt_sched_attr[1], Service_2, (void *)&(threadParams[1]));
-    if(rc < 0)
-        perror("pthread_create for service 2");
-    else
-        printf("pthread_create successful for service 2\n");
+    // the capture stage runs at the camera rate
+    if(frameWidth > 0)
+    {
+        if(createFramePool(frameWidth, frameHeight) != 0)
+            exit(-1);
+        setServicePeriod(&initialSet[0], (unsigned long long)capturePeriodMs * USEC_PER_MSEC);
+    }
 
+    // each initial service may use the CPU time it declared per job
+    for(i=0; i < initialCount && budgetAction != BUDGET_NONE; i++)
+    {
+        initialSet[i].budgetUsec = initialSet[i].wcetUsec;
+        initialSet[i].budgetAction = budgetAction;
+    }
 
-    // Service_3 = RT_MAX-3	@ 5 Hz
-    //
-    rt_param[2].sched_priority=rt_max_prio-3;
-    pthread_attr_setschedparam(&rt_sched_attr[2], &rt_param[2]);
-    rc=pthread_create(&threads[2], &rt_sched_attr[2], Service_3, (void *)&(threadParams[2]));
-    if(rc < 0)
-        perror("pthread_create for service 3");
-    else
-        printf("pthread_create successful for service 3\n");
+    // a faster or slower tick changes the release quantum, the initial periods must still fit
+    if(!admitServiceSet(initialSet, initialCount, reason, sizeof(reason)))
+    {
+        printf("Initial service set rejected: %s\n", reason);
+        exit(-1);
+    }
+
+    // the aperiodic server puts demand on its core like one more service
+    if(aperiodicServerModel(&initialSet[initialCount]) &&
+       !admitServiceSet(initialSet, initialCount+1, reason, sizeof(reason)))
+    {
+        printf("Initial service set with the aperiodic server (S%d) rejected: %s\n", MAX_SERVICES+1, reason);
+        exit(-1);
+    }
+
+    for(i=0; i < initialCount; i++)
+    {
+        threadParams[i].model=initialSet[i];
 
+        if(startService(i) != 0)
+            exit(-1);
+    }
 
     // Wait for service threads to initialize and await relese by sequencer.
     //
@@ -373,44 +714,157 @@ int main(int arg, char* argv[])
     // program.
     //
     // sleep(1);
+
+    // The initial release table is installed directly, the sequencer is not running yet
+    buildReleaseTable(&releaseTables[0], initialSet, collectServiceModels(initialSet));
+    activeTable=&releaseTables[0];
+
+    // Non-RT thread accepting register/remove/period commands while the sequencer runs
+    if(controlSocketPath != NULL && startControlThread(controlSocketPath) != 0)
+        exit(-1);
  
     // Create Sequencer thread, which like a cyclic executive, is highest prio
     printf("Start sequencer\n");
-    sequencePeriods=2000;
+    sequencePeriods=((unsigned long long)runSeconds * NANOSEC_PER_SEC) / sequencerTickNsec;
 
-    // Sequencer = RT_MAX	@ 100 Hz
-    //
-    /* set up to signal SIGALRM if timer expires */
-    timer_create(CLOCK_REALTIME, NULL, &timer_1);
+    // Soak: no tick limit, windows start with the ideal schedule
+    if(soakMinutes > 0)
+    {
+        sequencePeriods=ULLONG_MAX;
+        signal(SIGINT, stopSoak);
+        signal(SIGTERM, stopSoak);
 
-    signal(SIGALRM, (void(*)()) Sequencer);
+        if(startSoakThread(soakMinutes) != 0)
+            exit(-1);
+    }
 
+    // Breakdown search: no tick limit, the search stops the run once it is done
+    if(breakdownWindowSec > 0)
+    {
+        sequencePeriods=ULLONG_MAX;
+        signal(SIGINT, stopSoak);
+        signal(SIGTERM, stopSoak);
 
-    /* arm the interval timer */
-    itime.it_interval.tv_sec = 0;
-    itime.it_interval.tv_nsec = 10000000;
-    itime.it_value.tv_sec = 0;
-    itime.it_value.tv_nsec = 10000000;
-    //itime.it_interval.tv_sec = 1;
-    //itime.it_interval.tv_nsec = 0;
-    //itime.it_value.tv_sec = 1;
-    //itime.it_value.tv_nsec = 0;
+        if(startBreakdownThread(breakdownWindowSec) != 0)
+            exit(-1);
+    }
+
+    if(jitterThresholdUsec > 0 && startJitterThread(jitterThresholdUsec) != 0)
+        exit(-1);
 
-    timer_settime(timer_1, flags, &itime, &last_itime);
+    // waits for events before the sequencer gives it any budget back
+    if(aperiodicServer && startAperiodicServer() != 0)
+        exit(-1);
 
+    // after the server, a burst of aperiodic events is posted to it
+    if(faultInjection && startFaultInjection(initialSet, initialCount, runSeconds) != 0)
+        exit(-1);
 
-    for(i=0;i<NUM_THREADS;i++)
+    // The cores the services run on stay in the power state asked for until the run ends
+    if(powerControl)
     {
-        if((rc=pthread_join(threads[i], NULL)) < 0)
-		perror("main pthread_join");
-	else
-		printf("joined thread %d\n", i);
+        for(i=0; i < initialCount; i++)
+            serviceCores |= 1ULL << initialSet[i].core;
+
+        if(startPowerControl(serviceCores, dmaLatencyUsec, &frequencyPin) != 0)
+            exit(-1);
+
+        signal(SIGINT, stopSoak);
+        signal(SIGTERM, stopSoak);
+    }
+
+    // Tickless sequencer: a one shot absolute timer, armed again by every wakeup
+    if(tickless)
+    {
+        startTicklessSequencer();
     }
+    else
+    {
+        // Sequencer = RT_MAX	@ 100 Hz
+        //
+        /* set up to signal SIGALRM if timer expires */
+        timer_create(CLOCK_REALTIME, NULL, &timer_1);
+
+        signal(SIGALRM, (void(*)()) Sequencer);
+
+
+        /* arm the interval timer */
+        itime.it_interval.tv_sec = sequencerTickNsec / NANOSEC_PER_SEC;
+        itime.it_interval.tv_nsec = sequencerTickNsec % NANOSEC_PER_SEC;
+        itime.it_value = itime.it_interval;
+        //itime.it_interval.tv_sec = 1;
+        //itime.it_interval.tv_nsec = 0;
+        //itime.it_value.tv_sec = 1;
+        //itime.it_value.tv_nsec = 0;
+
+        timerStartNsec = nowNsec();
+        timerStartMonoNsec = monotonicNsec();
+        timer_settime(timer_1, flags, &itime, &last_itime);
+    }
+
+
+    if(controlSocketPath != NULL)
+    {
+        // returns once the sequencer is done, after that the service table no longer changes
+        stopControlThread();
+
+        // a service registered while the sequencer was shutting down was not aborted by it
+        for(i=0; i < MAX_SERVICES; i++)
+        {
+            if(threadParams[i].inUse)
+                abortService(i);
+        }
+    }
+
+    for(i=0;i<MAX_SERVICES;i++)
+    {
+        if(threadParams[i].inUse)
+            joinService(i);
+    }
+
+    printf("Sequencer (%s): %llu wakeups for %llu releases, %llu timer expirations lost\n",
+           tickless ? "tickless" : "ticked", seqCnt - lostTicks, sequencerReleases, lostTicks);
+    periodicMisses = printRunSummary(tickless);
+
+    if(aperiodicServer)
+        stopAperiodicServer(periodicMisses);
+
+    if(faultInjection)
+        stopFaultInjection();
+
+    if(breakdownWindowSec > 0)
+        stopBreakdownThread();
+
+    if(powerControl)
+        stopPowerControl();
+
+    printPipelineStats();
+    printResourceStats();
+
+    if(resourcesActive)
+        destroyResources();
+
+    if(framePoolActive)
+        destroyFramePool();
+
+    if(soakMinutes > 0)
+        stopSoakThread();
+
+    if(jitterThresholdUsec > 0)
+        stopJitterThread();
+
+    if(releaseSegment != NULL)
+        destroyReleaseSegment();
+
+    destroyTelemetrySegment();
 
     if(csvFileOutput != NULL){
         fclose(csvFileOutput);
     }
 
+    if(traceFd >= 0)
+        closeTrace();
+
     syslog(LOG_CRIT, STOP_LOGGING_PATTERN);
 
    printf("\nTEST COMPLETE\n");
@@ -419,146 +873,804 @@ int main(int arg, char* argv[])
 
 
 
+// Releases given to a service and not completed yet
+unsigned long long releaseBacklog(int serviceIdx)
+{
+    unsigned long long completed;
+
+    if(releaseSegment != NULL)
+        completed = completedServiceProcess(serviceIdx);
+    else
+        completed = threadParams[serviceIdx].completedCnt;
+
+    return threadParams[serviceIdx].releasedCnt - completed;
+}
+
+// Gives one release to a service, thread or process. Async-signal-safe.
+static inline void releaseService(int serviceIdx, unsigned long long releaseNsec, long long releasePhaseNsec)
+{
+    // also given by the stage before it to a data driven pipeline stage
+    __atomic_add_fetch(&threadParams[serviceIdx].releasedCnt, 1, __ATOMIC_RELEASE);
+
+    if(releaseSegment != NULL)
+    {
+        releaseServiceProcess(serviceIdx, releaseNsec, releasePhaseNsec);
+    }
+    else
+    {
+        threadParams[serviceIdx].releaseNsec = releaseNsec;
+        threadParams[serviceIdx].releasePhaseNsec = releasePhaseNsec;
+        sem_post(&threadParams[serviceIdx].sem);
+    }
+}
+
+// Synchronous abort request, the service exits after handling one last release
+static void abortService(int serviceIdx)
+{
+    if(releaseSegment != NULL)
+    {
+        abortServiceProcess(serviceIdx);
+    }
+    else
+    {
+        threadParams[serviceIdx].abort=TRUE;
+        releaseService(serviceIdx, nowNsec(), 0);
+    }
+}
+
+// Waits for an aborted service to end and prints its release statistics
+static void joinService(int serviceIdx)
+{
+    if(releaseSegment != NULL)
+    {
+        joinServiceProcess(serviceIdx);
+        printReleaseStats(SERVICE_MODE_NAME, serviceIdx, &releaseSegment->gates[serviceIdx].stats);
+        printOverloadActions(serviceIdx, overloadPolicyName(threadParams[serviceIdx].model.policy),
+                             &releaseSegment->gates[serviceIdx].stats,
+                             threadParams[serviceIdx].cappedCnt, threadParams[serviceIdx].degradedCnt);
+        printPerfStats(serviceIdx, &releaseSegment->gates[serviceIdx].stats.perf);
+        printSpinStats(serviceIdx, &releaseSegment->gates[serviceIdx].stats.spin);
+        printBudgetStats(serviceIdx, &releaseSegment->gates[serviceIdx].stats.budget);
+        return;
+    }
+
+    if(pthread_join(threadParams[serviceIdx].thread, NULL) != 0)
+        perror("main pthread_join");
+    else
+        printf("joined thread %d\n", serviceIdx);
+
+    printReleaseStats(SERVICE_MODE_NAME, serviceIdx, &threadParams[serviceIdx].stats);
+    printOverloadActions(serviceIdx, overloadPolicyName(threadParams[serviceIdx].model.policy),
+                         &threadParams[serviceIdx].stats,
+                         threadParams[serviceIdx].cappedCnt, threadParams[serviceIdx].degradedCnt);
+    printPerfStats(serviceIdx, &threadParams[serviceIdx].stats.perf);
+    printBlockingStats(serviceIdx, &threadParams[serviceIdx].stats.blocking);
+    printSpinStats(serviceIdx, &threadParams[serviceIdx].stats.spin);
+    printBudgetStats(serviceIdx, &threadParams[serviceIdx].stats.budget);
+}
+
+// One line summary of the run over all services, what seqsweep.py collects.
+// Returns the deadline misses of all services.
+static unsigned long long printRunSummary(int tickless)
+{
+    const releaseStats_t *stats;
+    unsigned long long releases=0, misses=0, maxLatencyNsec=0, maxIntervalErrorNsec=0;
+    double sumLatencyNsec=0.0, sumSqLatencyNsec=0.0, average=0.0, deviation=0.0;
+    int i, services=0;
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        if(!threadParams[i].inUse)
+            continue;
+
+        stats = (releaseSegment != NULL) ? &releaseSegment->gates[i].stats : &threadParams[i].stats;
+        services++;
+        releases += stats->releases;
+        misses += stats->deadlineMisses;
+        sumLatencyNsec += stats->sumLatencyNsec;
+        sumSqLatencyNsec += stats->sumSqLatencyNsec;
+        if(stats->maxLatencyNsec > maxLatencyNsec)
+            maxLatencyNsec = stats->maxLatencyNsec;
+        if(stats->maxIntervalErrorNsec > maxIntervalErrorNsec)
+            maxIntervalErrorNsec = stats->maxIntervalErrorNsec;
+    }
+
+    if(releases > 0)
+    {
+        average = sumLatencyNsec / releases;
+        deviation = sqrt(fmax(0.0, (sumSqLatencyNsec / releases) - (average * average)));
+    }
+
+    printf("Run summary: services=%d tick_hz=%.1lf wakeups=%llu tick_latency_usec p50=%.1lf p99=%.1lf max=%.1lf releases=%llu release_latency_usec avg=%.1lf jitter=%.1lf max=%.1lf interval_error_usec max=%.1lf misses=%llu\n",
+           services, tickless ? 0.0 : (double)NANOSEC_PER_SEC / sequencerTickNsec, seqCnt - lostTicks,
+           histogramPercentile(&tickLatencyNsec, 50.0) / 1000.0, histogramPercentile(&tickLatencyNsec, 99.0) / 1000.0,
+           tickLatencyNsec.max / 1000.0, releases, average / 1000.0, deviation / 1000.0, maxLatencyNsec / 1000.0,
+           maxIntervalErrorNsec / 1000.0, misses);
+
+    return misses;
+}
+
+// Takes a pending release table at a hyperperiod boundary, returns the table to release from
+static releaseTable_t *takePendingTable(releaseTable_t *table)
+{
+    releaseTable_t *next = __atomic_exchange_n(&pendingTable, NULL, __ATOMIC_ACQ_REL);
+
+    if(next == NULL)
+        return table;
+
+    activeTable = next;
+    // the old table is not referenced anymore once handed back
+    __atomic_store_n(&retiredTable, table, __ATOMIC_RELEASE);
+    return next;
+}
+
+// Most critical level among the services still busy with an earlier release,
+// the degradable services below it are not released this time
+static int lateCriticalityOf(const releaseTable_t *table)
+{
+    int i, serviceIdx, lateCriticality=-1;
+
+    for(i=0; i < table->count; i++)
+    {
+        serviceIdx = table->entries[i].serviceIdx;
+
+        if(threadParams[serviceIdx].model.criticality > lateCriticality && releaseBacklog(serviceIdx) > 0)
+            lateCriticality = threadParams[serviceIdx].model.criticality;
+    }
+
+    return lateCriticality;
+}
+
+// A release of serviceIdx is due: applies its overload policy and releases it
+static void releaseDue(int serviceIdx, unsigned long long releaseNsec, long long phaseNsec,
+                       int lateCriticality, sequencerTelemetry_t *telemetry)
+{
+    unsigned long long backlog;
+
+    if(pipelineDataDriven(serviceIdx))
+        return;
+
+    backlog = releaseBacklog(serviceIdx);
+
+    if(threadParams[serviceIdx].model.policy == OVERLOAD_DEGRADE &&
+       threadParams[serviceIdx].model.criticality < lateCriticality)
+    {
+        threadParams[serviceIdx].degradedCnt++;
+        if(telemetry != NULL)
+            telemetry->degraded[serviceIdx]++;
+        return;
+    }
+
+    if(threadParams[serviceIdx].model.policy == OVERLOAD_CAP &&
+       backlog >= threadParams[serviceIdx].model.backlogCap)
+    {
+        threadParams[serviceIdx].cappedCnt++;
+        if(telemetry != NULL)
+            telemetry->capped[serviceIdx]++;
+        return;
+    }
+
+    if(telemetry != NULL && backlog > 0)
+        telemetry->overruns[serviceIdx]++;
+
+    releaseService(serviceIdx, releaseNsec, phaseNsec);
+    sequencerReleases++;
+}
+
+// Sequencer wakeup bookkeeping, latency is how late it woke for what was due
+static sequencerTelemetry_t *telemetryWakeup(unsigned long long latencyNsec, long long phaseNsec)
+{
+    sequencerTelemetry_t *telemetry;
+
+    histogramRecord(&tickLatencyNsec, latencyNsec);
+
+    if(telemetrySegment == NULL)
+        return NULL;
+
+    telemetry = &telemetrySegment->sequencer;
+    telemetryWriteBegin(&telemetry->seq);
+    telemetry->ticks = seqCnt;
+    telemetry->lastTickLatencyNsec = latencyNsec;
+    if(telemetry->lastTickLatencyNsec > telemetry->maxTickLatencyNsec)
+        telemetry->maxTickLatencyNsec = telemetry->lastTickLatencyNsec;
+    if(telemetrySegment->soakIntervalNsec != 0)
+        soakAccountRelease(&telemetry->window, &telemetry->previous, telemetrySoakWindow(),
+                           telemetry->lastTickLatencyNsec, phaseNsec, 0);
+
+    return telemetry;
+}
+
+// Disarms the timer and shuts down all services, abort flag first so that the last release is also the final one
+static void stopSequencer(void)
+{
+    int i;
+
+    itime.it_interval.tv_sec = 0;
+    itime.it_interval.tv_nsec = 0;
+    itime.it_value.tv_sec = 0;
+    itime.it_value.tv_nsec = 0;
+    timer_settime(timer_1, 0, &itime, &last_itime);
+
+    printf("Disabling sequencer interval timer with abort=%d and %llu of %lld\n", abortTest, seqCnt, sequencePeriods);
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        if(threadParams[i].inUse)
+            abortService(i);
+    }
+
+    sequencerDone=TRUE;
+}
+
 void Sequencer(int id)
 {
     //struct timespec current_time_val;
     //double current_realtime;
-    int flags=0;
+    releaseTable_t *table = activeTable;
+    sequencerTelemetry_t *telemetry;
+    unsigned long long releaseNsec, idealNsec, quantum;
+    long long phaseNsec;
+    int i, lateCriticality, overrun;
 
     // received interval timer signal
            
+    // Expirations while the previous tick still ran (a tick delay, a late
+    // handler) are not signalled again, they are lost along with their
+    // releases but keep seqCnt and the ideal instants on the timer grid
+    overrun = timer_getoverrun(timer_1);
+    if(overrun > 0)
+    {
+        seqCnt += overrun;
+        lostTicks += overrun;
+    }
+
     seqCnt++;
 
+    // faults due at this quantum, a tick delay holds back the stamps like a late wakeup would
+    if((seqCnt % ticksPerQuantum) == 0)
+        injectFaults(seqCnt / ticksPerQuantum);
+
+    releaseNsec = nowNsec();
+    idealNsec = timerStartNsec + (seqCnt * sequencerTickNsec);
+    phaseNsec = (long long)(monotonicNsec() - (timerStartMonoNsec + (seqCnt * sequencerTickNsec)));
+
+    telemetry = telemetryWakeup((releaseNsec > idealNsec) ? (releaseNsec - idealNsec) : 0, phaseNsec);
+
     //clock_gettime(MY_CLOCK_TYPE, &current_time_val); current_realtime=realtime(&current_time_val);
     //printf("Sequencer on core %d for cycle %llu @ sec=%6.9lf\n", sched_getcpu(), seqCnt, current_realtime-start_realtime);
     //syslog(LOG_CRIT, "Sequencer on core %d for cycle %llu @ sec=%6.9lf\n", sched_getcpu(), seqCnt, current_realtime-start_realtime);
 
-    // Release each service at a sub-rate of the generic sequencer rate
+    // Ticks within a release quantum only keep time
+    if((seqCnt % ticksPerQuantum) == 0)
+    {
+        quantum = seqCnt / ticksPerQuantum;
 
-    // Servcie_1 = RT_MAX-1	@ 50 Hz
-    if((seqCnt % (int)(T1_PERIOD_MS / 10)) == 0) sem_post(&semS1); // 2
+        // At a hyperperiod boundary every service of the current table has just
+        // completed its pattern, so a new table can take over without skewing any phase
+        if((quantum % table->hyperperiodTicks) == 0)
+            table = takePendingTable(table);
 
-    // Service_2 = RT_MAX-2	@ 10 Hz
-    if((seqCnt % (int)(T2_PERIOD_MS / 10)) == 0) sem_post(&semS2); // 10
+        lateCriticality = lateCriticalityOf(table);
 
-    // Service_3 = RT_MAX-3	@ 6.66 Hz
-    if((seqCnt % (int)(T3_PERIOD_MS / 10)) == 0) sem_post(&semS3); // 15
+        // Release each service at a sub-rate of the generic sequencer rate
+        for(i=0; i < table->count; i++)
+        {
+            if((quantum % table->entries[i].periodTicks) == 0)
+                releaseDue(table->entries[i].serviceIdx, releaseNsec, phaseNsec, lateCriticality, telemetry);
+        }
+
+        // the aperiodic server gets its budget back at the quantum, like a release
+        replenishAperiodicServer(quantum, monotonicNsec());
+    }
+
+    if(telemetry != NULL)
+        telemetryWriteEnd(&telemetry->seq);
 
     
     if(abortTest || (seqCnt >= sequencePeriods))
+        stopSequencer();
+
+}
+
+static void armTicklessTimer(unsigned long long dueNsec)
+{
+    itime.it_interval.tv_sec = 0;
+    itime.it_interval.tv_nsec = 0;
+    itime.it_value.tv_sec = dueNsec / NANOSEC_PER_SEC;
+    itime.it_value.tv_nsec = dueNsec % NANOSEC_PER_SEC;
+    ticklessArmedNsec = dueNsec;
+    timer_settime(timer_1, TIMER_ABSTIME, &itime, &last_itime);
+}
+
+// Tickless sequencer: woken by the absolute timer at the earliest due release,
+// releases everything due by now and arms the timer for the next one
+void TicklessSequencer(int id)
+{
+    releaseTable_t *table = activeTable;
+    sequencerTelemetry_t *telemetry;
+    unsigned long long nowMonoNsec, dueNsec, releaseNsec, hyperperiodNsec, nextNsec;
+    int serviceIdx, lateCriticality;
+
+    seqCnt++;
+    nowMonoNsec = monotonicNsec();
+    releaseNsec = nowNsec();
+    dueNsec = ticklessArmedNsec;
+
+    telemetry = telemetryWakeup((nowMonoNsec > dueNsec) ? (nowMonoNsec - dueNsec) : 0, (long long)(nowMonoNsec - dueNsec));
+
+    // with no service left no hyperperiod boundary comes, a new table starts at once on its grid
+    if(ticklessNextDue() == ULLONG_MAX && __atomic_load_n(&pendingTable, __ATOMIC_ACQUIRE) != NULL)
     {
-        // disable interval timer
-        itime.it_interval.tv_sec = 0;
-        itime.it_interval.tv_nsec = 0;
-        itime.it_value.tv_sec = 0;
-        itime.it_value.tv_nsec = 0;
-        timer_settime(timer_1, flags, &itime, &last_itime);
+        table = takePendingTable(table);
+        ticklessBuild(table, timerStartMonoNsec, nowMonoNsec);
+    }
+
+    lateCriticality = lateCriticalityOf(table);
+
+    while((dueNsec = ticklessNextDue()) <= nowMonoNsec)
+    {
+        // a hyperperiod boundary of the active table, the new table starts from it on its own grid.
+        // Coprime usec periods can have a hyperperiod of hours, past MAX_HYPERPERIOD_USEC the
+        // swap is at the next release instead: every service stays on its grid from the start
+        // anyway, so at most the longest period goes by before a new table is in.
+        hyperperiodNsec = table->hyperperiodUsec * 1000;
+        if((table->hyperperiodUsec > MAX_HYPERPERIOD_USEC || ((dueNsec - timerStartMonoNsec) % hyperperiodNsec) == 0) &&
+           __atomic_load_n(&pendingTable, __ATOMIC_ACQUIRE) != NULL)
+        {
+            table = takePendingTable(table);
+            ticklessBuild(table, timerStartMonoNsec, dueNsec);
+            lateCriticality = lateCriticalityOf(table);
+            continue;
+        }
 
-	    printf("Disabling sequencer interval timer with abort=%d and %llu of %lld\n", abortTest, seqCnt, sequencePeriods);
+        serviceIdx = ticklessTakeDue(&dueNsec);
+        releaseDue(serviceIdx, releaseNsec, (long long)(nowMonoNsec - dueNsec), lateCriticality, telemetry);
+    }
 
-	    // shutdown all services
-        sem_post(&semS1); sem_post(&semS2); sem_post(&semS3);
+    if(telemetry != NULL)
+        telemetryWriteEnd(&telemetry->seq);
 
-        abortS1=TRUE; abortS2=TRUE; abortS3=TRUE;
+    if(abortTest || nowMonoNsec >= ticklessEndNsec)
+    {
+        stopSequencer();
+        return;
     }
 
+    // the end of the run may come before the next release
+    nextNsec = ticklessNextDue();
+    if(nextNsec == ULLONG_MAX)
+        nextNsec = nowMonoNsec + (TABLE_SWAP_POLL_MS * NANOSEC_PER_MSEC);
+    if(nextNsec > ticklessEndNsec)
+        nextNsec = ticklessEndNsec;
+
+    armTicklessTimer(nextNsec);
 }
 
+static void startTicklessSequencer(void)
+{
+    timer_create(CLOCK_MONOTONIC, NULL, &timer_1);
+    signal(SIGALRM, (void(*)()) TicklessSequencer);
+
+    timerStartNsec = nowNsec();
+    timerStartMonoNsec = monotonicNsec();
+    ticklessEndNsec = (sequencePeriods == ULLONG_MAX) ? ULLONG_MAX :
+                      timerStartMonoNsec + (sequencePeriods * sequencerTickNsec);
+
+    ticklessBuild(activeTable, timerStartMonoNsec, timerStartMonoNsec);
+    armTicklessTimer(ticklessNextDue());
+}
 
 
-void *Service_1(void *threadp)
+
+// Waits on a service semaphore until the MY_CLOCK_TYPE instant untilNsec, 0 if it was taken
+static int semWaitUntil(sem_t *sem, unsigned long long untilNsec)
+{
+    struct timespec until;
+
+    until.tv_sec = untilNsec / NANOSEC_PER_SEC;
+    until.tv_nsec = untilNsec % NANOSEC_PER_SEC;
+
+    while(sem_timedwait(sem, &until) != 0)
+    {
+        if(errno != EINTR)
+            return -1;
+    }
+
+    return 0;
+}
+
+void *Service(void *threadp)
 {
     struct timespec current_time_val;
     double current_realtime;
-    unsigned long long S1Cnt=0;
-    // threadParams_t *threadParams = (threadParams_t *)threadp;
+    unsigned long long releaseCnt=0, handledCnt=0, wakeNsec, releaseNsec, waitNsec, openNsec, execNsec;
+    long long releasePhaseNsec;
+    threadParams_t *service = (threadParams_t *)threadp;
+    perfCounters_t counters;
+    perfSample_t begin, end;
+    spinWindow_t spin = {{0}};
+    spinOutcome_t spun;
+    budgetTimer_t budget;
+    int serviceNum = service->threadIdx + 1, nextStage;
 
     // Start up processing and resource initialization
     clock_gettime(MY_CLOCK_TYPE, &current_time_val); current_realtime=realtime(&current_time_val);
-    syslog(LOG_CRIT, "S1 thread @ sec=%6.9lf\n", current_realtime-start_realtime);
-    printf("S1 thread @ sec=%6.9lf\n", current_realtime-start_realtime);
+    syslog(LOG_CRIT, "S%d thread @ sec=%6.9lf\n", serviceNum, current_realtime-start_realtime);
+    printf("S%d thread @ sec=%6.9lf\n", serviceNum, current_realtime-start_realtime);
 
-    while(!abortS1) // check for synchronous abort request
-    {
-	// wait for service request from the sequencer, a signal handler or ISR in kernel
-        sem_wait(&semS1);
+    // counters of this thread only, none if not enabled or not available
+    perfOpen(&counters);
+    pipelineStageOpen(service->threadIdx);
 
-        S1Cnt++;
+    // on the CPU clock of this thread, the service runs without enforcement if it cannot be created
+    budgetOpen(&budget);
 
-	// DO WORK
+    while(!service->abort) // check for synchronous abort request
+    {
+	// wait for service request from the sequencer, a signal handler or ISR in kernel,
+        // with a spin budget spinning for it once the learned window opens
+        waitNsec = nowNsec();
+        openNsec = spinOpenNsec(&spin, waitNsec, service->model.spinUsec);
+        if(openNsec != ULLONG_MAX && openNsec > waitNsec && semWaitUntil(&service->sem, openNsec) == 0)
+        {
+            spun = SPIN_EARLY;
+        }
+        else
+        {
+            spun = spinForRelease(&spin, &service->stats.spin, &service->releasedCnt, handledCnt, service->model.spinUsec);
+            sem_wait(&service->sem);
+        }
+        handledCnt++;
+
+        // a late service only handles the most recent of its pending releases
+        if(service->model.policy == OVERLOAD_SKIP)
+        {
+            while(sem_trywait(&service->sem) == 0)
+            {
+                handledCnt++;
+                service->stats.skipped++;
+            }
+        }
 
-	// on order of up to milliseconds of latency to get time
-        clock_gettime(MY_CLOCK_TYPE, &current_time_val); current_realtime=realtime(&current_time_val);
-        syslog(LOG_CRIT, "S1 %2.2lf Hz on core %d for release %llu @ sec=%6.9lf\n", F1_FREQ_HZ, sched_getcpu(), S1Cnt, current_realtime-start_realtime);
+        wakeNsec = nowNsec();
+        releaseNsec = service->releaseNsec;
+        releasePhaseNsec = service->releasePhaseNsec;
+        releaseCnt++;
+        perfRead(&counters, &begin);
 
-        if(csvFileOutput!=NULL){
-            // print to csv file
-            fprintf(csvFileOutput, "%2.2lf;%d;%llu;%6.9lf\n", F1_FREQ_HZ, sched_getcpu(), S1Cnt, current_realtime-start_realtime  );
+	// DO WORK
+        budgetArm(&budget, service->model.budgetUsec, service->model.budgetAction);
+        logRelease(service->threadIdx, service->model.periodMs, releaseCnt);
+        injectJobFaults(service->threadIdx, releaseCnt, &budget);
+        serviceJob(&service->model, &service->releasedCnt, handledCnt, &service->stats, &budget);
+        budgetDisarm(&budget, &service->stats.budget);
+        perfRead(&counters, &end);
+
+        // the abort release is not a timed one
+        if(!service->abort)
+        {
+            // accounted once the response time is taken, the counters log line is not part of it
+            execNsec = nowNsec() - wakeNsec;
+            completeRelease(service->threadIdx, &service->stats, &service->model, releaseNsec, wakeNsec, releasePhaseNsec);
+            perfRecordRelease(&service->stats.perf, &counters, service->threadIdx, releaseCnt, execNsec, &begin, &end);
+            spinLearn(&spin, &service->stats.spin, spun, service->model.spinUsec, waitNsec, releaseNsec, wakeNsec);
+
+            nextStage = pipelineRunStage(service->threadIdx, releaseNsec, releaseCnt);
+            if(nextStage >= 0)
+                releaseService(nextStage, nowNsec(), 0);
         }
-
+        __atomic_store_n(&service->completedCnt, handledCnt, __ATOMIC_RELEASE);
     }
 
     // Resource shutdown here
     //
+    budgetClose(&budget);
+    pipelineStageClose(service->threadIdx);
+    perfClose(&counters);
     pthread_exit((void *)0);
 }
 
 
-void *Service_2(void *threadp)
+// Accounts a timed release once its work is done: statistics of the run and live telemetry.
+// A release completed after the next one was due is a deadline miss.
+void completeRelease(int serviceIdx, releaseStats_t *stats, const serviceModel_t *model,
+                     unsigned long long releaseNsec, unsigned long long wakeNsec, long long releasePhaseNsec)
+{
+    unsigned long long latencyNsec, responseNsec;
+    int missed;
+
+    latencyNsec = recordRelease(stats, releaseNsec, wakeNsec, model->periodUsec);
+    responseNsec = nowNsec() - releaseNsec;
+    missed = (responseNsec > model->periodUsec * 1000);
+    stats->deadlineMisses += missed;
+    jitterAccountRelease(serviceIdx, releaseNsec, latencyNsec);
+    faultAccountRelease(serviceIdx, releaseNsec, latencyNsec, responseNsec, missed);
+
+    // the wakeup is late on the ideal schedule by the tick phase plus the release latency
+    telemetryPublishRelease(serviceIdx, model, stats, latencyNsec, releasePhaseNsec + (long long)latencyNsec, missed);
+}
+
+
+// What a job checks between reads of its CPU time
+typedef struct
+{
+    const serviceModel_t *model;
+    const unsigned long long *releasedCnt;
+    unsigned long long handledCnt;
+    const budgetTimer_t *budget;
+    int aborted;
+} jobStop_t;
+
+static int jobStopDue(void *arg)
+{
+    jobStop_t *job = arg;
+
+    if(job->model->policy == OVERLOAD_ABORT && __atomic_load_n(job->releasedCnt, __ATOMIC_ACQUIRE) > job->handledCnt)
+    {
+        job->aborted = TRUE;
+        return TRUE;
+    }
+
+    // counted as an overrun when the budget is disarmed
+    return budgetAbortDue(job->budget);
+}
+
+// Synthetic work of a release: the critical section on its shared resource if
+// any, then model->loadUsec of CPU time (thread CPU time, so time spent
+// preempted does not count). With OVERLOAD_ABORT the job gives up as soon as a
+// newer release than the handledCnt-th is given, with a budget to abort once the
+// budget is used up; the critical section is never aborted.
+void serviceJob(const serviceModel_t *model, const unsigned long long *releasedCnt,
+                unsigned long long handledCnt, releaseStats_t *stats, const budgetTimer_t *budget)
+{
+    jobStop_t job = {model, releasedCnt, handledCnt, budget, FALSE};
+
+    useResource(model->serviceIdx, model->resource, model->criticalSectionUsec, &stats->blocking);
+
+    burnCpuNsec((unsigned long long)model->loadUsec * 1000, jobStopDue, &job);
+
+    if(job.aborted)
+        stats->aborted++;
+}
+
+
+// Logs a release in the format parsed by seqanalyze
+void logRelease(int serviceIdx, unsigned int periodMs, unsigned long long releaseCnt)
 {
     struct timespec current_time_val;
     double current_realtime;
-    unsigned long long S2Cnt=0;
-    // threadParams_t *threadParams = (threadParams_t *)threadp;
 
+    // a soak run would fill the disk, it only writes window summaries
+    if(telemetrySoaking())
+        return;
+
+    if(traceFd >= 0)
+    {
+        traceRelease(serviceIdx, periodMs, releaseCnt, nowNsec());
+        return;
+    }
+
+    // on order of up to milliseconds of latency to get time
     clock_gettime(MY_CLOCK_TYPE, &current_time_val); current_realtime=realtime(&current_time_val);
-    syslog(LOG_CRIT, "S2 thread @ sec=%6.9lf\n", current_realtime-start_realtime);
-    printf("S2 thread @ sec=%6.9lf\n", current_realtime-start_realtime);
+    // the period in ms too, the rounded rate does not give it back
+    syslog(LOG_CRIT, "S%d %2.2lf Hz on core %d for release %llu @ sec=%6.9lf period=%u ms\n", serviceIdx+1, PERIOD_MS_TO_FREQ_HZ(periodMs), sched_getcpu(), releaseCnt, current_realtime-start_realtime, periodMs);
+
+    if(csvFileOutput!=NULL){
+        // print to csv file
+        fprintf(csvFileOutput, "%2.2lf;%d;%llu;%6.9lf\n", PERIOD_MS_TO_FREQ_HZ(periodMs), sched_getcpu(), releaseCnt, current_realtime-start_realtime  );
+    }
+}
+
 
-    while(!abortS2)
+// RM priority of a model: one level below the sequencer for the highest rate,
+// one more level down for each registered service, or the aperiodic server,
+// with a higher rate
+int rmPriorityOfModel(const serviceModel_t *model)
+{
+    int i, rank=0;
+
+    for(i=0; i < MAX_SERVICES; i++)
     {
-        sem_wait(&semS2);
-        S2Cnt++;
+        if(i != model->serviceIdx && threadParams[i].inUse &&
+           rmHigherPriority(&threadParams[i].model, model))
+            rank++;
+    }
+
+    if(aperiodicServerOutranks(model))
+        rank++;
 
-        clock_gettime(MY_CLOCK_TYPE, &current_time_val); current_realtime=realtime(&current_time_val);
-        syslog(LOG_CRIT, "S2 %2.2lf Hz on core %d for release %llu @ sec=%6.9lf\n", F2_FREQ_HZ, sched_getcpu(), S2Cnt, current_realtime-start_realtime);
+    // beyond the range of SCHED_FIFO the slowest services share the lowest priority
+    if(rank > rt_max_prio - 1 - rt_min_prio)
+        return rt_min_prio;
 
-        if(csvFileOutput!=NULL){
-            // print to csv file
-            fprintf(csvFileOutput, "%2.2lf;%d;%llu;%6.9lf\n", F2_FREQ_HZ, sched_getcpu(), S2Cnt, current_realtime-start_realtime  );
+    return rt_max_prio - 1 - rank;
+}
+
+static int rmPriorityOf(int serviceIdx)
+{
+    return rmPriorityOfModel(&threadParams[serviceIdx].model);
+}
+
+// Brings the priority of every running service in line with its current period
+void assignRmPriorities(void)
+{
+    int i, priority;
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        if(!threadParams[i].inUse)
+            continue;
+
+        priority = rmPriorityOf(i);
+        if(priority != threadParams[i].priority)
+        {
+            threadParams[i].priority = priority;
+
+            if(releaseSegment != NULL)
+                setServiceProcessPriority(i, priority);
+            else
+                pthread_setschedprio(threadParams[i].thread, priority);
         }
     }
+}
 
-    pthread_exit((void *)0);
+// Creates the thread (or process) of the service whose model is filled in threadParams[serviceIdx]
+// (SCHED_FIFO, pinned to its core, RM priority) and demotes the slower ones
+int startService(int serviceIdx)
+{
+    threadParams_t *service = &threadParams[serviceIdx];
+    pthread_attr_t rt_sched_attr;
+    struct sched_param rt_param;
+    cpu_set_t threadcpu;
+    int rc;
+
+    service->threadIdx=serviceIdx;
+    service->abort=FALSE;
+    service->releasedCnt=0;
+    service->completedCnt=0;
+    service->cappedCnt=0;
+    service->degradedCnt=0;
+    memset(&service->stats, 0, sizeof(service->stats));
+    telemetryResetService(serviceIdx);
+
+    if(releaseSegment != NULL)
+    {
+        service->priority=rmPriorityOf(serviceIdx);
+        if(startServiceProcess(serviceIdx) != 0)
+            return -1;
+
+        printf("fork successful for service %d\n", serviceIdx+1);
+        service->inUse=TRUE;
+        assignRmPriorities();
+        return 0;
+    }
+
+    if (sem_init (&service->sem, 0, 0)) { printf ("Failed to initialize S%d semaphore\n", serviceIdx+1); return -1; }
+
+    CPU_ZERO(&threadcpu);
+    CPU_SET(service->model.core, &threadcpu);
+
+    rc=pthread_attr_init(&rt_sched_attr);
+    rc=pthread_attr_setinheritsched(&rt_sched_attr, PTHREAD_EXPLICIT_SCHED);
+    rc=pthread_attr_setschedpolicy(&rt_sched_attr, SCHED_FIFO);
+    rc=pthread_attr_setaffinity_np(&rt_sched_attr, sizeof(cpu_set_t), &threadcpu);
+
+    service->priority=rmPriorityOf(serviceIdx);
+    rt_param.sched_priority=service->priority;
+    pthread_attr_setschedparam(&rt_sched_attr, &rt_param);
+
+    rc=startRtThread(&service->thread,          // pointer to thread descriptor
+                     &rt_sched_attr,            // use specific attributes
+                     Service,                   // thread function entry point
+                     (void *)service            // parameters to pass in
+                    );
+    pthread_attr_destroy(&rt_sched_attr);
+
+    if(rc != 0)
+    {
+        errno=rc;
+        perror("pthread_create for service");
+        sem_destroy(&service->sem);
+        return -1;
+    }
+
+    printf("pthread_create successful for service %d\n", serviceIdx+1);
+    service->inUse=TRUE;
+    assignRmPriorities();
+
+    return 0;
 }
 
+// Aborts and joins a service that the sequencer no longer releases
+void stopService(int serviceIdx)
+{
+    threadParams_t *service = &threadParams[serviceIdx];
+
+    abortService(serviceIdx);
+    joinService(serviceIdx);
 
-void *Service_3(void *threadp)
+    service->inUse=FALSE;
+    if(releaseSegment == NULL)
+        sem_destroy(&service->sem);
+    assignRmPriorities();
+}
+
+// New model of a running service (for a new period, once the sequencer already
+// releases it at that rate). Single fields are read by the sequencer and the
+// service as they go, priorities follow the period.
+void updateServiceModel(int serviceIdx, const serviceModel_t *model)
 {
-    struct timespec current_time_val;
-    double current_realtime;
-    unsigned long long S3Cnt=0;
-    // threadParams_t *threadParams = (threadParams_t *)threadp;
+    threadParams[serviceIdx].model = *model;
 
-    clock_gettime(MY_CLOCK_TYPE, &current_time_val); current_realtime=realtime(&current_time_val);
-    syslog(LOG_CRIT, "S3 thread @ sec=%6.9lf\n", current_realtime-start_realtime);
-    printf("S3 thread @ sec=%6.9lf\n", current_realtime-start_realtime);
+    if(releaseSegment != NULL)
+        releaseSegment->gates[serviceIdx].model = *model;
 
-    while(!abortS3)
+    assignRmPriorities();
+}
+
+// Copies the model of every registered service into set, returns how many
+int collectServiceModels(serviceModel_t *set)
+{
+    int i, count=0;
+
+    for(i=0; i < MAX_SERVICES; i++)
     {
-        sem_wait(&semS3);
-        S3Cnt++;
+        if(threadParams[i].inUse)
+            set[count++] = threadParams[i].model;
+    }
+
+    return count;
+}
+
+void buildReleaseTable(releaseTable_t *table, const serviceModel_t *set, int count)
+{
+    int i;
 
-        clock_gettime(MY_CLOCK_TYPE, &current_time_val); current_realtime=realtime(&current_time_val);
-        syslog(LOG_CRIT, "S3 %2.2lf Hz on core %d for release %llu @ sec=%6.9lf\n", F3_FREQ_HZ, sched_getcpu(), S3Cnt, current_realtime-start_realtime);
-        if(csvFileOutput!=NULL){
-            // print to csv file
-            fprintf(csvFileOutput, "%2.2lf;%d;%llu;%6.9lf\n", F3_FREQ_HZ, sched_getcpu(), S3Cnt, current_realtime-start_realtime  );
+    table->count = count;
+    table->hyperperiodTicks = hyperperiodTicks(set, count);
+    table->hyperperiodUsec = hyperperiodUsec(set, count);
+
+    for(i=0; i < count; i++)
+    {
+        table->entries[i].serviceIdx = set[i].serviceIdx;
+        table->entries[i].periodTicks = set[i].periodUsec / ((unsigned long long)releaseQuantumMs * USEC_PER_MSEC);
+        table->entries[i].periodUsec = set[i].periodUsec;
+    }
+}
+
+// Hands a new release table to the sequencer and waits until it is in use.
+// Only one caller at a time (the control thread). Returns 0 once the sequencer
+// releases from the new table, -1 if it stopped before reaching a boundary.
+int publishReleaseTable(const releaseTable_t *table)
+{
+    releaseTable_t *spare, *withdrawn;
+    struct timespec poll = {0, TABLE_SWAP_POLL_MS * NANOSEC_PER_MSEC};
+
+    // the active table is stable here, no swap is in progress
+    spare = (activeTable == &releaseTables[0]) ? &releaseTables[1] : &releaseTables[0];
+    *spare = *table;
+
+    __atomic_store_n(&retiredTable, NULL, __ATOMIC_RELAXED);
+    __atomic_store_n(&pendingTable, spare, __ATOMIC_RELEASE);
+
+    while(__atomic_load_n(&retiredTable, __ATOMIC_ACQUIRE) == NULL)
+    {
+        if(sequencerDone)
+        {
+            withdrawn = __atomic_exchange_n(&pendingTable, NULL, __ATOMIC_ACQ_REL);
+
+            // taken in the very last tick, the swap did happen
+            if(withdrawn == NULL)
+                break;
+
+            return -1;
         }
 
+        nanosleep(&poll, NULL);
     }
 
-    pthread_exit((void *)0);
+    __atomic_store_n(&retiredTable, NULL, __ATOMIC_RELAXED);
+    return 0;
 }
 
 double getTimeMsec(void)
@@ -598,4 +1710,3 @@ void print_scheduler(void)
            break;
    }
 }
-
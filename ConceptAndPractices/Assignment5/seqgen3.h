@@ -0,0 +1,148 @@
+// Shared declarations of the seqgen3 sequencer and of its companion modules
+//
+// The service set used to be three hard-coded threads (Service_1..3). It is now
+// a table of up to MAX_SERVICES slots, so services can be registered, removed and
+// re-periodized while the sequencer runs (see seqctl.c).
+
+#ifndef SEQGEN3_H
+#define SEQGEN3_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define USEC_PER_MSEC (1000)
+#define NANOSEC_PER_MSEC (1000000)
+#define NANOSEC_PER_SEC (1000000000)
+#define NUM_CPU_CORES (4)
+#define TRUE (1)
+#define FALSE (0)
+
+// Maximum number of services the sequencer can release
+#define MAX_SERVICES (256)
+
+// The sequencer is driven by a 100 Hz interval timer by default, all periods are multiples of it
+#define SEQUENCER_PERIOD_MS (10)
+
+// Longest hyperperiod accepted for a service set, so a release table swap never waits for minutes
+#define MAX_HYPERPERIOD_TICKS (6000)
+#define MAX_HYPERPERIOD_USEC ((unsigned long long)MAX_HYPERPERIOD_TICKS * SEQUENCER_PERIOD_MS * USEC_PER_MSEC)
+
+// Of the available user space clocks, CLOCK_MONONTONIC_RAW is typically most precise and not subject to
+// updates from external timer adjustments
+//
+// However, some POSIX functions like clock_nanosleep can only use adjusted CLOCK_MONOTONIC or CLOCK_REALTIME
+//
+#define MY_CLOCK_TYPE CLOCK_REALTIME
+//#define MY_CLOCK_TYPE CLOCK_MONOTONIC
+//#define MY_CLOCK_TYPE CLOCK_MONOTONIC_RAW
+//#define MY_CLOCK_TYPE CLOCK_REALTIME_COARSE
+//#define MY_CLOCK_TYPE CLOCK_MONTONIC_COARSE
+
+#define MS_TO_SEC_FACTOR (double)(1/(double)1000.0)
+
+#define PERIOD_MS_TO_FREQ_HZ(periodMs) (double) (1 / (MS_TO_SEC_FACTOR * (double)(periodMs)))
+
+#include "seqstats.h"
+
+// What happens to the releases of a service that runs late
+typedef enum
+{
+    OVERLOAD_QUEUE,          // every release is handled, late ones back to back (plain sem_post)
+    OVERLOAD_SKIP,           // a late service skips to its latest release
+    OVERLOAD_CAP,            // at most backlogCap releases pending, the sequencer refuses further ones
+    OVERLOAD_ABORT,          // a new release aborts the job still running
+    OVERLOAD_DEGRADE,        // not released while a service of higher criticality is late
+    NUM_OVERLOAD_POLICIES
+} overloadPolicy_t;
+
+// Overload handling of a service until told otherwise
+#define DEFAULT_BACKLOG_CAP (1)
+#define DEFAULT_CRITICALITY (0)
+
+// Timing model of a service: what admission control and priority assignment look at
+typedef struct
+{
+    int serviceIdx;          // slot in the service table, the service is logged as S<serviceIdx+1>
+    unsigned int periodMs;   // release period in whole ms, as logged and reported (setServicePeriod)
+    unsigned long long periodUsec;  // the same period in usec, what is released and admitted on;
+                             // finer than 1 ms only when tickless, periodMs is then rounded
+    unsigned int wcetUsec;   // declared worst case execution time of one release
+    int core;                // core the service is pinned to
+    unsigned int loadUsec;   // synthetic CPU time burned by each release, 0 for logging only
+    overloadPolicy_t policy;
+    unsigned int backlogCap; // pending releases allowed with OVERLOAD_CAP
+    int criticality;         // higher is more critical, for OVERLOAD_DEGRADE
+    int resource;            // shared resource locked by each release (seqres.h), -1 for none
+    unsigned int criticalSectionUsec;  // CPU time the resource is held for
+    unsigned int spinUsec;   // longest spin for a release before blocking (seqspin.h), 0 to block at once
+    unsigned int budgetUsec; // CPU time a job may use before budgetAction (seqbudget.h), 0 for no budget
+    budgetAction_t budgetAction;
+} serviceModel_t;
+
+// One slot of the service table, also the parameter passed to the service thread
+typedef struct
+{
+    int threadIdx;
+    volatile int inUse;      // slot holds a registered service
+    volatile int abort;      // synchronous abort request, checked after each release
+    serviceModel_t model;
+    int priority;            // SCHED_FIFO priority, assigned rate monotonic
+    sem_t sem;               // given by the sequencer at every release
+    pthread_t thread;
+    pid_t pid;               // service process in multi-process mode
+    volatile unsigned long long releaseNsec;  // stamp of the latest release
+    volatile long long releasePhaseNsec;      // its sequencer tick vs the ideal CLOCK_MONOTONIC schedule
+    unsigned long long releasedCnt;           // releases given, written by the sequencer only
+    volatile unsigned long long completedCnt; // releases completed, written by the service only
+    unsigned long long cappedCnt;             // releases refused by OVERLOAD_CAP, by the sequencer
+    unsigned long long degradedCnt;           // releases dropped by OVERLOAD_DEGRADE, by the sequencer
+    releaseStats_t stats;
+} threadParams_t;
+
+// One service to release, and how often, in sequencer ticks
+typedef struct
+{
+    int serviceIdx;
+    unsigned int periodTicks;
+    unsigned long long periodUsec;   // the tickless sequencer releases on it
+} releaseEntry_t;
+
+// Release table read by the sequencer at every tick.
+// It is never modified while in use: changes are made on a copy which is
+// swapped in by the sequencer itself at a hyperperiod boundary.
+typedef struct
+{
+    int count;
+    unsigned long long hyperperiodTicks;
+    unsigned long long hyperperiodUsec;
+    releaseEntry_t entries[MAX_SERVICES];
+} releaseTable_t;
+
+extern threadParams_t threadParams[MAX_SERVICES];
+extern double start_realtime;
+extern volatile int sequencerDone;
+extern volatile int abortTest;
+
+double getTimeMsec(void);
+double realtime(struct timespec *tsptr);
+void logRelease(int serviceIdx, unsigned int periodMs, unsigned long long releaseCnt);
+void completeRelease(int serviceIdx, releaseStats_t *stats, const serviceModel_t *model,
+                     unsigned long long releaseNsec, unsigned long long wakeNsec, long long releasePhaseNsec);
+void serviceJob(const serviceModel_t *model, const unsigned long long *releasedCnt,
+                unsigned long long handledCnt, releaseStats_t *stats, const budgetTimer_t *budget);
+const char *overloadPolicyName(overloadPolicy_t policy);
+
+// Service lifecycle, implemented in seqgen3.c
+int startService(int serviceIdx);
+void stopService(int serviceIdx);
+void updateServiceModel(int serviceIdx, const serviceModel_t *model);
+void assignRmPriorities(void);
+int rmPriorityOfModel(const serviceModel_t *model);
+int collectServiceModels(serviceModel_t *set);
+unsigned long long releaseBacklog(int serviceIdx);
+void buildReleaseTable(releaseTable_t *table, const serviceModel_t *set, int count);
+int publishReleaseTable(const releaseTable_t *table);
+
+#endif
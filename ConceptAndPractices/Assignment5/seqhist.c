@@ -0,0 +1,60 @@
+// Log-linear histogram of nanosecond values
+
+#include <math.h>
+
+#include "seqhist.h"
+
+static int histogramBucket(unsigned long long value)
+{
+    int exponent;
+
+    if(value < HIST_SUB_BUCKETS)
+        return value;
+
+    exponent = 63 - __builtin_clzll(value);
+    return ((exponent - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS) + ((value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+// Middle of the values falling into a bucket
+static double histogramValue(int bucket)
+{
+    int exponent = (bucket / HIST_SUB_BUCKETS) + HIST_SUB_BITS - 1;
+    unsigned long long width;
+
+    if(bucket < HIST_SUB_BUCKETS)
+        return bucket;
+
+    width = 1ULL << (exponent - HIST_SUB_BITS);
+    return (double)((HIST_SUB_BUCKETS + (bucket % HIST_SUB_BUCKETS)) * width) + ((width - 1) / 2.0);
+}
+
+void histogramRecord(histogram_t *histogram, unsigned long long value)
+{
+    histogram->buckets[histogramBucket(value)]++;
+    histogram->count++;
+    if(value > histogram->max)
+        histogram->max = value;
+}
+
+// Percentile in (0, 100], never above the largest value recorded, 0 if empty
+double histogramPercentile(const histogram_t *histogram, double percentile)
+{
+    unsigned long long rank, cumulative = 0;
+    int bucket;
+
+    if(histogram->count == 0)
+        return 0.0;
+
+    rank = (unsigned long long)ceil(histogram->count * percentile / 100.0);
+    if(rank == 0)
+        rank = 1;
+
+    for(bucket=0; bucket < HIST_BUCKETS; bucket++)
+    {
+        cumulative += histogram->buckets[bucket];
+        if(cumulative >= rank)
+            return fmin(histogramValue(bucket), (double)histogram->max);
+    }
+
+    return (double)histogram->max;
+}
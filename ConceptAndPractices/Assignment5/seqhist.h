@@ -0,0 +1,24 @@
+// Log-linear histogram of nanosecond values, for percentiles in constant memory
+//
+// Values below HIST_SUB_BUCKETS have a bucket each, above that every power of
+// two is split into HIST_SUB_BUCKETS buckets, so a percentile is within about
+// 3% of the true value whatever its magnitude. A histogram has a single writer.
+
+#ifndef SEQHIST_H
+#define SEQHIST_H
+
+#define HIST_SUB_BITS (4)
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct
+{
+    unsigned long long count;
+    unsigned long long max;
+    unsigned long long buckets[HIST_BUCKETS];
+} histogram_t;
+
+void histogramRecord(histogram_t *histogram, unsigned long long value);
+double histogramPercentile(const histogram_t *histogram, double percentile);
+
+#endif
@@ -0,0 +1,1010 @@
+// seqisol - preflight of the real-time cores of seqgen3 and fifothreads
+//
+// The services of seqgen3 are pinned to cores 2 and 3 and the threads of
+// fifothreads to core 3, but nothing keeps the rest of the system off those
+// cores. seqisol reports every setting that leaves one of them unshielded:
+//
+//   - not in isolcpus (/sys/devices/system/cpu/isolated), so the scheduler
+//     balances other tasks onto it
+//   - not in nohz_full, so the scheduler tick keeps interrupting it
+//   - RCU callbacks not offloaded (rcu_nocbs, or implied by nohz_full)
+//   - irqbalance running, it rewrites IRQ affinities behind our back
+//   - every IRQ whose affinity includes the core
+//   - every unbound kernel thread allowed on the core, and the unbound
+//     workqueue cpumask
+//
+// and measures the wakeup latency of a SCHED_FIFO thread on each core, a
+// 1 ms absolute CLOCK_MONOTONIC sleep like cyclictest.
+//
+// With -s it also shields the cores for the length of its run: a cgroup v2
+// cpuset partition holding only them (isolated, or root if the kernel has no
+// isolated partitions), every movable IRQ, the unbound workqueues and every
+// unbound kernel thread moved to the other cores. The partition is a threaded
+// cgroup under the root cgroup, which is left with the housekeeping cores:
+// seqisol moves itself into the root cgroup and starts the command from there,
+// and only the threads pinned to an RT core are admitted to the partition,
+// through its cgroup.threads (see seqthread.h). The sequencer, the helper
+// threads and everything else of the command stay on the housekeeping cores.
+// The checks and the latency are then repeated, the command given after the
+// options runs, and every setting is restored on exit.
+//
+// Usage: seqisol [-c cpus] [-s] [-d seconds] [command [args]]
+//
+//   sudo ./seqisol -s ./seqgen3
+//   sudo ./seqisol -c 3 -s ../Assignment3/fifothreads
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/sysinfo.h>
+
+#include "seqgen3.h"
+#include "seqhist.h"
+#include "seqthread.h"
+
+// The cores seqgen3 pins its services to
+#define DEFAULT_RT_CPUS "2,3"
+
+// Length of each latency measurement, 0 to skip it
+#define DEFAULT_PROBE_SEC (5)
+#define PROBE_PERIOD_NSEC (1000000ULL)
+
+#define ISOLATED_CPUS_PATH "/sys/devices/system/cpu/isolated"
+#define NOHZ_FULL_CPUS_PATH "/sys/devices/system/cpu/nohz_full"
+#define KERNEL_CMDLINE_PATH "/proc/cmdline"
+#define IRQ_DIR "/proc/irq"
+#define DEFAULT_IRQ_AFFINITY_PATH "/proc/irq/default_smp_affinity"
+#define WORKQUEUE_CPUMASK_PATH "/sys/devices/virtual/workqueue/cpumask"
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#define SHIELD_CGROUP CGROUP_ROOT "/seqisol"
+
+// kthreadd, the parent of every kernel thread
+#define KTHREADD_PID (2)
+
+#define LINE_MAX_LEN (4096)
+#define MAX_SAVED_IRQS (4096)
+#define MAX_SAVED_KTHREADS (4096)
+
+// A cpuset partition is gone once rmdir succeeds, which waits for the last task to leave
+#define RMDIR_RETRIES (50)
+#define RMDIR_RETRY_MS (20)
+
+typedef struct
+{
+    int cpu;
+    unsigned int seconds;
+    int fifo;                          // SCHED_FIFO could be set
+    histogram_t latency;
+    pthread_t thread;
+} probe_t;
+
+typedef struct
+{
+    int irq;
+    char affinity[LINE_MAX_LEN];
+} savedIrq_t;
+
+typedef struct
+{
+    pid_t pid;
+    cpu_set_t allowed;
+} savedKthread_t;
+
+static cpu_set_t rtCpus, housekeepingCpus;
+static int configuredCpus;
+static volatile sig_atomic_t interrupted = FALSE;
+
+// Shield state to restore, only what was actually changed
+static savedIrq_t savedIrqs[MAX_SAVED_IRQS];
+static int savedIrqCount;
+static savedKthread_t savedKthreads[MAX_SAVED_KTHREADS];
+static int savedKthreadCount;
+static char savedDefaultIrqAffinity[LINE_MAX_LEN];
+static char savedWorkqueueMask[LINE_MAX_LEN];
+static char originalCgroup[LINE_MAX_LEN];
+static int cpusetEnabledByUs, shieldCgroupCreated, movedToHousekeeping;
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [-c cpus] [-s] [-d seconds] [command [args]]\n", program);
+    printf("  -c cpus     real-time cores to check, a list like 2,3 or 1-3 (%s by default)\n", DEFAULT_RT_CPUS);
+    printf("  -s          shield the cores for the run: cpuset partition, IRQs, workqueues and kernel threads\n");
+    printf("              moved off them, all restored on exit\n");
+    printf("  -d seconds  length of each wakeup latency measurement, %d by default, 0 for none\n", DEFAULT_PROBE_SEC);
+    printf("  command     run once the checks are done, with -s on the housekeeping cores but for the threads\n");
+    printf("              it pins to an RT core, which are admitted to the partition\n");
+}
+
+static void stopOnSignal(int signo)
+{
+    interrupted = TRUE;
+}
+
+// Reads the first line of a sysfs or procfs file, without its newline
+static int readLine(const char *path, char *line, size_t len)
+{
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL)
+        return -1;
+
+    if(fgets(line, len, file) == NULL)
+        line[0] = '\0';
+    fclose(file);
+
+    line[strcspn(line, "\n")] = '\0';
+    return 0;
+}
+
+// One write of value, as sysfs and procfs expect
+static int writeValue(const char *path, const char *value)
+{
+    int fd = open(path, O_WRONLY), rc = 0;
+
+    if(fd < 0)
+        return -1;
+
+    if(write(fd, value, strlen(value)) < 0)
+        rc = -1;
+
+    close(fd);
+    return rc;
+}
+
+// "0-2,5" into a CPU set, an empty list or "(null)" is the empty set
+static int parseCpuList(const char *list, cpu_set_t *set)
+{
+    const char *cursor = list;
+    char *end;
+    long first, last, cpu;
+
+    CPU_ZERO(set);
+
+    if(strcmp(list, "(null)") == 0)
+        return 0;
+
+    while(*cursor != '\0')
+    {
+        first = strtol(cursor, &end, 10);
+        if(end == cursor || first < 0)
+            return -1;
+
+        last = first;
+        cursor = end;
+        if(*cursor == '-')
+        {
+            cursor++;
+            last = strtol(cursor, &end, 10);
+            if(end == cursor || last < first)
+                return -1;
+            cursor = end;
+        }
+
+        for(cpu=first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+
+        if(*cursor == ',')
+            cursor++;
+        else if(*cursor != '\0')
+            return -1;
+    }
+
+    return 0;
+}
+
+static void formatCpuList(const cpu_set_t *set, char *list, size_t len)
+{
+    size_t used = 0;
+    int cpu, last;
+
+    list[0] = '\0';
+
+    for(cpu=0; cpu < CPU_SETSIZE && used < len; cpu++)
+    {
+        if(!CPU_ISSET(cpu, set))
+            continue;
+
+        for(last=cpu; last+1 < CPU_SETSIZE && CPU_ISSET(last+1, set); last++);
+
+        if(last == cpu)
+            used += snprintf(list + used, len - used, "%s%d", (used > 0) ? "," : "", cpu);
+        else
+            used += snprintf(list + used, len - used, "%s%d-%d", (used > 0) ? "," : "", cpu, last);
+
+        cpu = last;
+    }
+}
+
+// Hex bitmap, 32 CPUs per comma separated group, as the kernel writes cpumasks
+static void formatCpuMask(const cpu_set_t *set, char *mask, size_t len)
+{
+    size_t used = 0;
+    unsigned int group;
+    int groups = (configuredCpus + 31) / 32, g, bit;
+
+    mask[0] = '\0';
+
+    for(g=groups-1; g >= 0 && used < len; g--)
+    {
+        group = 0;
+        for(bit=0; bit < 32; bit++)
+        {
+            if(CPU_ISSET((g * 32) + bit, set))
+                group |= 1U << bit;
+        }
+
+        used += snprintf(mask + used, len - used, "%s%08x", (g < groups-1) ? "," : "", group);
+    }
+}
+
+// Hex bitmap back into a CPU set
+static int parseCpuMask(const char *mask, cpu_set_t *set)
+{
+    int cpu = 0, i, bit, digit;
+
+    CPU_ZERO(set);
+
+    for(i=strlen(mask)-1; i >= 0; i--)
+    {
+        if(mask[i] == ',')
+            continue;
+
+        if(mask[i] >= '0' && mask[i] <= '9')
+            digit = mask[i] - '0';
+        else if(mask[i] >= 'a' && mask[i] <= 'f')
+            digit = mask[i] - 'a' + 10;
+        else
+            return -1;
+
+        for(bit=0; bit < 4; bit++, cpu++)
+        {
+            if((digit & (1 << bit)) && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, set);
+        }
+    }
+
+    return 0;
+}
+
+// RT cores found in set, as a list
+static int rtCpusIn(const cpu_set_t *set, char *list, size_t len)
+{
+    cpu_set_t overlap;
+
+    CPU_AND(&overlap, set, &rtCpus);
+    formatCpuList(&overlap, list, len);
+
+    return CPU_COUNT(&overlap);
+}
+
+// RT cores missing from set, as a list
+static int rtCpusNotIn(const cpu_set_t *set, char *list, size_t len)
+{
+    cpu_set_t missing;
+
+    CPU_XOR(&missing, set, &rtCpus);
+    CPU_AND(&missing, &missing, &rtCpus);
+    formatCpuList(&missing, list, len);
+
+    return CPU_COUNT(&missing);
+}
+
+// The value of a name=value parameter of the kernel command line, NULL if absent
+static const char *kernelParameter(const char *cmdline, const char *name, char *value, size_t len)
+{
+    const char *cursor = cmdline;
+    size_t nameLen = strlen(name);
+
+    while((cursor = strstr(cursor, name)) != NULL)
+    {
+        if((cursor == cmdline || cursor[-1] == ' ') && cursor[nameLen] == '=')
+        {
+            cursor += nameLen + 1;
+            snprintf(value, len, "%.*s", (int)strcspn(cursor, " "), cursor);
+            return value;
+        }
+        cursor += nameLen;
+    }
+
+    return NULL;
+}
+
+static pid_t irqbalancePid(void)
+{
+    char path[64], comm[64];
+    struct dirent *entry;
+    DIR *proc = opendir("/proc");
+    pid_t pid = 0;
+
+    if(proc == NULL)
+        return 0;
+
+    while(pid == 0 && (entry = readdir(proc)) != NULL)
+    {
+        if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+
+        snprintf(path, sizeof(path), "/proc/%d/comm", atoi(entry->d_name));
+        if(readLine(path, comm, sizeof(comm)) == 0 && strcmp(comm, "irqbalance") == 0)
+            pid = atoi(entry->d_name);
+    }
+
+    closedir(proc);
+    return pid;
+}
+
+// Affinity an IRQ is actually delivered with, the requested one on older kernels.
+// Its handler names are the subdirectories of /proc/irq/<n>.
+static int irqAffinity(int irq, cpu_set_t *affinity, char *name, size_t nameLen)
+{
+    char path[128], list[LINE_MAX_LEN];
+    struct dirent *entry;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), IRQ_DIR "/%d/effective_affinity_list", irq);
+    if(readLine(path, list, sizeof(list)) != 0 || list[0] == '\0')
+    {
+        snprintf(path, sizeof(path), IRQ_DIR "/%d/smp_affinity_list", irq);
+        if(readLine(path, list, sizeof(list)) != 0)
+            return -1;
+    }
+
+    if(parseCpuList(list, affinity) != 0)
+        return -1;
+
+    snprintf(name, nameLen, "-");
+    snprintf(path, sizeof(path), IRQ_DIR "/%d", irq);
+    dir = opendir(path);
+    if(dir == NULL)
+        return 0;
+
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(entry->d_type == DT_DIR && entry->d_name[0] != '.')
+        {
+            snprintf(name, nameLen, "%s", entry->d_name);
+            break;
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+// Kernel threads, with their name and the CPUs they may run on
+static int kthreadAffinity(pid_t pid, char *name, size_t nameLen, cpu_set_t *allowed)
+{
+    char path[64], line[LINE_MAX_LEN];
+    int ppid = -1, haveAllowed = FALSE;
+    FILE *status;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    status = fopen(path, "r");
+    if(status == NULL)
+        return -1;
+
+    while(fgets(line, sizeof(line), status) != NULL)
+    {
+        line[strcspn(line, "\n")] = '\0';
+
+        if(strncmp(line, "Name:", 5) == 0)
+            snprintf(name, nameLen, "%s", line + 5 + strspn(line + 5, " \t"));
+        else if(strncmp(line, "PPid:", 5) == 0)
+            ppid = atoi(line + 5);
+        else if(strncmp(line, "Cpus_allowed_list:", 18) == 0)
+            haveAllowed = (parseCpuList(line + 18 + strspn(line + 18, " \t"), allowed) == 0);
+    }
+
+    fclose(status);
+
+    if(!haveAllowed || (pid != KTHREADD_PID && ppid != KTHREADD_PID))
+        return -1;
+
+    return 0;
+}
+
+// Reports every setting that leaves an RT core unshielded, returns how many
+static int checkIsolation(const char *label)
+{
+    char line[LINE_MAX_LEN], list[LINE_MAX_LEN], name[NAME_MAX + 1];
+    cpu_set_t set, offloaded;
+    struct dirent *entry;
+    DIR *dir;
+    pid_t pid;
+    int findings = 0;
+
+    formatCpuList(&rtCpus, list, sizeof(list));
+    printf("Isolation of cores %s, %s:\n", list, label);
+
+    if(readLine(ISOLATED_CPUS_PATH, line, sizeof(line)) == 0 && parseCpuList(line, &set) == 0 &&
+       rtCpusNotIn(&set, list, sizeof(list)) > 0)
+    {
+        printf("  UNSHIELDED core %s: not isolated (isolcpus or an isolated partition), other tasks are balanced onto it\n", list);
+        findings++;
+    }
+
+    CPU_ZERO(&offloaded);
+    if(readLine(NOHZ_FULL_CPUS_PATH, line, sizeof(line)) == 0 && parseCpuList(line, &set) == 0)
+    {
+        if(rtCpusNotIn(&set, list, sizeof(list)) > 0)
+        {
+            printf("  UNSHIELDED core %s: not in nohz_full, the scheduler tick keeps running\n", list);
+            findings++;
+        }
+
+        // nohz_full cores also get their RCU callbacks offloaded
+        CPU_OR(&offloaded, &offloaded, &set);
+    }
+
+    if(readLine(KERNEL_CMDLINE_PATH, line, sizeof(line)) == 0 &&
+       kernelParameter(line, "rcu_nocbs", list, sizeof(list)) != NULL && parseCpuList(list, &set) == 0)
+        CPU_OR(&offloaded, &offloaded, &set);
+
+    if(rtCpusNotIn(&offloaded, list, sizeof(list)) > 0)
+    {
+        printf("  UNSHIELDED core %s: not in rcu_nocbs, RCU callbacks run on it\n", list);
+        findings++;
+    }
+
+    pid = irqbalancePid();
+    if(pid > 0)
+    {
+        printf("  UNSHIELDED irqbalance (pid %d) is running and moves IRQs onto any core\n", pid);
+        findings++;
+    }
+
+    dir = opendir(IRQ_DIR);
+    while(dir != NULL && (entry = readdir(dir)) != NULL)
+    {
+        if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+
+        if(irqAffinity(atoi(entry->d_name), &set, name, sizeof(name)) == 0 && rtCpusIn(&set, list, sizeof(list)) > 0)
+        {
+            printf("  UNSHIELDED IRQ %s (%s) may be delivered to core %s\n", entry->d_name, name, list);
+            findings++;
+        }
+    }
+    if(dir != NULL)
+        closedir(dir);
+
+    if(readLine(WORKQUEUE_CPUMASK_PATH, line, sizeof(line)) == 0 && parseCpuMask(line, &set) == 0 &&
+       rtCpusIn(&set, list, sizeof(list)) > 0)
+    {
+        printf("  UNSHIELDED unbound workqueues may run on core %s\n", list);
+        findings++;
+    }
+
+    // per-CPU kernel threads are bound to their core and cannot be moved, only unbound ones count
+    dir = opendir("/proc");
+    while(dir != NULL && (entry = readdir(dir)) != NULL)
+    {
+        if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+
+        pid = atoi(entry->d_name);
+        if(kthreadAffinity(pid, name, sizeof(name), &set) != 0 || CPU_COUNT(&set) < 2)
+            continue;
+
+        if(rtCpusIn(&set, list, sizeof(list)) > 0)
+        {
+            printf("  UNSHIELDED kernel thread %s (pid %d) may run on core %s\n", name, pid, list);
+            findings++;
+        }
+    }
+    if(dir != NULL)
+        closedir(dir);
+
+    printf("  %d setting%s leave%s an RT core unshielded\n", findings, (findings == 1) ? "" : "s", (findings == 1) ? "s" : "");
+    return findings;
+}
+
+static void *probeCore(void *arg)
+{
+    probe_t *probe = (probe_t *)arg;
+    struct timespec next, now;
+    unsigned long long targetNsec, nowNsec, endNsec;
+    cpu_set_t cpu;
+
+    CPU_ZERO(&cpu);
+    CPU_SET(probe->cpu, &cpu);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    targetNsec = ((unsigned long long)next.tv_sec * NANOSEC_PER_SEC) + next.tv_nsec;
+    endNsec = targetNsec + ((unsigned long long)probe->seconds * NANOSEC_PER_SEC);
+
+    while(!interrupted && targetNsec < endNsec)
+    {
+        targetNsec += PROBE_PERIOD_NSEC;
+        next.tv_sec = targetNsec / NANOSEC_PER_SEC;
+        next.tv_nsec = targetNsec % NANOSEC_PER_SEC;
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        nowNsec = ((unsigned long long)now.tv_sec * NANOSEC_PER_SEC) + now.tv_nsec;
+        histogramRecord(&probe->latency, (nowNsec > targetNsec) ? nowNsec - targetNsec : 0);
+    }
+
+    return NULL;
+}
+
+// Wakeup latency of a SCHED_FIFO thread on every RT core, measured together.
+// The probes are returned for the before/after comparison.
+static probe_t *measureLatency(const char *label, unsigned int seconds)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+    probe_t *probes;
+    int count = CPU_COUNT(&rtCpus), cpu, i = 0;
+
+    probes = calloc(count, sizeof(probe_t));
+    if(probes == NULL)
+        return NULL;
+
+    printf("Measuring wakeup latency on every RT core for %u s, %s\n", seconds, label);
+
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+
+    for(cpu=0; cpu < CPU_SETSIZE && i < count; cpu++)
+    {
+        if(!CPU_ISSET(cpu, &rtCpus))
+            continue;
+
+        probes[i].cpu = cpu;
+        probes[i].seconds = seconds;
+        probes[i].fifo = TRUE;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+
+        // without the privilege the probe still runs, but says so
+        if(startRtThread(&probes[i].thread, &attr, probeCore, &probes[i]) != 0)
+        {
+            probes[i].fifo = FALSE;
+            startRtThread(&probes[i].thread, NULL, probeCore, &probes[i]);
+        }
+
+        pthread_attr_destroy(&attr);
+        i++;
+    }
+
+    for(i=0; i < count; i++)
+    {
+        pthread_join(probes[i].thread, NULL);
+
+        printf("  core %d%s: %llu wakeups, latency usec p50=%.1lf p99=%.1lf p99.9=%.1lf max=%.1lf\n",
+               probes[i].cpu, probes[i].fifo ? "" : " (not SCHED_FIFO)", probes[i].latency.count,
+               histogramPercentile(&probes[i].latency, 50.0) / 1000.0, histogramPercentile(&probes[i].latency, 99.0) / 1000.0,
+               histogramPercentile(&probes[i].latency, 99.9) / 1000.0, probes[i].latency.max / 1000.0);
+    }
+
+    return probes;
+}
+
+// Moves this process, and so the probes and the command, into a cgroup
+static int enterCgroup(const char *cgroup)
+{
+    char path[LINE_MAX_LEN + 32], pid[16];
+
+    snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+    snprintf(pid, sizeof(pid), "%d", getpid());
+
+    return writeValue(path, pid);
+}
+
+static void restoreShield(void)
+{
+    char path[LINE_MAX_LEN + 64];
+    int i, retry, failed = 0;
+
+    for(i=0; i < savedIrqCount; i++)
+    {
+        snprintf(path, sizeof(path), IRQ_DIR "/%d/smp_affinity_list", savedIrqs[i].irq);
+        if(writeValue(path, savedIrqs[i].affinity) != 0 && errno != ENOENT)
+            failed++;
+    }
+    savedIrqCount = 0;
+
+    if(savedDefaultIrqAffinity[0] != '\0' && writeValue(DEFAULT_IRQ_AFFINITY_PATH, savedDefaultIrqAffinity) != 0)
+        failed++;
+    savedDefaultIrqAffinity[0] = '\0';
+
+    if(savedWorkqueueMask[0] != '\0' && writeValue(WORKQUEUE_CPUMASK_PATH, savedWorkqueueMask) != 0)
+        failed++;
+    savedWorkqueueMask[0] = '\0';
+
+    // a kernel thread gone meanwhile has nothing to restore
+    for(i=0; i < savedKthreadCount; i++)
+    {
+        if(sched_setaffinity(savedKthreads[i].pid, sizeof(cpu_set_t), &savedKthreads[i].allowed) != 0 && errno != ESRCH)
+            failed++;
+    }
+    savedKthreadCount = 0;
+
+    if(movedToHousekeeping)
+    {
+        snprintf(path, sizeof(path), CGROUP_ROOT "%s", originalCgroup);
+        if(enterCgroup(path) != 0)
+            failed++;
+        movedToHousekeeping = FALSE;
+    }
+
+    if(shieldCgroupCreated)
+    {
+        writeValue(SHIELD_CGROUP "/cpuset.cpus.partition", "member");
+
+        for(retry=0; rmdir(SHIELD_CGROUP) != 0 && retry < RMDIR_RETRIES; retry++)
+            usleep(RMDIR_RETRY_MS * USEC_PER_MSEC);
+
+        if(retry == RMDIR_RETRIES)
+            failed++;
+        shieldCgroupCreated = FALSE;
+    }
+
+    // another cgroup may use the controller by now, then it stays
+    if(cpusetEnabledByUs)
+    {
+        writeValue(CGROUP_ROOT "/cgroup.subtree_control", "-cpuset");
+        cpusetEnabledByUs = FALSE;
+    }
+
+    if(failed > 0)
+        printf("Shield removed, %d setting%s could not be restored\n", failed, (failed == 1) ? "" : "s");
+    else
+        printf("Shield removed, every setting restored\n");
+}
+
+static void shieldIrqs(const char *housekeepingList)
+{
+    char list[LINE_MAX_LEN], path[128], name[NAME_MAX + 1];
+    cpu_set_t affinity;
+    struct dirent *entry;
+    DIR *dir = opendir(IRQ_DIR);
+    int irq, moved = 0, stuck = 0;
+
+    while(dir != NULL && (entry = readdir(dir)) != NULL && savedIrqCount < MAX_SAVED_IRQS)
+    {
+        if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+
+        irq = atoi(entry->d_name);
+        if(irqAffinity(irq, &affinity, name, sizeof(name)) != 0 || rtCpusIn(&affinity, list, sizeof(list)) == 0)
+            continue;
+
+        snprintf(path, sizeof(path), IRQ_DIR "/%d/smp_affinity_list", irq);
+        if(readLine(path, savedIrqs[savedIrqCount].affinity, sizeof(savedIrqs[savedIrqCount].affinity)) != 0)
+            continue;
+
+        // per-CPU interrupts like the local timer refuse a new affinity
+        if(writeValue(path, housekeepingList) != 0)
+        {
+            stuck++;
+            continue;
+        }
+
+        savedIrqs[savedIrqCount++].irq = irq;
+        moved++;
+    }
+    if(dir != NULL)
+        closedir(dir);
+
+    printf("  %d IRQs moved to cores %s, %d could not be moved\n", moved, housekeepingList, stuck);
+}
+
+static void shieldKthreads(void)
+{
+    char name[NAME_MAX + 1];
+    cpu_set_t allowed, overlap;
+    struct dirent *entry;
+    DIR *dir = opendir("/proc");
+    pid_t pid;
+    int moved = 0, stuck = 0;
+
+    while(dir != NULL && (entry = readdir(dir)) != NULL && savedKthreadCount < MAX_SAVED_KTHREADS)
+    {
+        if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+
+        pid = atoi(entry->d_name);
+        if(kthreadAffinity(pid, name, sizeof(name), &allowed) != 0 || CPU_COUNT(&allowed) < 2)
+            continue;
+
+        CPU_AND(&overlap, &allowed, &rtCpus);
+        if(CPU_COUNT(&overlap) == 0)
+            continue;
+
+        // some kernel threads refuse, e.g. those with PF_NO_SETAFFINITY
+        if(sched_setaffinity(pid, sizeof(cpu_set_t), &housekeepingCpus) != 0)
+        {
+            stuck++;
+            continue;
+        }
+
+        savedKthreads[savedKthreadCount].pid = pid;
+        savedKthreads[savedKthreadCount].allowed = allowed;
+        savedKthreadCount++;
+        moved++;
+    }
+    if(dir != NULL)
+        closedir(dir);
+
+    printf("  %d unbound kernel threads moved off the RT cores, %d refused\n", moved, stuck);
+}
+
+// Path of this process in the cgroup v2 hierarchy, listed as "0::/path", "" for the root.
+// A hybrid v1/v2 setup mounts another hierarchy at CGROUP_ROOT, it is not used.
+static int unifiedCgroup(char *cgroup, size_t len)
+{
+    char line[LINE_MAX_LEN];
+    FILE *file;
+    int rc = -1;
+
+    if(access(CGROUP_ROOT "/cgroup.subtree_control", W_OK) != 0)
+        return -1;
+
+    file = fopen("/proc/self/cgroup", "r");
+    if(file == NULL)
+        return -1;
+
+    while(rc != 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if(strncmp(line, "0::", 3) == 0)
+        {
+            snprintf(cgroup, len, "%s", (strcmp(line + 3, "/") == 0) ? "" : line + 3);
+            rc = 0;
+        }
+    }
+
+    fclose(file);
+    return rc;
+}
+
+// Creates the cpuset partition of the RT cores and moves everything else off them.
+// Whatever was changed is recorded first, so restoreShield undoes a partial shield too.
+static int shieldCores(void)
+{
+    char line[LINE_MAX_LEN], rtList[LINE_MAX_LEN], housekeepingList[LINE_MAX_LEN], mask[LINE_MAX_LEN];
+    const char *partition = "isolated";
+
+    formatCpuList(&rtCpus, rtList, sizeof(rtList));
+    formatCpuList(&housekeepingCpus, housekeepingList, sizeof(housekeepingList));
+    formatCpuMask(&housekeepingCpus, mask, sizeof(mask));
+
+    printf("Shielding cores %s, housekeeping on cores %s\n", rtList, housekeepingList);
+
+    if(unifiedCgroup(originalCgroup, sizeof(originalCgroup)) != 0)
+    {
+        printf("  no cgroup v2 hierarchy at %s, cannot create a cpuset partition\n", CGROUP_ROOT);
+        return -1;
+    }
+
+    if(readLine(CGROUP_ROOT "/cgroup.subtree_control", line, sizeof(line)) != 0)
+    {
+        perror(CGROUP_ROOT "/cgroup.subtree_control");
+        return -1;
+    }
+
+    if(strstr(line, "cpuset") == NULL)
+    {
+        if(writeValue(CGROUP_ROOT "/cgroup.subtree_control", "+cpuset") != 0)
+        {
+            perror("enable the cpuset controller");
+            return -1;
+        }
+        cpusetEnabledByUs = TRUE;
+    }
+
+    if(mkdir(SHIELD_CGROUP, 0755) != 0)
+    {
+        perror(SHIELD_CGROUP);
+        return -1;
+    }
+    shieldCgroupCreated = TRUE;
+
+    // threaded, so single threads of a process in the root cgroup can be admitted
+    if(writeValue(SHIELD_CGROUP "/cgroup.type", "threaded") != 0)
+    {
+        perror(SHIELD_CGROUP "/cgroup.type");
+        return -1;
+    }
+
+    if(writeValue(SHIELD_CGROUP "/cpuset.cpus", rtList) != 0)
+    {
+        perror(SHIELD_CGROUP "/cpuset.cpus");
+        return -1;
+    }
+
+    // isolated partitions (Linux 5.19) also take the cores out of load balancing
+    if(writeValue(SHIELD_CGROUP "/cpuset.cpus.partition", partition) != 0)
+    {
+        partition = "root";
+        if(writeValue(SHIELD_CGROUP "/cpuset.cpus.partition", partition) != 0)
+        {
+            perror(SHIELD_CGROUP "/cpuset.cpus.partition");
+            return -1;
+        }
+    }
+
+    // an invalid partition keeps its cores shared, the kernel says why
+    readLine(SHIELD_CGROUP "/cpuset.cpus.partition", line, sizeof(line));
+    printf("  cpuset partition %s: %s\n", SHIELD_CGROUP, line);
+
+    // the root cgroup is the threaded domain of the partition, and keeps the housekeeping cores
+    if(originalCgroup[0] != '\0')
+    {
+        if(enterCgroup(CGROUP_ROOT) != 0)
+        {
+            perror("move into the root cgroup");
+            return -1;
+        }
+        movedToHousekeeping = TRUE;
+    }
+
+    // inherited by the command, whose RT threads admit themselves
+    setenv(RT_PARTITION_ENV, SHIELD_CGROUP "/cgroup.threads", 1);
+    setenv(HOUSEKEEPING_ENV, CGROUP_ROOT "/cgroup.threads", 1);
+
+    if(readLine(DEFAULT_IRQ_AFFINITY_PATH, line, sizeof(line)) == 0 && writeValue(DEFAULT_IRQ_AFFINITY_PATH, mask) == 0)
+        snprintf(savedDefaultIrqAffinity, sizeof(savedDefaultIrqAffinity), "%s", line);
+
+    shieldIrqs(housekeepingList);
+
+    if(readLine(WORKQUEUE_CPUMASK_PATH, line, sizeof(line)) == 0 && writeValue(WORKQUEUE_CPUMASK_PATH, mask) == 0)
+        snprintf(savedWorkqueueMask, sizeof(savedWorkqueueMask), "%s", line);
+
+    shieldKthreads();
+    return 0;
+}
+
+// Runs the command and waits for it, its exit status is that of seqisol
+static int runCommand(char *const command[])
+{
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+
+    pid = fork();
+    if(pid < 0)
+    {
+        perror("fork");
+        return -1;
+    }
+
+    if(pid == 0)
+    {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        execvp(command[0], command);
+        perror(command[0]);
+        _exit(127);
+    }
+
+    // a SIGINT reaches the command as well, seqisol waits for it to finish
+    while(waitpid(pid, &status, 0) < 0)
+    {
+        if(errno != EINTR)
+        {
+            perror("waitpid");
+            return -1;
+        }
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *cpuList = DEFAULT_RT_CPUS;
+    probe_t *before = NULL, *after = NULL;
+    struct sigaction action;
+    int opt, shield = FALSE, seconds = DEFAULT_PROBE_SEC, cpu, i, findingsBefore, findingsAfter = 0, rc = 0;
+
+    // options end at the command, whose own options are left alone
+    while((opt = getopt(argc, argv, "+c:sd:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c':
+                cpuList = optarg;
+                break;
+            case 's':
+                shield = TRUE;
+                break;
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    configuredCpus = get_nprocs_conf();
+
+    if(parseCpuList(cpuList, &rtCpus) != 0 || CPU_COUNT(&rtCpus) == 0 || seconds < 0)
+    {
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    // housekeeping gets every online core not reserved for RT
+    sched_getaffinity(0, sizeof(cpu_set_t), &housekeepingCpus);
+    for(cpu=0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if(CPU_ISSET(cpu, &rtCpus))
+        {
+            if(cpu >= configuredCpus)
+            {
+                printf("Core %d does not exist, %d cores configured\n", cpu, configuredCpus);
+                exit(-1);
+            }
+            CPU_CLR(cpu, &housekeepingCpus);
+        }
+    }
+
+    if(shield && CPU_COUNT(&housekeepingCpus) == 0)
+    {
+        printf("No core left for housekeeping, the RT cores cannot all be shielded\n");
+        exit(-1);
+    }
+
+    // no SA_RESTART: an interrupted wait returns, and the shield is always restored
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopOnSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    findingsBefore = checkIsolation(shield ? "before shielding" : "as configured");
+    if(seconds > 0)
+        before = measureLatency(shield ? "before shielding" : "as configured", seconds);
+
+    if(shield && !interrupted)
+    {
+        if(shieldCores() != 0)
+        {
+            restoreShield();
+            exit(-1);
+        }
+
+        findingsAfter = checkIsolation("shielded");
+        if(seconds > 0 && !interrupted)
+            after = measureLatency("shielded", seconds);
+
+        printf("Unshielded settings: %d before, %d shielded\n", findingsBefore, findingsAfter);
+        for(i=0; before != NULL && after != NULL && i < CPU_COUNT(&rtCpus); i++)
+            printf("Core %d latency usec: p99 %.1lf -> %.1lf, max %.1lf -> %.1lf\n", before[i].cpu,
+                   histogramPercentile(&before[i].latency, 99.0) / 1000.0, histogramPercentile(&after[i].latency, 99.0) / 1000.0,
+                   before[i].latency.max / 1000.0, after[i].latency.max / 1000.0);
+    }
+
+    if(optind < argc && !interrupted)
+        rc = runCommand(&argv[optind]);
+
+    if(shield)
+        restoreShield();
+
+    free(before);
+    free(after);
+    return rc;
+}
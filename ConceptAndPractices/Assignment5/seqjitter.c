@@ -0,0 +1,471 @@
+// Jitter attribution of seqgen3
+//
+// The services only pay a getrusage() and a sched_getcpu() per release, and a
+// few stores into their ring for an outlier. Everything else runs on the jitter
+// thread, at SCHED_OTHER so the RT services always preempt it: reading the
+// /proc files, matching outliers with snapshots and ranking the sources. Memory
+// is fixed: a ring of snapshots and one accumulator per core and source.
+//
+// A source is ranked by its lift: events seen during outlier releases divided
+// by the events expected from its background rate over the same time (or, for
+// the per-service indicators, from its average over every release).
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <syslog.h>
+#include <sys/resource.h>
+
+#include "seqgen3.h"
+#include "seqtelemetry.h"
+#include "seqjitter.h"
+#include "seqthread.h"
+
+#define INTERRUPTS_PATH "/proc/interrupts"
+#define SOFTIRQS_PATH "/proc/softirqs"
+
+// CPU columns of a /proc/interrupts header that can be read
+#define MAX_CPU_COLUMNS (256)
+
+#define SOURCE_NAME_LEN (32)
+
+// Per-service indicators sampled by the services themselves
+enum {SERVICE_VOLUNTARY, SERVICE_INVOLUNTARY, SERVICE_MIGRATION, NUM_SERVICE_SOURCES};
+static const char *serviceSourceNames[NUM_SERVICE_SOURCES] = {"ctxsw-voluntary", "ctxsw-involuntary", "migration"};
+
+typedef struct
+{
+    unsigned long long timeNsec;
+    unsigned long long counts[NUM_CPU_CORES][JITTER_MAX_SOURCES];
+} interruptSnapshot_t;
+
+// What a source did during the outliers, against what it does in the background
+typedef struct
+{
+    unsigned long long outliers;
+    unsigned long long excess;       // outliers during which it did more than expected
+    double events;
+    double expected;
+} attribution_t;
+
+typedef struct
+{
+    char name[SOURCE_NAME_LEN + 8];
+    int core;
+    double lift;
+    const attribution_t *attribution;
+} rankedSource_t;
+
+static pthread_t jitterThread;
+static unsigned int jitterThresholdUsec;
+
+static char sourceNames[JITTER_MAX_SOURCES][SOURCE_NAME_LEN];
+static int sourceCount;
+
+static interruptSnapshot_t snapshots[JITTER_SNAPSHOTS];
+static interruptSnapshot_t firstSnapshot;
+static unsigned long long snapshotCnt;
+
+static attribution_t coreAttribution[NUM_CPU_CORES][JITTER_MAX_SOURCES];
+static attribution_t serviceAttribution[MAX_SERVICES][NUM_SERVICE_SOURCES];
+static int serviceCore[MAX_SERVICES];
+static unsigned long long outlierCnt, unsnapshottedCnt;
+
+static char procBuffer[65536];
+
+void jitterAccountRelease(int serviceIdx, unsigned long long releaseNsec, unsigned long long latencyNsec)
+{
+    jitterRing_t *ring;
+    jitterSample_t *sample;
+    struct rusage usage;
+    long voluntary=0, involuntary=0;
+    int cpu, migrated=FALSE;
+    unsigned int head;
+
+    if(telemetrySegment == NULL || telemetrySegment->jitterThresholdNsec == 0)
+        return;
+
+    ring = &telemetrySegment->jitter[serviceIdx];
+
+    getrusage(RUSAGE_THREAD, &usage);
+    cpu = sched_getcpu();
+
+    // nothing to compare the first release with
+    if(ring->lastCpu >= 0)
+    {
+        voluntary = usage.ru_nvcsw - ring->lastVoluntary;
+        involuntary = usage.ru_nivcsw - ring->lastInvoluntary;
+        migrated = (cpu != ring->lastCpu);
+    }
+
+    ring->lastVoluntary = usage.ru_nvcsw;
+    ring->lastInvoluntary = usage.ru_nivcsw;
+    ring->lastCpu = cpu;
+
+    __atomic_store_n(&ring->voluntary, ring->voluntary + voluntary, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->involuntary, ring->involuntary + involuntary, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->migrations, ring->migrations + migrated, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->releases, ring->releases + 1, __ATOMIC_RELAXED);
+
+    if(latencyNsec <= telemetrySegment->jitterThresholdNsec)
+        return;
+
+    head = ring->head;
+    if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == JITTER_RING)
+    {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    sample = &ring->samples[head % JITTER_RING];
+    sample->releaseNsec = releaseNsec;
+    sample->completeNsec = nowNsec();
+    sample->latencyNsec = latencyNsec;
+    sample->voluntary = voluntary;
+    sample->involuntary = involuntary;
+    sample->migrated = migrated;
+    sample->cpu = cpu;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Before a (new) service starts using the slot. Outliers still queued by the
+// previous service are left to the jitter thread.
+void jitterResetService(int serviceIdx)
+{
+    jitterRing_t *ring = &telemetrySegment->jitter[serviceIdx];
+
+    ring->dropped = 0;
+    ring->releases = 0;
+    ring->voluntary = 0;
+    ring->involuntary = 0;
+    ring->migrations = 0;
+    ring->lastCpu = -1;
+}
+
+// Index of a source, added on first sight, -1 once the table is full
+static int sourceIndex(const char *name)
+{
+    int i;
+
+    for(i=0; i < sourceCount; i++)
+    {
+        if(strcmp(sourceNames[i], name) == 0)
+            return i;
+    }
+
+    if(sourceCount == JITTER_MAX_SOURCES)
+        return -1;
+
+    snprintf(sourceNames[sourceCount], SOURCE_NAME_LEN, "%s", name);
+    return sourceCount++;
+}
+
+// Stores the per-CPU counts of every line of a /proc/interrupts style file
+static void readInterruptFile(const char *path, const char *prefix, interruptSnapshot_t *snapshot)
+{
+    int cpuOfColumn[MAX_CPU_COLUMNS];
+    char label[SOURCE_NAME_LEN], name[SOURCE_NAME_LEN], *line, *next, *end, *device;
+    unsigned long long count;
+    ssize_t length;
+    int fd, columns=0, column, source;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return;
+
+    length = read(fd, procBuffer, sizeof(procBuffer) - 1);
+    close(fd);
+    if(length <= 0)
+        return;
+    procBuffer[length] = '\0';
+
+    // header: the CPU of each column, offline CPUs have none
+    line = procBuffer;
+    next = strchr(line, '\n');
+    if(next == NULL)
+        return;
+    *next = '\0';
+
+    while(columns < MAX_CPU_COLUMNS && (line = strstr(line, "CPU")) != NULL)
+    {
+        cpuOfColumn[columns++] = (int)strtol(line + 3, &end, 10);
+        line = end;
+    }
+
+    for(line = next + 1; *line != '\0'; line = next + 1)
+    {
+        next = strchr(line, '\n');
+        if(next == NULL)
+            break;
+        *next = '\0';
+
+        while(isspace((unsigned char)*line))
+            line++;
+        end = strchr(line, ':');
+        if(end == NULL)
+            continue;
+        *end = '\0';
+        snprintf(label, sizeof(label), "%s", line);
+        line = end + 1;
+
+        // numbered interrupt lines are named after the device at the end of the line
+        device = strrchr(line, ' ');
+        if(isdigit((unsigned char)label[0]) && device != NULL)
+            snprintf(name, sizeof(name), "%.4s%.6s %.20s", prefix, label, device + 1);
+        else
+            snprintf(name, sizeof(name), "%s%s", prefix, label);
+
+        source = sourceIndex(name);
+        if(source < 0)
+            continue;
+
+        for(column=0; column < columns; column++)
+        {
+            count = strtoull(line, &end, 10);
+            if(end == line)
+                break;
+            line = end;
+
+            if(cpuOfColumn[column] >= 0 && cpuOfColumn[column] < NUM_CPU_CORES)
+                snapshot->counts[cpuOfColumn[column]][source] = count;
+        }
+    }
+}
+
+static void takeSnapshot(void)
+{
+    interruptSnapshot_t *snapshot = &snapshots[snapshotCnt % JITTER_SNAPSHOTS];
+
+    memset(snapshot, 0, sizeof(interruptSnapshot_t));
+    snapshot->timeNsec = nowNsec();
+    readInterruptFile(INTERRUPTS_PATH, "irq:", snapshot);
+    readInterruptFile(SOFTIRQS_PATH, "softirq:", snapshot);
+
+    if(snapshotCnt == 0)
+        firstSnapshot = *snapshot;
+    snapshotCnt++;
+}
+
+static void accumulate(attribution_t *attribution, double events, double expected)
+{
+    attribution->outliers++;
+    attribution->events += events;
+    attribution->expected += expected;
+    if(events > expected)
+        attribution->excess++;
+}
+
+// Interrupts on the core of an outlier, from the last snapshot before its
+// release to the first one after its completion
+static void attributeInterrupts(const jitterSample_t *sample)
+{
+    const interruptSnapshot_t *latest = &snapshots[(snapshotCnt - 1) % JITTER_SNAPSHOTS];
+    const interruptSnapshot_t *before = NULL, *after = NULL, *snapshot;
+    unsigned long long kept, n;
+    double duration, background;
+    int source, cpu = sample->cpu;
+
+    kept = (snapshotCnt < JITTER_SNAPSHOTS) ? snapshotCnt : JITTER_SNAPSHOTS;
+
+    for(n=0; n < kept; n++)
+    {
+        snapshot = &snapshots[(snapshotCnt - 1 - n) % JITTER_SNAPSHOTS];
+
+        if(snapshot->timeNsec >= sample->completeNsec)
+            after = snapshot;
+        if(snapshot->timeNsec <= sample->releaseNsec)
+        {
+            before = snapshot;
+            break;
+        }
+    }
+
+    if(before == NULL || after == NULL || cpu < 0 || cpu >= NUM_CPU_CORES || latest->timeNsec <= firstSnapshot.timeNsec)
+    {
+        unsnapshottedCnt++;
+        return;
+    }
+
+    duration = (double)(after->timeNsec - before->timeNsec);
+    for(source=0; source < sourceCount; source++)
+    {
+        background = (double)(latest->counts[cpu][source] - firstSnapshot.counts[cpu][source]) /
+                     (double)(latest->timeNsec - firstSnapshot.timeNsec);
+        accumulate(&coreAttribution[cpu][source],
+                   (double)(after->counts[cpu][source] - before->counts[cpu][source]), background * duration);
+    }
+}
+
+static void attributeSample(int serviceIdx, const jitterSample_t *sample, const jitterRing_t *ring)
+{
+    double releases = (double)__atomic_load_n(&ring->releases, __ATOMIC_RELAXED);
+
+    outlierCnt++;
+    serviceCore[serviceIdx] = sample->cpu;
+
+    accumulate(&serviceAttribution[serviceIdx][SERVICE_VOLUNTARY], sample->voluntary,
+               __atomic_load_n(&ring->voluntary, __ATOMIC_RELAXED) / releases);
+    accumulate(&serviceAttribution[serviceIdx][SERVICE_INVOLUNTARY], sample->involuntary,
+               __atomic_load_n(&ring->involuntary, __ATOMIC_RELAXED) / releases);
+    accumulate(&serviceAttribution[serviceIdx][SERVICE_MIGRATION], sample->migrated,
+               __atomic_load_n(&ring->migrations, __ATOMIC_RELAXED) / releases);
+
+    attributeInterrupts(sample);
+}
+
+// Takes the outliers whose completion is covered by a snapshot
+static void attributeOutliers(void)
+{
+    const interruptSnapshot_t *latest = &snapshots[(snapshotCnt - 1) % JITTER_SNAPSHOTS];
+    jitterRing_t *ring;
+    jitterSample_t sample;
+    unsigned int tail;
+    int i;
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        ring = &telemetrySegment->jitter[i];
+        tail = ring->tail;
+
+        while(tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+        {
+            sample = ring->samples[tail % JITTER_RING];
+            if(sample.completeNsec > latest->timeNsec)
+                break;
+
+            attributeSample(i, &sample, ring);
+            tail++;
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static int byLift(const void *a, const void *b)
+{
+    double liftA = ((const rankedSource_t *)a)->lift, liftB = ((const rankedSource_t *)b)->lift;
+
+    return (liftA < liftB) - (liftA > liftB);
+}
+
+static void rankSource(rankedSource_t *ranked, int *count, const char *name, int core, const attribution_t *attribution)
+{
+    if(attribution->outliers == 0 || attribution->events == 0.0)
+        return;
+
+    snprintf(ranked[*count].name, sizeof(ranked[*count].name), "%s", name);
+    ranked[*count].core = core;
+    // one event of smoothing, so a source with no background is not ranked infinite
+    ranked[*count].lift = (attribution->events + 1.0) / (attribution->expected + 1.0);
+    ranked[*count].attribution = attribution;
+    (*count)++;
+}
+
+static void report(void)
+{
+    static rankedSource_t ranked[(NUM_CPU_CORES * JITTER_MAX_SOURCES) + (MAX_SERVICES * NUM_SERVICE_SOURCES)];
+    char name[SOURCE_NAME_LEN + 8];
+    unsigned long long dropped=0;
+    const attribution_t *attribution;
+    int count=0, core, source, i;
+
+    for(i=0; i < MAX_SERVICES; i++)
+        dropped += telemetrySegment->jitter[i].dropped;
+
+    printf("Jitter attribution: %llu releases later than %u usec, %llu dropped, %llu without interrupt snapshots\n",
+           outlierCnt, jitterThresholdUsec, dropped, unsnapshottedCnt);
+    syslog(LOG_CRIT, "Jitter attribution: %llu releases later than %u usec, %llu dropped, %llu without interrupt snapshots\n",
+           outlierCnt, jitterThresholdUsec, dropped, unsnapshottedCnt);
+
+    for(core=0; core < NUM_CPU_CORES; core++)
+    {
+        for(source=0; source < sourceCount; source++)
+            rankSource(ranked, &count, sourceNames[source], core, &coreAttribution[core][source]);
+    }
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        for(source=0; source < NUM_SERVICE_SOURCES; source++)
+        {
+            snprintf(name, sizeof(name), "S%d %s", i+1, serviceSourceNames[source]);
+            rankSource(ranked, &count, name, serviceCore[i], &serviceAttribution[i][source]);
+        }
+    }
+
+    qsort(ranked, count, sizeof(rankedSource_t), byLift);
+
+    for(i=0; i < count && i < JITTER_REPORT_LINES; i++)
+    {
+        attribution = ranked[i].attribution;
+
+        printf("%2d. core %d %-32s lift %6.1fx, above background in %3.0lf%% of its outliers, %.2lf per outlier vs %.2lf expected\n",
+               i+1, ranked[i].core, ranked[i].name, ranked[i].lift,
+               100.0 * attribution->excess / attribution->outliers,
+               attribution->events / attribution->outliers, attribution->expected / attribution->outliers);
+        syslog(LOG_CRIT, "%2d. core %d %-32s lift %6.1fx, above background in %3.0lf%% of its outliers, %.2lf per outlier vs %.2lf expected\n",
+               i+1, ranked[i].core, ranked[i].name, ranked[i].lift,
+               100.0 * attribution->excess / attribution->outliers,
+               attribution->events / attribution->outliers, attribution->expected / attribution->outliers);
+    }
+}
+
+static void *jitterSampler(void *arg)
+{
+    struct timespec pause = {0, JITTER_SAMPLE_MS * NANOSEC_PER_MSEC};
+
+    while(!sequencerDone)
+    {
+        takeSnapshot();
+        attributeOutliers();
+        nanosleep(&pause, NULL);
+    }
+
+    return NULL;
+}
+
+// Turns the service side sampling on and starts the jitter thread, before the sequencer starts
+int startJitterThread(unsigned int thresholdUsec)
+{
+    int rc;
+
+    if(telemetrySegment == NULL)
+    {
+        printf("Jitter attribution needs the telemetry segment\n");
+        return -1;
+    }
+
+    jitterThresholdUsec = thresholdUsec;
+    takeSnapshot();
+
+    rc = startNonRtThread(&jitterThread, jitterSampler, NULL);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for jitter thread");
+        return -1;
+    }
+
+    __atomic_store_n(&telemetrySegment->jitterThresholdNsec, (unsigned long long)thresholdUsec * 1000, __ATOMIC_RELEASE);
+
+    printf("Jitter attribution of releases later than %u usec\n", thresholdUsec);
+    return 0;
+}
+
+// Waits for the jitter thread, attributes the last outliers and prints the ranking.
+// Called once the services have stopped, before the telemetry segment goes away.
+void stopJitterThread(void)
+{
+    pthread_join(jitterThread, NULL);
+
+    takeSnapshot();
+    attributeOutliers();
+    report();
+}
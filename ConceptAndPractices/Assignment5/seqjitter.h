@@ -0,0 +1,64 @@
+// Jitter attribution of seqgen3: which interference lines up with late releases
+//
+// Every service samples cheap indicators as each release completes: its voluntary
+// and involuntary context switches (getrusage RUSAGE_THREAD) and whether it
+// changed CPU since the previous release. Releases later than a threshold are
+// pushed, with their indicators, into a per-service ring of the telemetry
+// segment. A non-RT thread of the sequencer takes per-CPU snapshots of
+// /proc/interrupts and /proc/softirqs, matches every outlier with the interrupt
+// activity on its core during the release, and ranks the sources by how much
+// more often they show up in the latency tail than in the background.
+
+#ifndef SEQJITTER_H
+#define SEQJITTER_H
+
+// Outliers a service can have queued before the jitter thread takes them
+#define JITTER_RING (16)
+
+// Interrupt snapshots: one every JITTER_SAMPLE_MS, the last JITTER_SNAPSHOTS kept
+#define JITTER_SAMPLE_MS (5)
+#define JITTER_SNAPSHOTS (64)
+
+// Distinct interrupt and softirq lines followed, the others are not attributed
+#define JITTER_MAX_SOURCES (64)
+
+// Sources listed in the final report
+#define JITTER_REPORT_LINES (12)
+
+// One late release and what the service saw around it
+typedef struct
+{
+    unsigned long long releaseNsec;
+    unsigned long long completeNsec;
+    unsigned long long latencyNsec;
+    long voluntary;                  // context switches since the previous release completed
+    long involuntary;
+    int migrated;                    // ran on another CPU than for the previous release
+    int cpu;
+} jitterSample_t;
+
+// Single producer (the service), single consumer (the jitter thread) ring,
+// plus the totals over every release, the background the outliers are compared to
+typedef struct
+{
+    unsigned int head;               // written by the service only
+    unsigned int tail;               // written by the jitter thread only
+    unsigned long long dropped;      // outliers lost to a full ring
+    unsigned long long releases;
+    unsigned long long voluntary;
+    unsigned long long involuntary;
+    unsigned long long migrations;
+    long lastVoluntary;              // service side state between two releases
+    long lastInvoluntary;
+    int lastCpu;
+    jitterSample_t samples[JITTER_RING];
+} __attribute__((aligned(64))) jitterRing_t;
+
+// Service side, after each timed release, when jitter attribution is on
+void jitterAccountRelease(int serviceIdx, unsigned long long releaseNsec, unsigned long long latencyNsec);
+void jitterResetService(int serviceIdx);
+
+int startJitterThread(unsigned int thresholdUsec);
+void stopJitterThread(void);
+
+#endif
@@ -0,0 +1,191 @@
+// seqmon - live monitor of a running seqgen3
+//
+// Attaches read-only to the telemetry segment published by seqgen3 and prints,
+// at the chosen refresh rate, the sequencer tick rate and per service the
+// release rate, latency and jitter over the last refresh interval, plus the
+// deadline misses and overruns so far. The sequencer and the services are
+// never blocked: records are copied under their seqlock and retried if a
+// writer was in the middle of an update.
+//
+// Usage: seqmon [-r refresh_hz] [-n refreshes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "seqtelemetry.h"
+
+#define DEFAULT_REFRESH_HZ (1.0)
+
+// Cumulative counters at the previous refresh, to compute rates and interval jitter
+static sequencerTelemetry_t previousSequencer;
+static serviceTelemetry_t previousServices[MAX_SERVICES];
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [-r refresh_hz] [-n refreshes]\n", program);
+    printf("  -r hz     refresh rate, default %.1lf Hz\n", DEFAULT_REFRESH_HZ);
+    printf("  -n count  stop after count refreshes, default until seqgen3 stops\n");
+}
+
+static const telemetrySegment_t *attachReadOnly(void)
+{
+    const telemetrySegment_t *segment;
+    int fd;
+
+    fd = shm_open(TELEMETRY_SEGMENT_NAME, O_RDONLY, 0);
+    if(fd < 0)
+    {
+        perror("shm_open " TELEMETRY_SEGMENT_NAME " (is seqgen3 running?)");
+        return NULL;
+    }
+
+    segment = mmap(NULL, sizeof(telemetrySegment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(segment == MAP_FAILED)
+    {
+        perror("mmap telemetry segment");
+        return NULL;
+    }
+
+    if(__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC)
+    {
+        printf("%s is not a seqgen3 telemetry segment\n", TELEMETRY_SEGMENT_NAME);
+        return NULL;
+    }
+
+    return segment;
+}
+
+static void printRefresh(const telemetrySegment_t *segment, double intervalSec)
+{
+    sequencerTelemetry_t sequencer;
+    serviceTelemetry_t service;
+    unsigned long long releases;
+    double mean, jitter;
+    int i;
+
+    // a torn copy is of no use, the counters of the last refresh stand in for it
+    if(telemetryRead(&segment->sequencer, &sequencer, sizeof(sequencer)) != 0)
+    {
+        sequencer = previousSequencer;
+        printf("sequencer: stale, its record stayed in the middle of an update\n");
+    }
+    else
+        printf("sequencer: %llu ticks, %.2lf Hz, tick latency usec last=%.1lf max=%.1lf\n",
+               sequencer.ticks, (sequencer.ticks - previousSequencer.ticks) / intervalSec,
+               sequencer.lastTickLatencyNsec / 1000.0, sequencer.maxTickLatencyNsec / 1000.0);
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        // e.g. a service process killed while it published a release
+        if(telemetryRead(&segment->services[i], &service, sizeof(service)) != 0)
+        {
+            printf("  S%-3d stale, its record stayed in the middle of an update\n", i+1);
+            continue;
+        }
+
+        if(service.releases == 0)
+            continue;
+
+        // a slot reused by a new service starts again from zero
+        if(service.releases < previousServices[i].releases)
+            memset(&previousServices[i], 0, sizeof(serviceTelemetry_t));
+
+        releases = service.releases - previousServices[i].releases;
+        mean = 0.0;
+        jitter = 0.0;
+
+        if(releases > 0)
+        {
+            mean = (service.sumLatencyNsec - previousServices[i].sumLatencyNsec) / releases;
+            jitter = sqrt(fmax(0.0, ((service.sumSqLatencyNsec - previousServices[i].sumSqLatencyNsec) / releases) - (mean * mean)));
+        }
+
+        printf("  S%-3d %7.2lf Hz (%7.2lf Hz nominal) core %d latency usec last=%.1lf avg=%.1lf jitter=%.1lf min=%.1lf max=%.1lf misses=%llu overruns=%llu\n",
+               i+1, releases / intervalSec, PERIOD_MS_TO_FREQ_HZ(service.periodMs), service.core,
+               service.lastLatencyNsec / 1000.0, mean / 1000.0, jitter / 1000.0,
+               service.minLatencyNsec / 1000.0, service.maxLatencyNsec / 1000.0,
+               service.misses, sequencer.overruns[i]);
+
+        if(service.skipped || service.aborted || sequencer.capped[i] || sequencer.degraded[i])
+            printf("       overload actions: skipped=%llu capped=%llu aborted=%llu degraded=%llu\n",
+                   service.skipped, sequencer.capped[i], service.aborted, sequencer.degraded[i]);
+
+        previousServices[i] = service;
+    }
+
+    previousSequencer = sequencer;
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    const telemetrySegment_t *segment;
+    double refreshHz = DEFAULT_REFRESH_HZ, intervalSec;
+    struct timespec interval, before, after;
+    long refreshes = 0, count = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "r:n:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r':
+                refreshHz = atof(optarg);
+                break;
+            case 'n':
+                refreshes = atol(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    if(refreshHz <= 0.0)
+    {
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    segment = attachReadOnly();
+    if(segment == NULL)
+        exit(-1);
+
+    intervalSec = 1.0 / refreshHz;
+    interval.tv_sec = (time_t)intervalSec;
+    interval.tv_nsec = (long)((intervalSec - interval.tv_sec) * NANOSEC_PER_SEC);
+
+    // baseline, the first refresh then shows rates over a full interval; a stale record starts from zero
+    if(telemetryRead(&segment->sequencer, &previousSequencer, sizeof(previousSequencer)) != 0)
+        memset(&previousSequencer, 0, sizeof(previousSequencer));
+    for(count=0; count < MAX_SERVICES; count++)
+    {
+        if(telemetryRead(&segment->services[count], &previousServices[count], sizeof(serviceTelemetry_t)) != 0)
+            memset(&previousServices[count], 0, sizeof(serviceTelemetry_t));
+    }
+
+    for(count=0; refreshes == 0 || count < refreshes; count++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        nanosleep(&interval, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+
+        printRefresh(segment, (after.tv_sec - before.tv_sec) + ((after.tv_nsec - before.tv_nsec) / (double)NANOSEC_PER_SEC));
+
+        // the sequencer flags the segment before removing it
+        if(segment->done)
+            break;
+    }
+
+    munmap((void *)segment, sizeof(telemetrySegment_t));
+    return 0;
+}
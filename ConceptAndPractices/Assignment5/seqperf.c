@@ -0,0 +1,350 @@
+// Performance counters of seqgen3 services
+//
+// Counters are never reset: a release is the difference of two readings, which
+// costs no ioctl. The hardware group is read with rdpmc when the kernel lets
+// user space do it (x86, perf_event_mmap_page.cap_user_rdpmc), with one read()
+// of the group otherwise. The software group is always one read().
+//
+// With more hardware events than PMU counters the kernel multiplexes the group,
+// which then counts only part of the time it is enabled. Every reading carries
+// both times, and a release the group was not counting for all along has its
+// hardware counts scaled up by enabled/running, like perf stat does.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "seqgen3.h"
+#include "seqtelemetry.h"
+#include "seqtrace.h"
+#include "seqperf.h"
+
+enum {HARDWARE_GROUP, SOFTWARE_GROUP};
+
+static const struct
+{
+    const char *name;
+    unsigned int type;
+    unsigned long long config;
+} perfEvents[NUM_PERF_COUNTERS] =
+{
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    // generic cache misses, the last level cache on the usual PMUs
+    {"llc-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+static long perfEventOpen(struct perf_event_attr *attr, int groupFd)
+{
+    // this thread, on whatever CPU it runs
+    return syscall(SYS_perf_event_open, attr, 0, -1, groupFd, 0);
+}
+
+// Opens one counter into its group, kernel included if allowed
+static int openCounter(int counter, int groupFd)
+{
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perfEvents[counter].type;
+    attr.config = perfEvents[counter].config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_hv = 1;
+
+    fd = perfEventOpen(&attr, groupFd);
+    if(fd < 0)
+    {
+        attr.exclude_kernel = 1;
+        fd = perfEventOpen(&attr, groupFd);
+    }
+
+    return fd;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline unsigned long long rdpmc(unsigned int counter)
+{
+    unsigned int low, high;
+
+    asm volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+    return low | ((unsigned long long)high << 32);
+}
+
+// Reads a counter and the times of its group through its user page, as
+// documented in linux/perf_event.h. Returns FALSE if the counter is not on a
+// PMU right now, or its times cannot be brought up to date in user space.
+static int readUserPage(struct perf_event_mmap_page *page, unsigned long long *value,
+                        unsigned long long *enabledNsec, unsigned long long *runningNsec)
+{
+    unsigned long long enabled, running, cycles, delta;
+    long long count, pmc;
+    unsigned int seq, index;
+
+    do
+    {
+        seq = __atomic_load_n(&page->lock, __ATOMIC_ACQUIRE);
+        index = page->index;
+        count = page->offset;
+        enabled = page->time_enabled;
+        running = page->time_running;
+
+        if(!page->cap_user_rdpmc || index == 0)
+            return FALSE;
+
+        // the times are as of the last switch onto the PMU: equal they stay
+        // equal, otherwise the time since then is added from the TSC
+        delta = 0;
+        if(enabled != running)
+        {
+            if(!page->cap_user_time)
+                return FALSE;
+
+            cycles = __rdtsc();
+            delta = page->time_offset + (cycles >> page->time_shift) * page->time_mult +
+                    (((cycles & ((1ULL << page->time_shift) - 1)) * page->time_mult) >> page->time_shift);
+        }
+
+        // the counter is pmc_width bits wide and signed, offset makes up the rest of the count
+        pmc = rdpmc(index - 1);
+        pmc <<= 64 - page->pmc_width;
+        pmc >>= 64 - page->pmc_width;
+        count += pmc;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+    while(__atomic_load_n(&page->lock, __ATOMIC_RELAXED) != seq);
+
+    *value = count;
+    *enabledNsec = enabled + delta;
+    *runningNsec = running + delta;
+    return TRUE;
+}
+#else
+static int readUserPage(struct perf_event_mmap_page *page, unsigned long long *value,
+                        unsigned long long *enabledNsec, unsigned long long *runningNsec)
+{
+    return FALSE;
+}
+#endif
+
+// Opens the counters of the calling thread, none at all if perf is off or unavailable
+void perfOpen(perfCounters_t *counters)
+{
+    struct perf_event_mmap_page *page;
+    int counter, group, fd;
+
+    memset(counters, 0, sizeof(perfCounters_t));
+    for(counter=0; counter < NUM_PERF_COUNTERS; counter++)
+        counters->fds[counter] = -1;
+    counters->groupFds[HARDWARE_GROUP] = counters->groupFds[SOFTWARE_GROUP] = -1;
+
+    if(telemetrySegment == NULL || !telemetrySegment->perfCounters)
+        return;
+
+    for(counter=0; counter < NUM_PERF_COUNTERS; counter++)
+    {
+        group = (counter < PERF_HARDWARE_COUNTERS) ? HARDWARE_GROUP : SOFTWARE_GROUP;
+
+        fd = openCounter(counter, counters->groupFds[group]);
+        if(fd < 0)
+            continue;
+
+        if(counters->groupFds[group] < 0)
+            counters->groupFds[group] = fd;
+        counters->fds[counter] = fd;
+        counters->groupMembers[group][counters->groupSizes[group]++] = counter;
+        counters->available |= (1 << counter);
+    }
+
+    // rdpmc only if every hardware counter offers it
+    counters->rdpmc = (counters->groupSizes[HARDWARE_GROUP] > 0);
+    for(counter=0; counter < PERF_HARDWARE_COUNTERS; counter++)
+    {
+        if(counters->fds[counter] < 0)
+            continue;
+
+        page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, counters->fds[counter], 0);
+        if(page == MAP_FAILED)
+        {
+            counters->rdpmc = FALSE;
+            continue;
+        }
+
+        counters->pages[counter] = page;
+        if(!page->cap_user_rdpmc)
+            counters->rdpmc = FALSE;
+    }
+}
+
+void perfClose(perfCounters_t *counters)
+{
+    int counter;
+
+    for(counter=0; counter < NUM_PERF_COUNTERS; counter++)
+    {
+        if(counter < PERF_HARDWARE_COUNTERS && counters->pages[counter] != NULL)
+            munmap(counters->pages[counter], sysconf(_SC_PAGESIZE));
+        if(counters->fds[counter] >= 0)
+            close(counters->fds[counter]);
+    }
+
+    counters->available = 0;
+}
+
+// One read() of a whole group: the number of counters, the enabled and running
+// times, then their values in opening order
+static void readGroup(perfCounters_t *counters, int group, perfSample_t *sample)
+{
+    unsigned long long values[3 + NUM_PERF_COUNTERS];
+    int member;
+
+    if(counters->groupFds[group] < 0 ||
+       read(counters->groupFds[group], values, sizeof(values)) < (ssize_t)(3 * sizeof(unsigned long long)))
+        return;
+
+    // software events are never multiplexed
+    if(group == HARDWARE_GROUP)
+    {
+        sample->enabledNsec = values[1];
+        sample->runningNsec = values[2];
+    }
+
+    for(member=0; member < counters->groupSizes[group] && member < (int)values[0]; member++)
+        sample->values[counters->groupMembers[group][member]] = values[3 + member];
+}
+
+void perfRead(perfCounters_t *counters, perfSample_t *sample)
+{
+    int counter, userSpace = counters->rdpmc;
+
+    memset(sample, 0, sizeof(perfSample_t));
+    if(counters->available == 0)
+        return;
+
+    for(counter=0; userSpace && counter < PERF_HARDWARE_COUNTERS; counter++)
+    {
+        if(counters->pages[counter] != NULL &&
+           !readUserPage(counters->pages[counter], &sample->values[counter], &sample->enabledNsec, &sample->runningNsec))
+            userSpace = FALSE;
+    }
+
+    if(!userSpace)
+        readGroup(counters, HARDWARE_GROUP, sample);
+    readGroup(counters, SOFTWARE_GROUP, sample);
+}
+
+// Accounts the counters of one release, and logs them unless soaking
+void perfRecordRelease(perfStats_t *stats, const perfCounters_t *counters, int serviceIdx,
+                       unsigned long long releaseCnt, unsigned long long execNsec,
+                       const perfSample_t *begin, const perfSample_t *end)
+{
+    perfSample_t delta;
+    int counter, multiplexed;
+
+    if(counters->available == 0)
+        return;
+
+    delta.enabledNsec = end->enabledNsec - begin->enabledNsec;
+    delta.runningNsec = end->runningNsec - begin->runningNsec;
+    multiplexed = (delta.runningNsec < delta.enabledNsec);
+
+    for(counter=0; counter < NUM_PERF_COUNTERS; counter++)
+    {
+        delta.values[counter] = end->values[counter] - begin->values[counter];
+
+        // the share of the release the hardware group spent off the PMU is extrapolated
+        if(multiplexed && counter < PERF_HARDWARE_COUNTERS)
+            delta.values[counter] = (delta.runningNsec > 0) ?
+                (unsigned long long)((double)delta.values[counter] * delta.enabledNsec / delta.runningNsec) : 0;
+
+        stats->sums[counter] += (double)delta.values[counter];
+    }
+
+    if(multiplexed)
+        stats->multiplexed++;
+
+    stats->available = counters->available;
+    stats->rdpmc = counters->rdpmc;
+    stats->sumExecNsec += (double)execNsec;
+    if(execNsec >= stats->maxExecNsec)
+    {
+        stats->maxExecNsec = execNsec;
+        stats->slowest = delta;
+    }
+    stats->releases++;
+
+    // a soak or a binary trace runs without a syslog line per release
+    if(telemetrySoaking() || traceFd >= 0)
+        return;
+
+    syslog(LOG_CRIT, "S%d release %llu exec usec=%.1lf cycles=%llu instructions=%llu llc-misses=%llu context-switches=%llu task-clock usec=%.1lf%s\n",
+           serviceIdx+1, releaseCnt, execNsec / 1000.0,
+           delta.values[PERF_CYCLES], delta.values[PERF_INSTRUCTIONS], delta.values[PERF_LLC_MISSES],
+           delta.values[PERF_CONTEXT_SWITCHES], delta.values[PERF_TASK_CLOCK] / 1000.0,
+           multiplexed ? " multiplexed, scaled" : "");
+}
+
+// Per release averages next to the execution time, and the counters of the slowest release
+void printPerfStats(int serviceIdx, const perfStats_t *stats)
+{
+    char available[192];
+    const perfSample_t *slowest = &stats->slowest;
+    double releases = (double)stats->releases, ipc = 0.0, slowestIpc = 0.0, slowestGhz = 0.0;
+    size_t used = 0;
+    int counter;
+
+    if(stats->releases == 0)
+        return;
+
+    available[0] = '\0';
+    for(counter=0; counter < NUM_PERF_COUNTERS; counter++)
+    {
+        if(stats->available & (1 << counter))
+            used += snprintf(available + used, sizeof(available) - used, "%s%s", (used > 0) ? "," : "", perfEvents[counter].name);
+    }
+
+    if(stats->rdpmc)
+        used += snprintf(available + used, sizeof(available) - used, ", rdpmc");
+    if(stats->multiplexed > 0)
+        used += snprintf(available + used, sizeof(available) - used, ", %llu multiplexed releases scaled", stats->multiplexed);
+
+    if(stats->sums[PERF_CYCLES] > 0.0)
+        ipc = stats->sums[PERF_INSTRUCTIONS] / stats->sums[PERF_CYCLES];
+    if(slowest->values[PERF_CYCLES] > 0)
+        slowestIpc = (double)slowest->values[PERF_INSTRUCTIONS] / slowest->values[PERF_CYCLES];
+    if(slowest->values[PERF_TASK_CLOCK] > 0)
+        slowestGhz = (double)slowest->values[PERF_CYCLES] / slowest->values[PERF_TASK_CLOCK];
+
+    printf("S%d perf (%s): avg exec usec=%.1lf cycles=%.0lf instructions=%.0lf IPC=%.2lf llc-misses=%.0lf context-switches=%.2lf task-clock usec=%.1lf\n",
+           serviceIdx+1, available, stats->sumExecNsec / releases / 1000.0,
+           stats->sums[PERF_CYCLES] / releases, stats->sums[PERF_INSTRUCTIONS] / releases, ipc,
+           stats->sums[PERF_LLC_MISSES] / releases, stats->sums[PERF_CONTEXT_SWITCHES] / releases,
+           stats->sums[PERF_TASK_CLOCK] / releases / 1000.0);
+    printf("S%d perf slowest release: exec usec=%.1lf cycles=%llu instructions=%llu IPC=%.2lf llc-misses=%llu context-switches=%llu task-clock usec=%.1lf GHz=%.2lf\n",
+           serviceIdx+1, stats->maxExecNsec / 1000.0, slowest->values[PERF_CYCLES], slowest->values[PERF_INSTRUCTIONS],
+           slowestIpc, slowest->values[PERF_LLC_MISSES], slowest->values[PERF_CONTEXT_SWITCHES],
+           slowest->values[PERF_TASK_CLOCK] / 1000.0, slowestGhz);
+    syslog(LOG_CRIT, "S%d perf (%s): avg exec usec=%.1lf cycles=%.0lf instructions=%.0lf IPC=%.2lf llc-misses=%.0lf context-switches=%.2lf task-clock usec=%.1lf\n",
+           serviceIdx+1, available, stats->sumExecNsec / releases / 1000.0,
+           stats->sums[PERF_CYCLES] / releases, stats->sums[PERF_INSTRUCTIONS] / releases, ipc,
+           stats->sums[PERF_LLC_MISSES] / releases, stats->sums[PERF_CONTEXT_SWITCHES] / releases,
+           stats->sums[PERF_TASK_CLOCK] / releases / 1000.0);
+    syslog(LOG_CRIT, "S%d perf slowest release: exec usec=%.1lf cycles=%llu instructions=%llu IPC=%.2lf llc-misses=%llu context-switches=%llu task-clock usec=%.1lf GHz=%.2lf\n",
+           serviceIdx+1, stats->maxExecNsec / 1000.0, slowest->values[PERF_CYCLES], slowest->values[PERF_INSTRUCTIONS],
+           slowestIpc, slowest->values[PERF_LLC_MISSES], slowest->values[PERF_CONTEXT_SWITCHES],
+           slowest->values[PERF_TASK_CLOCK] / 1000.0, slowestGhz);
+}
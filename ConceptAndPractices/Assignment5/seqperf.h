@@ -0,0 +1,66 @@
+// Performance counters of seqgen3 services (perf_event_open)
+//
+// Each service opens its own counters, for itself only: a hardware group
+// (cycles, instructions, last level cache misses) and a software group
+// (context switches, task clock). Every release is measured from wakeup to the
+// end of its job, so a slow release can be told apart: more instructions, a
+// low IPC from cache misses, a low clock rate (cycles per task clock) or
+// preemption. Counters the platform does not offer (hardware ones in most VMs)
+// are left out, with none at all the measurement is a no-op.
+
+#ifndef SEQPERF_H
+#define SEQPERF_H
+
+enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_TASK_CLOCK,                 // nanoseconds on the CPU
+    NUM_PERF_COUNTERS
+};
+
+#define PERF_HARDWARE_COUNTERS (PERF_LLC_MISSES + 1)
+
+typedef struct
+{
+    unsigned long long values[NUM_PERF_COUNTERS];
+    unsigned long long enabledNsec;  // hardware group enabled, on a PMU or waiting for one
+    unsigned long long runningNsec;  // hardware group on a PMU
+} perfSample_t;
+
+// Counters of one service over the run, plain data like releaseStats_t
+typedef struct
+{
+    unsigned int available;          // bit per counter that could be opened
+    int rdpmc;                       // hardware counters read in user space
+    unsigned long long releases;
+    unsigned long long multiplexed;  // releases with the hardware group off the PMU for a while, scaled
+    double sumExecNsec;              // wakeup to end of job
+    double sums[NUM_PERF_COUNTERS];
+    unsigned long long maxExecNsec;
+    perfSample_t slowest;            // counters of the release with the longest execution
+} perfStats_t;
+
+// Counters opened by (and counting) the calling service thread
+typedef struct
+{
+    int fds[NUM_PERF_COUNTERS];
+    int groupFds[2];                 // hardware and software group leaders
+    int groupSizes[2];
+    int groupMembers[2][NUM_PERF_COUNTERS];
+    void *pages[PERF_HARDWARE_COUNTERS]; // user pages of the hardware counters, for rdpmc
+    unsigned int available;
+    int rdpmc;
+} perfCounters_t;
+
+void perfOpen(perfCounters_t *counters);
+void perfClose(perfCounters_t *counters);
+void perfRead(perfCounters_t *counters, perfSample_t *sample);
+void perfRecordRelease(perfStats_t *stats, const perfCounters_t *counters, int serviceIdx,
+                       unsigned long long releaseCnt, unsigned long long execNsec,
+                       const perfSample_t *begin, const perfSample_t *end);
+void printPerfStats(int serviceIdx, const perfStats_t *stats);
+
+#endif
@@ -0,0 +1,178 @@
+// Pipeline mode of seqgen3
+//
+// Each stage measures, per frame, the time from being handed to its queue (its
+// release, for stage 0) to the end of its job, and the last stage the time from
+// the origin of the frame. Every histogram and counter has a single writer, the
+// stage thread, and is read once the stages have been joined.
+
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "seqgen3.h"
+#include "seqpipe.h"
+#include "seqframe.h"
+
+static const double reportPercentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+pipelineMode_t pipelineMode = PIPELINE_OFF;
+int pipelineStages;
+
+// queues[i] feeds stage i, queues[0] is not used
+static pipeQueue_t queues[MAX_SERVICES];
+static histogram_t stageLatencyNsec[MAX_SERVICES];
+static histogram_t endToEndNsec;
+static unsigned long long captured;
+
+void startPipeline(pipelineMode_t mode, int stages)
+{
+    memset(queues, 0, sizeof(queues));
+    memset(stageLatencyNsec, 0, sizeof(stageLatencyNsec));
+    memset(&endToEndNsec, 0, sizeof(endToEndNsec));
+    captured = 0;
+
+    pipelineStages = stages;
+    pipelineMode = mode;
+}
+
+void pipelineStageOpen(int serviceIdx)
+{
+    if(pipelineMode != PIPELINE_OFF && serviceIdx < pipelineStages)
+        frameStageOpen(serviceIdx);
+}
+
+void pipelineStageClose(int serviceIdx)
+{
+    if(pipelineMode != PIPELINE_OFF && serviceIdx < pipelineStages)
+        frameStageClose(serviceIdx);
+}
+
+static int pipePush(pipeQueue_t *queue, const pipeItem_t *item)
+{
+    unsigned int head = queue->head;
+
+    if(head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == PIPE_QUEUE_DEPTH)
+    {
+        __atomic_store_n(&queue->drops, queue->drops + 1, __ATOMIC_RELAXED);
+        return FALSE;
+    }
+
+    queue->items[head % PIPE_QUEUE_DEPTH] = *item;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+    return TRUE;
+}
+
+int pipelineRunStage(int serviceIdx, unsigned long long releaseNsec, unsigned long long releaseCnt)
+{
+    pipeItem_t batch[PIPE_QUEUE_DEPTH];
+    pipeQueue_t *queue;
+    unsigned long long doneNsec;
+    unsigned int head, tail, count, i, pushed = 0;
+
+    if(pipelineMode == PIPELINE_OFF || serviceIdx >= pipelineStages)
+        return -1;
+
+    if(serviceIdx == 0)
+    {
+        batch[0].frame = releaseCnt;
+        batch[0].originNsec = releaseNsec;
+        batch[0].enqueueNsec = releaseNsec;
+        batch[0].buffer = framePoolActive ? frameCapture(0, releaseCnt, releaseNsec) : -1;
+        captured++;
+
+        // no free buffer, the frame is lost before it exists
+        count = (framePoolActive && batch[0].buffer < 0) ? 0 : 1;
+    }
+    else
+    {
+        queue = &queues[serviceIdx];
+        tail = queue->tail;
+        head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        count = head - tail;
+
+        for(i=0; i < count; i++)
+            batch[i] = queue->items[(tail + i) % PIPE_QUEUE_DEPTH];
+        __atomic_store_n(&queue->tail, head, __ATOMIC_RELEASE);
+
+        if(count > queue->maxDepth)
+            queue->maxDepth = count;
+        queue->sumDepth += count;
+        queue->takes++;
+
+        for(i=0; i < count; i++)
+        {
+            if(batch[i].buffer >= 0)
+                frameProcess(serviceIdx, batch[i].buffer, serviceIdx == pipelineStages-1);
+        }
+    }
+
+    doneNsec = nowNsec();
+
+    for(i=0; i < count; i++)
+    {
+        histogramRecord(&stageLatencyNsec[serviceIdx], doneNsec - batch[i].enqueueNsec);
+
+        if(serviceIdx == pipelineStages-1)
+        {
+            histogramRecord(&endToEndNsec, doneNsec - batch[i].originNsec);
+            if(batch[i].buffer >= 0)
+                frameRelease(batch[i].buffer);
+            continue;
+        }
+
+        batch[i].enqueueNsec = doneNsec;
+        if(pipePush(&queues[serviceIdx+1], &batch[i]))
+            pushed++;
+        else if(batch[i].buffer >= 0)
+            frameRelease(batch[i].buffer);
+    }
+
+    return (pushed > 0 && pipelineDataDriven(serviceIdx+1)) ? serviceIdx+1 : -1;
+}
+
+static void printLatencies(const char *what, const histogram_t *histogram)
+{
+    char line[256];
+    int len, p;
+
+    len = snprintf(line, sizeof(line), "%s: %llu frames, latency usec", what, histogram->count);
+    for(p=0; p < sizeof(reportPercentiles) / sizeof(reportPercentiles[0]) && len < sizeof(line); p++)
+        len += snprintf(line + len, sizeof(line) - len, " p%g=%.1lf", reportPercentiles[p],
+                        histogramPercentile(histogram, reportPercentiles[p]) / 1000.0);
+    if(len < sizeof(line))
+        snprintf(line + len, sizeof(line) - len, " max=%.1lf", histogram->max / 1000.0);
+
+    printf("%s\n", line);
+    syslog(LOG_CRIT, "%s\n", line);
+}
+
+void printPipelineStats(void)
+{
+    char what[64];
+    pipeQueue_t *queue;
+    int i;
+
+    if(pipelineMode == PIPELINE_OFF)
+        return;
+
+    printf("\nPipeline of %d stages, %s: %llu frames captured, %llu delivered\n", pipelineStages,
+           (pipelineMode == PIPELINE_DATA) ? "later stages woken by their input" : "every stage released by the sequencer",
+           captured, endToEndNsec.count);
+
+    for(i=0; i < pipelineStages; i++)
+    {
+        snprintf(what, sizeof(what), "Pipeline stage %d (S%d)", i, i+1);
+        printLatencies(what, &stageLatencyNsec[i]);
+
+        if(i == 0)
+            continue;
+
+        queue = &queues[i];
+        printf("Pipeline queue into S%d: depth avg=%.2lf max=%u, %llu drops\n", i+1,
+               (queue->takes > 0) ? (double)queue->sumDepth / queue->takes : 0.0, queue->maxDepth, queue->drops);
+    }
+
+    printLatencies("Pipeline end to end", &endToEndNsec);
+    printFrameStats(pipelineStages);
+}
@@ -0,0 +1,72 @@
+// Pipeline mode of seqgen3: the initial services chained as the stages of a
+// frame pipeline (capture -> process -> output), in thread mode
+//
+// Frames are time stamps only, or with a frame pool (seqframe.h) buffers of
+// pixels the stages work on in place.
+//
+// Stage 0 makes one frame per release, stamped with its release time as the
+// origin. Each later stage takes every frame waiting in its input queue, runs
+// its job once for them and passes them on. Consecutive stages share a single
+// producer, single consumer queue whose producer and consumer indexes sit on
+// separate cache lines; a frame that finds the queue full is dropped.
+//
+// With PIPELINE_SEQUENCER every stage is released by the sequencer at its own
+// rate, with PIPELINE_DATA only stage 0 is, and a stage that passes frames on
+// releases the next one itself.
+
+#ifndef SEQPIPE_H
+#define SEQPIPE_H
+
+#include "seqhist.h"
+
+// Frames a queue between two stages holds
+#define PIPE_QUEUE_DEPTH (64)
+
+typedef enum
+{
+    PIPELINE_OFF,
+    PIPELINE_SEQUENCER,
+    PIPELINE_DATA
+} pipelineMode_t;
+
+typedef struct
+{
+    unsigned long long frame;        // release of stage 0 that made it
+    unsigned long long originNsec;   // release time of that release
+    unsigned long long enqueueNsec;  // handed to the queue by the previous stage
+    int buffer;                      // in the frame pool, -1 without one
+} pipeItem_t;
+
+typedef struct
+{
+    unsigned int head;                           // written by the producer only
+    unsigned long long drops;                    // frames that found the queue full
+    unsigned int tail __attribute__((aligned(64)));  // written by the consumer only
+    unsigned int maxDepth;                       // seen by the consumer
+    unsigned long long sumDepth;
+    unsigned long long takes;
+    pipeItem_t items[PIPE_QUEUE_DEPTH] __attribute__((aligned(64)));
+} __attribute__((aligned(64))) pipeQueue_t;
+
+extern pipelineMode_t pipelineMode;
+extern int pipelineStages;
+
+// A later stage of a data driven pipeline is not released by the sequencer
+static inline int pipelineDataDriven(int serviceIdx)
+{
+    return pipelineMode == PIPELINE_DATA && serviceIdx > 0 && serviceIdx < pipelineStages;
+}
+
+void startPipeline(pipelineMode_t mode, int stages);
+
+// Calling service thread, at its start and end
+void pipelineStageOpen(int serviceIdx);
+void pipelineStageClose(int serviceIdx);
+
+// After the job of a timed release of stage serviceIdx. Returns the service
+// to release for the frames just passed on, -1 if none.
+int pipelineRunStage(int serviceIdx, unsigned long long releaseNsec, unsigned long long releaseCnt);
+
+void printPipelineStats(void);
+
+#endif
@@ -0,0 +1,449 @@
+// Power state of the real-time cores during a run
+//
+// The latency limit is a PM QoS request: it holds as long as the file
+// descriptor stays open, and the kernel drops it when the process exits,
+// however it exits. The cpufreq settings outlive the process, so the values
+// found are saved per core before the first write and written back by an
+// atexit handler as well as by stopPowerControl.
+//
+// APERF counts cycles at the actual frequency and MPERF at the base frequency,
+// both only while the core is not idle: their ratio over a sampling interval
+// is the average frequency the core ran at while it was busy.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <syslog.h>
+#include <stdint.h>
+
+#include "seqpower.h"
+#include "seqthread.h"
+
+#define DMA_LATENCY_PATH "/dev/cpu_dma_latency"
+#define CPUFREQ_PATH "/sys/devices/system/cpu/cpu%d/cpufreq/%s"
+#define CPUIDLE_PATH "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/%s"
+#define MSR_PATH "/dev/cpu/%d/msr"
+
+#define MSR_IA32_MPERF (0xe7)
+#define MSR_IA32_APERF (0xe8)
+
+#define POWER_VALUE_LEN (64)
+
+static const char *frequencyModeNames[NUM_FREQUENCY_MODES] = {"keep", "performance", "max", "fixed"};
+
+typedef struct
+{
+    int pinned;                            // settings below saved and changed
+    char governor[POWER_VALUE_LEN];
+    char minKhz[POWER_VALUE_LEN];
+    char maxKhz[POWER_VALUE_LEN];
+    int msrFd;                             // -1 to sample scaling_cur_freq
+    double baseMhz;                        // MPERF rate
+    unsigned long long lastAperf, lastMperf;
+    unsigned long long samples;
+    double minMhz, maxMhz, sumMhz;
+} powerCore_t;
+
+static powerCore_t cores[POWER_MAX_CORES];
+static unsigned long long powerCores;
+static int dmaLatencyFd = -1, dmaLatencyUsec;
+static frequencyPin_t frequencyPin;
+static pthread_t samplerThread;
+static volatile int samplerActive = 0, samplerStop = 0;
+static int atexitRegistered = 0;
+
+static int readPath(const char *path, char *value, size_t len)
+{
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL)
+        return -1;
+
+    if(fgets(value, len, file) == NULL)
+        value[0] = '\0';
+    fclose(file);
+
+    value[strcspn(value, "\n")] = '\0';
+    return 0;
+}
+
+// A cpufreq attribute of a core
+static int readValue(int core, const char *name, char *value, size_t len)
+{
+    char path[128];
+
+    snprintf(path, sizeof(path), CPUFREQ_PATH, core, name);
+    return readPath(path, value, len);
+}
+
+static int writeValue(int core, const char *name, const char *value)
+{
+    char path[128];
+    int fd, rc = 0;
+
+    snprintf(path, sizeof(path), CPUFREQ_PATH, core, name);
+    fd = open(path, O_WRONLY);
+    if(fd < 0)
+        return -1;
+
+    if(write(fd, value, strlen(value)) < 0)
+        rc = -1;
+
+    close(fd);
+    return rc;
+}
+
+// The range is widened to the hardware minimum first, so min never goes above max on the way
+static int writeFrequencyRange(int core, const char *minKhz, const char *maxKhz)
+{
+    char lowest[POWER_VALUE_LEN];
+
+    if(readValue(core, "cpuinfo_min_freq", lowest, sizeof(lowest)) != 0 ||
+       writeValue(core, "scaling_min_freq", lowest) != 0 ||
+       writeValue(core, "scaling_max_freq", maxKhz) != 0 ||
+       writeValue(core, "scaling_min_freq", minKhz) != 0)
+        return -1;
+
+    return 0;
+}
+
+int parseFrequencyPin(const char *arg, frequencyPin_t *pin)
+{
+    char *end;
+    int mode;
+
+    for(mode=0; mode < FREQUENCY_FIXED; mode++)
+    {
+        if(strcmp(arg, frequencyModeNames[mode]) == 0)
+        {
+            pin->mode = mode;
+            pin->fixedKhz = 0;
+            return 0;
+        }
+    }
+
+    pin->fixedKhz = strtoul(arg, &end, 10);
+    if(end == arg || *end != '\0' || pin->fixedKhz == 0)
+        return -1;
+
+    pin->mode = FREQUENCY_FIXED;
+    return 0;
+}
+
+static void restorePower(void)
+{
+    int core;
+
+    for(core=0; core < POWER_MAX_CORES; core++)
+    {
+        if(!cores[core].pinned)
+            continue;
+
+        if((cores[core].governor[0] != '\0' && writeValue(core, "scaling_governor", cores[core].governor) != 0) ||
+           writeFrequencyRange(core, cores[core].minKhz, cores[core].maxKhz) != 0)
+            printf("Core %d: cpufreq settings could not be restored (%s)\n", core, strerror(errno));
+
+        cores[core].pinned = 0;
+    }
+
+    if(dmaLatencyFd >= 0)
+    {
+        close(dmaLatencyFd);
+        dmaLatencyFd = -1;
+    }
+}
+
+static int pinCore(int core)
+{
+    powerCore_t *state = &cores[core];
+    char khz[POWER_VALUE_LEN];
+
+    if(readValue(core, "scaling_governor", state->governor, sizeof(state->governor)) != 0 ||
+       readValue(core, "scaling_min_freq", state->minKhz, sizeof(state->minKhz)) != 0 ||
+       readValue(core, "scaling_max_freq", state->maxKhz, sizeof(state->maxKhz)) != 0)
+    {
+        printf("Core %d has no cpufreq policy, its frequency cannot be pinned\n", core);
+        return -1;
+    }
+
+    state->pinned = 1;
+
+    switch(frequencyPin.mode)
+    {
+        case FREQUENCY_PERFORMANCE:
+            if(writeValue(core, "scaling_governor", "performance") != 0)
+            {
+                perror("performance governor");
+                return -1;
+            }
+            break;
+
+        case FREQUENCY_MAX:
+        case FREQUENCY_FIXED:
+            if(frequencyPin.mode == FREQUENCY_MAX)
+                readValue(core, "cpuinfo_max_freq", khz, sizeof(khz));
+            else
+                snprintf(khz, sizeof(khz), "%u", frequencyPin.fixedKhz);
+
+            if(writeFrequencyRange(core, khz, khz) != 0)
+            {
+                perror("scaling_min_freq/scaling_max_freq");
+                return -1;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    readValue(core, "scaling_governor", khz, sizeof(khz));
+    printf("Core %d cpufreq pinned (%s): governor %s, ", core, frequencyModeNames[frequencyPin.mode], khz);
+    readValue(core, "scaling_min_freq", khz, sizeof(khz));
+    printf("%s-", khz);
+    readValue(core, "scaling_max_freq", khz, sizeof(khz));
+    printf("%s kHz, was %s %s-%s kHz\n", khz, state->governor, state->minKhz, state->maxKhz);
+    return 0;
+}
+
+// Idle states whose exit latency exceeds the limit, which the cores no longer enter
+static void reportIdleStates(int core)
+{
+    char path[128], name[POWER_VALUE_LEN], latency[POWER_VALUE_LEN];
+    int state, skipped = 0;
+
+    for(state=0; ; state++)
+    {
+        snprintf(path, sizeof(path), CPUIDLE_PATH, core, state, "latency");
+        if(readPath(path, latency, sizeof(latency)) != 0)
+            break;
+
+        if(atoi(latency) <= dmaLatencyUsec)
+            continue;
+
+        snprintf(path, sizeof(path), CPUIDLE_PATH, core, state, "name");
+        if(readPath(path, name, sizeof(name)) != 0)
+            snprintf(name, sizeof(name), "state%d", state);
+
+        if(skipped++ == 0)
+            printf("Core %d idle states kept out by the %d usec latency limit:", core, dmaLatencyUsec);
+        printf(" %s (%s usec)", name, latency);
+    }
+
+    if(skipped > 0)
+        printf("\n");
+    else if(state == 0)
+        printf("Core %d has no cpuidle states to keep out\n", core);
+    else
+        printf("Core %d has no idle state slower to exit than %d usec\n", core, dmaLatencyUsec);
+}
+
+static int readMsr(int fd, unsigned int msr, unsigned long long *value)
+{
+    uint64_t raw;
+
+    if(pread(fd, &raw, sizeof(raw), msr) != sizeof(raw))
+        return -1;
+
+    *value = raw;
+    return 0;
+}
+
+// APERF/MPERF needs the msr driver (modprobe msr) and the base frequency of intel_pstate
+static void openFrequencyCounters(int core)
+{
+    powerCore_t *state = &cores[core];
+    char path[64], khz[POWER_VALUE_LEN];
+
+    state->msrFd = -1;
+
+    if(readValue(core, "base_frequency", khz, sizeof(khz)) != 0 || atof(khz) <= 0.0)
+        return;
+
+    snprintf(path, sizeof(path), MSR_PATH, core);
+    state->msrFd = open(path, O_RDONLY);
+    if(state->msrFd < 0)
+        return;
+
+    state->baseMhz = atof(khz) / 1000.0;
+    if(readMsr(state->msrFd, MSR_IA32_APERF, &state->lastAperf) != 0 ||
+       readMsr(state->msrFd, MSR_IA32_MPERF, &state->lastMperf) != 0)
+    {
+        close(state->msrFd);
+        state->msrFd = -1;
+    }
+}
+
+static void sampleCore(int core)
+{
+    powerCore_t *state = &cores[core];
+    unsigned long long aperf, mperf;
+    double mhz;
+
+    if(state->msrFd >= 0)
+    {
+        if(readMsr(state->msrFd, MSR_IA32_APERF, &aperf) != 0 || readMsr(state->msrFd, MSR_IA32_MPERF, &mperf) != 0)
+            return;
+
+        // a core idle for the whole interval did not run at any frequency
+        if(mperf == state->lastMperf)
+            return;
+
+        mhz = state->baseMhz * (double)(aperf - state->lastAperf) / (double)(mperf - state->lastMperf);
+        state->lastAperf = aperf;
+        state->lastMperf = mperf;
+    }
+    else
+    {
+        mhz = coreFrequencyMhz(core);
+        if(mhz <= 0.0)
+            return;
+    }
+
+    if(state->samples == 0 || mhz < state->minMhz)
+        state->minMhz = mhz;
+    if(mhz > state->maxMhz)
+        state->maxMhz = mhz;
+    state->sumMhz += mhz;
+    state->samples++;
+}
+
+static void *sampleFrequencies(void *arg)
+{
+    struct timespec pause = {POWER_SAMPLE_MS / 1000, (POWER_SAMPLE_MS % 1000) * 1000000L};
+    int core;
+
+    while(!samplerStop)
+    {
+        nanosleep(&pause, NULL);
+
+        for(core=0; core < POWER_MAX_CORES; core++)
+        {
+            if(powerCores & (1ULL << core))
+                sampleCore(core);
+        }
+    }
+
+    return NULL;
+}
+
+double coreFrequencyMhz(int core)
+{
+    char khz[POWER_VALUE_LEN];
+
+    if(readValue(core, "scaling_cur_freq", khz, sizeof(khz)) != 0)
+        return 0.0;
+
+    return atof(khz) / 1000.0;
+}
+
+int startPowerControl(unsigned long long coreMask, int latencyUsec, const frequencyPin_t *pin)
+{
+    int32_t request;
+    int core, rc;
+
+    powerCores = coreMask;
+    frequencyPin = *pin;
+    dmaLatencyUsec = latencyUsec;
+
+    if(!atexitRegistered)
+    {
+        atexit(restorePower);
+        atexitRegistered = 1;
+    }
+
+    // the PM QoS interface takes a binary 32 bit value
+    if(latencyUsec >= 0)
+    {
+        dmaLatencyFd = open(DMA_LATENCY_PATH, O_RDWR);
+        request = latencyUsec;
+        if(dmaLatencyFd < 0 || write(dmaLatencyFd, &request, sizeof(request)) != sizeof(request))
+        {
+            perror(DMA_LATENCY_PATH);
+            restorePower();
+            return -1;
+        }
+
+        printf("Holding %s at %d usec\n", DMA_LATENCY_PATH, latencyUsec);
+        syslog(LOG_CRIT, "Holding %s at %d usec\n", DMA_LATENCY_PATH, latencyUsec);
+    }
+
+    for(core=0; core < POWER_MAX_CORES; core++)
+    {
+        if(!(coreMask & (1ULL << core)))
+            continue;
+
+        if(latencyUsec >= 0)
+            reportIdleStates(core);
+
+        if(frequencyPin.mode != FREQUENCY_KEEP && pinCore(core) != 0)
+        {
+            restorePower();
+            return -1;
+        }
+
+        cores[core].samples = 0;
+        cores[core].sumMhz = cores[core].maxMhz = 0.0;
+        openFrequencyCounters(core);
+    }
+
+    samplerStop = 0;
+    rc = startNonRtThread(&samplerThread, sampleFrequencies, NULL);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for frequency sampler");
+        restorePower();
+        return -1;
+    }
+
+    samplerActive = 1;
+    return 0;
+}
+
+void stopPowerControl(void)
+{
+    const powerCore_t *state;
+    int core;
+
+    if(samplerActive)
+    {
+        samplerStop = 1;
+        pthread_join(samplerThread, NULL);
+        samplerActive = 0;
+    }
+
+    for(core=0; core < POWER_MAX_CORES; core++)
+    {
+        if(!(powerCores & (1ULL << core)))
+            continue;
+
+        state = &cores[core];
+        if(state->samples == 0)
+        {
+            printf("Core %d frequency unknown: no cpufreq policy and no APERF/MPERF\n", core);
+            continue;
+        }
+
+        printf("Core %d frequency MHz min/avg/max=%.0lf/%.0lf/%.0lf over %llu samples (%s, cpufreq %s)\n", core,
+               state->minMhz, state->sumMhz / state->samples, state->maxMhz, state->samples,
+               (state->msrFd >= 0) ? "APERF/MPERF" : "scaling_cur_freq", frequencyModeNames[frequencyPin.mode]);
+        syslog(LOG_CRIT, "Core %d frequency MHz min/avg/max=%.0lf/%.0lf/%.0lf over %llu samples (%s, cpufreq %s)\n", core,
+               state->minMhz, state->sumMhz / state->samples, state->maxMhz, state->samples,
+               (state->msrFd >= 0) ? "APERF/MPERF" : "scaling_cur_freq", frequencyModeNames[frequencyPin.mode]);
+
+        if(state->msrFd >= 0)
+            close(state->msrFd);
+    }
+
+    restorePower();
+}
@@ -0,0 +1,56 @@
+// Power state of the real-time cores during a run: C-state and frequency pinning
+//
+// Wakeup latency includes the exit from a deep idle state and the time the
+// core takes to ramp its frequency back up, which hides the software behaviour
+// being measured. For the length of a run this module can hold
+// /dev/cpu_dma_latency open with a latency limit, which keeps every core out of
+// the idle states that take longer to exit, and pin the cpufreq policy of the
+// RT cores: the performance governor, or scaling_min_freq = scaling_max_freq.
+// Everything changed is restored at the end of the run, or at exit.
+//
+// Whether pinned or not, a non-RT thread samples the actual frequency of every
+// RT core, from APERF/MPERF through /dev/cpu/<n>/msr where the msr driver and
+// a base frequency are available, from scaling_cur_freq otherwise, so results
+// show the power state they ran in.
+//
+// The module does not depend on the sequencer, posix_clock links it as well.
+
+#ifndef SEQPOWER_H
+#define SEQPOWER_H
+
+// Frequency sampling interval. An MSR read interrupts the core it is read on.
+#define POWER_SAMPLE_MS (500)
+
+// Cores a power policy can apply to, one bit each
+#define POWER_MAX_CORES (64)
+
+typedef enum
+{
+    FREQUENCY_KEEP,          // cpufreq left alone, only sampled
+    FREQUENCY_PERFORMANCE,   // performance governor
+    FREQUENCY_MAX,           // min = max = cpuinfo_max_freq
+    FREQUENCY_FIXED,         // min = max = a given frequency
+    NUM_FREQUENCY_MODES
+} frequencyMode_t;
+
+typedef struct
+{
+    frequencyMode_t mode;
+    unsigned int fixedKhz;   // with FREQUENCY_FIXED
+} frequencyPin_t;
+
+// "keep", "performance", "max" or a frequency in kHz, -1 if none of those
+int parseFrequencyPin(const char *arg, frequencyPin_t *pin);
+
+// Holds the latency limit (dmaLatencyUsec < 0 for none), pins the frequency of
+// the cores of coreMask and starts sampling them. On failure whatever was
+// changed is restored.
+int startPowerControl(unsigned long long coreMask, int dmaLatencyUsec, const frequencyPin_t *pin);
+
+// Stops sampling, prints the frequency every core ran at and restores the settings
+void stopPowerControl(void);
+
+// Current frequency of a core as cpufreq reports it, 0 if unknown
+double coreFrequencyMhz(int core);
+
+#endif
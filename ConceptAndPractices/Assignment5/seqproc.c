@@ -0,0 +1,311 @@
+// Multi-process mode of seqgen3
+//
+// With every service a thread of the sequencer process, one crashing or leaking
+// service takes the whole timing loop down. In this mode the sequencer owns a
+// shared memory segment with one release gate per service, and each service
+// runs as its own process (seqgen3 -S <n>, exec'd by the sequencer) that
+// attaches to the segment by name.
+//
+// A release stamps the gate, increments its futex word and wakes the waiter
+// with a (non private) FUTEX_WAKE, all async-signal-safe from the Sequencer
+// handler. The service counts the releases it handled, so like sem_post in the
+// thread mode no release is lost if it runs late.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "seqproc.h"
+#include "seqtelemetry.h"
+#include "seqtrace.h"
+#include "seqspin.h"
+#include "seqbudget.h"
+#include "seqthread.h"
+
+releaseSegment_t *releaseSegment = NULL;
+
+static const char *serviceProgramName;
+
+static int futexWait(unsigned int *word, unsigned int value)
+{
+    return syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+// Same, returns after timeoutNsec at the latest
+static int futexWaitFor(unsigned int *word, unsigned int value, unsigned long long timeoutNsec)
+{
+    struct timespec timeout;
+
+    timeout.tv_sec = timeoutNsec / NANOSEC_PER_SEC;
+    timeout.tv_nsec = timeoutNsec % NANOSEC_PER_SEC;
+
+    return syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static int futexWake(unsigned int *word)
+{
+    return syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Creates and maps the release segment, services are exec'd as programName -S <n>
+int createReleaseSegment(const char *programName)
+{
+    int fd;
+
+    serviceProgramName = programName;
+
+    fd = shm_open(RELEASE_SEGMENT_NAME, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if(fd < 0)
+    {
+        perror("shm_open release segment");
+        return -1;
+    }
+
+    if(ftruncate(fd, sizeof(releaseSegment_t)) < 0)
+    {
+        perror("ftruncate release segment");
+        close(fd);
+        shm_unlink(RELEASE_SEGMENT_NAME);
+        return -1;
+    }
+
+    releaseSegment = mmap(NULL, sizeof(releaseSegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(releaseSegment == MAP_FAILED)
+    {
+        perror("mmap release segment");
+        releaseSegment = NULL;
+        shm_unlink(RELEASE_SEGMENT_NAME);
+        return -1;
+    }
+
+    memset(releaseSegment, 0, sizeof(releaseSegment_t));
+    releaseSegment->startRealtime = start_realtime;
+    releaseSegment->traceFd = traceFd;
+
+    return 0;
+}
+
+void destroyReleaseSegment(void)
+{
+    munmap(releaseSegment, sizeof(releaseSegment_t));
+    releaseSegment = NULL;
+    shm_unlink(RELEASE_SEGMENT_NAME);
+}
+
+// Forks and execs the process of the service whose model and priority are filled in threadParams[serviceIdx]
+int startServiceProcess(int serviceIdx)
+{
+    releaseGate_t *gate = &releaseSegment->gates[serviceIdx];
+    struct sched_param param;
+    cpu_set_t servicecpu;
+    char serviceArg[16];
+    pid_t pid;
+
+    memset(gate, 0, sizeof(releaseGate_t));
+    gate->model = threadParams[serviceIdx].model;
+
+    // prepared before the fork, only async-signal-safe calls in the child
+    snprintf(serviceArg, sizeof(serviceArg), "%d", serviceIdx+1);
+    CPU_ZERO(&servicecpu);
+    CPU_SET(gate->model.core, &servicecpu);
+    param.sched_priority = threadParams[serviceIdx].priority;
+
+    // forked from inside the RT partition under seqisol, so the child can be pinned
+    if(enterRtPartition() != 0)
+    {
+        perror("enter the RT partition");
+        return -1;
+    }
+
+    pid = fork();
+    if(pid != 0 && leaveRtPartition() != 0)
+        perror("leave the RT partition");
+
+    if(pid < 0)
+    {
+        perror("fork for service process");
+        return -1;
+    }
+
+    if(pid == 0)
+    {
+        // the service process must not run at the RT_MAX priority inherited from main
+        if(sched_setaffinity(0, sizeof(cpu_set_t), &servicecpu) < 0 ||
+           sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+            _exit(126);
+
+        execl("/proc/self/exe", serviceProgramName, "-S", serviceArg, (char *)NULL);
+        _exit(127);
+    }
+
+    threadParams[serviceIdx].pid = pid;
+    return 0;
+}
+
+// Called from the Sequencer signal handler
+void releaseServiceProcess(int serviceIdx, unsigned long long releaseNsec, long long releasePhaseNsec)
+{
+    releaseGate_t *gate = &releaseSegment->gates[serviceIdx];
+
+    gate->releaseNsec = releaseNsec;
+    gate->releasePhaseNsec = releasePhaseNsec;
+    __atomic_store_n(&gate->released, gate->released + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&gate->gate, 1, __ATOMIC_RELEASE);
+    futexWake(&gate->gate);
+}
+
+void abortServiceProcess(int serviceIdx)
+{
+    releaseSegment->gates[serviceIdx].abort = TRUE;
+    releaseServiceProcess(serviceIdx, nowNsec(), 0);
+}
+
+// Waits for the service process to exit and reports how it ended
+void joinServiceProcess(int serviceIdx)
+{
+    int status;
+
+    if(waitpid(threadParams[serviceIdx].pid, &status, 0) < 0)
+    {
+        perror("waitpid service process");
+        return;
+    }
+
+    if(WIFSIGNALED(status))
+        printf("S%d process killed by signal %d\n", serviceIdx+1, WTERMSIG(status));
+    else if(WEXITSTATUS(status) != 0)
+        printf("S%d process exited with status %d\n", serviceIdx+1, WEXITSTATUS(status));
+    else
+        printf("joined process %d\n", serviceIdx);
+}
+
+unsigned long long completedServiceProcess(int serviceIdx)
+{
+    return releaseSegment->gates[serviceIdx].completed;
+}
+
+void setServiceProcessPriority(int serviceIdx, int priority)
+{
+    struct sched_param param;
+
+    param.sched_priority = priority;
+    if(sched_setparam(threadParams[serviceIdx].pid, &param) < 0)
+        perror("sched_setparam service process");
+}
+
+// Body of a service process (seqgen3 -S <n>): attach to the release segment
+// and handle every release given through the gate until aborted
+int serviceProcessMain(int serviceIdx)
+{
+    releaseGate_t *gate;
+    unsigned long long releaseCnt=0, handledCnt=0, wakeNsec, releaseNsec, waitNsec, openNsec, now, execNsec;
+    long long releasePhaseNsec;
+    unsigned int handled=0, latest;
+    perfCounters_t counters;
+    perfSample_t begin, end;
+    spinWindow_t spin = {{0}};
+    spinOutcome_t spun;
+    budgetTimer_t budget;
+    int fd;
+
+    fd = shm_open(RELEASE_SEGMENT_NAME, O_RDWR, 0);
+    if(fd < 0)
+    {
+        perror("shm_open release segment");
+        return -1;
+    }
+
+    releaseSegment = mmap(NULL, sizeof(releaseSegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(releaseSegment == MAP_FAILED)
+    {
+        perror("mmap release segment");
+        return -1;
+    }
+
+    start_realtime = releaseSegment->startRealtime;
+    traceFd = releaseSegment->traceFd;
+    gate = &releaseSegment->gates[serviceIdx];
+
+    // best effort, the service runs without telemetry if the segment is not there
+    attachTelemetrySegment();
+
+    syslog(LOG_CRIT, "S%d process @ sec=%6.9lf\n", serviceIdx+1, ((double)nowNsec() / NANOSEC_PER_SEC) - start_realtime);
+
+    // counters of this process only, none if not enabled or not available
+    perfOpen(&counters);
+
+    // on the CPU clock of this process, it runs without enforcement if it cannot be created
+    budgetOpen(&budget);
+
+    while(!gate->abort)
+    {
+        // sleep until the sequencer gives a release this process has not handled yet,
+        // with a spin budget spinning for it once the learned window opens
+        waitNsec = nowNsec();
+        openNsec = spinOpenNsec(&spin, waitNsec, gate->model.spinUsec);
+        if(openNsec != ULLONG_MAX)
+        {
+            while(__atomic_load_n(&gate->gate, __ATOMIC_ACQUIRE) == handled && (now = nowNsec()) < openNsec)
+                futexWaitFor(&gate->gate, handled, openNsec - now);
+        }
+        spun = spinForRelease(&spin, &gate->stats.spin, &gate->released, handledCnt, gate->model.spinUsec);
+        while(__atomic_load_n(&gate->gate, __ATOMIC_ACQUIRE) == handled)
+            futexWait(&gate->gate, handled);
+
+        handled++;
+        handledCnt++;
+
+        // a late service only handles the most recent of its pending releases
+        if(gate->model.policy == OVERLOAD_SKIP)
+        {
+            latest = __atomic_load_n(&gate->gate, __ATOMIC_ACQUIRE);
+            gate->stats.skipped += latest - handled;
+            handledCnt += latest - handled;
+            handled = latest;
+        }
+
+        wakeNsec = nowNsec();
+        releaseNsec = gate->releaseNsec;
+        releasePhaseNsec = gate->releasePhaseNsec;
+        releaseCnt++;
+        perfRead(&counters, &begin);
+
+        budgetArm(&budget, gate->model.budgetUsec, gate->model.budgetAction);
+        logRelease(serviceIdx, gate->model.periodMs, releaseCnt);
+        serviceJob(&gate->model, &gate->released, handledCnt, &gate->stats, &budget);
+        budgetDisarm(&budget, &gate->stats.budget);
+        perfRead(&counters, &end);
+
+        // the abort release is not a timed one
+        if(!gate->abort)
+        {
+            // accounted once the response time is taken, the counters log line is not part of it
+            execNsec = nowNsec() - wakeNsec;
+            completeRelease(serviceIdx, &gate->stats, &gate->model, releaseNsec, wakeNsec, releasePhaseNsec);
+            perfRecordRelease(&gate->stats.perf, &counters, serviceIdx, releaseCnt, execNsec, &begin, &end);
+            spinLearn(&spin, &gate->stats.spin, spun, gate->model.spinUsec, waitNsec, releaseNsec, wakeNsec);
+        }
+        __atomic_store_n(&gate->completed, handledCnt, __ATOMIC_RELEASE);
+    }
+
+    budgetClose(&budget);
+    perfClose(&counters);
+    munmap(releaseSegment, sizeof(releaseSegment_t));
+    return 0;
+}
@@ -0,0 +1,47 @@
+// Multi-process mode of seqgen3: every service is a separate process released
+// through a process-shared futex gate in a POSIX shared memory segment
+
+#ifndef SEQPROC_H
+#define SEQPROC_H
+
+#include <sys/types.h>
+
+#include "seqgen3.h"
+#include "seqstats.h"
+
+#define RELEASE_SEGMENT_NAME "/seqgen3_release"
+
+// Release gate of one service, on its own cache line
+typedef struct
+{
+    unsigned int gate;                        // futex word: number of releases given so far
+    volatile int abort;                       // set by the sequencer before the last release
+    volatile unsigned long long releaseNsec;  // stamp of the latest release
+    volatile long long releasePhaseNsec;      // its sequencer tick vs the ideal CLOCK_MONOTONIC schedule
+    unsigned long long released;              // 64 bit copy of the gate count, for serviceJob
+    volatile unsigned long long completed;    // releases completed, written by the service process
+    serviceModel_t model;
+    releaseStats_t stats;                     // written by the service process only
+} __attribute__((aligned(64))) releaseGate_t;
+
+typedef struct
+{
+    double startRealtime;                     // start_realtime of the sequencer, for the log time base
+    int traceFd;                              // binary trace inherited from the sequencer, -1 without
+    releaseGate_t gates[MAX_SERVICES];
+} releaseSegment_t;
+
+// Mapped by the sequencer in multi-process mode, NULL in the default thread mode
+extern releaseSegment_t *releaseSegment;
+
+int createReleaseSegment(const char *programName);
+void destroyReleaseSegment(void);
+int startServiceProcess(int serviceIdx);
+void releaseServiceProcess(int serviceIdx, unsigned long long releaseNsec, long long releasePhaseNsec);
+void abortServiceProcess(int serviceIdx);
+void joinServiceProcess(int serviceIdx);
+void setServiceProcessPriority(int serviceIdx, int priority);
+unsigned long long completedServiceProcess(int serviceIdx);
+int serviceProcessMain(int serviceIdx);
+
+#endif
@@ -0,0 +1,188 @@
+// Shared resources of seqgen3 services
+//
+// The statistics of a resource are only written by the service holding its
+// mutex, so they need no other synchronization. A critical section burns
+// thread CPU time like the synthetic load of a job; the wall time it is held
+// for also grows with every preemption of the holder, which is where priority
+// inversion shows.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "seqgen3.h"
+#include "seqres.h"
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    unsigned long long acquires;
+    unsigned long long contended;
+    unsigned long long maxBlockedNsec;
+    double sumBlockedNsec;
+    int worstService;                 // where maxBlockedNsec was suffered
+    unsigned long long maxHeldNsec;   // wall time, preemptions of the holder included
+} sharedResource_t;
+
+int resourcesActive = FALSE;
+
+static sharedResource_t resources[MAX_RESOURCES];
+static resourceProtocol_t resourceProtocol;
+static int resourceCeiling;
+
+static const char *resourceProtocolNames[NUM_RESOURCE_PROTOCOLS] = {"none", "inherit", "protect"};
+
+resourceProtocol_t resourceProtocolByName(const char *name)
+{
+    resourceProtocol_t protocol;
+
+    for(protocol=0; protocol < NUM_RESOURCE_PROTOCOLS && strcmp(name, resourceProtocolNames[protocol]) != 0; protocol++);
+
+    return protocol;
+}
+
+const char *resourceProtocolName(resourceProtocol_t protocol)
+{
+    if(protocol < 0 || protocol >= NUM_RESOURCE_PROTOCOLS)
+        return "unknown";
+
+    return resourceProtocolNames[protocol];
+}
+
+int createResources(resourceProtocol_t protocol, int ceilingPriority)
+{
+    static const int protocols[NUM_RESOURCE_PROTOCOLS] = {PTHREAD_PRIO_NONE, PTHREAD_PRIO_INHERIT, PTHREAD_PRIO_PROTECT};
+    pthread_mutexattr_t attr;
+    int i, rc;
+
+    pthread_mutexattr_init(&attr);
+
+    rc = pthread_mutexattr_setprotocol(&attr, protocols[protocol]);
+    if(rc == 0 && protocol == RESOURCE_PROTECT)
+        rc = pthread_mutexattr_setprioceiling(&attr, ceilingPriority);
+
+    if(rc != 0)
+    {
+        printf("Resource protocol %s: %s\n", resourceProtocolName(protocol), strerror(rc));
+        pthread_mutexattr_destroy(&attr);
+        return -1;
+    }
+
+    memset(resources, 0, sizeof(resources));
+    for(i=0; i < MAX_RESOURCES; i++)
+    {
+        resources[i].worstService = -1;
+        pthread_mutex_init(&resources[i].mutex, &attr);
+    }
+
+    pthread_mutexattr_destroy(&attr);
+
+    resourceProtocol = protocol;
+    resourceCeiling = ceilingPriority;
+    resourcesActive = TRUE;
+    return 0;
+}
+
+void destroyResources(void)
+{
+    int i;
+
+    resourcesActive = FALSE;
+    for(i=0; i < MAX_RESOURCES; i++)
+        pthread_mutex_destroy(&resources[i].mutex);
+}
+
+void useResource(int serviceIdx, int resource, unsigned int criticalSectionUsec, blockingStats_t *stats)
+{
+    sharedResource_t *shared;
+    unsigned long long requestNsec, acquiredNsec, blockedNsec, heldNsec;
+    int contended = FALSE;
+
+    if(!resourcesActive || resource < 0 || resource >= MAX_RESOURCES)
+        return;
+
+    shared = &resources[resource];
+    requestNsec = monotonicNsec();
+
+    // the resource is contended when held by another service at the request
+    if(pthread_mutex_trylock(&shared->mutex) != 0)
+    {
+        contended = TRUE;
+        if(pthread_mutex_lock(&shared->mutex) != 0)
+            return;
+    }
+
+    acquiredNsec = monotonicNsec();
+    blockedNsec = acquiredNsec - requestNsec;
+
+    shared->acquires++;
+    shared->sumBlockedNsec += blockedNsec;
+    if(contended)
+        shared->contended++;
+    if(shared->acquires == 1 || blockedNsec > shared->maxBlockedNsec)
+    {
+        shared->maxBlockedNsec = blockedNsec;
+        shared->worstService = serviceIdx;
+    }
+
+    burnCpuNsec((unsigned long long)criticalSectionUsec * 1000, NULL, NULL);
+
+    heldNsec = monotonicNsec() - acquiredNsec;
+    if(heldNsec > shared->maxHeldNsec)
+        shared->maxHeldNsec = heldNsec;
+
+    pthread_mutex_unlock(&shared->mutex);
+
+    stats->acquires++;
+    stats->sumBlockedNsec += blockedNsec;
+    if(contended)
+        stats->contended++;
+    if(stats->acquires == 1 || blockedNsec > stats->maxBlockedNsec)
+    {
+        stats->maxBlockedNsec = blockedNsec;
+        stats->worstResource = resource;
+    }
+}
+
+void printBlockingStats(int serviceIdx, const blockingStats_t *stats)
+{
+    if(stats->acquires == 0)
+        return;
+
+    printf("S%d blocking (%s): %llu acquires, %llu contended, blocked usec avg=%.1lf max=%.1lf on R%d\n",
+           serviceIdx+1, resourceProtocolName(resourceProtocol), stats->acquires, stats->contended,
+           stats->sumBlockedNsec / stats->acquires / 1000.0, stats->maxBlockedNsec / 1000.0, stats->worstResource);
+    syslog(LOG_CRIT, "S%d blocking (%s): %llu acquires, %llu contended, blocked usec avg=%.1lf max=%.1lf on R%d\n",
+           serviceIdx+1, resourceProtocolName(resourceProtocol), stats->acquires, stats->contended,
+           stats->sumBlockedNsec / stats->acquires / 1000.0, stats->maxBlockedNsec / 1000.0, stats->worstResource);
+}
+
+void printResourceStats(void)
+{
+    const sharedResource_t *shared;
+    int i;
+
+    if(!resourcesActive)
+        return;
+
+    for(i=0; i < MAX_RESOURCES; i++)
+    {
+        shared = &resources[i];
+        if(shared->acquires == 0)
+            continue;
+
+        printf("R%d (%s", i, resourceProtocolName(resourceProtocol));
+        if(resourceProtocol == RESOURCE_PROTECT)
+            printf(", ceiling %d", resourceCeiling);
+        printf("): %llu acquires, %llu contended, blocked usec avg=%.1lf max=%.1lf by S%d, held usec max=%.1lf\n",
+               shared->acquires, shared->contended, shared->sumBlockedNsec / shared->acquires / 1000.0,
+               shared->maxBlockedNsec / 1000.0, shared->worstService+1, shared->maxHeldNsec / 1000.0);
+        syslog(LOG_CRIT, "R%d (%s): %llu acquires, %llu contended, blocked usec avg=%.1lf max=%.1lf by S%d, held usec max=%.1lf\n",
+               i, resourceProtocolName(resourceProtocol), shared->acquires, shared->contended,
+               shared->sumBlockedNsec / shared->acquires / 1000.0, shared->maxBlockedNsec / 1000.0,
+               shared->worstService+1, shared->maxHeldNsec / 1000.0);
+    }
+}
@@ -0,0 +1,48 @@
+// Shared resources of seqgen3 services, in thread mode
+//
+// A service may lock one of MAX_RESOURCES mutexes for a critical section of
+// criticalSectionUsec of CPU time at every release. All the mutexes use the
+// protocol given with -R: none (a plain mutex, open to unbounded priority
+// inversion), PTHREAD_PRIO_INHERIT, or PTHREAD_PRIO_PROTECT with the highest
+// service priority as the ceiling. Every acquire measures how long the service
+// was blocked, per service and per resource, so runs of the same scenario
+// under the three protocols can be compared.
+
+#ifndef SEQRES_H
+#define SEQRES_H
+
+#define MAX_RESOURCES (8)
+
+typedef enum
+{
+    RESOURCE_PLAIN,
+    RESOURCE_INHERIT,
+    RESOURCE_PROTECT,
+    NUM_RESOURCE_PROTOCOLS
+} resourceProtocol_t;
+
+// Blocking of one service over the run, plain data like releaseStats_t
+typedef struct
+{
+    unsigned long long acquires;
+    unsigned long long contended;     // the resource was held by another service
+    unsigned long long maxBlockedNsec;
+    double sumBlockedNsec;
+    int worstResource;                // where maxBlockedNsec was suffered
+} blockingStats_t;
+
+extern int resourcesActive;
+
+resourceProtocol_t resourceProtocolByName(const char *name);
+const char *resourceProtocolName(resourceProtocol_t protocol);
+
+int createResources(resourceProtocol_t protocol, int ceilingPriority);
+void destroyResources(void);
+
+// Critical section of a release of service serviceIdx, no-op without resources
+void useResource(int serviceIdx, int resource, unsigned int criticalSectionUsec, blockingStats_t *stats);
+
+void printBlockingStats(int serviceIdx, const blockingStats_t *stats);
+void printResourceStats(void);
+
+#endif
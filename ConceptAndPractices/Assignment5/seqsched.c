@@ -0,0 +1,246 @@
+// Rate monotonic analysis of a seqgen3 service set, and the set seqgen3 starts with
+//
+// Services are pinned (AMP), so each core is analysed on its own: a service is
+// only interfered with by the higher priority services on its core. The
+// sequencer itself is not modelled, it runs at RT_MAX and takes microseconds
+// per tick.
+
+#include <stdio.h>
+
+#include "seqsched.h"
+
+#define NUM_THREADS (3)
+
+#define T1_PERIOD_MS 20
+#define T2_PERIOD_MS 100
+#define T3_PERIOD_MS 150
+
+// Declared execution time of the initial services, used by admission control
+// when more services are registered at run time
+#define T1_WCET_USEC 1000
+#define T2_WCET_USEC 1000
+#define T3_WCET_USEC 1000
+
+// Overload handling of the initial services. The default is the plain semaphore
+// behaviour: a late service handles its backlog back to back. Policies,
+// criticality and synthetic load can also be changed through the control socket.
+#define T1_POLICY OVERLOAD_QUEUE
+#define T2_POLICY OVERLOAD_QUEUE
+#define T3_POLICY OVERLOAD_QUEUE
+
+static const unsigned int initialPeriodsMs[NUM_THREADS] = {T1_PERIOD_MS, T2_PERIOD_MS, T3_PERIOD_MS};
+static const unsigned int initialWcetUsec[NUM_THREADS] = {T1_WCET_USEC, T2_WCET_USEC, T3_WCET_USEC};
+static const overloadPolicy_t initialPolicies[NUM_THREADS] = {T1_POLICY, T2_POLICY, T3_POLICY};
+
+// Services added by scaledServiceSet: logging only, at 2, 5 and 10 release quanta
+#define SCALED_WCET_USEC 10
+static const unsigned int scaledPeriodQuanta[] = {2, 5, 10};
+#define NUM_SCALED_PERIODS (sizeof(scaledPeriodQuanta) / sizeof(scaledPeriodQuanta[0]))
+
+static const char *overloadPolicyNames[NUM_OVERLOAD_POLICIES] = {"queue", "skip", "cap", "abort", "degrade"};
+
+unsigned int releaseQuantumMs = SEQUENCER_PERIOD_MS;
+unsigned int periodQuantumUsec = SEQUENCER_PERIOD_MS * USEC_PER_MSEC;
+unsigned int minPeriodUsec = SEQUENCER_PERIOD_MS * USEC_PER_MSEC;
+unsigned long long maxHyperperiodUsec = MAX_HYPERPERIOD_USEC;
+
+// The period of model in usec, and to the nearest whole ms for the logs
+void setServicePeriod(serviceModel_t *model, unsigned long long periodUsec)
+{
+    model->periodUsec = periodUsec;
+    model->periodMs = (periodUsec + (USEC_PER_MSEC / 2)) / USEC_PER_MSEC;
+    if(model->periodMs == 0)
+        model->periodMs = 1;
+}
+
+// Shorter period means higher priority, ties broken by registration order
+int rmHigherPriority(const serviceModel_t *a, const serviceModel_t *b)
+{
+    if(a->periodUsec != b->periodUsec)
+        return (a->periodUsec < b->periodUsec);
+
+    return (a->serviceIdx < b->serviceIdx);
+}
+
+static unsigned long long gcd(unsigned long long a, unsigned long long b)
+{
+    while(b != 0)
+    {
+        unsigned long long r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Least common multiple of all the periods, in usec. Past MAX_HYPERPERIOD_USEC
+// it is only known to be longer: the value returned is then the first partial
+// multiple above it.
+unsigned long long hyperperiodUsec(const serviceModel_t *set, int count)
+{
+    unsigned long long lcm = 1;
+    int i;
+
+    for(i=0; i < count; i++)
+    {
+        lcm = (lcm / gcd(lcm, set[i].periodUsec)) * set[i].periodUsec;
+
+        // no point going on, nobody waits that long for a boundary
+        if(lcm > MAX_HYPERPERIOD_USEC)
+            break;
+    }
+
+    return lcm;
+}
+
+// The same in release quanta (sequencer ticks), at least one: the sequencer
+// swaps tables at every quantum with an empty set, whose hyperperiod is 1 usec
+unsigned long long hyperperiodTicks(const serviceModel_t *set, int count)
+{
+    unsigned long long ticks = hyperperiodUsec(set, count) / ((unsigned long long)releaseQuantumMs * USEC_PER_MSEC);
+
+    return (ticks > 0) ? ticks : 1;
+}
+
+// Worst case response time of set[i] by the classic RTA recurrence
+//
+//   R(n+1) = C(i) + sum over higher priority j on the same core of ceil(R(n) / T(j)) * C(j)
+//
+// where the C(j) of a service that spins for its releases includes its spin
+// budget, the core is busy for that long too.
+// The iteration stops as soon as R exceeds the period of set[i]: the value
+// returned is then only known to be larger than the deadline.
+unsigned long long responseTimeUsec(const serviceModel_t *set, int count, int i)
+{
+    unsigned long long response, next = set[i].wcetUsec;
+    unsigned long long deadline = set[i].periodUsec;
+    int j;
+
+    do
+    {
+        response = next;
+        next = set[i].wcetUsec;
+
+        for(j=0; j < count; j++)
+        {
+            if(j == i || set[j].core != set[i].core || !rmHigherPriority(&set[j], &set[i]))
+                continue;
+
+            next += ((response + set[j].periodUsec - 1) / set[j].periodUsec) * (set[j].wcetUsec + set[j].spinUsec);
+        }
+    }
+    while(next != response && next <= deadline);
+
+    return next;
+}
+
+// Returns TRUE if every service of set meets its deadline (equal to its period)
+// under rate monotonic priorities. Otherwise FALSE, with the first failing
+// condition described in reason.
+int admitServiceSet(const serviceModel_t *set, int count, char *reason, size_t reasonLen)
+{
+    unsigned long long response;
+    int i;
+
+    if(count > MAX_SERVICES)
+    {
+        snprintf(reason, reasonLen, "more than %d services", MAX_SERVICES);
+        return FALSE;
+    }
+
+    for(i=0; i < count; i++)
+    {
+        if(set[i].periodUsec < minPeriodUsec)
+        {
+            snprintf(reason, reasonLen, "S%d period %llu usec is shorter than %u usec",
+                     set[i].serviceIdx+1, set[i].periodUsec, minPeriodUsec);
+            return FALSE;
+        }
+
+        if((set[i].periodUsec % periodQuantumUsec) != 0)
+        {
+            snprintf(reason, reasonLen, "S%d period %llu usec is not a multiple of the %u usec release quantum",
+                     set[i].serviceIdx+1, set[i].periodUsec, periodQuantumUsec);
+            return FALSE;
+        }
+
+        if(set[i].core < 0 || set[i].core >= NUM_CPU_CORES)
+        {
+            snprintf(reason, reasonLen, "S%d core %d does not exist", set[i].serviceIdx+1, set[i].core);
+            return FALSE;
+        }
+    }
+
+    if(hyperperiodUsec(set, count) > maxHyperperiodUsec)
+    {
+        snprintf(reason, reasonLen, "hyperperiod longer than %llu ms", maxHyperperiodUsec / USEC_PER_MSEC);
+        return FALSE;
+    }
+
+    for(i=0; i < count; i++)
+    {
+        response = responseTimeUsec(set, count, i);
+
+        if(response > set[i].periodUsec)
+        {
+            snprintf(reason, reasonLen, "S%d would miss its deadline on core %d (response > %llu usec)",
+                     set[i].serviceIdx+1, set[i].core, set[i].periodUsec);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// Services seqgen3 starts with, also the default set simulated by seqsim:
+// even indexed services on core 2, odd indexed ones on core 3
+int initialServiceSet(serviceModel_t *set)
+{
+    int i;
+
+    for(i=0; i < NUM_THREADS; i++)
+    {
+        set[i].serviceIdx=i;
+        setServicePeriod(&set[i], (unsigned long long)initialPeriodsMs[i] * USEC_PER_MSEC);
+        set[i].wcetUsec=initialWcetUsec[i];
+        set[i].core=(i % 2 == 0) ? 2 : 3;
+        set[i].loadUsec=0;
+        set[i].policy=initialPolicies[i];
+        set[i].backlogCap=DEFAULT_BACKLOG_CAP;
+        set[i].criticality=DEFAULT_CRITICALITY;
+        set[i].resource=-1;
+        set[i].criticalSectionUsec=0;
+        set[i].spinUsec=0;
+        set[i].budgetUsec=0;
+        set[i].budgetAction=BUDGET_NONE;
+    }
+
+    return NUM_THREADS;
+}
+
+// The initial set grown to count services for scalability runs, the extra
+// services alternately on cores 2 and 3 like the initial ones
+int scaledServiceSet(serviceModel_t *set, int count)
+{
+    int i;
+
+    for(i=initialServiceSet(set); i < count && i < MAX_SERVICES; i++)
+    {
+        set[i] = set[0];
+        set[i].serviceIdx=i;
+        setServicePeriod(&set[i], (unsigned long long)scaledPeriodQuanta[i % NUM_SCALED_PERIODS] * releaseQuantumMs * USEC_PER_MSEC);
+        set[i].wcetUsec=SCALED_WCET_USEC;
+        set[i].core=(i % 2 == 0) ? 2 : 3;
+        set[i].policy=OVERLOAD_QUEUE;
+    }
+
+    return i;
+}
+
+const char *overloadPolicyName(overloadPolicy_t policy)
+{
+    if(policy < 0 || policy >= NUM_OVERLOAD_POLICIES)
+        return "unknown";
+
+    return overloadPolicyNames[policy];
+}
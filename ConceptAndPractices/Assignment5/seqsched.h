@@ -0,0 +1,33 @@
+// Rate monotonic analysis of a seqgen3 service set: priority order,
+// hyperperiod and response time based admission control. Also the initial
+// service set, shared with seqsim.
+
+#ifndef SEQSCHED_H
+#define SEQSCHED_H
+
+#include <stddef.h>
+
+#include "seqgen3.h"
+
+// Unit of the periods, SEQUENCER_PERIOD_MS unless the sequencer is tickless
+extern unsigned int releaseQuantumMs;
+
+// Admitted periods in usec: multiples of periodQuantumUsec, at least minPeriodUsec.
+// Both are the release quantum unless the sequencer is tickless.
+extern unsigned int periodQuantumUsec;
+extern unsigned int minPeriodUsec;
+
+// Longest hyperperiod admitted, MAX_HYPERPERIOD_USEC unless the sequencer is
+// tickless: that one swaps tables at the next release when the hyperperiod is longer
+extern unsigned long long maxHyperperiodUsec;
+
+void setServicePeriod(serviceModel_t *model, unsigned long long periodUsec);
+int rmHigherPriority(const serviceModel_t *a, const serviceModel_t *b);
+unsigned long long hyperperiodUsec(const serviceModel_t *set, int count);
+unsigned long long hyperperiodTicks(const serviceModel_t *set, int count);
+unsigned long long responseTimeUsec(const serviceModel_t *set, int count, int i);
+int admitServiceSet(const serviceModel_t *set, int count, char *reason, size_t reasonLen);
+int initialServiceSet(serviceModel_t *set);
+int scaledServiceSet(serviceModel_t *set, int count);
+
+#endif
@@ -0,0 +1,642 @@
+// seqsim - virtual time simulation of a seqgen3 schedule
+//
+// Runs a seqgen3 service set through fixed priority preemptive scheduling in
+// virtual time, so an hour of schedule takes milliseconds of CPU and no root.
+// It follows seqgen3 as closely as the model allows: releases at multiples of
+// the 10 ms sequencer tick, rate monotonic priorities, every service pinned to
+// its core, the same overload policies. Each release executes for its declared
+// WCET, or for its synthetic load if one is set. The sequencer and the kernel
+// take no time: this is the ideal schedule.
+//
+// The result is per service response times and misses, next to the response
+// time analysis bound, and optionally the whole release/response timeline as CSV.
+//
+// Given the syslog of a real run (-r), the recorded wakeup of each release is
+// compared with its simulated start: misses in the simulation are a problem of
+// the schedule design, wakeups later than simulated are platform jitter.
+//
+// Usage: seqsim [-f script] [-d seconds] [-t timeline.csv] [-r syslog]
+//
+// Without a script the initial service set of seqgen3 is simulated. A script
+// holds one control socket command per line (see seqctl.c), services are
+// numbered S1, S2, ... in order of "add":
+//
+//   add <period_ms> <wcet_usec> <core>
+//   period <n> <period_ms>
+//   policy <n> queue|skip|abort|degrade, policy <n> cap <K>
+//   criticality <n> <level>
+//   load <n> <usec>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+
+#include "seqgen3.h"
+#include "seqsched.h"
+
+#define DEFAULT_DURATION_SEC (3600)
+
+// Pending releases of a service beyond which further ones are counted as overflowed
+#define SIM_MAX_BACKLOG (64)
+
+#define SIM_LINE_MAX (256)
+
+// As logged by seqgen3 around a run
+#define RUN_START_PATTERN "==== START LOGGING ===="
+#define RUN_STOP_PATTERN "==== STOP LOGGING ===="
+
+#define NOT_STARTED (ULLONG_MAX)
+
+typedef struct
+{
+    serviceModel_t model;
+    unsigned long long periodUsec;
+    unsigned long long demandUsec;                 // execution time of one release
+    unsigned long long nextReleaseUsec;
+    unsigned long long releaseCnt;                 // releases given, as numbered by the service
+    unsigned long long pendingUsec[SIM_MAX_BACKLOG];  // release instants of the pending jobs, FIFO
+    unsigned long long pendingCnt[SIM_MAX_BACKLOG];   // and their release numbers
+    unsigned int head;
+    unsigned int count;
+    int started;                                   // the job at head has run
+    unsigned long long startUsec;
+    unsigned long long remainingUsec;
+    unsigned long long completed;
+    unsigned long long misses;
+    unsigned long long overruns;
+    unsigned long long skipped;
+    unsigned long long capped;
+    unsigned long long aborted;
+    unsigned long long degraded;
+    unsigned long long overflowed;
+    unsigned long long maxResponseUsec;
+    double sumResponseUsec;
+    unsigned long long *patternUsec;               // simulated start of the releases of the first two hyperperiods
+    unsigned long long patternLen;
+} simService_t;
+
+static simService_t services[MAX_SERVICES];
+static int serviceCount;
+static FILE *timeline;
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [-f script] [-d seconds] [-t timeline.csv] [-r syslog]\n", program);
+    printf("  -f script   service set as control socket commands (add, period, policy, criticality, load),\n");
+    printf("              the initial seqgen3 set if not given\n");
+    printf("  -d seconds  virtual time to simulate, %d by default\n", DEFAULT_DURATION_SEC);
+    printf("  -t file     write every simulated release as CSV\n");
+    printf("  -r syslog   compare with the last seqgen3 run recorded in syslog\n");
+}
+
+// Service S<n> of the script, NULL if not added yet
+static serviceModel_t *scriptService(const char *name)
+{
+    int serviceNum;
+
+    if(name[0] == 'S' || name[0] == 's')
+        name++;
+
+    serviceNum = atoi(name);
+    if(serviceNum < 1 || serviceNum > serviceCount)
+        return NULL;
+
+    return &services[serviceNum-1].model;
+}
+
+static int readScript(const char *path)
+{
+    char line[SIM_LINE_MAX], command[16], name[16], policyName[16];
+    serviceModel_t *model;
+    unsigned int periodMs, wcetUsec, value;
+    int core, level, lineNum=0, policy;
+    FILE *script;
+
+    script = fopen(path, "r");
+    if(script == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), script) != NULL)
+    {
+        lineNum++;
+        if(sscanf(line, "%15s", command) != 1 || command[0] == '#')
+            continue;
+
+        value = 0;
+        model = NULL;
+
+        if(strcmp(command, "add") == 0 && sscanf(line, "%*s %u %u %d", &periodMs, &wcetUsec, &core) == 3 &&
+           serviceCount < MAX_SERVICES)
+        {
+            model = &services[serviceCount].model;
+            model->serviceIdx = serviceCount++;
+            setServicePeriod(model, (unsigned long long)periodMs * USEC_PER_MSEC);
+            model->wcetUsec = wcetUsec;
+            model->core = core;
+            model->loadUsec = 0;
+            model->policy = OVERLOAD_QUEUE;
+            model->backlogCap = DEFAULT_BACKLOG_CAP;
+            model->criticality = DEFAULT_CRITICALITY;
+            model->resource = -1;
+            model->criticalSectionUsec = 0;
+            model->spinUsec = 0;
+        }
+        else if(strcmp(command, "period") == 0 && sscanf(line, "%*s %15s %u", name, &value) == 2 &&
+                (model = scriptService(name)) != NULL)
+        {
+            setServicePeriod(model, (unsigned long long)value * USEC_PER_MSEC);
+        }
+        else if(strcmp(command, "policy") == 0 && sscanf(line, "%*s %15s %15s %u", name, policyName, &value) >= 2 &&
+                (model = scriptService(name)) != NULL)
+        {
+            for(policy=0; policy < NUM_OVERLOAD_POLICIES && strcmp(policyName, overloadPolicyName(policy)) != 0; policy++);
+
+            if(policy == NUM_OVERLOAD_POLICIES || (policy == OVERLOAD_CAP && value == 0))
+                model = NULL;
+            else
+            {
+                model->policy = policy;
+                if(policy == OVERLOAD_CAP)
+                    model->backlogCap = value;
+            }
+        }
+        else if(strcmp(command, "criticality") == 0 && sscanf(line, "%*s %15s %d", name, &level) == 2 &&
+                (model = scriptService(name)) != NULL)
+        {
+            model->criticality = level;
+        }
+        else if(strcmp(command, "load") == 0 && sscanf(line, "%*s %15s %u", name, &value) == 2 &&
+                (model = scriptService(name)) != NULL)
+        {
+            model->loadUsec = value;
+        }
+
+        if(model == NULL)
+        {
+            printf("%s:%d: cannot use \"%s\"\n", path, lineNum, strtok(line, "\n"));
+            fclose(script);
+            return -1;
+        }
+    }
+
+    fclose(script);
+    return 0;
+}
+
+// Highest priority service with a pending release on a core, NULL if the core is idle
+static simService_t *runningOn(int core)
+{
+    simService_t *running = NULL;
+    int i;
+
+    for(i=0; i < serviceCount; i++)
+    {
+        if(services[i].count > 0 && services[i].model.core == core &&
+           (running == NULL || rmHigherPriority(&services[i].model, &running->model)))
+            running = &services[i];
+    }
+
+    return running;
+}
+
+// The service wakes up for the job at head: it skips to its latest release if told to
+static void startJob(simService_t *service, unsigned long long nowUsec)
+{
+    unsigned long long releaseCnt;
+
+    if(service->model.policy == OVERLOAD_SKIP && service->count > 1)
+    {
+        service->skipped += service->count - 1;
+        service->head = (service->head + service->count - 1) % SIM_MAX_BACKLOG;
+        service->count = 1;
+    }
+
+    service->started = TRUE;
+    service->startUsec = nowUsec;
+    service->remainingUsec = service->demandUsec;
+
+    releaseCnt = service->pendingCnt[service->head];
+    if(releaseCnt <= service->patternLen)
+        service->patternUsec[releaseCnt-1] = nowUsec;
+}
+
+static void completeJob(simService_t *service, unsigned long long nowUsec)
+{
+    unsigned long long releaseUsec = service->pendingUsec[service->head];
+    unsigned long long responseUsec = nowUsec - releaseUsec;
+    int missed = (responseUsec > service->periodUsec);
+
+    if(!service->started)
+        service->startUsec = nowUsec;
+
+    service->completed++;
+    service->misses += missed;
+    service->sumResponseUsec += (double)responseUsec;
+    if(responseUsec > service->maxResponseUsec)
+        service->maxResponseUsec = responseUsec;
+
+    if(timeline != NULL)
+        fprintf(timeline, "S%d,%llu,%llu,%llu,%llu,%llu,%d\n", service->model.serviceIdx+1,
+                service->pendingCnt[service->head], releaseUsec, service->startUsec, nowUsec, responseUsec, missed);
+
+    service->head = (service->head + 1) % SIM_MAX_BACKLOG;
+    service->count--;
+    service->started = FALSE;
+}
+
+// What the sequencer and the service do at a release, policy by policy
+static void releaseJob(simService_t *service, unsigned long long nowUsec, int lateCriticality)
+{
+    if(service->model.policy == OVERLOAD_DEGRADE && service->model.criticality < lateCriticality)
+    {
+        service->degraded++;
+        return;
+    }
+
+    if(service->model.policy == OVERLOAD_CAP && service->count >= service->model.backlogCap)
+    {
+        service->capped++;
+        return;
+    }
+
+    if(service->count > 0)
+        service->overruns++;
+
+    // pending jobs give up as soon as they see a newer release
+    while(service->model.policy == OVERLOAD_ABORT && service->count > 0)
+    {
+        service->aborted++;
+        completeJob(service, nowUsec);
+    }
+
+    service->releaseCnt++;
+
+    if(service->count == SIM_MAX_BACKLOG)
+    {
+        service->overflowed++;
+        return;
+    }
+
+    service->pendingUsec[(service->head + service->count) % SIM_MAX_BACKLOG] = nowUsec;
+    service->pendingCnt[(service->head + service->count) % SIM_MAX_BACKLOG] = service->releaseCnt;
+    service->count++;
+}
+
+static void simulate(unsigned long long horizonUsec)
+{
+    simService_t *running[NUM_CPU_CORES];
+    unsigned long long nowUsec = 0, nextUsec;
+    int i, core, lateCriticality;
+
+    for(i=0; i < serviceCount; i++)
+        services[i].nextReleaseUsec = services[i].periodUsec;
+
+    while(nowUsec < horizonUsec)
+    {
+        nextUsec = horizonUsec;
+
+        for(i=0; i < serviceCount; i++)
+        {
+            if(services[i].nextReleaseUsec < nextUsec)
+                nextUsec = services[i].nextReleaseUsec;
+        }
+
+        for(core=0; core < NUM_CPU_CORES; core++)
+        {
+            running[core] = runningOn(core);
+            if(running[core] == NULL)
+                continue;
+
+            if(!running[core]->started)
+                startJob(running[core], nowUsec);
+            if(nowUsec + running[core]->remainingUsec < nextUsec)
+                nextUsec = nowUsec + running[core]->remainingUsec;
+        }
+
+        for(core=0; core < NUM_CPU_CORES; core++)
+        {
+            if(running[core] != NULL)
+                running[core]->remainingUsec -= nextUsec - nowUsec;
+        }
+
+        nowUsec = nextUsec;
+
+        for(core=0; core < NUM_CPU_CORES; core++)
+        {
+            if(running[core] != NULL && running[core]->remainingUsec == 0)
+                completeJob(running[core], nowUsec);
+        }
+
+        // the sequencer looks at the late services before releasing any
+        lateCriticality = -1;
+        for(i=0; i < serviceCount; i++)
+        {
+            if(services[i].count > 0 && services[i].model.criticality > lateCriticality)
+                lateCriticality = services[i].model.criticality;
+        }
+
+        for(i=0; i < serviceCount; i++)
+        {
+            if(services[i].nextReleaseUsec == nowUsec)
+            {
+                releaseJob(&services[i], nowUsec, lateCriticality);
+                services[i].nextReleaseUsec += services[i].periodUsec;
+            }
+        }
+    }
+}
+
+// Simulated start of release releaseCnt (from 1), NOT_STARTED if it never ran.
+// The schedule repeats from the second hyperperiod on, when all services are
+// released together with nothing pending, so two hyperperiods cover any release.
+static unsigned long long simulatedStart(const simService_t *service, unsigned long long releaseCnt,
+                                         unsigned long long hyperperiodUsec)
+{
+    unsigned long long perHyperperiod = service->patternLen / 2, shift;
+
+    if(releaseCnt == 0)
+        return NOT_STARTED;
+    if(releaseCnt <= service->patternLen)
+        return service->patternUsec[releaseCnt-1];
+
+    shift = (releaseCnt - perHyperperiod - 1) / perHyperperiod;
+    if(service->patternUsec[releaseCnt - (shift * perHyperperiod) - 1] == NOT_STARTED)
+        return NOT_STARTED;
+
+    return service->patternUsec[releaseCnt - (shift * perHyperperiod) - 1] + (shift * hyperperiodUsec);
+}
+
+// A release logged by seqgen3: "S<n> <hz> Hz on core <c> for release <k> @ sec=<s>"
+static int parseRelease(const char *line, int *serviceNum, unsigned long long *releaseCnt, double *sec)
+{
+    const char *record = strstr(line, "seqgen3");
+    double hz;
+    int core;
+
+    if(record == NULL || (record = strstr(record, ": S")) == NULL)
+        return FALSE;
+
+    return sscanf(record + 2, "S%d %lf Hz on core %d for release %llu @ sec=%lf",
+                  serviceNum, &hz, &core, releaseCnt, sec) == 5;
+}
+
+// Recorded wakeups of the last run in the syslog against the simulated starts.
+// Three passes, nothing kept per release: the last run, the time base offset
+// (the smallest recorded minus simulated, no wakeup comes early), the deltas.
+static int compareRun(const char *path, unsigned long long hyperperiodUsec)
+{
+    char line[SIM_LINE_MAX];
+    unsigned long long releaseCnt, startUsec, compared[MAX_SERVICES] = {0}, late[MAX_SERVICES] = {0};
+    unsigned long long unsimulated[MAX_SERVICES] = {0};
+    double sec, deltaUsec, offsetUsec = INFINITY, sum[MAX_SERVICES] = {0}, sumSq[MAX_SERVICES] = {0};
+    double maxDelta[MAX_SERVICES] = {0}, average, deviation;
+    long runOffset = -1;
+    int serviceNum, pass, i;
+    FILE *log;
+
+    log = fopen(path, "r");
+    if(log == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), log) != NULL)
+    {
+        if(strstr(line, RUN_START_PATTERN) != NULL)
+            runOffset = ftell(log);
+    }
+
+    if(runOffset < 0)
+    {
+        printf("No seqgen3 run found in %s\n", path);
+        fclose(log);
+        return -1;
+    }
+
+    for(pass=0; pass < 2; pass++)
+    {
+        fseek(log, runOffset, SEEK_SET);
+
+        while(fgets(line, sizeof(line), log) != NULL && strstr(line, RUN_STOP_PATTERN) == NULL)
+        {
+            if(!parseRelease(line, &serviceNum, &releaseCnt, &sec) || serviceNum < 1 || serviceNum > serviceCount)
+                continue;
+
+            i = serviceNum-1;
+            startUsec = simulatedStart(&services[i], releaseCnt, hyperperiodUsec);
+            if(startUsec == NOT_STARTED)
+            {
+                unsimulated[i] += pass;
+                continue;
+            }
+
+            deltaUsec = (sec * 1000000.0) - (double)startUsec;
+            if(pass == 0)
+            {
+                if(deltaUsec < offsetUsec)
+                    offsetUsec = deltaUsec;
+                continue;
+            }
+
+            deltaUsec -= offsetUsec;
+            compared[i]++;
+            sum[i] += deltaUsec;
+            sumSq[i] += deltaUsec * deltaUsec;
+            if(deltaUsec > maxDelta[i])
+                maxDelta[i] = deltaUsec;
+            if(deltaUsec > (double)services[i].periodUsec)
+                late[i]++;
+        }
+    }
+
+    fclose(log);
+
+    printf("\nRecorded run in %s against the simulation (time base offset %.1lf usec):\n", path, offsetUsec);
+
+    for(i=0; i < serviceCount; i++)
+    {
+        if(compared[i] == 0)
+        {
+            printf("S%d: no recorded releases\n", i+1);
+            continue;
+        }
+
+        average = sum[i] / compared[i];
+        deviation = sqrt(fmax(0.0, (sumSq[i] / compared[i]) - (average * average)));
+
+        printf("S%d: %llu releases, wakeup after simulated start usec avg=%.1lf max=%.1lf sd=%.1lf, %llu later by more than a period, %llu not released in the simulation\n",
+               i+1, compared[i], average, maxDelta[i], deviation, late[i], unsimulated[i]);
+        printf("S%d: %s\n", i+1,
+               (services[i].misses > 0) ? "misses in the simulation too: schedule design problem" :
+               (late[i] > 0) ? "schedule meets its deadlines, late wakeups are platform jitter" :
+                               "recorded run follows the simulated schedule");
+    }
+
+    return 0;
+}
+
+static void report(double simulatedSec, double cpuMsec)
+{
+    serviceModel_t set[MAX_SERVICES];
+    char reason[SIM_LINE_MAX];
+    unsigned long long bound;
+    simService_t *service;
+    int i;
+
+    for(i=0; i < serviceCount; i++)
+        set[i] = services[i].model;
+
+    printf("Simulated %.0lf s of schedule in %.1lf ms of CPU\n", simulatedSec, cpuMsec);
+    if(admitServiceSet(set, serviceCount, reason, sizeof(reason)))
+        printf("Admission control: accepted\n");
+    else
+        printf("Admission control: rejected, %s\n", reason);
+
+    for(i=0; i < serviceCount; i++)
+    {
+        service = &services[i];
+        bound = responseTimeUsec(set, serviceCount, i);
+
+        printf("S%d period %u ms demand %llu usec core %d: %llu releases, %llu completed, %llu misses, response usec avg=%.1lf max=%llu, RTA bound on declared WCET %s%llu\n",
+               i+1, service->model.periodMs, service->demandUsec, service->model.core,
+               service->releaseCnt, service->completed, service->misses,
+               (service->completed > 0) ? service->sumResponseUsec / service->completed : 0.0,
+               service->maxResponseUsec, (bound > service->periodUsec) ? "> " : "",
+               (bound > service->periodUsec) ? service->periodUsec : bound);
+
+        if(service->overruns || service->skipped || service->capped || service->aborted || service->degraded || service->overflowed)
+            printf("S%d overload policy %s: overruns=%llu skipped=%llu capped=%llu aborted=%llu degraded=%llu overflowed=%llu\n",
+                   i+1, overloadPolicyName(service->model.policy), service->overruns, service->skipped,
+                   service->capped, service->aborted, service->degraded, service->overflowed);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *scriptPath = NULL, *timelinePath = NULL, *syslogPath = NULL;
+    serviceModel_t set[MAX_SERVICES];
+    unsigned long long horizonUsec, hyperperiodUsec;
+    struct timespec cpuStart, cpuEnd;
+    double durationSec = DEFAULT_DURATION_SEC;
+    int opt, i;
+
+    while((opt = getopt(argc, argv, "f:d:t:r:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f':
+                scriptPath = optarg;
+                break;
+            case 'd':
+                durationSec = atof(optarg);
+                break;
+            case 't':
+                timelinePath = optarg;
+                break;
+            case 'r':
+                syslogPath = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    if(scriptPath != NULL)
+    {
+        if(readScript(scriptPath) != 0)
+            exit(-1);
+    }
+    else
+    {
+        serviceCount = initialServiceSet(set);
+        for(i=0; i < serviceCount; i++)
+            services[i].model = set[i];
+    }
+
+    if(serviceCount == 0 || durationSec <= 0.0)
+    {
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    for(i=0; i < serviceCount; i++)
+    {
+        set[i] = services[i].model;
+
+        if(set[i].periodMs == 0 || (set[i].periodMs % SEQUENCER_PERIOD_MS) != 0 ||
+           set[i].core < 0 || set[i].core >= NUM_CPU_CORES)
+        {
+            printf("S%d: period must be a multiple of %d ms and core below %d\n", i+1, SEQUENCER_PERIOD_MS, NUM_CPU_CORES);
+            exit(-1);
+        }
+
+        services[i].periodUsec = (unsigned long long)set[i].periodMs * USEC_PER_MSEC;
+        services[i].demandUsec = (set[i].loadUsec > 0) ? set[i].loadUsec : set[i].wcetUsec;
+    }
+
+    horizonUsec = (unsigned long long)(durationSec * 1000000.0);
+    hyperperiodUsec = hyperperiodTicks(set, serviceCount) * SEQUENCER_PERIOD_MS * USEC_PER_MSEC;
+
+    // the comparison needs the starts of two whole hyperperiods
+    if(syslogPath != NULL)
+    {
+        if(hyperperiodTicks(set, serviceCount) > MAX_HYPERPERIOD_TICKS)
+        {
+            printf("Hyperperiod longer than %d ticks, cannot compare with a recorded run\n", MAX_HYPERPERIOD_TICKS);
+            exit(-1);
+        }
+
+        if(horizonUsec < 2 * hyperperiodUsec)
+            horizonUsec = 2 * hyperperiodUsec;
+
+        for(i=0; i < serviceCount; i++)
+        {
+            services[i].patternLen = 2 * hyperperiodUsec / services[i].periodUsec;
+            services[i].patternUsec = malloc(services[i].patternLen * sizeof(unsigned long long));
+            if(services[i].patternUsec == NULL)
+            {
+                perror("malloc");
+                exit(-1);
+            }
+            memset(services[i].patternUsec, 0xff, services[i].patternLen * sizeof(unsigned long long));
+        }
+    }
+
+    if(timelinePath != NULL)
+    {
+        timeline = fopen(timelinePath, "w");
+        if(timeline == NULL)
+        {
+            perror(timelinePath);
+            exit(-1);
+        }
+        fprintf(timeline, "service,release,release_usec,start_usec,complete_usec,response_usec,missed\n");
+    }
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+    simulate(horizonUsec);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuEnd);
+
+    if(timeline != NULL)
+        fclose(timeline);
+
+    report(horizonUsec / 1000000.0,
+           ((cpuEnd.tv_sec - cpuStart.tv_sec) * 1000.0) + ((cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1000000.0));
+
+    if(syslogPath != NULL && compareRun(syslogPath, hyperperiodUsec) != 0)
+        exit(-1);
+
+    for(i=0; i < serviceCount; i++)
+        free(services[i].patternUsec);
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Soak mode of seqgen3
+//
+// The window a release belongs to is derived from its own CLOCK_MONOTONIC time,
+// so services never wait for the summary thread and no release is lost at a
+// window boundary: a record keeps its current window and the previous one, and
+// the summary thread, running SOAK_GRACE_MS after a boundary, takes whichever
+// of the two has the id of the window it reports.
+//
+// Syslog is not a ring: only the lines of the first and the last window, and
+// those of a window with a deadline miss, without releases or with a stale
+// record, go there too.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <syslog.h>
+
+#include "seqgen3.h"
+#include "seqtelemetry.h"
+#include "seqsoak.h"
+#include "seqthread.h"
+
+// How often the summary thread checks whether the sequencer is done
+#define SOAK_POLL_MS (200)
+
+static pthread_t soakThread;
+static int summaryFd = -1;
+static unsigned long long summaryLines;
+static unsigned long long reportedWindows;
+
+void soakAccountRelease(soakWindow_t *window, soakWindow_t *previous, unsigned long long windowId,
+                        unsigned long long latencyNsec, long long phaseNsec, int missed)
+{
+    if(windowId != window->windowId)
+    {
+        *previous = *window;
+        memset(window, 0, sizeof(soakWindow_t));
+        window->windowId = windowId;
+    }
+
+    if(window->releases == 0 || latencyNsec < window->minLatencyNsec)
+        window->minLatencyNsec = latencyNsec;
+    if(latencyNsec > window->maxLatencyNsec)
+        window->maxLatencyNsec = latencyNsec;
+    if(window->releases == 0 || phaseNsec < window->minPhaseNsec)
+        window->minPhaseNsec = phaseNsec;
+    if(window->releases == 0 || phaseNsec > window->maxPhaseNsec)
+        window->maxPhaseNsec = phaseNsec;
+
+    window->lastPhaseNsec = phaseNsec;
+    window->sumLatencyNsec += (double)latencyNsec;
+    window->sumSqLatencyNsec += (double)latencyNsec * (double)latencyNsec;
+    window->misses += missed;
+    window->releases++;
+}
+
+// The window of a record with the given id, NULL if it had no release in it
+static const soakWindow_t *windowOf(const soakWindow_t *window, const soakWindow_t *previous,
+                                    unsigned long long windowId)
+{
+    if(window->releases > 0 && window->windowId == windowId)
+        return window;
+    if(previous->releases > 0 && previous->windowId == windowId)
+        return previous;
+
+    return NULL;
+}
+
+// One fixed-size line into the ring file, and to syslog if asked
+static void writeSummaryLine(const char *line, int toSyslog)
+{
+    char record[SOAK_LINE_LEN];
+    int length;
+
+    if(toSyslog)
+        syslog(LOG_CRIT, "%s\n", line);
+
+    length = snprintf(record, sizeof(record), "%s", line);
+    if(length > SOAK_LINE_LEN - 1)
+        length = SOAK_LINE_LEN - 1;
+
+    memset(record + length, ' ', SOAK_LINE_LEN - 1 - length);
+    record[SOAK_LINE_LEN - 1] = '\n';
+
+    if(pwrite(summaryFd, record, SOAK_LINE_LEN, (off_t)(summaryLines % SOAK_SUMMARY_LINES) * SOAK_LINE_LEN) < 0)
+        perror("soak summary write");
+    summaryLines++;
+}
+
+// An anomalous window (no release, a deadline miss) is sent to syslog as well
+static void summarizeWindow(const char *stamp, unsigned long long windowId, const char *name,
+                            const soakWindow_t *window, int toSyslog)
+{
+    char line[SOAK_LINE_LEN];
+    double average, deviation;
+
+    if(window == NULL)
+    {
+        snprintf(line, sizeof(line), "%6llu %s %-4s no releases", windowId, stamp, name);
+        writeSummaryLine(line, TRUE);
+        return;
+    }
+
+    average = window->sumLatencyNsec / window->releases;
+    deviation = sqrt(fmax(0.0, (window->sumSqLatencyNsec / window->releases) - (average * average)));
+
+    snprintf(line, sizeof(line),
+             "%6llu %s %-4s n=%llu miss=%llu lat_us min/avg/max/sd=%.1lf/%.1lf/%.1lf/%.1lf phase_us last/min/max=%+.1lf/%+.1lf/%+.1lf",
+             windowId, stamp, name, window->releases, window->misses,
+             window->minLatencyNsec / 1000.0, average / 1000.0, window->maxLatencyNsec / 1000.0, deviation / 1000.0,
+             window->lastPhaseNsec / 1000.0, window->minPhaseNsec / 1000.0, window->maxPhaseNsec / 1000.0);
+    writeSummaryLine(line, toSyslog || window->misses > 0);
+}
+
+// A record left in the middle of an update, e.g. by a killed service process
+static void staleWindow(const char *stamp, unsigned long long windowId, const char *name)
+{
+    char line[SOAK_LINE_LEN];
+
+    snprintf(line, sizeof(line), "%6llu %s %-4s stale record", windowId, stamp, name);
+    writeSummaryLine(line, TRUE);
+}
+
+// Summary lines of window windowId: the sequencer ticks, then every registered service.
+// toSyslog for the first and the last window, which bracket the run in syslog.
+static void summarize(unsigned long long windowId, int toSyslog)
+{
+    sequencerTelemetry_t sequencer;
+    serviceTelemetry_t service;
+    char stamp[32], name[8];
+    struct tm local;
+    time_t now = time(NULL);
+    int i;
+
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &local);
+
+    if(telemetryRead(&telemetrySegment->sequencer, &sequencer, sizeof(sequencer)) != 0)
+        staleWindow(stamp, windowId, "SEQ");
+    else
+        summarizeWindow(stamp, windowId, "SEQ", windowOf(&sequencer.window, &sequencer.previous, windowId), toSyslog);
+
+    for(i=0; i < MAX_SERVICES; i++)
+    {
+        if(!threadParams[i].inUse)
+            continue;
+
+        snprintf(name, sizeof(name), "S%d", i+1);
+        if(telemetryRead(&telemetrySegment->services[i], &service, sizeof(service)) != 0)
+            staleWindow(stamp, windowId, name);
+        else
+            summarizeWindow(stamp, windowId, name, windowOf(&service.window, &service.previous, windowId), toSyslog);
+    }
+
+    reportedWindows = windowId + 1;
+}
+
+static void *soakSummary(void *arg)
+{
+    unsigned long long intervalNsec = telemetrySegment->soakIntervalNsec;
+    unsigned long long windowId = 0, deadlineNsec;
+    struct timespec pause = {0, SOAK_POLL_MS * NANOSEC_PER_MSEC};
+
+    while(!sequencerDone)
+    {
+        deadlineNsec = telemetrySegment->soakStartNsec + ((windowId + 1) * intervalNsec) +
+                       ((unsigned long long)SOAK_GRACE_MS * NANOSEC_PER_MSEC);
+
+        if(monotonicNsec() < deadlineNsec)
+        {
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        summarize(windowId, windowId == 0);
+        windowId++;
+    }
+
+    return NULL;
+}
+
+// Opens the summary ring and starts the windows, before the sequencer starts
+int startSoakThread(unsigned int intervalMinutes)
+{
+    int rc;
+
+    if(telemetrySegment == NULL)
+    {
+        printf("Soak mode needs the telemetry segment\n");
+        return -1;
+    }
+
+    summaryFd = open(SOAK_SUMMARY_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(summaryFd < 0)
+    {
+        perror("open soak summary");
+        return -1;
+    }
+
+    telemetrySegment->soakStartNsec = monotonicNsec();
+    __atomic_store_n(&telemetrySegment->soakIntervalNsec,
+                     (unsigned long long)intervalMinutes * 60 * NANOSEC_PER_SEC, __ATOMIC_RELEASE);
+
+    rc = startNonRtThread(&soakThread, soakSummary, NULL);
+
+    if(rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create for soak thread");
+        close(summaryFd);
+        return -1;
+    }
+
+    printf("Soak mode: summary every %u min into %s, stop with SIGINT\n", intervalMinutes, SOAK_SUMMARY_PATH);
+    return 0;
+}
+
+// Waits for the summary thread, then reports the last, partial, window.
+// Called once the services have stopped, before the telemetry segment goes away.
+void stopSoakThread(void)
+{
+    pthread_join(soakThread, NULL);
+
+    summarize(reportedWindows, TRUE);
+    close(summaryFd);
+}
@@ -0,0 +1,46 @@
+// Soak mode of seqgen3: runs until interrupted, for hours or days, with memory
+// and disk use that do not grow with the length of the run
+//
+// Every service (and the sequencer) accumulates its releases into a window
+// record of the telemetry segment, a new window every summary interval. A
+// non-RT thread writes one compact summary line per window and service into a
+// fixed-size ring file, so slow drift and rare outliers show up window by window.
+
+#ifndef SEQSOAK_H
+#define SEQSOAK_H
+
+// Summary ring file, written in the current directory like the CSV output
+#define SOAK_SUMMARY_PATH "seqgen3_soak.log"
+
+// The ring holds the most recent SOAK_SUMMARY_LINES lines of SOAK_LINE_LEN bytes
+#define SOAK_SUMMARY_LINES (4096)
+#define SOAK_LINE_LEN (160)
+
+// Releases woken before a window boundary may still be publishing just after it
+#define SOAK_GRACE_MS (1000)
+
+// Releases of one summary window. Phase is the wakeup time relative to the ideal
+// CLOCK_MONOTONIC schedule (start of the run plus a whole number of ticks): it
+// is not reset, so its trend over the windows is the cumulative drift.
+typedef struct
+{
+    unsigned long long windowId;
+    unsigned long long releases;
+    unsigned long long misses;
+    unsigned long long minLatencyNsec;
+    unsigned long long maxLatencyNsec;
+    double sumLatencyNsec;
+    double sumSqLatencyNsec;
+    long long lastPhaseNsec;
+    long long minPhaseNsec;
+    long long maxPhaseNsec;
+} soakWindow_t;
+
+// Async-signal-safe, also used by the sequencer for its ticks
+void soakAccountRelease(soakWindow_t *window, soakWindow_t *previous, unsigned long long windowId,
+                        unsigned long long latencyNsec, long long phaseNsec, int missed);
+
+int startSoakThread(unsigned int intervalMinutes);
+void stopSoakThread(void);
+
+#endif
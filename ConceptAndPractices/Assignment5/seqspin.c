@@ -0,0 +1,144 @@
+// Adaptive spin-then-block wait of a service for its next release
+//
+// The spin polls the 64 bit release count the sequencer increments before it
+// posts the semaphore or bumps the futex gate, so a hit is followed by a wait
+// that does not block. The clock is read between polls to bound the spin.
+
+#include <stdio.h>
+#include <limits.h>
+#include <syslog.h>
+
+#include "seqgen3.h"
+#include "seqspin.h"
+
+// Lets the sibling hyperthread run while polling
+static inline void cpuRelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+unsigned long long spinOpenNsec(const spinWindow_t *window, unsigned long long waitNsec, unsigned int spinUsec)
+{
+    if(spinUsec == 0 || window->windowNsec == 0)
+        return ULLONG_MAX;
+
+    return (window->openNsec > 0) ? waitNsec + window->openNsec : 0;
+}
+
+spinOutcome_t spinForRelease(spinWindow_t *window, spinStats_t *stats, const unsigned long long *releasedCnt,
+                             unsigned long long handledCnt, unsigned int spinUsec)
+{
+    unsigned long long startNsec, now;
+
+    if(spinUsec == 0)
+        return SPIN_NONE;
+
+    if(window->windowNsec == 0)
+        return SPIN_BLOCKED;
+
+    if(__atomic_load_n(releasedCnt, __ATOMIC_ACQUIRE) > handledCnt)
+        return SPIN_EARLY;
+
+    startNsec = nowNsec();
+    now = startNsec;
+
+    while(__atomic_load_n(releasedCnt, __ATOMIC_ACQUIRE) <= handledCnt)
+    {
+        now = nowNsec();
+        if(now - startNsec >= window->windowNsec)
+        {
+            stats->spinNsec += now - startNsec;
+            return SPIN_MISS;
+        }
+
+        cpuRelax();
+    }
+
+    stats->spinNsec += now - startNsec;
+    return SPIN_HIT;
+}
+
+// Recent lead times in increasing order
+static void sortLeads(const spinWindow_t *window, unsigned long long *sorted)
+{
+    unsigned long long lead;
+    unsigned int i, j;
+
+    for(i=0; i < window->filled; i++)
+    {
+        lead = window->leadNsec[i];
+        for(j=i; j > 0 && sorted[j-1] > lead; j--)
+            sorted[j] = sorted[j-1];
+        sorted[j] = lead;
+    }
+}
+
+void spinLearn(spinWindow_t *window, spinStats_t *stats, spinOutcome_t outcome, unsigned int spinUsec,
+               unsigned long long waitNsec, unsigned long long releaseNsec, unsigned long long wakeNsec)
+{
+    unsigned long long sorted[SPIN_HISTORY], latencyNsec, leadNsec, first, third, margin;
+
+    if(outcome == SPIN_NONE)
+        return;
+
+    stats->outcomes[outcome]++;
+
+    latencyNsec = (wakeNsec > releaseNsec) ? wakeNsec - releaseNsec : 0;
+    if(outcome == SPIN_HIT)
+    {
+        stats->sumHitLatencyNsec += latencyNsec;
+        if(latencyNsec > stats->maxHitLatencyNsec)
+            stats->maxHitLatencyNsec = latencyNsec;
+    }
+    else
+    {
+        stats->sumSleptLatencyNsec += latencyNsec;
+        if(latencyNsec > stats->maxSleptLatencyNsec)
+            stats->maxSleptLatencyNsec = latencyNsec;
+    }
+
+    // a release already pending when the wait started had no lead
+    leadNsec = (releaseNsec > waitNsec) ? releaseNsec - waitNsec : 0;
+    window->leadNsec[window->next] = leadNsec;
+    window->next = (window->next + 1) % SPIN_HISTORY;
+    if(window->filled < SPIN_HISTORY)
+        window->filled++;
+
+    // from the 1st to the 3rd quartile with margins, no spin if that exceeds the budget
+    sortLeads(window, sorted);
+    first = sorted[window->filled / 4];
+    third = sorted[(window->filled * 3) / 4];
+    margin = ((third - first) / 4) + SPIN_GUARD_NSEC;
+
+    window->openNsec = (first > margin) ? first - margin : 0;
+    window->windowNsec = third + margin - window->openNsec;
+    if(window->windowNsec > (unsigned long long)spinUsec * 1000)
+        window->windowNsec = 0;
+
+    stats->windowNsec = window->windowNsec;
+}
+
+void printSpinStats(int serviceIdx, const spinStats_t *stats)
+{
+    const unsigned long long *outcomes = stats->outcomes;
+    unsigned long long waits = outcomes[SPIN_BLOCKED] + outcomes[SPIN_EARLY] + outcomes[SPIN_HIT] + outcomes[SPIN_MISS];
+    unsigned long long slept = waits - outcomes[SPIN_HIT];
+
+    if(waits == 0)
+        return;
+
+    printf("S%d spin wait: %llu hits, %llu misses, %llu early, %llu blocked at once, wakeup usec avg/max spun=%.1lf/%.1lf slept=%.1lf/%.1lf, CPU burned spinning %.1lf ms (%.1lf usec per release), window %.1lf usec\n",
+           serviceIdx+1, outcomes[SPIN_HIT], outcomes[SPIN_MISS], outcomes[SPIN_EARLY], outcomes[SPIN_BLOCKED],
+           (outcomes[SPIN_HIT] > 0) ? stats->sumHitLatencyNsec / outcomes[SPIN_HIT] / 1000.0 : 0.0, stats->maxHitLatencyNsec / 1000.0,
+           (slept > 0) ? stats->sumSleptLatencyNsec / slept / 1000.0 : 0.0, stats->maxSleptLatencyNsec / 1000.0,
+           stats->spinNsec / 1000000.0, (double)stats->spinNsec / waits / 1000.0, stats->windowNsec / 1000.0);
+    syslog(LOG_CRIT, "S%d spin wait: %llu hits, %llu misses, %llu early, %llu blocked at once, wakeup usec avg/max spun=%.1lf/%.1lf slept=%.1lf/%.1lf, CPU burned spinning %.1lf ms\n",
+           serviceIdx+1, outcomes[SPIN_HIT], outcomes[SPIN_MISS], outcomes[SPIN_EARLY], outcomes[SPIN_BLOCKED],
+           (outcomes[SPIN_HIT] > 0) ? stats->sumHitLatencyNsec / outcomes[SPIN_HIT] / 1000.0 : 0.0, stats->maxHitLatencyNsec / 1000.0,
+           (slept > 0) ? stats->sumSleptLatencyNsec / slept / 1000.0 : 0.0, stats->maxSleptLatencyNsec / 1000.0,
+           stats->spinNsec / 1000000.0);
+}
@@ -0,0 +1,71 @@
+// Adaptive spin-then-block wait of a service for its next release
+//
+// A service given a spin budget (model spinUsec) polls its release count
+// before it falls back to its blocking wait (semaphore or futex gate). Where
+// and how long it polls is learned from its recent lead times, from the start
+// of a wait to the release that ends it: the spin window covers the spread of
+// the last SPIN_HISTORY leads (1st to 3rd quartile plus margins). The service
+// first blocks with a timeout until the window opens, at once if the leads are
+// short, which keeps a periodic service from spinning through its whole idle
+// time. When the window would exceed the budget it does not spin at all.
+//
+// A spinning service keeps its core busy at its SCHED_FIFO priority, it only
+// makes sense on a core it does not share with lower priority work, and
+// admission control counts the budget as demand on the core.
+
+#ifndef SEQSPIN_H
+#define SEQSPIN_H
+
+// Recent lead times the spin window is learned from
+#define SPIN_HISTORY (16)
+
+// Margin on each side of the window, at least the wakeup latency of a timed wait
+#define SPIN_GUARD_NSEC (50000ULL)
+
+typedef enum
+{
+    SPIN_NONE,               // no spin budget
+    SPIN_BLOCKED,            // no window, blocked at once
+    SPIN_EARLY,              // released before the window opened
+    SPIN_HIT,                // released while spinning
+    SPIN_MISS                // spun through the window, then blocked
+} spinOutcome_t;
+
+// Learning state of one service, private to its thread or process
+typedef struct
+{
+    unsigned long long leadNsec[SPIN_HISTORY];
+    unsigned int next;
+    unsigned int filled;
+    unsigned long long openNsec;       // window opens this long after the wait starts
+    unsigned long long windowNsec;     // 0 for no spin
+} spinWindow_t;
+
+// Waits of one service over the run, plain data like releaseStats_t
+typedef struct
+{
+    unsigned long long outcomes[SPIN_MISS + 1];
+    unsigned long long spinNsec;       // CPU burned spinning
+    double sumHitLatencyNsec;          // release to wakeup, spun or slept
+    double sumSleptLatencyNsec;
+    unsigned long long maxHitLatencyNsec;
+    unsigned long long maxSleptLatencyNsec;
+    unsigned long long windowNsec;     // latest learned window
+} spinStats_t;
+
+// Instant to block until before spinning for a wait started at waitNsec: 0 to
+// spin at once, ULLONG_MAX not to spin
+unsigned long long spinOpenNsec(const spinWindow_t *window, unsigned long long waitNsec, unsigned int spinUsec);
+
+// Once the window is open, polls for the release after the handledCnt-th.
+// The CPU time burned is accounted here, the outcome by spinLearn.
+spinOutcome_t spinForRelease(spinWindow_t *window, spinStats_t *stats, const unsigned long long *releasedCnt,
+                             unsigned long long handledCnt, unsigned int spinUsec);
+
+// After the wakeup: accounts the wait and learns its lead time
+void spinLearn(spinWindow_t *window, spinStats_t *stats, spinOutcome_t outcome, unsigned int spinUsec,
+               unsigned long long waitNsec, unsigned long long releaseNsec, unsigned long long wakeNsec);
+
+void printSpinStats(int serviceIdx, const spinStats_t *stats);
+
+#endif
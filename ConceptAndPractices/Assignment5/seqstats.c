@@ -0,0 +1,108 @@
+// Release latency statistics of a seqgen3 service
+
+#include <stdio.h>
+#include <math.h>
+#include <syslog.h>
+
+#include "seqgen3.h"
+#include "seqstats.h"
+
+// Current time of MY_CLOCK_TYPE in nanoseconds, the time base of every release stamp
+unsigned long long nowNsec(void)
+{
+    struct timespec now;
+
+    clock_gettime(MY_CLOCK_TYPE, &now);
+    return ((unsigned long long)now.tv_sec * NANOSEC_PER_SEC) + now.tv_nsec;
+}
+
+// Current CLOCK_MONOTONIC time in nanoseconds, the time base of the ideal schedule in soak mode
+unsigned long long monotonicNsec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * NANOSEC_PER_SEC) + now.tv_nsec;
+}
+
+// CPU time of the calling thread in nanoseconds, the time base of loads, budgets and spikes
+unsigned long long threadCpuNsec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return ((unsigned long long)now.tv_sec * NANOSEC_PER_SEC) + now.tv_nsec;
+}
+
+// Burns burnNsec of CPU time of the calling thread, time spent preempted does not
+// count. Gives up as soon as stop(arg) is true when a stop is given; returns how much it burned
+unsigned long long burnCpuNsec(unsigned long long burnNsec, int (*stop)(void *arg), void *arg)
+{
+    unsigned long long startNsec = threadCpuNsec(), usedNsec = 0;
+
+    while(usedNsec < burnNsec && (stop == NULL || !stop(arg)))
+        usedNsec = threadCpuNsec() - startNsec;
+
+    return usedNsec;
+}
+
+// Accounts one release of a service woken at wakeNsec for a release stamped at releaseNsec,
+// returns the release latency
+unsigned long long recordRelease(releaseStats_t *stats, unsigned long long releaseNsec, unsigned long long wakeNsec, unsigned long long periodUsec)
+{
+    unsigned long long latency = (wakeNsec > releaseNsec) ? (wakeNsec - releaseNsec) : 0;
+    unsigned long long periodNsec = periodUsec * 1000;
+    unsigned long long interval, error;
+
+    if(stats->releases == 0 || latency < stats->minLatencyNsec)
+        stats->minLatencyNsec = latency;
+    if(latency > stats->maxLatencyNsec)
+        stats->maxLatencyNsec = latency;
+
+    stats->sumLatencyNsec += (double)latency;
+    stats->sumSqLatencyNsec += (double)latency * (double)latency;
+
+    if(stats->releases > 0)
+    {
+        interval = wakeNsec - stats->lastWakeNsec;
+        error = (interval > periodNsec) ? (interval - periodNsec) : (periodNsec - interval);
+        if(error > stats->maxIntervalErrorNsec)
+            stats->maxIntervalErrorNsec = error;
+    }
+
+    stats->lastWakeNsec = wakeNsec;
+    stats->releases++;
+
+    return latency;
+}
+
+// One summary line per service, in the same format for every mode so runs can be compared
+void printReleaseStats(const char *mode, int serviceIdx, const releaseStats_t *stats)
+{
+    double average = 0.0, deviation = 0.0;
+
+    if(stats->releases > 0)
+    {
+        average = stats->sumLatencyNsec / stats->releases;
+        deviation = sqrt(fmax(0.0, (stats->sumSqLatencyNsec / stats->releases) - (average * average)));
+    }
+
+    printf("S%d %s: %llu releases, release latency usec min=%.1lf avg=%.1lf max=%.1lf jitter(stddev)=%.1lf, max interval error usec=%.1lf\n",
+           serviceIdx+1, mode, stats->releases,
+           stats->minLatencyNsec / 1000.0, average / 1000.0, stats->maxLatencyNsec / 1000.0,
+           deviation / 1000.0, stats->maxIntervalErrorNsec / 1000.0);
+    syslog(LOG_CRIT, "S%d %s: %llu releases, release latency usec min=%.1lf avg=%.1lf max=%.1lf jitter(stddev)=%.1lf, max interval error usec=%.1lf\n",
+           serviceIdx+1, mode, stats->releases,
+           stats->minLatencyNsec / 1000.0, average / 1000.0, stats->maxLatencyNsec / 1000.0,
+           deviation / 1000.0, stats->maxIntervalErrorNsec / 1000.0);
+}
+
+// Actions taken by the overload policy of a service over the run
+void printOverloadActions(int serviceIdx, const char *policy, const releaseStats_t *stats,
+                          unsigned long long capped, unsigned long long degraded)
+{
+    printf("S%d overload policy %s: skipped=%llu capped=%llu aborted=%llu degraded=%llu\n",
+           serviceIdx+1, policy, stats->skipped, capped, stats->aborted, degraded);
+    syslog(LOG_CRIT, "S%d overload policy %s: skipped=%llu capped=%llu aborted=%llu degraded=%llu\n",
+           serviceIdx+1, policy, stats->skipped, capped, stats->aborted, degraded);
+}
@@ -0,0 +1,41 @@
+// Release latency statistics of a seqgen3 service
+//
+// Plain data, so the same record can live in a thread's service slot or in the
+// shared memory segment of the multi-process mode.
+
+#ifndef SEQSTATS_H
+#define SEQSTATS_H
+
+#include "seqperf.h"
+#include "seqres.h"
+#include "seqspin.h"
+#include "seqbudget.h"
+
+typedef struct
+{
+    unsigned long long releases;
+    unsigned long long minLatencyNsec;       // release instant to service wakeup
+    unsigned long long maxLatencyNsec;
+    double sumLatencyNsec;
+    double sumSqLatencyNsec;
+    unsigned long long lastWakeNsec;
+    unsigned long long maxIntervalErrorNsec; // worst |wakeup interval - period|
+    unsigned long long skipped;              // releases skipped by OVERLOAD_SKIP
+    unsigned long long aborted;              // jobs aborted by OVERLOAD_ABORT
+    unsigned long long deadlineMisses;       // completed after the next release was due
+    perfStats_t perf;                        // performance counters, when enabled
+    blockingStats_t blocking;                // on shared resources, in thread mode
+    spinStats_t spin;                        // spin-then-block waits, with a spin budget
+    budgetStats_t budget;                    // jobs run with an execution budget
+} releaseStats_t;
+
+unsigned long long nowNsec(void);
+unsigned long long monotonicNsec(void);
+unsigned long long threadCpuNsec(void);
+unsigned long long burnCpuNsec(unsigned long long burnNsec, int (*stop)(void *arg), void *arg);
+unsigned long long recordRelease(releaseStats_t *stats, unsigned long long releaseNsec, unsigned long long wakeNsec, unsigned long long periodUsec);
+void printReleaseStats(const char *mode, int serviceIdx, const releaseStats_t *stats);
+void printOverloadActions(int serviceIdx, const char *policy, const releaseStats_t *stats,
+                          unsigned long long capped, unsigned long long degraded);
+
+#endif
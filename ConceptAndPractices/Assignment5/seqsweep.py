@@ -0,0 +1,122 @@
+import argparse
+import csv
+import re
+import subprocess
+import sys
+
+# This python script finds where the seqgen3 design breaks down: it runs
+# seqgen3 once per service count and sequencer rate, collects the one line run
+# summary of each run and reports, per rate, the largest service count that
+# still holds, and the knee of the tick latency over the offered release rate.
+# Run it as root from the directory of seqgen3, e.g.
+#
+#   sudo python3 seqsweep.py -d 5 -o seqsweep_$(hostname).csv
+
+# Points of the sweep
+default_counts = [3, 8, 16, 32, 64, 128, 256]
+default_rates_hz = [100, 200, 500, 1000, 2000, 5000, 10000, 20000]
+
+# Seconds to microseconds conversion factor
+seconds_to_microseconds = 1000000
+
+# Releases are written to a binary trace nobody reads, so syslog is not what breaks
+seqgen3_command = ["./seqgen3", "-b", "/dev/null"]
+
+summary_pattern = re.compile(r"Run summary: services=(\d+) tick_hz=([\d.]+) wakeups=(\d+) "
+                             r"tick_latency_usec p50=([\d.]+) p99=([\d.]+) max=([\d.]+) releases=(\d+) "
+                             r"release_latency_usec avg=([\d.]+) jitter=([\d.]+) max=([\d.]+) "
+                             r"interval_error_usec max=([\d.]+) misses=(\d+)")
+
+fields = ["services", "rate_hz", "wakeups", "tick_p50_us", "tick_p99_us", "tick_max_us", "releases",
+          "release_avg_us", "release_jitter_us", "release_max_us", "interval_error_max_us", "misses",
+          "release_rate_hz", "miss_rate", "broken"]
+
+def run_point(count, rate_hz, seconds):
+
+    result = subprocess.run(seqgen3_command + ["-n", str(count), "-r", str(rate_hz), "-d", str(seconds)],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    match = summary_pattern.search(result.stdout)
+    if result.returncode != 0 or match is None:
+        # e.g. a service set admission control rejects at this rate
+        reason = result.stdout.strip().splitlines()[-1:] or ["no output"]
+        print("  {} services at {} Hz: no run ({})".format(count, rate_hz, reason[0]), file=sys.stderr)
+        return None
+
+    values = match.groups()
+    point = {"services": int(values[0]), "rate_hz": rate_hz, "wakeups": int(values[2]),
+             "tick_p50_us": float(values[3]), "tick_p99_us": float(values[4]), "tick_max_us": float(values[5]),
+             "releases": int(values[6]), "release_avg_us": float(values[7]), "release_jitter_us": float(values[8]),
+             "release_max_us": float(values[9]), "interval_error_max_us": float(values[10]), "misses": int(values[11])}
+    point["release_rate_hz"] = point["releases"] / float(seconds)
+    point["miss_rate"] = point["misses"] / float(point["releases"]) if point["releases"] > 0 else 0.0
+    return point
+
+def is_broken(point, max_miss_rate, max_tick_fraction):
+
+    # deadlines missed, or the sequencer no longer keeps up with its own tick
+    tick_us = seconds_to_microseconds / float(point["rate_hz"])
+    return point["miss_rate"] > max_miss_rate or point["tick_p99_us"] > max_tick_fraction * tick_us
+
+def knee(points, key):
+
+    # Kneedle: the point furthest below the chord from the lightest to the heaviest
+    # point, with both axes normalised
+    ordered = sorted(points, key=lambda p: p["release_rate_hz"])
+    if len(ordered) < 3:
+        return None
+
+    x0, x1 = ordered[0]["release_rate_hz"], ordered[-1]["release_rate_hz"]
+    y0, y1 = min(p[key] for p in ordered), max(p[key] for p in ordered)
+    if x1 == x0 or y1 == y0:
+        return None
+
+    def distance(p):
+        x = (p["release_rate_hz"] - x0) / (x1 - x0)
+        y = (p[key] - y0) / (y1 - y0)
+        return x - y
+
+    return max(ordered, key=distance)
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Sweep seqgen3 over service counts and sequencer rates")
+    parser.add_argument("-n", "--counts", type=int, nargs="+", default=default_counts, help="service counts")
+    parser.add_argument("-r", "--rates", type=int, nargs="+", default=default_rates_hz, help="sequencer rates in Hz")
+    parser.add_argument("-d", "--seconds", type=int, default=5, help="length of each run")
+    parser.add_argument("-m", "--max-miss-rate", type=float, default=0.001, help="deadline misses a point may have")
+    parser.add_argument("-t", "--max-tick-fraction", type=float, default=0.5,
+                        help="p99 sequencer latency a point may have, as a fraction of its tick")
+    parser.add_argument("-o", "--output", default="seqsweep.csv", help="CSV file of all points")
+    args = parser.parse_args()
+
+    points = []
+    for rate_hz in args.rates:
+        for count in args.counts:
+            print("{} services at {} Hz".format(count, rate_hz), file=sys.stderr)
+            point = run_point(count, rate_hz, args.seconds)
+            if point is None:
+                continue
+            point["broken"] = int(is_broken(point, args.max_miss_rate, args.max_tick_fraction))
+            points.append(point)
+
+    with open(args.output, "w") as output:
+        writer = csv.DictWriter(output, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(points)
+
+    # Capacity per rate: the largest count before the first broken point
+    print("rate_hz,max_services_held,first_broken_services")
+    for rate_hz in args.rates:
+        held, broken = None, None
+        for point in sorted((p for p in points if p["rate_hz"] == rate_hz), key=lambda p: p["services"]):
+            if point["broken"]:
+                broken = point["services"]
+                break
+            held = point["services"]
+        print("{},{},{}".format(rate_hz, held if held is not None else "-", broken if broken is not None else "-"))
+
+    for key in ["tick_p99_us", "release_jitter_us"]:
+        point = knee(points, key)
+        if point is not None:
+            print("Knee of {}: {} services at {} Hz, {:.0f} releases/s, {} = {:.1f}".format(
+                key, point["services"], point["rate_hz"], point["release_rate_hz"], key, point[key]))
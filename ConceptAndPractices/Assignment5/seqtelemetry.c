@@ -0,0 +1,150 @@
+// Live telemetry of seqgen3 in a POSIX shared memory segment
+//
+// The segment is created by the sequencer and attached read-write by the
+// service processes of the multi-process mode. A service pays a handful of
+// stores per release, the sequencer a few per tick. Telemetry is best effort:
+// if the segment cannot be created the run goes on without it.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "seqtelemetry.h"
+
+telemetrySegment_t *telemetrySegment = NULL;
+
+int createTelemetrySegment(void)
+{
+    telemetrySegment_t *segment;
+    int fd;
+
+    fd = shm_open(TELEMETRY_SEGMENT_NAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        perror("shm_open telemetry segment, running without telemetry");
+        return -1;
+    }
+
+    if(ftruncate(fd, sizeof(telemetrySegment_t)) < 0)
+    {
+        perror("ftruncate telemetry segment, running without telemetry");
+        close(fd);
+        shm_unlink(TELEMETRY_SEGMENT_NAME);
+        return -1;
+    }
+
+    segment = mmap(NULL, sizeof(telemetrySegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(segment == MAP_FAILED)
+    {
+        perror("mmap telemetry segment, running without telemetry");
+        shm_unlink(TELEMETRY_SEGMENT_NAME);
+        return -1;
+    }
+
+    memset(segment, 0, sizeof(telemetrySegment_t));
+    segment->startNsec = nowNsec();
+    __atomic_store_n(&segment->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+
+    telemetrySegment = segment;
+    return 0;
+}
+
+// Service process side, the sequencer already created the segment
+int attachTelemetrySegment(void)
+{
+    telemetrySegment_t *segment;
+    int fd;
+
+    fd = shm_open(TELEMETRY_SEGMENT_NAME, O_RDWR, 0);
+    if(fd < 0)
+        return -1;
+
+    segment = mmap(NULL, sizeof(telemetrySegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(segment == MAP_FAILED)
+        return -1;
+
+    telemetrySegment = segment;
+    return 0;
+}
+
+// Sequencer side: flags the run as done for the monitors, then removes the segment
+void destroyTelemetrySegment(void)
+{
+    if(telemetrySegment == NULL)
+        return;
+
+    telemetrySegment->done = TRUE;
+    munmap(telemetrySegment, sizeof(telemetrySegment_t));
+    telemetrySegment = NULL;
+    shm_unlink(TELEMETRY_SEGMENT_NAME);
+}
+
+// Clears the record of a service slot before its (new) service starts writing it
+void telemetryResetService(int serviceIdx)
+{
+    serviceTelemetry_t *record;
+
+    if(telemetrySegment == NULL)
+        return;
+
+    record = &telemetrySegment->services[serviceIdx];
+
+    telemetryWriteBegin(&record->seq);
+    record->core = 0;
+    record->periodMs = 0;
+    record->releases = 0;
+    record->lastLatencyNsec = 0;
+    record->minLatencyNsec = 0;
+    record->maxLatencyNsec = 0;
+    record->sumLatencyNsec = 0.0;
+    record->sumSqLatencyNsec = 0.0;
+    record->misses = 0;
+    record->skipped = 0;
+    record->aborted = 0;
+    memset(&record->window, 0, sizeof(record->window));
+    memset(&record->previous, 0, sizeof(record->previous));
+    telemetryWriteEnd(&record->seq);
+
+    jitterResetService(serviceIdx);
+
+    // outside the sequencer seqlock, but the sequencer does not release this slot yet
+    __atomic_store_n(&telemetrySegment->sequencer.overruns[serviceIdx], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&telemetrySegment->sequencer.capped[serviceIdx], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&telemetrySegment->sequencer.degraded[serviceIdx], 0, __ATOMIC_RELAXED);
+}
+
+// Called by the service after each timed release, phaseNsec is its wakeup
+// relative to the ideal schedule
+void telemetryPublishRelease(int serviceIdx, const serviceModel_t *model, const releaseStats_t *stats,
+                             unsigned long long latencyNsec, long long phaseNsec, int missed)
+{
+    serviceTelemetry_t *record;
+
+    if(telemetrySegment == NULL)
+        return;
+
+    record = &telemetrySegment->services[serviceIdx];
+
+    telemetryWriteBegin(&record->seq);
+    record->core = model->core;
+    record->periodMs = model->periodMs;
+    if(record->releases == 0 || latencyNsec < record->minLatencyNsec)
+        record->minLatencyNsec = latencyNsec;
+    if(latencyNsec > record->maxLatencyNsec)
+        record->maxLatencyNsec = latencyNsec;
+    record->lastLatencyNsec = latencyNsec;
+    record->sumLatencyNsec += (double)latencyNsec;
+    record->sumSqLatencyNsec += (double)latencyNsec * (double)latencyNsec;
+    record->misses += missed;
+    record->skipped = stats->skipped;
+    record->aborted = stats->aborted;
+    if(telemetrySegment->soakIntervalNsec != 0)
+        soakAccountRelease(&record->window, &record->previous, telemetrySoakWindow(), latencyNsec, phaseNsec, missed);
+    record->releases++;
+    telemetryWriteEnd(&record->seq);
+}
@@ -0,0 +1,130 @@
+// Live telemetry of seqgen3 in a POSIX shared memory segment
+//
+// Every record has a single writer (the sequencer, or one service) and is
+// protected by a seqlock: the writer never waits, it makes the sequence count
+// odd, stores the fields and makes it even again. Readers (seqmon) copy the
+// record and retry if the count was odd or changed meanwhile, a bounded number
+// of times: a service process killed mid-update leaves its count odd for good,
+// and the record is then reported stale instead.
+
+#ifndef SEQTELEMETRY_H
+#define SEQTELEMETRY_H
+
+#include <string.h>
+
+#include "seqgen3.h"
+#include "seqsoak.h"
+#include "seqjitter.h"
+
+#define TELEMETRY_SEGMENT_NAME "/seqgen3_telemetry"
+#define TELEMETRY_MAGIC (0x53455133)
+
+// Copies of a record tried before it is reported stale, a few ms of spinning:
+// far longer than an update, unless its writer is preempted in the middle
+#define TELEMETRY_READ_RETRIES (1000000)
+
+// Written by the service only, once per release
+typedef struct
+{
+    unsigned int seq;
+    int core;
+    unsigned int periodMs;
+    unsigned long long releases;
+    unsigned long long lastLatencyNsec;
+    unsigned long long minLatencyNsec;
+    unsigned long long maxLatencyNsec;
+    double sumLatencyNsec;                    // sums, so readers get jitter over their own interval
+    double sumSqLatencyNsec;
+    unsigned long long misses;                // releases completed after their deadline (next release)
+    unsigned long long skipped;               // overload actions taken by the service
+    unsigned long long aborted;
+    soakWindow_t window;                      // soak mode only: current and previous summary window
+    soakWindow_t previous;
+} __attribute__((aligned(64))) serviceTelemetry_t;
+
+// Written by the sequencer only, once per tick
+typedef struct
+{
+    unsigned int seq;
+    unsigned long long ticks;
+    unsigned long long lastTickLatencyNsec;   // handler entry vs ideal tick time
+    unsigned long long maxTickLatencyNsec;
+    unsigned long long overruns[MAX_SERVICES]; // released again before the previous release completed
+    unsigned long long capped[MAX_SERVICES];   // overload actions taken by the sequencer
+    unsigned long long degraded[MAX_SERVICES];
+    soakWindow_t window;                      // soak mode only: ticks of the current and previous window
+    soakWindow_t previous;
+} __attribute__((aligned(64))) sequencerTelemetry_t;
+
+typedef struct
+{
+    unsigned int magic;
+    volatile int done;                        // set when the sequencer has stopped
+    unsigned long long startNsec;
+    unsigned long long soakStartNsec;         // CLOCK_MONOTONIC start of the first soak window
+    unsigned long long soakIntervalNsec;      // length of a soak window, 0 when not soaking
+    unsigned long long jitterThresholdNsec;   // outlier threshold of jitter attribution, 0 when off
+    int perfCounters;                         // services open performance counters
+    sequencerTelemetry_t sequencer;
+    serviceTelemetry_t services[MAX_SERVICES];
+    jitterRing_t jitter[MAX_SERVICES];
+} telemetrySegment_t;
+
+// Mapped read-write by the sequencer and the service processes, NULL if unavailable
+extern telemetrySegment_t *telemetrySegment;
+
+static inline void telemetryWriteBegin(unsigned int *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    // the field stores below must not become visible before the odd count
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void telemetryWriteEnd(unsigned int *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+// Consistent copy of a record of size bytes starting with its sequence count.
+// Returns 0, or -1 if the record stayed in the middle of an update: copy is torn then.
+static inline int telemetryRead(const void *record, void *copy, size_t size)
+{
+    const unsigned int *seq = (const unsigned int *)record;
+    unsigned int before, after;
+    int retries = 0;
+
+    do
+    {
+        if(retries++ == TELEMETRY_READ_RETRIES)
+            return -1;
+
+        before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        memcpy(copy, record, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    }
+    while((before & 1) || before != after);
+
+    return 0;
+}
+
+// Soak window of a release happening now, only meaningful when soakIntervalNsec is set
+static inline unsigned long long telemetrySoakWindow(void)
+{
+    return (monotonicNsec() - telemetrySegment->soakStartNsec) / telemetrySegment->soakIntervalNsec;
+}
+
+// TRUE while soaking: per release logging is off, only window summaries are written
+static inline int telemetrySoaking(void)
+{
+    return (telemetrySegment != NULL) && (telemetrySegment->soakIntervalNsec != 0);
+}
+
+int createTelemetrySegment(void);
+int attachTelemetrySegment(void);
+void destroyTelemetrySegment(void);
+void telemetryResetService(int serviceIdx);
+void telemetryPublishRelease(int serviceIdx, const serviceModel_t *model, const releaseStats_t *stats,
+                             unsigned long long latencyNsec, long long phaseNsec, int missed);
+
+#endif
@@ -0,0 +1,86 @@
+// Helper and RT thread start of seqgen3, posix_clock and the tools beside them
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "seqthread.h"
+
+int startNonRtThread(pthread_t *thread, void *(*entry)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    struct sched_param param = {0};
+    sigset_t alarmSet, callerSet;
+    int rc;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+
+    // a new thread starts with the signal mask of its creator, so SIGALRM is
+    // blocked from its first instruction; the creator gets its mask back
+    sigemptyset(&alarmSet);
+    sigaddset(&alarmSet, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarmSet, &callerSet);
+    rc = pthread_create(thread, &attr, entry, arg);
+    pthread_sigmask(SIG_SETMASK, &callerSet, NULL);
+
+    pthread_attr_destroy(&attr);
+    return rc;
+}
+
+// Writes the calling thread (tid 0) into the cgroup.threads file named by variable
+static int moveThread(const char *variable)
+{
+    const char *path = getenv(variable);
+    int fd, rc = 0;
+
+    if(path == NULL)
+        return 0;
+
+    fd = open(path, O_WRONLY);
+    if(fd < 0)
+        return -1;
+
+    if(write(fd, "0", 1) != 1)
+        rc = -1;
+
+    close(fd);
+    return rc;
+}
+
+int enterRtPartition(void)
+{
+    return moveThread(RT_PARTITION_ENV);
+}
+
+int leaveRtPartition(void)
+{
+    return moveThread(HOUSEKEEPING_ENV);
+}
+
+int startRtThread(pthread_t *thread, const pthread_attr_t *attr, void *(*entry)(void *), void *arg)
+{
+    int rc;
+
+    if(enterRtPartition() != 0)
+    {
+        rc = errno;
+        perror("enter the RT partition");
+        return rc;
+    }
+
+    rc = pthread_create(thread, attr, entry, arg);
+
+    // the creator is not an RT thread itself, only its new thread stays
+    if(leaveRtPartition() != 0)
+        perror("leave the RT partition");
+
+    return rc;
+}
@@ -0,0 +1,38 @@
+// Helper and RT thread start of seqgen3, posix_clock and the tools beside them
+//
+// Control, soak, jitter, breakdown, power sampling and aperiodic generation
+// run beside the real-time threads: SCHED_OTHER, whatever the creator runs at
+// (main runs SCHED_FIFO at RT_MAX), and with SIGALRM blocked so the signal
+// handler of a signal driven sequencer never runs on them.
+//
+// Under seqisol -s the RT cores are a cpuset partition of their own, a
+// threaded cgroup the rest of the program stays out of: only a thread in it
+// can be pinned to an RT core. seqisol names the cgroup.threads files of the
+// partition and of the housekeeping cgroup in the environment of the command,
+// and a thread is admitted by writing itself to the first. Without seqisol
+// the variables are unset and admission costs nothing.
+//
+// The module does not depend on the sequencer, posix_clock links it as well.
+
+#ifndef SEQTHREAD_H
+#define SEQTHREAD_H
+
+#include <pthread.h>
+
+#define RT_PARTITION_ENV "SEQISOL_RT_THREADS"
+#define HOUSEKEEPING_ENV "SEQISOL_HOUSEKEEPING_THREADS"
+
+// Starts entry(arg) on a SCHED_OTHER thread with SIGALRM blocked, returns 0 or the pthread_create error
+int startNonRtThread(pthread_t *thread, void *(*entry)(void *), void *arg);
+
+// Moves the calling thread into the RT partition, or back to housekeeping.
+// Threads and processes it creates in between start in the partition.
+// Returns 0, also when there is no partition, or -1 with errno set.
+int enterRtPartition(void);
+int leaveRtPartition(void);
+
+// pthread_create from inside the RT partition, for a thread that attr pins to
+// an RT core or that pins itself. Returns 0 or an errno value.
+int startRtThread(pthread_t *thread, const pthread_attr_t *attr, void *(*entry)(void *), void *arg);
+
+#endif
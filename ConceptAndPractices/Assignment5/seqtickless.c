@@ -0,0 +1,72 @@
+// Tickless sequencer of seqgen3: binary min-heap of the next releases
+
+#include <limits.h>
+
+#include "seqgen3.h"
+#include "seqsched.h"
+#include "seqtickless.h"
+
+static ticklessEntry_t heap[MAX_SERVICES];
+static int heapCount;
+
+static inline int earlier(const ticklessEntry_t *a, const ticklessEntry_t *b)
+{
+    // same instant: in table order, like the ticked sequencer
+    return (a->dueNsec < b->dueNsec) || (a->dueNsec == b->dueNsec && a->serviceIdx < b->serviceIdx);
+}
+
+static void siftDown(int i)
+{
+    ticklessEntry_t entry = heap[i];
+    int child;
+
+    while((child = (2 * i) + 1) < heapCount)
+    {
+        if(child + 1 < heapCount && earlier(&heap[child+1], &heap[child]))
+            child++;
+        if(!earlier(&heap[child], &entry))
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = entry;
+}
+
+void ticklessBuild(const releaseTable_t *table, unsigned long long startNsec, unsigned long long fromNsec)
+{
+    unsigned long long periodNsec;
+    int i;
+
+    heapCount = table->count;
+
+    for(i=0; i < table->count; i++)
+    {
+        periodNsec = table->entries[i].periodUsec * 1000;
+
+        heap[i].serviceIdx = table->entries[i].serviceIdx;
+        heap[i].periodNsec = periodNsec;
+        // release 1 is one period after the start, as with the ticked sequencer
+        heap[i].dueNsec = startNsec + periodNsec * ((fromNsec > startNsec) ? (fromNsec - startNsec + periodNsec - 1) / periodNsec : 1);
+    }
+
+    for(i=(heapCount / 2) - 1; i >= 0; i--)
+        siftDown(i);
+}
+
+unsigned long long ticklessNextDue(void)
+{
+    return (heapCount > 0) ? heap[0].dueNsec : ULLONG_MAX;
+}
+
+int ticklessTakeDue(unsigned long long *dueNsec)
+{
+    int serviceIdx = heap[0].serviceIdx;
+
+    *dueNsec = heap[0].dueNsec;
+    heap[0].dueNsec += heap[0].periodNsec;
+    siftDown(0);
+
+    return serviceIdx;
+}
@@ -0,0 +1,41 @@
+// Tickless sequencer of seqgen3: the next release of every service in a
+// min-heap, one absolute CLOCK_MONOTONIC timer armed for the earliest
+//
+// The sequencer wakes up only when a release is due, so a 150 ms service costs
+// one wakeup per 150 ms instead of fifteen ticks, and periods are any whole
+// number of microseconds (model periodUsec) from TICKLESS_MIN_PERIOD_USEC on
+// instead of multiples of the 10 ms tick. Finding the next release and
+// rescheduling one are O(log n) in the number of services, which is bounded by
+// MAX_SERVICES like the service table. Everything here runs in the SIGALRM
+// handler of the sequencer, so it only touches preallocated memory.
+
+#ifndef SEQTICKLESS_H
+#define SEQTICKLESS_H
+
+#include "seqgen3.h"
+
+// Release quantum in tickless mode, the unit of the ms based schedules (faults, capture)
+#define TICKLESS_QUANTUM_MS (1)
+
+// Shortest period in tickless mode, a wakeup and its releases take tens of usec
+#define TICKLESS_MIN_PERIOD_USEC (100)
+
+typedef struct
+{
+    unsigned long long dueNsec;      // CLOCK_MONOTONIC
+    unsigned long long periodNsec;
+    int serviceIdx;
+} ticklessEntry_t;
+
+// Loads the services of table, each due at its first release at or after
+// fromNsec on the grid of its period from startNsec
+void ticklessBuild(const releaseTable_t *table, unsigned long long startNsec, unsigned long long fromNsec);
+
+// Earliest due release, ULLONG_MAX if there is none
+unsigned long long ticklessNextDue(void);
+
+// Takes the earliest due release and schedules the next one of the same
+// service a period later. Returns the service.
+int ticklessTakeDue(unsigned long long *dueNsec);
+
+#endif
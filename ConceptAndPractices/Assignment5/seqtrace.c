@@ -0,0 +1,66 @@
+// Binary release trace of seqgen3
+//
+// Every service appends its own records with a single write() to a file opened
+// with O_APPEND, so records of concurrent services never interleave and no lock
+// is shared between them. The descriptor is not close-on-exec: the service
+// processes of multi-process mode write to the same file.
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include "seqgen3.h"
+#include "seqtrace.h"
+
+int traceFd = -1;
+
+int openTrace(const char *path, unsigned long long startNsec)
+{
+    traceHeader_t header;
+
+    traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if(traceFd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.startNsec = startNsec;
+
+    if(write(traceFd, &header, sizeof(header)) != sizeof(header))
+    {
+        perror("write trace header");
+        closeTrace();
+        return -1;
+    }
+
+    return 0;
+}
+
+void traceRelease(int serviceIdx, unsigned int periodMs, unsigned long long releaseCnt, unsigned long long wakeNsec)
+{
+    traceRecord_t record;
+
+    record.releaseCnt = releaseCnt;
+    record.wakeNsec = wakeNsec;
+    record.periodMs = periodMs;
+    record.serviceNum = serviceIdx+1;
+    record.core = sched_getcpu();
+
+    // a short write only loses this record, the service does not retry in its release
+    if(write(traceFd, &record, sizeof(record)) != sizeof(record))
+        return;
+}
+
+void closeTrace(void)
+{
+    close(traceFd);
+    traceFd = -1;
+}
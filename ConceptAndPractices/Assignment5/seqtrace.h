@@ -0,0 +1,36 @@
+// Binary release trace of seqgen3: one fixed size record per release
+//
+// The compact alternative to one syslog line per release for long runs, read
+// by seqanalyze. The file starts with a traceHeader_t, followed by traceRecord_t
+// records in the order the services woke up, in host byte order.
+
+#ifndef SEQTRACE_H
+#define SEQTRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "SEQTRC1"
+
+typedef struct
+{
+    char magic[8];                   // TRACE_MAGIC
+    uint64_t startNsec;              // MY_CLOCK_TYPE time of the start of the run
+} traceHeader_t;
+
+typedef struct
+{
+    uint64_t releaseCnt;             // as numbered by the service, from 1
+    uint64_t wakeNsec;               // MY_CLOCK_TYPE time the service woke up for it
+    uint32_t periodMs;
+    uint16_t serviceNum;             // S<n>
+    int16_t core;
+} traceRecord_t;
+
+// Open by the sequencer, inherited by the service processes, -1 without a trace
+extern int traceFd;
+
+int openTrace(const char *path, unsigned long long startNsec);
+void traceRelease(int serviceIdx, unsigned int periodMs, unsigned long long releaseCnt, unsigned long long wakeNsec);
+void closeTrace(void);
+
+#endif
@@ -0,0 +1,483 @@
+// seqtrig - latency of the ways an external event can wake a real-time thread
+//
+// The sequencer of seqgen3 is woken by its own timer. Work triggered from
+// outside (a device daemon, another process, an operator) reaches a
+// SCHED_FIFO thread through an IPC mechanism instead, and each one takes a
+// different path through the kernel. seqtrig forks a trigger process that
+// fires events, periodic or at Poisson distributed instants, and a SCHED_FIFO
+// handler thread measures the time from the send stamp to its wakeup for
+// every mechanism in turn:
+//
+//   eventfd   write of 1, the handler blocks in poll and reads the counter
+//   pipe      8 byte write, the handler blocks in poll and reads it
+//   socket    8 byte datagram on a UNIX socket pair, same as the pipe
+//   signal    sigqueue of a real-time signal to the handler process, the
+//             handler blocks in sigtimedwait
+//   futex     increment of a shared futex word and FUTEX_WAKE, the handler
+//             blocks in FUTEX_WAIT
+//
+// The trigger stamps CLOCK_MONOTONIC into shared memory right before it
+// fires, and waits for the handler to take the event before it fires the
+// next, so no two events are ever coalesced. The handler and the trigger are
+// pinned to different cores, the trigger runs SCHED_OTHER like an external
+// producer would.
+//
+// Usage: seqtrig [-n count] [-p usec] [-r] [-c core] [-t core] [-m mechanisms]
+//
+//   sudo ./seqtrig -n 100000 -p 500 -r
+
+// This is necessary for CPU affinity macros in Linux
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <linux/futex.h>
+
+#include "seqgen3.h"
+#include "seqhist.h"
+#include "seqthread.h"
+
+#define DEFAULT_EVENTS (10000)
+#define DEFAULT_PERIOD_USEC (1000)
+
+// seqgen3 services run on cores 2 and 3, the trigger comes from another core
+#define DEFAULT_HANDLER_CORE (2)
+#define DEFAULT_TRIGGER_CORE (1)
+
+// Sent to the handler process, blocked in every one of its threads but taken by sigtimedwait
+#define TRIGGER_SIGNO (SIGRTMIN + 3)
+
+// A handler wait, or the trigger waiting for the handler, gives up after this long
+#define TRIGGER_TIMEOUT_MS (1000)
+
+// How often the trigger checks whether the handler took the last event
+#define TRIGGER_POLL_USEC (20)
+
+// Lets the handler block in its wait before the first event of a mechanism
+#define TRIGGER_SETTLE_MS (10)
+
+typedef enum
+{
+    TRIGGER_EVENTFD,
+    TRIGGER_PIPE,
+    TRIGGER_SOCKET,
+    TRIGGER_SIGNAL,
+    TRIGGER_FUTEX,
+    NUM_TRIGGERS
+} trigger_t;
+
+// Shared by the handler process and the trigger process
+typedef struct
+{
+    volatile unsigned long long sendNsec;    // stamped by the trigger right before it fires
+    volatile int ready;                      // mechanism whose handler is waiting, -1 for none
+    volatile unsigned int handled;           // events of that mechanism taken by the handler
+    volatile int finished;                   // last mechanism the trigger is done with, -1 for none
+    unsigned int futexWord;
+    unsigned long long timeouts[NUM_TRIGGERS];  // events the handler did not take in time
+} triggerShared_t;
+
+typedef struct
+{
+    trigger_t trigger;
+    int fifo;                                // SCHED_FIFO could be set
+    unsigned long long minNsec;
+    histogram_t latency;
+    pthread_t thread;
+} handler_t;
+
+static const char *triggerNames[NUM_TRIGGERS] = {"eventfd", "pipe", "socket", "signal", "futex"};
+
+static triggerShared_t *shared;
+static int eventFd = -1, pipeFds[2] = {-1, -1}, socketFds[2] = {-1, -1};
+static pid_t handlerPid;
+
+static unsigned int eventCount = DEFAULT_EVENTS, periodUsec = DEFAULT_PERIOD_USEC;
+static int randomArrivals = FALSE, handlerCore = DEFAULT_HANDLER_CORE, triggerCore = DEFAULT_TRIGGER_CORE;
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [-n count] [-p usec] [-r] [-c core] [-t core] [-m mechanisms]\n", program);
+    printf("  -n count       events per mechanism, %d by default\n", DEFAULT_EVENTS);
+    printf("  -p usec        period of the events, %d by default\n", DEFAULT_PERIOD_USEC);
+    printf("  -r             Poisson arrivals, the period is their mean interval\n");
+    printf("  -c core        core of the SCHED_FIFO handler, %d by default\n", DEFAULT_HANDLER_CORE);
+    printf("  -t core        core of the trigger process, %d by default\n", DEFAULT_TRIGGER_CORE);
+    printf("  -m mechanisms  comma separated subset of eventfd,pipe,socket,signal,futex, all by default\n");
+}
+
+static unsigned long long stampNsec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * NANOSEC_PER_SEC) + now.tv_nsec;
+}
+
+static void sleepUntil(unsigned long long untilNsec)
+{
+    struct timespec until;
+
+    until.tv_sec = untilNsec / NANOSEC_PER_SEC;
+    until.tv_nsec = untilNsec % NANOSEC_PER_SEC;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+}
+
+static long futexWait(unsigned int *word, unsigned int value, unsigned int timeoutMs)
+{
+    struct timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * NANOSEC_PER_MSEC};
+
+    // shared between processes, so not FUTEX_PRIVATE_FLAG
+    return syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static long futexWake(unsigned int *word)
+{
+    return syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Blocks until the next event of the mechanism, FALSE on timeout
+static int waitEvent(trigger_t trigger, unsigned int *seenFutex)
+{
+    struct pollfd pending = {-1, POLLIN, 0};
+    struct timespec timeout = {TRIGGER_TIMEOUT_MS / 1000, (TRIGGER_TIMEOUT_MS % 1000) * NANOSEC_PER_MSEC};
+    unsigned long long payload;
+    sigset_t triggerSet;
+
+    switch(trigger)
+    {
+        case TRIGGER_EVENTFD:
+            pending.fd = eventFd;
+            break;
+        case TRIGGER_PIPE:
+            pending.fd = pipeFds[0];
+            break;
+        case TRIGGER_SOCKET:
+            pending.fd = socketFds[0];
+            break;
+        case TRIGGER_SIGNAL:
+            sigemptyset(&triggerSet);
+            sigaddset(&triggerSet, TRIGGER_SIGNO);
+            return (sigtimedwait(&triggerSet, NULL, &timeout) == TRIGGER_SIGNO);
+        case TRIGGER_FUTEX:
+            while(__atomic_load_n(&shared->futexWord, __ATOMIC_ACQUIRE) == *seenFutex)
+            {
+                if(futexWait(&shared->futexWord, *seenFutex, TRIGGER_TIMEOUT_MS) != 0 && errno == ETIMEDOUT)
+                    return FALSE;
+            }
+            (*seenFutex)++;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+
+    if(poll(&pending, 1, TRIGGER_TIMEOUT_MS) <= 0)
+        return FALSE;
+
+    return (read(pending.fd, &payload, sizeof(payload)) == sizeof(payload));
+}
+
+static void *handleEvents(void *arg)
+{
+    handler_t *handler = (handler_t *)arg;
+    unsigned long long latencyNsec;
+    unsigned int seenFutex = __atomic_load_n(&shared->futexWord, __ATOMIC_ACQUIRE), i;
+
+    handler->minNsec = ULLONG_MAX;
+    __atomic_store_n(&shared->ready, handler->trigger, __ATOMIC_RELEASE);
+
+    for(i=0; i < eventCount; i++)
+    {
+        // an event the trigger gave up on is not waited for
+        while(!waitEvent(handler->trigger, &seenFutex))
+        {
+            if(shared->finished == (int)handler->trigger)
+                return NULL;
+        }
+
+        latencyNsec = stampNsec() - shared->sendNsec;
+        histogramRecord(&handler->latency, latencyNsec);
+        if(latencyNsec < handler->minNsec)
+            handler->minNsec = latencyNsec;
+
+        __atomic_add_fetch(&shared->handled, 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+static void fire(trigger_t trigger, unsigned long long sequence)
+{
+    union sigval value;
+    unsigned long long one = 1;
+
+    shared->sendNsec = stampNsec();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    switch(trigger)
+    {
+        case TRIGGER_EVENTFD:
+            if(write(eventFd, &one, sizeof(one)) != sizeof(one))
+                perror("eventfd write");
+            break;
+        case TRIGGER_PIPE:
+            if(write(pipeFds[1], &sequence, sizeof(sequence)) != sizeof(sequence))
+                perror("pipe write");
+            break;
+        case TRIGGER_SOCKET:
+            if(send(socketFds[1], &sequence, sizeof(sequence), 0) != sizeof(sequence))
+                perror("socket send");
+            break;
+        case TRIGGER_SIGNAL:
+            value.sival_int = (int)sequence;
+            if(sigqueue(handlerPid, TRIGGER_SIGNO, value) != 0)
+                perror("sigqueue");
+            break;
+        case TRIGGER_FUTEX:
+            __atomic_add_fetch(&shared->futexWord, 1, __ATOMIC_RELEASE);
+            futexWake(&shared->futexWord);
+            break;
+        default:
+            break;
+    }
+}
+
+// Body of the trigger process: every selected mechanism in the order the handler takes them
+static void triggerEvents(const int *selected)
+{
+    cpu_set_t cpu;
+    unsigned long long nextNsec, giveUpNsec;
+    unsigned int seed = (unsigned int)getpid(), i;
+    double uniform;
+    trigger_t trigger;
+
+    CPU_ZERO(&cpu);
+    CPU_SET(triggerCore, &cpu);
+    if(sched_setaffinity(0, sizeof(cpu), &cpu) != 0)
+        perror("sched_setaffinity trigger");
+
+    for(trigger=0; trigger < NUM_TRIGGERS; trigger++)
+    {
+        if(!selected[trigger])
+            continue;
+
+        while(__atomic_load_n(&shared->ready, __ATOMIC_ACQUIRE) != (int)trigger)
+            usleep(1000);
+        usleep(TRIGGER_SETTLE_MS * 1000);
+
+        nextNsec = stampNsec();
+        for(i=0; i < eventCount; i++)
+        {
+            if(randomArrivals)
+            {
+                uniform = (double)rand_r(&seed) / ((double)RAND_MAX + 1.0);
+                nextNsec += (unsigned long long)(-(double)periodUsec * 1000.0 * log(1.0 - uniform));
+            }
+            else
+            {
+                nextNsec += (unsigned long long)periodUsec * 1000;
+            }
+
+            sleepUntil(nextNsec);
+            fire(trigger, i);
+
+            // the next event only once this one is taken, a late handler is not sent a burst
+            giveUpNsec = stampNsec() + ((unsigned long long)TRIGGER_TIMEOUT_MS * NANOSEC_PER_MSEC);
+            while(__atomic_load_n(&shared->handled, __ATOMIC_ACQUIRE) <= i && stampNsec() < giveUpNsec)
+                usleep(TRIGGER_POLL_USEC);
+
+            if(__atomic_load_n(&shared->handled, __ATOMIC_ACQUIRE) <= i)
+            {
+                shared->timeouts[trigger]++;
+                break;
+            }
+        }
+
+        __atomic_store_n(&shared->finished, trigger, __ATOMIC_RELEASE);
+    }
+}
+
+// Runs the handler of one mechanism while the trigger fires its events, then reports it
+static void measureTrigger(trigger_t trigger)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t cpu;
+    handler_t *handler;
+
+    handler = calloc(1, sizeof(handler_t));
+    if(handler == NULL)
+        return;
+
+    handler->trigger = trigger;
+    handler->fifo = TRUE;
+    shared->handled = 0;
+
+    CPU_ZERO(&cpu);
+    CPU_SET(handlerCore, &cpu);
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu);
+
+    // without the privilege the handler still runs, but says so
+    if(startRtThread(&handler->thread, &attr, handleEvents, handler) != 0)
+    {
+        handler->fifo = FALSE;
+        pthread_attr_destroy(&attr);
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu);
+        startRtThread(&handler->thread, &attr, handleEvents, handler);
+    }
+    pthread_attr_destroy(&attr);
+
+    pthread_join(handler->thread, NULL);
+
+    printf("  %s%s: %llu events, latency usec min=%.1lf p50=%.1lf p90=%.1lf p99=%.1lf p99.9=%.1lf max=%.1lf, %llu timed out\n",
+           triggerNames[trigger], handler->fifo ? "" : " (not SCHED_FIFO)", handler->latency.count,
+           (handler->latency.count > 0) ? handler->minNsec / 1000.0 : 0.0,
+           histogramPercentile(&handler->latency, 50.0) / 1000.0, histogramPercentile(&handler->latency, 90.0) / 1000.0,
+           histogramPercentile(&handler->latency, 99.0) / 1000.0, histogramPercentile(&handler->latency, 99.9) / 1000.0,
+           handler->latency.max / 1000.0, shared->timeouts[trigger]);
+
+    free(handler);
+}
+
+// Marks the mechanisms of a comma separated list, -1 for an unknown one
+static int selectTriggers(char *list, int *selected)
+{
+    char *name, *next = NULL;
+    trigger_t trigger;
+
+    memset(selected, 0, NUM_TRIGGERS * sizeof(int));
+
+    for(name = strtok_r(list, ",", &next); name != NULL; name = strtok_r(NULL, ",", &next))
+    {
+        for(trigger=0; trigger < NUM_TRIGGERS && strcmp(name, triggerNames[trigger]) != 0; trigger++);
+
+        if(trigger == NUM_TRIGGERS)
+            return -1;
+
+        selected[trigger] = TRUE;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int selected[NUM_TRIGGERS] = {TRUE, TRUE, TRUE, TRUE, TRUE}, opt, status;
+    sigset_t triggerSet;
+    pid_t triggerPid;
+    trigger_t trigger;
+
+    while((opt = getopt(argc, argv, "n:p:rc:t:m:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n':
+                eventCount = atoi(optarg);
+                break;
+            case 'p':
+                periodUsec = atoi(optarg);
+                break;
+            case 'r':
+                randomArrivals = TRUE;
+                break;
+            case 'c':
+                handlerCore = atoi(optarg);
+                break;
+            case 't':
+                triggerCore = atoi(optarg);
+                break;
+            case 'm':
+                if(selectTriggers(optarg, selected) != 0)
+                {
+                    usage(argv[0]);
+                    exit(-1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    if(eventCount == 0 || periodUsec == 0 ||
+       handlerCore < 0 || handlerCore >= get_nprocs_conf() || triggerCore < 0 || triggerCore >= get_nprocs_conf())
+    {
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    if(handlerCore == triggerCore)
+        printf("Handler and trigger share core %d, the handler preempts the trigger as soon as it is woken\n", handlerCore);
+
+    shared = mmap(NULL, sizeof(triggerShared_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shared == MAP_FAILED)
+    {
+        perror("mmap shared stamps");
+        exit(-1);
+    }
+    shared->ready = -1;
+    shared->finished = -1;
+
+    eventFd = eventfd(0, EFD_NONBLOCK);
+    if(eventFd < 0 || pipe(pipeFds) != 0 || socketpair(AF_UNIX, SOCK_DGRAM, 0, socketFds) != 0)
+    {
+        perror("event channels");
+        exit(-1);
+    }
+
+    // taken by sigtimedwait only, in every thread the handler process will ever have
+    sigemptyset(&triggerSet);
+    sigaddset(&triggerSet, TRIGGER_SIGNO);
+    sigprocmask(SIG_BLOCK, &triggerSet, NULL);
+
+    handlerPid = getpid();
+    triggerPid = fork();
+    if(triggerPid < 0)
+    {
+        perror("fork trigger");
+        exit(-1);
+    }
+
+    if(triggerPid == 0)
+    {
+        triggerEvents(selected);
+        _exit(0);
+    }
+
+    printf("Trigger latency: %u %s events per mechanism every %u usec%s, handler on core %d, trigger on core %d\n",
+           eventCount, randomArrivals ? "Poisson" : "periodic", periodUsec, randomArrivals ? " on average" : "",
+           handlerCore, triggerCore);
+
+    for(trigger=0; trigger < NUM_TRIGGERS; trigger++)
+    {
+        if(selected[trigger])
+            measureTrigger(trigger);
+    }
+
+    waitpid(triggerPid, &status, 0);
+    munmap(shared, sizeof(triggerShared_t));
+    return 0;
+}